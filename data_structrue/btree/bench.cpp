@@ -0,0 +1,611 @@
+// bench: 在BTree、DiskBTree和LsmTree上全速回放gen_workload生成的负载，报告吞吐量、延迟分布和读写计数
+//
+// 用法：bench workload=FILE [name=value ...]
+//   tree=T       mem（BTree）、disk（DiskBTree）、lsm（LsmTree）或all（默认，三个都跑），还可以是sharded
+//                （ShardedTree，分片是BTree，不包括在all中）
+//   file=F       DiskBTree的文件，默认bench.bin，每次运行前都会删掉重建
+//   bloom=R      DiskBTree布隆过滤器的误判率，默认0（不用布隆过滤器）；LsmTree每个run的误判率，默认0.01
+//   trace=N      每N个操作采样跟踪一个，默认0（不采样）
+//   slow_us=U    被采样的操作耗时达到这么多微秒时打印出来，默认1000
+//   bulk=N       N>0时BTree的装载阶段改用N个线程的BulkLoad（关键字先排序去重），默认0（逐个Insert）
+//   image=F      非空时BTree在装载阶段之后Save到映像文件F，清空后再Load回来（冷启动），报告两者的耗时，
+//                运行阶段在映射进来的树上进行，默认空（不用）
+//   multiget=N   N>0时在BTree的运行阶段结束后，把运行阶段的所有查找分别逐个Search和每N个一批MultiGet一遍，
+//                对比两者的吞吐量，默认0（不比较）
+//   batch=N      N>0时DiskBTree的装载阶段改用每N个一批的InsertBatch，运行阶段结束后把运行阶段的所有查找分别逐个
+//                Search和每N个一批SearchBatch一遍，对比两者的吞吐量和读次数，默认0（都不用）
+//   finger=B     为1时在BTree的运行阶段结束后，用装载阶段插入的关键字分别逐个Insert和带finger的Insert建两棵树，
+//                再在后一棵树上把运行阶段的查找分别逐个Search和带finger的Search一遍，对比耗时和读次数；DiskBTree在
+//                运行阶段结束后只对比查找（见DiskBTreeFinger），默认0（不比较）
+//   augmented=B  为1时BTree和DiskBTree都维护子树的聚合值（Rank/Select/Count/Sum要用），用来衡量维护的开销，默认0
+//   lazy=N       N>0时BTree和DiskBTree都推迟删除后的调整，每累计N次推迟调整的删除Compact一次；N<0时推迟调整
+//                但运行阶段不Compact，运行阶段结束后再单独Compact一次并报告它的开销；默认0（立即调整）。对比每次
+//                删除的写次数（DiskBTree另有写入字节数）和查找的读次数
+//   bstar=B      为1时BTree和DiskBTree插入时都用B*-树的分裂策略（挪给兄弟、两个分成三个，见BTree::SetBStar），
+//                为0时一分为二；给出这个选项时逐个Insert的装载阶段结束后也打印统计，对比两者的写次数（DiskBTree
+//                另有写入字节数）和填充率、结点个数、树高，即写的代价和省下的空间
+//   buffer=N     N>0时DiskBTree用写优化的缓冲模式，每个分支结点的缓冲区放N条消息（见DiskBTree::SetBuffered），
+//                运行阶段结束后单独FlushBuffers一次并报告它的开销；默认0（不用）
+//   frames=N     N>0时DiskBTree用能放N个结点的帧池（见DiskBTree::SetFramePool），默认0（不用）；
+//                帧池只加速查找，更新要多拷贝结点，写多的负载不要打开
+//   order=N      DiskBTree的阶数，默认0（由page决定，page也为0时是DISK_M）
+//   page=N       DiskBTree每个结点在文件中占的字节数，默认0（正好放下一个结点）；auto表示测量设备后选择
+//   store=S      DiskBTree读写文件的方式：fstream（默认）、pread、mmap、direct、memory（见PageStoreFactory），
+//                或者all（每种方式各跑一遍，对比吞吐量）
+//   memtable=N   LsmTree的内存表中有N个关键字和墓碑时写成run，默认LSM_MEMTABLE_CAPACITY
+//   fanout=N     LsmTree一层的run达到N个时合并到下一层，默认LSM_FANOUT。LsmTree的文件以file为前缀，
+//                运行阶段结束后单独Flush一次（写完内存表、做完合并）并报告它的开销
+//   shards=N     ShardedTree开始时的分片个数，默认SHARD_COUNT；all表示1个、2个和SHARD_COUNT个分片各跑一遍
+//   clients=N    ShardedTree的运行阶段分成N段，由N个客户线程同时回放，默认与shards相同
+//   rebalance_ms=N  ShardedTree每隔N毫秒检查一次负载、分裂热分片，默认100，0表示不分裂
+//
+// 装载阶段的结果单独报告，运行阶段开始前清零统计，所以延迟和读写计数只反映运行阶段的混合操作
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include "btree.h"
+#include "disk_btree.h"
+#include "lsm_tree.h"
+#include "sharded_tree.h"
+#include "workload.h"
+
+using namespace std;
+
+/**
+ * @brief 用BulkLoad完成装载阶段：取出装载阶段插入的关键字，排序去重后建树
+ */
+void BulkLoadPhase(BTree& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops, int thread_count)
+{
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<KeyType> keys;
+    keys.reserve(header.load_count);
+
+    for (uint64_t i = 0; i < header.load_count; ++i)
+    {
+        if (WORKLOAD_INSERT == GetWorkloadOpCode(ops[i]))
+        {
+            keys.push_back(ops[i].key);
+        }
+    }
+
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    const chrono::steady_clock::time_point sorted = chrono::steady_clock::now();
+    tree.BulkLoad(keys.data(), keys.size(), thread_count);
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    cout << "Load phase: " << keys.size() << " keys bulk loaded with " << thread_count << " threads in " << fixed
+        << setprecision(3) << chrono::duration<double>(end - start).count() << " s (sort "
+        << chrono::duration<double>(sorted - start).count() << " s, build "
+        << chrono::duration<double>(end - sorted).count() << " s)" << endl;
+    cout.unsetf(ios::fixed);
+}
+
+/**
+ * @brief 把装载好的树Save成映像，清空后再Load回来，模拟服务重启
+ */
+void ImagePhase(BTree& tree, const string& image)
+{
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const int save_ret = tree.Save(image.c_str());
+    const chrono::steady_clock::time_point saved = chrono::steady_clock::now();
+
+    tree.BulkLoad(NULL, 0); // 清空，下面计时的只有映射
+    const chrono::steady_clock::time_point cleared = chrono::steady_clock::now();
+    const int load_ret = tree.Load(image.c_str());
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    if (save_ret != 0 || load_ret != 0)
+    {
+        cout << "Image: cannot " << (save_ret != 0 ? "save" : "load") << " " << image << endl;
+        return;
+    }
+
+    struct stat st;
+    stat(image.c_str(), &st);
+
+    cout << "Image: " << st.st_size << " bytes saved in " << fixed << setprecision(3)
+        << chrono::duration<double>(saved - start).count() << " s, loaded in " << setprecision(6)
+        << chrono::duration<double>(end - cleared).count() << " s ("
+        << (tree.IsImageRelocated() ? "relocated" : "mapped at its base address") << ")" << endl;
+    cout.unsetf(ios::fixed);
+}
+
+/**
+ * @brief 对比从根结点开始和从finger开始的Insert与Search（见BTreeFinger），关键字成簇时后者读的结点少得多
+ */
+void FingerPhase(const WorkloadHeader& header, const vector<WorkloadOp>& ops, bool augmented)
+{
+    vector<KeyType> inserts;
+    vector<KeyType> searches;
+
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        if (i < header.load_count && WORKLOAD_INSERT == GetWorkloadOpCode(ops[i]))
+        {
+            inserts.push_back(ops[i].key);
+        }
+        else if (i >= header.load_count && WORKLOAD_SEARCH == GetWorkloadOpCode(ops[i]))
+        {
+            searches.push_back(ops[i].key);
+        }
+    }
+
+    BTree plain(augmented);
+    BTree fingered(augmented);
+    BTreeFinger finger;
+    plain.SetVerbose(false);
+    fingered.SetVerbose(false);
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < inserts.size(); ++i)
+    {
+        plain.Insert(inserts[i]);
+    }
+
+    const chrono::steady_clock::time_point inserted = chrono::steady_clock::now();
+    for (size_t i = 0; i < inserts.size(); ++i)
+    {
+        fingered.Insert(inserts[i], finger);
+    }
+
+    const chrono::steady_clock::time_point finger_inserted = chrono::steady_clock::now();
+    const long insert_reads = plain.Stats().reads;
+    const long finger_insert_reads = fingered.Stats().reads;
+    fingered.ResetStats();
+
+    vector<char> expected(searches.size());
+    for (size_t i = 0; i < searches.size(); ++i)
+    {
+        expected[i] = fingered.Search(searches[i]);
+    }
+
+    const chrono::steady_clock::time_point searched = chrono::steady_clock::now();
+    const long search_reads = fingered.Stats().reads;
+    fingered.ResetStats();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < searches.size(); ++i)
+    {
+        mismatches += (fingered.Search(searches[i], finger) != (expected[i] != 0)) ? 1 : 0;
+    }
+
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    const long finger_search_reads = fingered.Stats().reads;
+
+    const double insert_seconds = chrono::duration<double>(inserted - start).count();
+    const double finger_insert_seconds = chrono::duration<double>(finger_inserted - inserted).count();
+    const double search_seconds = chrono::duration<double>(searched - finger_inserted).count();
+    const double finger_search_seconds = chrono::duration<double>(end - searched).count();
+
+    cout << "Finger: " << inserts.size() << " inserts, from the root " << fixed << setprecision(3) << insert_seconds
+        << " s (" << insert_reads << " reads), from a finger " << finger_insert_seconds << " s ("
+        << finger_insert_reads << " reads, " << setprecision(2)
+        << (finger_insert_seconds > 0 ? insert_seconds / finger_insert_seconds : 0) << "x)" << endl
+        << "Finger: " << searches.size() << " searches, from the root " << setprecision(3) << search_seconds << " s ("
+        << search_reads << " reads), from a finger " << finger_search_seconds << " s (" << finger_search_reads
+        << " reads, " << setprecision(2) << (finger_search_seconds > 0 ? search_seconds / finger_search_seconds : 0)
+        << "x), " << mismatches << " mismatches" << endl;
+    cout.unsetf(ios::fixed);
+}
+
+/**
+ * @brief 在DiskBTree上把运行阶段的查找分别逐个Search和带finger的Search一遍，对比耗时和读次数（见DiskBTreeFinger）
+ */
+void DiskFingerPhase(DiskBTree& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops)
+{
+    vector<KeyType> searches;
+    for (size_t i = header.load_count; i < ops.size(); ++i)
+    {
+        if (WORKLOAD_SEARCH == GetWorkloadOpCode(ops[i]))
+        {
+            searches.push_back(ops[i].key);
+        }
+    }
+
+    tree.ResetStats();
+    vector<char> expected(searches.size());
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < searches.size(); ++i)
+    {
+        expected[i] = tree.Search(searches[i]);
+    }
+
+    const chrono::steady_clock::time_point searched = chrono::steady_clock::now();
+    const long search_reads = tree.Stats().reads;
+    tree.ResetStats();
+
+    DiskBTreeFinger finger;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < searches.size(); ++i)
+    {
+        mismatches += (tree.Search(searches[i], finger) != (expected[i] != 0)) ? 1 : 0;
+    }
+
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    const long finger_search_reads = tree.Stats().reads;
+
+    const double search_seconds = chrono::duration<double>(searched - start).count();
+    const double finger_search_seconds = chrono::duration<double>(end - searched).count();
+
+    cout << "Finger: " << searches.size() << " searches, from the root " << fixed << setprecision(3) << search_seconds
+        << " s (" << search_reads << " reads), from a finger " << finger_search_seconds << " s (" << finger_search_reads
+        << " reads, " << setprecision(2) << (finger_search_seconds > 0 ? search_seconds / finger_search_seconds : 0)
+        << "x), " << mismatches << " mismatches" << endl;
+    cout.unsetf(ios::fixed);
+}
+
+/**
+ * @brief 用InsertBatch完成装载阶段：装载阶段插入的关键字每batch个一批
+ */
+void BatchLoadPhase(DiskBTree& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops, size_t batch)
+{
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<KeyType> keys;
+    size_t count = 0;
+
+    for (uint64_t i = 0; i < header.load_count; ++i)
+    {
+        if (WORKLOAD_INSERT == GetWorkloadOpCode(ops[i]))
+        {
+            keys.push_back(ops[i].key);
+        }
+
+        if (keys.size() >= batch || (i + 1 == header.load_count && !keys.empty()))
+        {
+            tree.InsertBatch(keys.data(), keys.size());
+            count += keys.size();
+            keys.clear();
+        }
+    }
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const DiskBTreeStats stats = tree.Stats();
+
+    cout << "Load phase: " << count << " keys inserted in batches of " << batch << " in " << fixed << setprecision(3)
+        << seconds << " s, reads: " << stats.reads << ", writes: " << stats.writes << endl;
+    cout.unsetf(ios::fixed);
+}
+
+/**
+ * @brief 把运行阶段的查找逐个Search一遍，再每batch个一批用batch_search查一遍，对比吞吐量并核对结果
+ * @param name 批量查找的名字，MultiGet或者SearchBatch
+ */
+template <class Tree, class BatchSearch>
+void BatchSearchPhase(Tree& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops, size_t batch,
+    const char* name, BatchSearch batch_search)
+{
+    vector<KeyType> keys;
+    for (size_t i = header.load_count; i < ops.size(); ++i)
+    {
+        if (WORKLOAD_SEARCH == GetWorkloadOpCode(ops[i]))
+        {
+            keys.push_back(ops[i].key);
+        }
+    }
+
+    vector<char> expected(keys.size());
+    bool* results = new bool[keys.size() + 1];
+
+    tree.ResetStats();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        expected[i] = tree.Search(keys[i]);
+    }
+
+    const chrono::steady_clock::time_point searched = chrono::steady_clock::now();
+    const long search_reads = tree.Stats().reads;
+    tree.ResetStats();
+
+    for (size_t i = 0; i < keys.size(); i += batch)
+    {
+        batch_search(keys.data() + i, min(batch, keys.size() - i), results + i);
+    }
+
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    const long batch_reads = tree.Stats().reads;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        mismatches += (results[i] != (expected[i] != 0)) ? 1 : 0;
+    }
+
+    delete[] results;
+
+    const double search_seconds = chrono::duration<double>(searched - start).count();
+    const double batch_seconds = chrono::duration<double>(end - searched).count();
+
+    cout << name << ": " << keys.size() << " searches, one by one " << fixed << setprecision(3) << search_seconds
+        << " s (" << search_reads << " reads), in batches of " << batch << " " << batch_seconds << " s ("
+        << batch_reads << " reads, " << setprecision(2) << (batch_seconds > 0 ? search_seconds / batch_seconds : 0)
+        << "x), " << mismatches << " mismatches" << endl;
+    cout.unsetf(ios::fixed);
+}
+
+template <class Tree>
+void RunBench(Tree& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops, int trace, double slow_us,
+    bool loaded = false, bool load_stats = false)
+{
+    tree.SetVerbose(false);
+
+    if (!loaded) // 还没有装载过时逐个Insert
+    {
+        cout << "Load phase: ";
+        PrintReplayResult(ReplayWorkload(tree, ops.data(), header.load_count), cout);
+        if (load_stats)
+        {
+            tree.PrintStats();
+        }
+    }
+
+    tree.ResetStats();
+    tree.SetTrace(trace, slow_us);
+
+    cout << "Run phase: ";
+    PrintReplayResult(ReplayWorkload(tree, ops.data() + header.load_count, ops.size() - header.load_count), cout);
+
+    tree.PrintLatency();
+    tree.PrintStats();
+}
+
+/**
+ * @brief 运行阶段结束后单独做一次推迟了的工作（Compact、FlushBuffers或者Flush），报告它的耗时和读写计数
+ */
+template <class Tree>
+void DeferredPhase(Tree& tree, const char* name, void (Tree::*work)())
+{
+    tree.ResetStats();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    (tree.*work)();
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << name << ": " << fixed << setprecision(3) << seconds << " s" << endl;
+    cout.unsetf(ios::fixed);
+    tree.PrintStats();
+}
+
+/**
+ * @brief ShardedTree的运行阶段：把运行阶段的操作分成clients段，每段由一个客户线程回放，报告总的吞吐量
+ */
+void ShardedRunPhase(ShardedTree<BTree>& tree, const WorkloadHeader& header, const vector<WorkloadOp>& ops,
+    int clients)
+{
+    const size_t count = ops.size() - header.load_count;
+    vector<ReplayResult> results(clients);
+    vector<thread> threads;
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < clients; ++i)
+    {
+        const size_t first = count * i / clients;
+        const size_t last = count * (i + 1) / clients;
+        threads.push_back(thread([&tree, &ops, &header, &results, i, first, last]
+        {
+            results[i] = ReplayWorkload(tree, ops.data() + header.load_count + first, last - first);
+        }));
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    ReplayResult total = ReplayResult();
+    for (int i = 0; i < clients; ++i)
+    {
+        for (int code = 0; code < WORKLOAD_OP_CODE_COUNT; ++code)
+        {
+            total.ops[code] += results[i].ops[code];
+            total.failed[code] += results[i].failed[code];
+        }
+
+        total.scanned += results[i].scanned;
+    }
+
+    total.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Run phase (" << clients << " clients): ";
+    PrintReplayResult(total, cout);
+    tree.PrintStats();
+}
+
+int main(int argc, char* argv[])
+{
+    map<string, string> options;
+    if (ParseOptions(argc, argv, options) != 0 || 0 == options.count("workload"))
+    {
+        cout << "Usage: bench workload=FILE [tree=mem|disk|lsm|all] [file=F] [bloom=R] [trace=N] [slow_us=U]" << endl
+            << "             [bulk=N] [image=F] [multiget=N] [finger=0|1] [batch=N] [augmented=0|1] [lazy=N]" << endl
+            << "             [bstar=0|1] [buffer=N] [frames=N] [order=N] [page=N|auto] [store=S|all]" << endl
+            << "             [memtable=N] [fanout=N] [shards=N|all] [clients=N] [rebalance_ms=N]" << endl;
+        return 1;
+    }
+
+    const string workload = GetOption(options, "workload", "");
+    const string tree_type = GetOption(options, "tree", "all");
+    const string file = GetOption(options, "file", "bench.bin");
+    const double bloom_fpr = atof(GetOption(options, "bloom", "0").c_str());
+    const int trace = atoi(GetOption(options, "trace", "0").c_str());
+    const double slow_us = atof(GetOption(options, "slow_us", "1000").c_str());
+    const int bulk = atoi(GetOption(options, "bulk", "0").c_str());
+    const string image = GetOption(options, "image", "");
+    const long multi_get = atol(GetOption(options, "multiget", "0").c_str());
+    const bool finger = (GetOption(options, "finger", "0") != "0");
+    const long batch = atol(GetOption(options, "batch", "0").c_str());
+    const bool augmented = (GetOption(options, "augmented", "0") != "0");
+    const long lazy = atol(GetOption(options, "lazy", "0").c_str());
+    const bool bstar = (GetOption(options, "bstar", "0") != "0");
+    const bool load_stats = (options.count("bstar") > 0);
+    const long buffer = atol(GetOption(options, "buffer", "0").c_str());
+    const long frames = atol(GetOption(options, "frames", "0").c_str());
+    const string store = GetOption(options, "store", "fstream");
+    DiskBTreeFormat format = DEFAULT_DISK_FORMAT;
+    format.order = atoi(GetOption(options, "order", "0").c_str());
+    format.page_size = ("auto" == GetOption(options, "page", "0")) ? DISK_PAGE_AUTO
+        : atol(GetOption(options, "page", "0").c_str());
+    const long memtable = atol(GetOption(options, "memtable", to_string(LSM_MEMTABLE_CAPACITY)).c_str());
+    const int fanout = atoi(GetOption(options, "fanout", to_string(LSM_FANOUT)).c_str());
+    vector<int> shard_counts;
+    if ("all" == GetOption(options, "shards", ""))
+    {
+        shard_counts.push_back(1);
+        shard_counts.push_back(2);
+        shard_counts.push_back(SHARD_COUNT);
+    }
+    else
+    {
+        shard_counts.push_back(atoi(GetOption(options, "shards", to_string(SHARD_COUNT)).c_str()));
+    }
+
+    const int clients = atoi(GetOption(options, "clients", "0").c_str()); // 不大于0时与分片个数相同
+    const int rebalance_ms = atoi(GetOption(options, "rebalance_ms", "100").c_str());
+
+    vector<PageStoreType> store_types;
+    for (int i = 0; i < PAGE_STORE_TYPE_COUNT; ++i)
+    {
+        if ("all" == store || store == PageStoreFactory::Name((PageStoreType) i))
+        {
+            store_types.push_back((PageStoreType) i);
+        }
+    }
+
+    if (store_types.empty())
+    {
+        cout << "Unknown storage backend " << store << endl;
+        return 1;
+    }
+
+    WorkloadHeader header;
+    vector<WorkloadOp> ops;
+
+    if (ReadWorkload(workload.c_str(), header, ops) != 0)
+    {
+        cout << "Cannot read workload file " << workload << endl;
+        return 1;
+    }
+
+    cout << "Workload " << workload << ": seed " << header.seed << ", " << header.load_count << " load ops, "
+        << header.op_count - header.load_count << " run ops" << endl;
+
+    if ("mem" == tree_type || "all" == tree_type)
+    {
+        cout << endl << "== BTree (M = " << M << ") ==" << endl;
+        BTree tree(augmented);
+        tree.SetLazyDelete(lazy != 0, lazy > 0 ? lazy : 0);
+        tree.SetBStar(bstar);
+        bool loaded = false;
+        if (bulk > 0)
+        {
+            BulkLoadPhase(tree, header, ops, bulk);
+            loaded = true;
+        }
+
+        if (!image.empty())
+        {
+            if (!loaded)
+            {
+                tree.SetVerbose(false);
+                cout << "Load phase: ";
+                PrintReplayResult(ReplayWorkload(tree, ops.data(), header.load_count), cout);
+                loaded = true;
+            }
+
+            ImagePhase(tree, image);
+        }
+
+        RunBench(tree, header, ops, trace, slow_us, loaded, load_stats);
+        if (multi_get > 0)
+        {
+            BatchSearchPhase(tree, header, ops, multi_get, "MultiGet",
+                [&tree](const KeyType* keys, size_t count, bool* results) { tree.MultiGet(keys, count, results); });
+        }
+
+        if (finger)
+        {
+            FingerPhase(header, ops, augmented);
+        }
+
+        if (lazy < 0)
+        {
+            DeferredPhase(tree, "Compact", &BTree::Compact);
+        }
+    }
+
+    for (size_t s = 0; s < store_types.size() && ("disk" == tree_type || "all" == tree_type); ++s)
+    {
+        remove(file.c_str());
+        remove((file + ".bloom").c_str());
+
+        if (DISK_PAGE_AUTO == format.page_size)
+        {
+            cout << endl << "Page size tuning on the device of " << file << ":" << endl;
+            format.page_size = TuneDiskPageSize(file.c_str(), augmented, true);
+        }
+
+        DiskBTree tree(file.c_str(), bloom_fpr, augmented, store_types[s], format);
+        cout << endl << "== DiskBTree (M = " << tree.Order() << ", page size " << tree.PageSize() << ", file " << file
+            << ", " << PageStoreFactory::Name(store_types[s]) << ") ==" << endl;
+        tree.SetLazyDelete(lazy != 0, lazy > 0 ? lazy : 0);
+        tree.SetBStar(bstar);
+        tree.SetBuffered(buffer > 0, buffer);
+        tree.SetFramePool(frames);
+        if (batch > 0)
+        {
+            BatchLoadPhase(tree, header, ops, batch);
+        }
+
+        RunBench(tree, header, ops, trace, slow_us, batch > 0, load_stats);
+        if (batch > 0)
+        {
+            BatchSearchPhase(tree, header, ops, batch, "SearchBatch",
+                [&tree](const KeyType* keys, size_t count, bool* results) { tree.SearchBatch(keys, count, results); });
+        }
+
+        if (finger)
+        {
+            DiskFingerPhase(tree, header, ops);
+        }
+
+        if (lazy < 0)
+        {
+            DeferredPhase(tree, "Compact", &DiskBTree::Compact);
+        }
+
+        if (buffer > 0)
+        {
+            DeferredPhase(tree, "Flush buffers", &DiskBTree::FlushBuffers);
+        }
+    }
+
+    if ("lsm" == tree_type || "all" == tree_type)
+    {
+        cout << endl << "== LsmTree (memtable " << memtable << ", fanout " << fanout << ", files " << file << ".*) =="
+            << endl;
+        LsmTree::RemoveFiles(file.c_str());
+
+        LsmTree tree(file.c_str(), memtable, fanout, bloom_fpr > 0 ? bloom_fpr : 0.01);
+        RunBench(tree, header, ops, trace, slow_us);
+        DeferredPhase(tree, "Flush", &LsmTree::Flush);
+    }
+
+    for (size_t s = 0; s < shard_counts.size() && "sharded" == tree_type; ++s)
+    {
+        const int shards = shard_counts[s];
+        cout << endl << "== ShardedTree (" << shards << " BTree shards, rebalance every " << rebalance_ms << " ms) =="
+            << endl;
+        ShardedTree<BTree> tree([augmented](int) { return new BTree(augmented); }, shards, rebalance_ms);
+        tree.SetVerbose(false);
+
+        cout << "Load phase: ";
+        PrintReplayResult(ReplayWorkload(tree, ops.data(), header.load_count), cout);
+        ShardedRunPhase(tree, header, ops, (clients > 0) ? clients : shards);
+    }
+
+    return 0;
+}
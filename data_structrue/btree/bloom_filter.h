@@ -0,0 +1,205 @@
+// bloom_filter: 分块布隆过滤器，DiskBTree用它跳过一定不存在的关键字的查找
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <fstream>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "btree_common.h"
+
+using namespace std;
+
+/**
+ * @brief 分块布隆过滤器（split block Bloom filter）
+ * @details 每个关键字只落在一个256位（32字节）的块中，块内8个32位的字各置1位，所以一次查询只访问一条cache line。
+ *          查询结果为false时关键字一定不存在，为true时可能存在（有一定的误判率）。不支持删除，删除过的关键字只能通过重建清除。
+ */
+class BloomFilter
+{
+public:
+    BloomFilter()
+    {
+        capacity_ = 0;
+        key_count_ = 0;
+        fpr_ = 0;
+    }
+
+    /**
+     * @brief 按预期的关键字个数和误判率分配位数组，并清空
+     * @param capacity 预期的关键字个数
+     * @param fpr 预期的误判率（false positive rate），取值范围(0, 1)
+     */
+    void Init(long capacity, double fpr);
+
+    void Add(KeyType x);
+
+    /**
+     * @return false表示x一定不存在，true表示x可能存在
+     */
+    bool MayContain(KeyType x) const;
+
+    long Capacity() const
+    {
+        return capacity_;
+    }
+
+    long KeyCount() const
+    {
+        return key_count_;
+    }
+
+    double Fpr() const
+    {
+        return fpr_;
+    }
+
+    /**
+     * @brief 保存到文件中
+     * @param tag 与过滤器一起保存的校验信息，加载时必须一致才认为过滤器与B-树文件匹配
+     * @return =0成功，否则失败
+     */
+    int Save(const char* file_path, const long tag[3]) const;
+    int Load(const char* file_path, const long tag[3]);
+
+private:
+    struct Block
+    {
+        uint32_t w[8];
+    };
+
+    static uint64_t Hash(KeyType x);
+
+private:
+    std::vector<Block> blocks_;
+    long capacity_;
+    long key_count_;
+    double fpr_;
+};
+
+inline void BloomFilter::Init(long capacity, double fpr)
+{
+    if (capacity < 1024)
+    {
+        capacity = 1024;
+    }
+
+    // 分块布隆过滤器所需的位数：m = -8 * n / ln(1 - fpr^(1/8))
+    const double bits = -8.0 * capacity / log(1.0 - pow(fpr, 1.0 / 8));
+    long block_count = (long) ceil(bits / 256);
+    if (block_count < 1)
+    {
+        block_count = 1;
+    }
+
+    blocks_.assign(block_count, Block());
+    capacity_ = capacity;
+    key_count_ = 0;
+    fpr_ = fpr;
+}
+
+inline uint64_t BloomFilter::Hash(KeyType x)
+{
+    // MurmurHash3的fmix64
+    uint64_t h = (uint32_t) x;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static const uint32_t BLOOM_SALT[8] =
+{
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+inline void BloomFilter::Add(KeyType x)
+{
+    const uint64_t h = Hash(x);
+    Block& block = blocks_[((h >> 32) * blocks_.size()) >> 32]; // 高32位选块
+    const uint32_t low = (uint32_t) h;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        block.w[i] |= 1U << ((low * BLOOM_SALT[i]) >> 27); // 低32位在每个字内选1位
+    }
+
+    ++key_count_;
+}
+
+inline bool BloomFilter::MayContain(KeyType x) const
+{
+    const uint64_t h = Hash(x);
+    const Block& block = blocks_[((h >> 32) * blocks_.size()) >> 32];
+    const uint32_t low = (uint32_t) h;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        if (0 == (block.w[i] & (1U << ((low * BLOOM_SALT[i]) >> 27))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// 过滤器文件格式：magic | tag[3] | capacity | key_count | fpr | block_count | blocks
+static const char BLOOM_MAGIC[8] = { 'B', 'T', 'B', 'L', 'O', 'O', 'M', '1' };
+
+inline int BloomFilter::Save(const char* file_path, const long tag[3]) const
+{
+    ofstream ofs(file_path, ios::out | ios::trunc | ios::binary);
+    if (ofs.fail())
+    {
+        return -1;
+    }
+
+    const long block_count = (long) blocks_.size();
+    ofs.write(BLOOM_MAGIC, sizeof(BLOOM_MAGIC));
+    ofs.write((const char*) tag, 3 * sizeof(long));
+    ofs.write((const char*) &capacity_, sizeof(capacity_));
+    ofs.write((const char*) &key_count_, sizeof(key_count_));
+    ofs.write((const char*) &fpr_, sizeof(fpr_));
+    ofs.write((const char*) &block_count, sizeof(block_count));
+    ofs.write((const char*) &blocks_[0], block_count * sizeof(Block));
+
+    return ofs.fail() ? -1 : 0;
+}
+
+inline int BloomFilter::Load(const char* file_path, const long tag[3])
+{
+    ifstream ifs(file_path, ios::in | ios::binary);
+    if (ifs.fail())
+    {
+        return -1;
+    }
+
+    char magic[sizeof(BLOOM_MAGIC)];
+    long file_tag[3];
+    long block_count = 0;
+
+    ifs.read(magic, sizeof(magic));
+    ifs.read((char*) file_tag, 3 * sizeof(long));
+    ifs.read((char*) &capacity_, sizeof(capacity_));
+    ifs.read((char*) &key_count_, sizeof(key_count_));
+    ifs.read((char*) &fpr_, sizeof(fpr_));
+    ifs.read((char*) &block_count, sizeof(block_count));
+
+    if (ifs.fail() || memcmp(magic, BLOOM_MAGIC, sizeof(magic)) != 0 || memcmp(file_tag, tag, 3 * sizeof(long)) != 0
+        || block_count <= 0)
+    {
+        return -1;
+    }
+
+    blocks_.resize(block_count);
+    ifs.read((char*) &blocks_[0], block_count * sizeof(Block));
+
+    return ifs.fail() ? -1 : 0;
+}
+
+#endif // BLOOM_FILTER_H
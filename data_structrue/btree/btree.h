@@ -0,0 +1,2851 @@
+// Copyright(c) 1996 Leendert Ammeraal. All rights reserved.
+// This program text occurs in Chapter 7 of
+//
+//    Ammeraal, L. (1996) Algorithms and Data Structures in C++,
+//       Chichester: John Wiley.
+
+// btree: B-tree of order M
+//  (with nodes that contain at most M links)
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "btree_common.h"
+#include "latency_histogram.h"
+#include "posting_list.h"
+
+using namespace std;
+
+static const int M = 5;  // Order of B-tree: M link fields in each node
+static const int MULTI_GET_GROUP = 16; // MultiGet中一起逐层前进的查找个数
+
+struct Node
+{
+    int n;        // Number of items stored in a Node (n < M)
+    KeyType k[M - 1]; // Data items (only the first n in use)
+    Node* p[M];   // Pointers to other nodes (n+1 in use)
+    SubtreeAgg* a; // 增强的B-树的分支结点中指向M个聚合值，a[i]是p[i]子树的聚合值；其余的结点为NULL
+    PostingList* v; // 有值的结点中指向M-1个值的块，v[i]是k[i]的值（data字段），随k[i]一起移动；没有值的结点为NULL
+};
+
+// 映像文件：BTreeImageHeader，然后从BTREE_IMAGE_HEADER_SIZE开始是按层序排列的Node，每个sizeof(Node)字节，
+// 接着是增强的B-树的分支结点的聚合值（每个M个SubtreeAgg，按结点的顺序），然后是有值的结点的值块（每个M-1个
+// PostingList，按结点的顺序），最后是各个关键字的溢出页（PostingPage），一直到文件结尾。结点中的p[i]、a、v，值块中的
+// head和溢出页中的指针是base + 它在文件中的偏移，映射到base时不用任何转换就是有效的指针
+const char BTREE_IMAGE_MAGIC[8] = { 'B', 'T', 'R', 'E', 'E', 'I', 'M', 'G' };
+const uint32_t BTREE_IMAGE_VERSION = 4;
+const size_t BTREE_IMAGE_HEADER_SIZE = 128;
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0 // 老的内核和头文件没有，这时base只是提示，映射到别处时按重定位处理
+#endif
+
+struct BTreeImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t order;      // M
+    uint32_t node_size;  // sizeof(Node)
+    uint32_t augmented;
+    uint64_t base;       // 保存时选定的映射地址，结点中的指针都按映射到这里算好
+    uint64_t root;       // 根结点在文件中的偏移，0表示空树
+    uint64_t node_count;
+    uint64_t key_count;
+    uint64_t agg_count;  // 结点之后的聚合值数组的个数
+    uint64_t value_count; // 聚合值数组之后的值块的个数
+};
+
+struct SearchResult
+{
+    Node* node;
+    int i;
+};
+
+// 指（finger）：上一次用它的Search/Insert从根结点到停下的结点的路径，以及路径上每棵子树的关键字范围。
+// 下一次操作从路径的底端往上退到范围包含新关键字的那一层，再从那里往下找。树的结构变了以后
+// （version不再等于BTree中的版本）自动从根结点重新开始
+struct BTreeFinger
+{
+    struct Level
+    {
+        Node* node;
+        bool has_lo;  // 为false时左边没有界限
+        bool has_hi;  // 为false时右边没有界限
+        KeyType lo;   // 子树中的关键字都大于lo、小于hi
+        KeyType hi;
+
+        bool Contains(KeyType x) const
+        {
+            return (!has_lo || x > lo) && (!has_hi || x < hi);
+        }
+    };
+
+    vector<Level> levels; // levels[0]是根结点，为空时从根结点开始
+    unsigned long version;
+
+    BTreeFinger() : version(0)
+    {
+    }
+};
+
+// Logical order:
+//    p[0], k[0], p[1], k[1], ..., p[n-1], k[n-1], p[n]
+
+struct BTreeStats
+{
+    // 操作计数，从构造或者上一次ResetStats()开始累计
+    long reads;          // 访问结点的次数
+    long writes;         // 修改结点的次数
+    long splits;         // Ins中结点分裂的次数，B*插入时两个满结点分成三个也算一次
+    long sibling_shifts; // B*插入时满结点把关键字挪给兄弟（不分裂）的次数
+    long appends;        // 比所有关键字都大、直接追加到最右叶结点的插入次数（不从根结点往下找）
+    long borrow_lefts;   // Del中从左兄弟借关键字的次数
+    long borrow_rights;  // Del中从右兄弟借关键字的次数
+    long merges;         // Del中与兄弟合并的次数
+    long lazy_deletes;   // 推迟调整的删除次数：删除后结点的关键字个数少于N_MIN，但没有借也没有合并
+    long compactions;    // Compact的次数
+
+    // 结构信息，由Stats()遍历整棵树得到
+    int height;
+    long node_count;
+    long key_count;
+    long underfull_count; // 关键字个数少于N_MIN的非根结点个数，只有推迟调整时才会有
+    double fill_factor;  // key_count / (node_count * (M - 1))
+    long image_node_count; // 其中还在Load映射的映像中的结点个数，其余的在堆上
+    long value_count;    // 所有关键字的值的个数
+    long posting_page_count; // 值放不下时用的溢出页的个数
+};
+
+class BTree
+{
+public:
+    /**
+     * @param augmented 是否在分支结点中维护各个子树的关键字个数和关键字之和，维护后才能用Rank/Select/Count/Sum
+     */
+    explicit BTree(bool augmented = false)
+    {
+        root_ = NULL;
+        verbose_ = true;
+        augmented_ = augmented;
+        lazy_delete_ = false;
+        bstar_ = false;
+        right_path_version_ = 0;
+        version_ = 1; // 与新的finger的版本不同
+        compact_threshold_ = 0;
+        pending_deletes_ = 0;
+        image_ = NULL;
+        image_size_ = 0;
+        image_relocated_ = false;
+        ResetStats();
+    }
+
+    ~BTree()
+    {
+        FreeNode(root_); // 通过后序遍历释放各个结点
+        ReleaseImage();
+    }
+
+    /**
+     * @brief 从根结点开始打印整棵B-树中的所有关键字
+     */
+    void Print() const
+    {
+        cout << "Contents:" << endl;
+        PrintNode(root_, 0);
+    }
+
+    /**
+     * @brief 设置Insert/Delete是否打印duplicate key和not found提示，批量操作（比如回放负载）时关掉
+     */
+    void SetVerbose(bool verbose)
+    {
+        verbose_ = verbose;
+    }
+
+    /**
+     * @brief 从根结点开始打印搜索过程
+     * @param x 待查找的关键字
+     * @details 从根结点开始，先打印结点内的所有关键字，然后换行；接着在结点内查找，如果找到则打印x的数组下标并结束；
+     *          如果找不到则进入子树中查找，循环进行直到遇到叶结点为止，打印not found并结束
+     */
+    SearchResult ShowSearch(KeyType x) const; // SearchResult是找到的结点，其中的关键字k[i] == x
+
+    /**
+     * @brief 查找关键字，不打印
+     * @return true表示找到
+     */
+    bool Search(KeyType x) const;
+
+    /**
+     * @brief 批量查找，results[i]表示keys[i]是否存在，结果与逐个Search相同
+     * @details 逐个Search时，每下一层都要等上一层的结点读进来才知道下一个结点在哪里，每层一次缓存缺失，
+     *          一次接一次地串行等待。这里每MULTI_GET_GROUP个查找为一组，一层一层地同步前进：组内每个查找
+     *          在当前结点中找到子结点后先发出预取（__builtin_prefetch），这一层的查找都走完了再访问下一层，
+     *          一组查找的缓存缺失就重叠在一起了。不记录延迟直方图，只累计reads
+     */
+    void MultiGet(const KeyType* keys, size_t count, bool* results) const;
+
+    /**
+     * @brief 从finger开始查找，结果同Search(x)，finger换成这次查找的路径
+     * @details 从finger的底端往上退到子树的范围包含x的那一层，再从那里往下找，代价是O(log d)而不是O(log n)，
+     *          d是x与finger上一次的关键字之间的关键字个数。关键字成簇（一批挨着上一批）时每个操作只走很少几层。
+     *          一个finger只能在一个线程中用；Insert(x, finger)以外的修改使所有的finger从根结点重新开始
+     */
+    bool Search(KeyType x, BTreeFinger& finger) const;
+
+    /**
+     * @brief 按从小到大的顺序取出[lo, hi]范围内的所有关键字
+     * @param keys 取出的关键字追加到其中
+     * @param limit 最多取出这么多个（最小的几个），取够了就不再往后读结点
+     * @return 取出的关键字个数
+     */
+    long Scan(KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit = SIZE_MAX) const;
+
+    /**
+     * @brief 向B-树中插入一个关键字
+     * @param x 待插入的关键字
+     * @details 如果关键字已经存在了则不插入，打印一句duplicate key提示
+     * @return =0插入成功，否则失败
+     */
+    int Insert(KeyType x);
+
+    /**
+     * @brief 从finger开始插入，结果同Insert(x)
+     * @details 同Search(x, finger)找到叶结点，然后沿着finger中的路径自下而上分裂，只回到分裂停下的那一层；
+     *          增强的B-树还要更新上面各层的聚合值，这部分仍是O(log n)。插入后finger留在叶结点，
+     *          分裂了时留在分裂停下的那一层，被分裂的这一次插入使别的finger从根结点重新开始
+     */
+    int Insert(KeyType x, BTreeFinger& finger);
+
+    /**
+     * @brief 从B-树中删除一个关键字
+     * @param x 待删除的关键字
+     * @details 如果关键字不存在则打印一句not found提示。关键字的值也一起删掉
+     * @return =0删除成功，否则失败
+     */
+    int Delete(KeyType x);
+
+    /**
+     * @brief 插入一个（关键字, 值）对，同一个关键字可以有任意多个值（multimap）
+     * @details 关键字不存在时像Insert(x)一样把它插入树中，带着这一个值；已经存在时只把值加入它的posting list，
+     *          树的结构不变。值按从小到大的顺序差值编码，少时就在结点中，多了移到溢出页中（见posting_list.h）
+     * @return =0成功
+     */
+    int Insert(KeyType x, ValueType value);
+
+    /**
+     * @brief 按从小到大的顺序取出关键字的所有值：从根结点往下走一趟找到关键字，再顺序解码它的posting list
+     * @param values 取出的值追加到其中
+     * @return 值的个数，关键字不存在时返回-1
+     */
+    long Get(KeyType x, vector<ValueType>& values) const;
+
+    /**
+     * @brief 删除一个（关键字, 值）对（值出现多次时只删一个），关键字的最后一个值删掉后关键字也从树中删掉
+     * @return =0成功，没有这个对时返回-1
+     */
+    int Delete(KeyType x, ValueType value);
+
+    /**
+     * @brief 删除[lo, hi]范围内的所有关键字
+     * @details 完全落在范围内的子树整棵释放，只修剪范围两端的两条路径并调整上面的结点，
+     *          代价与树高加上释放的结点个数成正比，而不是与删除的关键字个数成正比
+     * @return =0删除了至少一个关键字，范围内没有关键字时返回-1
+     */
+    int DeleteRange(KeyType lo, KeyType hi);
+
+    /**
+     * @brief 设置删除后是否推迟调整
+     * @param lazy 为true时Delete只在结点没有关键字了才向兄弟借或者合并，关键字个数少于N_MIN的结点留给Compact
+     *             批量调整，省掉删除阶段反复的借和合并；为false时先Compact，恢复B-树的性质
+     * @param compact_threshold 推迟调整的删除累计到这么多次时由Delete自动Compact，为0时只由调用者Compact
+     */
+    void SetLazyDelete(bool lazy, long compact_threshold = 0);
+
+    bool IsLazyDelete() const
+    {
+        return lazy_delete_;
+    }
+
+    /**
+     * @brief 设置插入时是否用B*-树的分裂策略
+     * @param bstar 为true时非根的满结点不再一分为二：先把关键字挪给一个不满的相邻兄弟，两个兄弟都满时
+     *              与其中一个一起分成三个各约2/3满的结点。每次插入多读写一个兄弟，换来更高的填充率、
+     *              更少的结点和更矮的树；为false时是原来的一分为二。只影响之后的插入，树中已有的结点不变
+     */
+    void SetBStar(bool bstar)
+    {
+        bstar_ = bstar;
+    }
+
+    bool IsBStar() const
+    {
+        return bstar_;
+    }
+
+    /**
+     * @brief 调整所有关键字个数少于N_MIN的结点：后序遍历，每个分支结点用FixNode调整它的子树
+     */
+    void Compact();
+
+    /**
+     * @brief 用排好序的关键字并行地建树，取代树中原有的内容
+     * @param keys 严格递增的关键字
+     * @param count 关键字个数
+     * @param thread_count 建树的线程数，为0时取CPU核数
+     * @details 先按关键字个数规划出整棵树的形状：高度h是使M^h >= count+1的最小值，每个结点的子树个数
+     *          c = max(下限, ceil(s / M^(h-1)))，s是子树的关键字个数加1，s平均分给各个子树。这样每个非根结点
+     *          的关键字个数都不少于N_MIN，满足Del的要求，而且接近于满。然后由主线程建出上面几层，把下面的子树
+     *          按关键字区间分给各个线程，每个线程各自分配结点建出自己的子树，最后挂到上层结点中相应的位置。
+     * @return =0成功，keys不是严格递增的时返回-1，这时树不变
+     */
+    int BulkLoad(const KeyType* keys, size_t count, int thread_count = 0);
+
+    bool IsAugmented() const
+    {
+        return augmented_;
+    }
+
+    /**
+     * @brief 小于x的关键字个数，只需从根结点往下走一趟
+     * @return 不是增强的B-树时返回-1
+     */
+    long Rank(KeyType x) const;
+
+    /**
+     * @brief 取出从小到大的第k个关键字（从0开始），沿着子树的关键字个数往下走一趟
+     * @return =0成功，k超出范围或者不是增强的B-树时返回-1
+     */
+    int Select(long k, KeyType& x) const;
+
+    /**
+     * @brief [lo, hi]范围内的关键字个数，两趟：不大于hi的个数减去小于lo的个数
+     * @return 不是增强的B-树时返回-1
+     */
+    long Count(KeyType lo, KeyType hi) const;
+
+    /**
+     * @brief [lo, hi]范围内的关键字之和，做法同Count
+     * @return =0成功，不是增强的B-树时返回-1
+     */
+    int Sum(KeyType lo, KeyType hi, long long& sum) const;
+
+    /**
+     * @brief 把整棵树保存为映像文件，Load可以直接映射使用
+     * @details 结点按层序排列，上层的结点集中在文件的开头几页中，溢出页在所有的结点之后。结点中的指针按一个
+     *          随机选定的基地址算好，Load映射到这个地址时不用做任何转换。
+     *          先写到image_file_path.tmp，写完再rename覆盖目标文件：Load映射的可能正是这个文件，原地截断重写会让
+     *          映射中还没读进来的页面失效（SIGBUS），rename后旧的文件一直留到映射解除，所以Load后可以Save回同一个路径
+     * @return =0成功，写文件失败时返回-1，这时目标文件不变
+     */
+    int Save(const char* image_file_path) const;
+
+    /**
+     * @brief 丢掉当前的树，把Save保存的映像文件映射（mmap）进来作为新的树，立即可以查找
+     * @details 映射是MAP_PRIVATE的：页面在第一次访问时才从文件中读进来，第一次修改时由内核复制一份（写时复制），
+     *          映像文件本身不会被修改。能映射到保存时的基地址时耗时与树的大小无关；基地址被占用时映射到别处，
+     *          再把所有的指针加上偏移差（重定位），这要访问所有的结点。映像中的结点不会被delete，删掉的结点
+     *          一直占着映射的内存，直到下次Load、BulkLoad或者析构。增强与否由映像决定。
+     *          映射期间映像文件不能被原地修改，Save用rename替换文件，不影响已经映射的旧文件
+     * @return =0成功，文件打不开或者不是同一个M、同一个Node布局的映像时返回-1，这时树不变
+     */
+    int Load(const char* image_file_path);
+
+    /**
+     * @brief 上一次Load是否映射到了别处、做了重定位
+     */
+    bool IsImageRelocated() const
+    {
+        return image_relocated_;
+    }
+
+    /**
+     * @brief 取得操作计数和结构信息的快照
+     * @details 操作计数只是几个整数的累加，开销可以忽略；结构信息需要遍历整棵树
+     */
+    BTreeStats Stats() const;
+
+    /**
+     * @brief 打印Stats()的结果
+     */
+    void PrintStats() const;
+
+    void ResetStats()
+    {
+        memset(&stats_, 0, sizeof(stats_));
+        profiler_.Reset();
+    }
+
+    /**
+     * @brief 设置慢操作的采样跟踪，参数见OpProfiler::SetTrace
+     */
+    void SetTrace(int sample_every, double slow_us, ostream* out = &cerr)
+    {
+        profiler_.SetTrace(sample_every, slow_us, out);
+    }
+
+    const OpProfiler& Profiler() const
+    {
+        return profiler_;
+    }
+
+    /**
+     * @brief 打印每类操作（Insert/Delete/Search/Scan）的延迟百分位数和读写明细
+     */
+    void PrintLatency() const
+    {
+        profiler_.Print(cout);
+    }
+
+private:
+    /**
+     * @brief BulkLoad中待建的一棵子树：包含keys[first, first + s - 1)，高度为h，建好后存入*slot
+     */
+    struct BulkTask
+    {
+        size_t first;
+        size_t s;
+        int h;
+        int min_children; // 根结点至少2棵子树，其余结点至少N_MIN+1棵
+        Node** slot;
+    };
+
+    /**
+     * @brief 按BulkLoad规划的形状建出一棵子树
+     * @param tasks 不为NULL时只建根结点，把它的各个子树作为待建的任务追加到其中，子树指针暂时为NULL
+     * @param node_count 累加新建的结点个数
+     */
+    Node* BuildNode(const KeyType* keys, const BulkTask& task, vector<BulkTask>* tasks, long& node_count) const;
+
+    /**
+     * @brief 结点及其所有子树的聚合值，由结点内的关键字和r->a[]算出
+     */
+    static SubtreeAgg NodeAgg(const Node* node);
+
+    /**
+     * @brief 预取结点中查找要用的k[]和p[]
+     */
+    static void PrefetchNode(const Node* node)
+    {
+        __builtin_prefetch(node);
+        __builtin_prefetch(&node->p[M - 1]);
+    }
+
+    /**
+     * @brief 增强的B-树中重新计算r->a[i]，p[i]子树的聚合值必须已经是对的。这时r本身没有别的修改，计一次写
+     */
+    void UpdateAgg(Node* r, int i) const
+    {
+        if (augmented_ && r->p[i] != NULL)
+        {
+            r->a[i] = NodeAgg(r->p[i]);
+            ++stats_.writes;
+        }
+    }
+
+    /**
+     * @brief 增强的B-树中重新计算r->a[]，用于结点的子树有增减或者移动之后
+     */
+    void RecomputeAgg(Node* r) const
+    {
+        for (int i = 0; augmented_ && r->p[0] != NULL && i <= r->n; ++i)
+        {
+            r->a[i] = NodeAgg(r->p[i]);
+        }
+    }
+
+    /**
+     * @brief 小于x（inclusive时为不大于x）的关键字的聚合值，从根结点往下走一趟
+     */
+    SubtreeAgg PrefixAgg(KeyType x, bool inclusive) const;
+
+    /**
+     * @brief 后序遍历释放结点及其所有子树
+     * @return 释放的关键字个数
+     */
+    long FreeNode(Node* node);
+
+    /**
+     * @brief 找到关键字x所在的结点，x是其中的k[i]
+     * @return 找不到时返回NULL
+     */
+    Node* FindNode(KeyType x, int& i) const;
+
+    /**
+     * @brief 插入关键字x，它的值是xv（没有值时为空），x已经存在时返回DUPLICATE_KEY
+     */
+    Status InsertKey(KeyType x, PostingList& xv);
+
+    /**
+     * @brief 递增关键字的快速路径：x比树中所有的关键字都大时直接追加到最右叶结点的末尾
+     * @details right_path_缓存从根结点到最右叶结点的路径，与最右叶结点的最后一个关键字比较就知道能不能追加，
+     *          不用从根结点往下找。叶结点满了时不从中间分裂，而是留下前M-2个关键字，k[M-2]提到父结点中，
+     *          x单独放进新的最右叶结点；父结点满了同样处理。这样顺序插入时左边的结点都是满的，只有每层
+     *          最右的那个结点可能少于N_MIN个关键字（同推迟调整的删除留下的结点，Del和Compact都能处理）。
+     *          right_path_在树的结构变了（version_变了）时失效，下一次追加时重新往下走一趟
+     * @return true表示已经追加了，false表示x不比所有的关键字都大（或者树为空），要走普通的插入
+     */
+    bool AppendKey(KeyType x, PostingList& xv);
+
+    /**
+     * @brief 根结点分裂了，新的根结点只有一个关键字y，两棵子树是原来的根结点和q
+     */
+    void GrowRoot(KeyType y, PostingList& yv, Node* q);
+
+    /**
+     * @brief finger中从底端往上退到范围包含x的那一层，再往下找x，finger换成找的路径
+     * @return x所在的结点，x是其中的k[i]；找不到时返回NULL，这时finger的底端是x应该插入的叶结点
+     */
+    Node* SeekFinger(KeyType x, BTreeFinger& finger, int& i) const;
+
+    /**
+     * @brief 分配一个结点，增强的B-树的分支结点同时分配聚合值数组。结点在树中的层次不会变，分支结点一直是分支结点
+     */
+    Node* NewNode(bool branch) const
+    {
+        Node* node = new Node;
+        node->a = (augmented_ && branch) ? new SubtreeAgg[M] : NULL;
+        node->v = NULL; // 第一次放进非空的值时才分配值块（见SetValue）
+        return node;
+    }
+
+    /**
+     * @brief 释放一个结点和它的聚合值数组、值块，映像中的不释放。值块中的溢出页由调用者释放
+     */
+    void DeleteNode(Node* node)
+    {
+        if (node->a != NULL && !InImage(node->a))
+        {
+            delete[] node->a;
+        }
+
+        if (node->v != NULL && !InImage(node->v))
+        {
+            delete[] node->v;
+        }
+
+        if (!InImage(node))
+        {
+            delete node;
+        }
+    }
+
+    /**
+     * @brief r->v[i]，没有值块的结点中的值都是空的
+     */
+    static PostingList ValueOf(const Node* r, int i)
+    {
+        PostingList list;
+        if (r->v != NULL)
+        {
+            return r->v[i];
+        }
+
+        InitPosting(list);
+        return list;
+    }
+
+    /**
+     * @brief r的值块，没有时分配一个，其中的值都是空的
+     */
+    PostingList* Values(Node* r)
+    {
+        if (NULL == r->v)
+        {
+            r->v = new PostingList[M - 1];
+            for (int i = 0; i < M - 1; ++i)
+            {
+                InitPosting(r->v[i]);
+            }
+        }
+
+        return r->v;
+    }
+
+    /**
+     * @brief 把list放到r->v[i]。list为空而r没有值块时什么也不做，只用Insert(x)的树不分配值块
+     */
+    void SetValue(Node* r, int i, const PostingList& list)
+    {
+        if (list.count > 0 || r->v != NULL)
+        {
+            Values(r)[i] = list;
+        }
+    }
+
+    /**
+     * @brief 释放r->v[i]的溢出页，没有值块时什么也不做
+     */
+    void FreeValue(Node* r, int i)
+    {
+        if (r->v != NULL)
+        {
+            FreePosting(r->v[i], postings_);
+        }
+    }
+
+    /**
+     * @brief 结点（或者它的聚合值数组、值块）是否在Load映射的映像中
+     */
+    bool InImage(const void* ptr) const
+    {
+        return (const char*) ptr >= image_ && (const char*) ptr < image_ + image_size_;
+    }
+
+    /**
+     * @brief 解除映像的映射，调用前树中的结点必须都已经释放
+     */
+    void ReleaseImage();
+
+    /**
+     * @brief 从r为根的子树中删除[lo, hi]范围内的关键字
+     * @param above_lo 子树中的关键字都不小于lo
+     * @param below_hi 子树中的关键字都不大于hi
+     * @param sep 两端的子树都只删掉一部分时，它们之间需要一个分隔关键字，这时留下一个范围内的关键字，
+     *            由DeleteRange最后用Del删除。整个DeleteRange中最多有一个这样的结点
+     * @details 返回后r的子树都满足N_MIN的要求；r自身的关键字个数可能不够，甚至为0（只剩一棵子树，
+     *          这棵子树的关键字个数也可能不够），由调用者调整
+     * @return 删除的关键字个数（不含留下的分隔关键字）
+     */
+    long DelRange(Node* r, KeyType lo, KeyType hi, bool above_lo, bool below_hi, KeyType& sep, bool& has_sep);
+
+    /**
+     * @brief 调整r的各个子树，使它们的关键字个数都不少于N_MIN
+     * @details r只有一棵子树（关键字个数为0）时无法调整，留给调用者
+     */
+    void FixNode(Node* r);
+
+    /**
+     * @brief 把r->p[i]和它的一个兄弟合并（合并后放得下时）或者重新平均分配，然后调整合并或分配后的结点的子树
+     * @return 接下来要检查的子树的下标：合并后的结点可能仍然不够，调整子树时的合并也可能使分配后的结点
+     *         又不够了，所以都从pivot开始再检查一次
+     */
+    int FixChild(Node* r, int i);
+
+    /**
+     * @brief 后序遍历r的子树，自下而上调整关键字个数不够的结点
+     */
+    void CompactNode(Node* r);
+
+    /**
+     * @brief Del修改完r之后判断它是否不够：推迟调整时只有没有关键字了才算不够，少于N_MIN的留给Compact
+     * @return SUCCESS/UNDERFLOW
+     */
+    Status CheckUnderflow(const Node* r);
+
+    /**
+     * @brief 前序遍历打印结点及其所有子树中的关键字
+     * @param node 待打印的结点
+     * @param indent_space_count 初始缩进值
+     * @details 先打印结点内的关键字，然后换行，再缩进8个空格，依次打印各个子树中的关键字，递归进行
+     */
+    void PrintNode(const Node* node, int indent_space_count) const;
+
+    /**
+     * @brief 在一个结点内查找
+     * @param x 待查找的关键字
+     * @param k 结点内的关键字数组
+     * @param n 结点内的关键字个数
+     * @return i 要么在结点内找到，则i就是数组下标；找不到则说明x在在p[i]指向的子树中
+     */
+    int SearchInNode(KeyType x, const KeyType* k, int n) const;
+
+    /**
+     * @brief 将关键字插入到结点中
+     * @param r 往其中插入的结点
+     * @param x 待插入的关键字
+     * @param xv x的值
+     * @prarm y 往上提到父结点中的关键字
+     * @param yv y的值
+     * @param q 分裂新增的结点
+     * @return SUCCESS/DUPLICATE_KEY/INSERT_NOT_COMPLETE/INSERT_OVERFLOW，INSERT_OVERFLOW时r不变，
+     *         y、yv、q是r放不下的那一项，由父结点用InsOverflow处理
+     * @details B-树的插入规则：首先在最底层的某个分支结点（通过查找得到）中添加待插入的关键字，若插入前该结点内的关键字个数小于m-1，则直接插入即可；
+     *          否则要进行结点的分裂，将该结点分裂成2个结点，左边一个结点包含前ceil(m/2)-1个关键字，右边一个结点包含后m-ceil(m/2)个关键字，
+     *          中间的那个关键字插入到父结点中。这样父结点中就多了一个关键字，可能需要继续分裂，分裂过程可能会一直波及到根结点。
+     */
+    Status Ins(Node* r, KeyType x, PostingList& xv, KeyType& y, PostingList& yv, Node*& u);
+
+    /**
+     * @brief Ins的后半部分：子树r->p[i]的插入返回了code，把往上提的(y1, y1v, q1)插入r中，满了时分裂
+     * @details Insert(x, finger)沿着finger中的路径自下而上调用，叶结点的子树是空的，code是INSERT_NOT_COMPLETE，
+     *          (y1, y1v, q1)就是(x, xv, NULL)
+     * @return 同Ins
+     */
+    Status InsUp(Node* r, int i, Status code, KeyType& y1, PostingList& y1v, Node*& q1, KeyType& y, PostingList& yv,
+        Node*& q);
+
+    /**
+     * @brief B*插入：满的r->p[i]还要插入(y, yv, q)，与一个相邻兄弟一起重新分配
+     * @details r->p[i]加上这一项、一个兄弟和它们之间的分隔关键字依次排开。有不满的兄弟时（先看左兄弟）
+     *          平均分给这两个结点，只改分隔关键字；两个兄弟都满时（优先右兄弟）共2M个关键字，分成三个结点
+     *          和两个分隔关键字，第二个分隔关键字和新结点要插入r中
+     * @return SUCCESS表示挪给兄弟就放下了；INSERT_NOT_COMPLETE表示分成了三个结点，y、yv、q换成要插入r的那一项
+     */
+    Status InsOverflow(Node* r, int i, KeyType& y, PostingList& yv, Node*& q);
+
+    /**
+     * @details 首先找到待删除的关键字所在的结点，
+     *          1，如果待删除的关键字在最下面一层的分支结点中，
+     *          1.1，如果待删关键字所在结点的关键字个数大于ceil(m/2)-1，则从该结点中直接删去该关键字即可
+     *          1.2，待删关键字所在结点p的关键字个数等于ceil(m/2)-1，则删去该关键字后需要进行结点的合并：
+     *             1.2.1，如果与结点p相邻的右兄弟（或左兄弟）结点q中的关键字个数大于ceil(m/2)-1个，则借一个过来。设K[pivot]是p中大于（或小于）x的最小（或最大）关键字，
+     *                    则将K[pivot]下移至p中，把q的最小（或最大）关键字上移至r的K[pivot]处。注意对右兄弟和左兄弟都要做。
+     *             1.2.2，与结点p相邻的右兄弟和左兄弟（也可能只有一个兄弟）结点中的关键字数目均等于ceil(m/2)-1，则需要把删除关键字x之后的p与其右兄弟（或左兄弟）结点以及
+     *                    父结点中分割二者的关键字K[pivot]合并成一个结点。分2种情况：（1）如果没有右兄弟，则将K[pivot]和自己合并到左兄弟中（2）有右兄弟，则将K[pivot]和右兄弟合并到自己中。
+     *                    由于合并会减少父结点中的一个关键字，如果因此使得父结点中的关键字个数少于ceil(m/2)-1，则对此父结点继续操作（要么从它的兄弟借，要么与它的兄弟合并），
+     *                    合并过程可能会一直波及到根节点。
+     *          2，待删除的关键字不在最下面一层的分支结点中，设待删关键字为该结点中第i个关键字key[i]，则用相邻的右子树p[i]（或左子树p[i-1]）
+     *             中的最小（或最大）关键字y与x交换，然后在p[i]（或p[i-1]）所指的子树中删去x。这样就将问题转化为第一种情况了
+     */
+    Status Del(Node* r, KeyType x);
+
+    /**
+     * @brief 后序遍历统计结点及其所有子树中的结点个数和关键字个数
+     */
+    void CountNode(const Node* node, BTreeStats& stats) const;
+
+    /**
+     * @brief 中序遍历结点及其子树，跳过[lo, hi]范围以外的子树
+     * @param limit keys中的关键字达到这么多个时停止
+     */
+    void ScanNode(const Node* node, KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit) const;
+
+private:
+    Node* root_;
+    bool verbose_;
+    bool augmented_;
+    bool lazy_delete_;
+    bool bstar_;
+    long compact_threshold_;
+    long pending_deletes_; // 上次Compact以后推迟调整的删除次数
+    char* image_;           // Load映射的映像，没有时为NULL
+    size_t image_size_;
+    bool image_relocated_;
+    PostingAllocator postings_; // 溢出页
+    vector<Node*> right_path_; // 从根结点到最右叶结点的路径，见AppendKey
+    unsigned long right_path_version_; // right_path_是在哪个版本的树中得到的
+    unsigned long version_;    // 树的结构（结点和分隔关键字）每变一次加1，right_path_和finger据此判断是否失效
+    mutable BTreeStats stats_; // 只有操作计数有效，结构信息由Stats()临时计算
+    mutable OpProfiler profiler_;
+};
+
+inline SearchResult BTree::ShowSearch(KeyType x) const
+{
+    cout << "Search path:" << endl;
+
+    int i, j, n;
+    Node* r = root_;
+
+    while (r)
+    {
+        ++stats_.reads;
+        n = r->n;
+
+        for (j = 0; j < r->n; ++j)
+        {
+            cout << " " << r->k[j];
+        }
+
+        cout << endl;
+
+        i = SearchInNode(x, r->k, n); // 要么在结点内找到，要么在p[i]子树中
+
+        if (i < n && x == r->k[i])
+        {
+            cout << "Key " << x << " found in position " << i << " of last displayed node";
+            if (ValueOf(r, i).count > 0)
+            {
+                cout << ", " << ValueOf(r, i).count << " values";
+            }
+
+            cout << "." << endl;
+            return {r, i};
+        }
+
+        r = r->p[i]; // 进入p[i]子树
+    }
+
+    cout << "Key " << x << " not found." << endl;
+    return { NULL, -1 };
+}
+
+inline bool BTree::Search(KeyType x) const
+{
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    const Node* r = root_;
+    bool found = false;
+
+    while (r)
+    {
+        ++stats_.reads;
+        profiler_.Visit((long) r);
+
+        const int i = SearchInNode(x, r->k, r->n);
+        if (i < r->n && x == r->k[i])
+        {
+            found = true;
+            break;
+        }
+
+        r = r->p[i];
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return found;
+}
+
+inline bool BTree::Search(KeyType x, BTreeFinger& finger) const
+{
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    int i;
+    const bool found = (SeekFinger(x, finger, i) != NULL);
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return found;
+}
+
+inline Node* BTree::SeekFinger(KeyType x, BTreeFinger& finger, int& i) const
+{
+    if (finger.levels.empty() || finger.version != version_ || finger.levels[0].node != root_)
+    {
+        finger.levels.clear();
+        finger.version = version_;
+
+        if (NULL == root_)
+        {
+            return NULL;
+        }
+
+        const BTreeFinger::Level root = { root_, false, false, 0, 0 };
+        finger.levels.push_back(root);
+    }
+
+    // 往上退到子树的范围包含x的那一层，根结点的范围是所有的关键字
+    size_t top = finger.levels.size() - 1;
+    while (top > 0 && !finger.levels[top].Contains(x))
+    {
+        --top;
+    }
+
+    finger.levels.resize(top + 1);
+
+    for (; ;)
+    {
+        const BTreeFinger::Level level = finger.levels.back();
+        Node* r = level.node;
+
+        ++stats_.reads;
+        profiler_.Visit((long) r);
+
+        i = SearchInNode(x, r->k, r->n);
+        if (i < r->n && x == r->k[i])
+        {
+            return r;
+        }
+
+        if (NULL == r->p[i])
+        {
+            return NULL;
+        }
+
+        // p[i]子树的范围是k[i - 1]和k[i]之间，两端的子树沿用r的界限
+        const BTreeFinger::Level child = { r->p[i], i > 0 || level.has_lo, i < r->n || level.has_hi,
+            (i > 0) ? r->k[i - 1] : level.lo, (i < r->n) ? r->k[i] : level.hi };
+        finger.levels.push_back(child);
+    }
+}
+
+inline void BTree::MultiGet(const KeyType* keys, size_t count, bool* results) const
+{
+    const Node* nodes[MULTI_GET_GROUP]; // 组内各个查找当前所在的结点
+    int active[MULTI_GET_GROUP];        // 组内还没有结果的查找
+
+    for (size_t first = 0; first < count; first += MULTI_GET_GROUP)
+    {
+        const int size = (int) min((size_t) MULTI_GET_GROUP, count - first);
+        int active_count = 0;
+
+        for (int j = 0; j < size; ++j)
+        {
+            results[first + j] = false;
+            if (root_ != NULL)
+            {
+                nodes[j] = root_;
+                active[active_count++] = j;
+            }
+        }
+
+        // 所有的叶结点都在同一层，组内的查找一起走到叶结点，中途找到的先退出
+        while (active_count > 0)
+        {
+            int next_count = 0;
+
+            for (int a = 0; a < active_count; ++a)
+            {
+                const int j = active[a];
+                const Node* r = nodes[j];
+                const KeyType x = keys[first + j];
+                ++stats_.reads;
+
+                const int i = SearchInNode(x, r->k, r->n);
+                if (i < r->n && x == r->k[i])
+                {
+                    results[first + j] = true;
+                    continue;
+                }
+
+                r = r->p[i];
+                if (r != NULL)
+                {
+                    PrefetchNode(r);
+                    nodes[j] = r;
+                    active[next_count++] = j;
+                }
+            }
+
+            active_count = next_count;
+        }
+    }
+}
+
+inline long BTree::Scan(KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit) const
+{
+    const bool profiling = profiler_.Begin(OP_SCAN, lo, stats_.reads, stats_.writes);
+    const size_t size = keys.size();
+
+    if (lo <= hi && limit > 0)
+    {
+        ScanNode(root_, lo, hi, keys, (limit < SIZE_MAX - size) ? size + limit : SIZE_MAX);
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return (long) (keys.size() - size);
+}
+
+inline long BTree::Rank(KeyType x) const
+{
+    return augmented_ ? PrefixAgg(x, false).count : -1;
+}
+
+inline int BTree::Select(long k, KeyType& x) const
+{
+    if (!augmented_ || k < 0)
+    {
+        return -1;
+    }
+
+    const Node* r = root_;
+
+    while (r)
+    {
+        ++stats_.reads;
+        const bool leaf = (NULL == r->p[0]);
+        int i;
+
+        // 依次跳过p[0], k[0], p[1], k[1], ...，直到第k个关键字落在某棵子树中或者就是某个k[i]
+        for (i = 0; i <= r->n; ++i)
+        {
+            const long count = leaf ? 0 : r->a[i].count;
+            if (k < count)
+            {
+                break;
+            }
+
+            k -= count;
+
+            if (i < r->n)
+            {
+                if (0 == k)
+                {
+                    x = r->k[i];
+                    return 0;
+                }
+
+                --k;
+            }
+        }
+
+        if (i > r->n)
+        {
+            return -1; // k不小于关键字总数
+        }
+
+        r = r->p[i];
+    }
+
+    return -1;
+}
+
+inline long BTree::Count(KeyType lo, KeyType hi) const
+{
+    if (!augmented_)
+    {
+        return -1;
+    }
+
+    return (lo <= hi) ? PrefixAgg(hi, true).count - PrefixAgg(lo, false).count : 0;
+}
+
+inline int BTree::Sum(KeyType lo, KeyType hi, long long& sum) const
+{
+    if (!augmented_)
+    {
+        return -1;
+    }
+
+    sum = (lo <= hi) ? PrefixAgg(hi, true).sum - PrefixAgg(lo, false).sum : 0;
+    return 0;
+}
+
+inline SubtreeAgg BTree::PrefixAgg(KeyType x, bool inclusive) const
+{
+    SubtreeAgg agg = { 0, 0 };
+    const Node* r = root_;
+
+    while (r)
+    {
+        ++stats_.reads;
+        const bool leaf = (NULL == r->p[0]);
+        const int i = SearchInNode(x, r->k, r->n);
+
+        // k[0]到k[i-1]都小于x，p[0]到p[i-1]子树也就都在x的左边
+        for (int j = 0; j < i; ++j)
+        {
+            agg.count += 1;
+            agg.sum += r->k[j];
+
+            if (!leaf)
+            {
+                agg.count += r->a[j].count;
+                agg.sum += r->a[j].sum;
+            }
+        }
+
+        if (i < r->n && x == r->k[i]) // p[i]子树也在x的左边，不必再往下走
+        {
+            if (!leaf)
+            {
+                agg.count += r->a[i].count;
+                agg.sum += r->a[i].sum;
+            }
+
+            if (inclusive)
+            {
+                agg.count += 1;
+                agg.sum += x;
+            }
+
+            break;
+        }
+
+        r = r->p[i];
+    }
+
+    return agg;
+}
+
+inline SubtreeAgg BTree::NodeAgg(const Node* node)
+{
+    SubtreeAgg agg = { node->n, 0 };
+
+    for (int i = 0; i < node->n; ++i)
+    {
+        agg.sum += node->k[i];
+    }
+
+    for (int i = 0; node->p[0] != NULL && i <= node->n; ++i)
+    {
+        agg.count += node->a[i].count;
+        agg.sum += node->a[i].sum;
+    }
+
+    return agg;
+}
+
+inline int BTree::Insert(KeyType x)
+{
+    int ret = 0;
+    PostingList xv;
+    InitPosting(xv);
+
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    Status code = InsertKey(x, xv);
+    switch (code)
+    {
+        case DUPLICATE_KEY:
+        {
+            if (verbose_)
+            {
+                cout << "Duplicate key ignored." << endl;
+            }
+
+            ret = -1;
+        }
+            break;
+
+        case SUCCESS:
+            break;
+
+        default:
+        {
+            ret = -1;
+        }
+            break;
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return ret;
+}
+
+inline int BTree::Insert(KeyType x, BTreeFinger& finger)
+{
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    int i;
+    Status code = DUPLICATE_KEY;
+
+    if (NULL == SeekFinger(x, finger, i))
+    {
+        KeyType y1 = x, y;
+        PostingList y1v, yv;
+        Node* q1 = NULL, * q = NULL;
+        InitPosting(y1v);
+
+        // 叶结点的空子树“分裂”出了(x, NULL)，沿着路径往上插入，直到有一层放下了
+        code = INSERT_NOT_COMPLETE;
+        int level = (int) finger.levels.size() - 1;
+
+        for (; level >= 0; --level)
+        {
+            Node* r = finger.levels[level].node;
+            if (r != finger.levels.back().node) // 叶结点中的位置SeekFinger已经找到了
+            {
+                i = SearchInNode(x, r->k, r->n);
+            }
+
+            code = InsUp(r, i, code, y1, y1v, q1, y, yv, q);
+            if (code != INSERT_NOT_COMPLETE && code != INSERT_OVERFLOW)
+            {
+                break;
+            }
+
+            y1 = y;
+            y1v = yv;
+            q1 = q;
+        }
+
+        if (level < 0)
+        {
+            GrowRoot(y1, y1v, q1); // 空树时就是只有x的根结点
+            code = SUCCESS;
+        }
+
+        // 上面各层的子树多了x
+        for (int j = level - 1; augmented_ && j >= 0; --j)
+        {
+            Node* r = finger.levels[j].node;
+            UpdateAgg(r, SearchInNode(x, r->k, r->n));
+        }
+
+        // 放下了x的那一层以下的结点分裂了，finger退到这一层，它和上面各层的范围没有变
+        finger.levels.resize(level + 1);
+        finger.version = version_;
+    }
+
+    if (DUPLICATE_KEY == code && verbose_)
+    {
+        cout << "Duplicate key ignored." << endl;
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return (SUCCESS == code) ? 0 : -1;
+}
+
+inline Status BTree::InsertKey(KeyType x, PostingList& xv)
+{
+    if (AppendKey(x, xv))
+    {
+        return SUCCESS;
+    }
+
+    KeyType y;
+    PostingList yv;
+    Node* q = NULL;
+
+    Status code = Ins(root_, x, xv, y, yv, q);
+    if (INSERT_NOT_COMPLETE == code)
+    {
+        GrowRoot(y, yv, q);
+        code = SUCCESS;
+    }
+
+    return code;
+}
+
+inline void BTree::GrowRoot(KeyType y, PostingList& yv, Node* q)
+{
+    Node* root = root_;
+    root_ = NewNode(root != NULL); // 空树中插入第一个关键字时新的根结点是叶结点
+    root_->n = 1;
+    root_->k[0] = y;
+    SetValue(root_, 0, yv);
+    root_->p[0] = root;
+    root_->p[1] = q;
+    RecomputeAgg(root_);
+    ++stats_.writes;
+    ++version_;
+}
+
+inline bool BTree::AppendKey(KeyType x, PostingList& xv)
+{
+    if (NULL == root_)
+    {
+        return false;
+    }
+
+    if (right_path_.empty() || right_path_version_ != version_ || right_path_[0] != root_)
+    {
+        right_path_.clear();
+        right_path_version_ = version_;
+        for (Node* r = root_; r != NULL; r = r->p[r->n])
+        {
+            ++stats_.reads;
+            right_path_.push_back(r);
+        }
+    }
+
+    Node* leaf = right_path_.back();
+    ++stats_.reads;
+    profiler_.Visit((long) leaf);
+
+    if (0 == leaf->n || x <= leaf->k[leaf->n - 1])
+    {
+        return false;
+    }
+
+    // 从叶结点往上追加(y, q)，满了的结点留下前M-2个关键字，k[M-2]换成接着往上追加的y
+    KeyType y = x;
+    PostingList yv = xv;
+    Node* q = NULL;
+    int level = (int) right_path_.size() - 1;
+
+    for (; level >= 0; --level)
+    {
+        Node* r = right_path_[level];
+        if (r->n < M - 1)
+        {
+            r->k[r->n] = y;
+            SetValue(r, r->n, yv);
+            r->p[++r->n] = q;
+            RecomputeAgg(r);
+            ++stats_.writes;
+            break;
+        }
+
+        Node* s = NewNode(r->p[0] != NULL);
+        s->n = 1;
+        s->k[0] = y;
+        SetValue(s, 0, yv);
+        s->p[0] = r->p[M - 1];
+        s->p[1] = q;
+
+        r->n = M - 2;
+        y = r->k[M - 2];
+        yv = ValueOf(r, M - 2);
+        q = s;
+
+        RecomputeAgg(r);
+        RecomputeAgg(s);
+        right_path_[level] = s;
+        stats_.writes += 2;
+        ++stats_.splits;
+        ++version_;
+    }
+
+    if (level < 0) // 根结点也满了，树长高一层
+    {
+        GrowRoot(y, yv, q);
+        right_path_.insert(right_path_.begin(), root_);
+    }
+
+    right_path_version_ = version_; // 自己的分裂不使right_path_失效
+
+    // 上面各层最右的子树多了x
+    for (--level; level >= 0; --level)
+    {
+        UpdateAgg(right_path_[level], right_path_[level]->n);
+    }
+
+    ++stats_.appends;
+    return true;
+}
+
+inline Node* BTree::FindNode(KeyType x, int& i) const
+{
+    Node* r = root_;
+
+    while (r)
+    {
+        ++stats_.reads;
+        profiler_.Visit((long) r);
+
+        i = SearchInNode(x, r->k, r->n);
+        if (i < r->n && x == r->k[i])
+        {
+            return r;
+        }
+
+        r = r->p[i];
+    }
+
+    return NULL;
+}
+
+inline int BTree::Insert(KeyType x, ValueType value)
+{
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    PostingList xv;
+    InitPosting(xv);
+    AddPosting(xv, value, postings_);
+
+    if (!AppendKey(x, xv)) // 比所有关键字都大时一定是新的关键字，不用先找
+    {
+        int i;
+        Node* r = FindNode(x, i);
+
+        if (r != NULL) // 已有的关键字只加一个值，不必动树的结构
+        {
+            FreePosting(xv, postings_);
+            AddPosting(Values(r)[i], value, postings_);
+            ++stats_.writes;
+        }
+        else
+        {
+            InsertKey(x, xv);
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return 0;
+}
+
+inline long BTree::Get(KeyType x, vector<ValueType>& values) const
+{
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    int i;
+    const Node* r = FindNode(x, i);
+
+    if (r != NULL)
+    {
+        DecodePosting(ValueOf(r, i), values);
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return (r != NULL) ? (long) ValueOf(r, i).count : -1;
+}
+
+inline int BTree::Delete(KeyType x, ValueType value)
+{
+    int i;
+    Node* r = FindNode(x, i);
+
+    if (NULL == r || NULL == r->v || RemovePosting(r->v[i], value, postings_) != 0)
+    {
+        return -1;
+    }
+
+    ++stats_.writes;
+    return (r->v[i].count > 0) ? 0 : Delete(x);
+}
+
+inline int BTree::Delete(KeyType x)
+{
+    int ret = 0;
+
+    const bool profiling = profiler_.Begin(OP_DELETE, x, stats_.reads, stats_.writes);
+    ++version_;
+    Status code = Del(root_, x);
+    switch (code)
+    {
+        case NOT_FOUND:
+        {
+            if (verbose_)
+            {
+                cout << "Key " << x << " not found." << endl;
+            }
+
+            ret = -1;
+        }
+            break;
+
+        case UNDERFLOW:
+        {
+            Node* root = root_;
+            root_ = root_->p[0];
+            DeleteNode(root);
+        }
+            break;
+
+        case SUCCESS:
+            break;
+
+        default:
+        {
+            ret = -1;
+        }
+            break;
+    }
+
+    // 自动Compact的开销算在触发它的这次删除上，延迟和写次数中能看到分摊的代价
+    if (0 == ret && compact_threshold_ > 0 && pending_deletes_ >= compact_threshold_)
+    {
+        Compact();
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return ret;
+}
+
+inline void BTree::SetLazyDelete(bool lazy, long compact_threshold)
+{
+    if (!lazy && lazy_delete_)
+    {
+        Compact();
+    }
+
+    lazy_delete_ = lazy;
+    compact_threshold_ = lazy ? compact_threshold : 0;
+}
+
+inline void BTree::Compact()
+{
+    ++version_;
+    CompactNode(root_);
+
+    // 根结点的子树都合并成一棵时降低树高，同DeleteRange
+    while (root_ != NULL && 0 == root_->n)
+    {
+        Node* root = root_;
+        root_ = root_->p[0];
+        DeleteNode(root);
+        FixNode(root_);
+    }
+
+    pending_deletes_ = 0;
+    ++stats_.compactions;
+}
+
+inline void BTree::CompactNode(Node* r)
+{
+    if (NULL == r || NULL == r->p[0])
+    {
+        return;
+    }
+
+    ++stats_.reads;
+    for (int i = 0; i <= r->n; ++i)
+    {
+        CompactNode(r->p[i]);
+    }
+
+    FixNode(r); // 子树的子树都已经满足N_MIN的要求了，这正是FixNode的前提
+}
+
+inline Status BTree::CheckUnderflow(const Node* r)
+{
+    const int N_MIN = (M - 1) / 2;
+
+    if (r == root_ || !lazy_delete_)
+    {
+        return (r->n >= (r == root_ ? 1 : N_MIN)) ? SUCCESS : UNDERFLOW;
+    }
+
+    if (0 == r->n)
+    {
+        return UNDERFLOW;
+    }
+
+    if (r->n < N_MIN)
+    {
+        ++pending_deletes_;
+        ++stats_.lazy_deletes;
+    }
+
+    return SUCCESS;
+}
+
+inline int BTree::DeleteRange(KeyType lo, KeyType hi)
+{
+    if (lo > hi || NULL == root_)
+    {
+        return -1;
+    }
+
+    KeyType sep;
+    bool has_sep = false;
+    ++version_;
+    long count = DelRange(root_, lo, hi, false, false, sep, has_sep);
+
+    // 根结点没有关键字时降低树高，新的根结点的子树可能还需要调整
+    while (root_ != NULL && 0 == root_->n)
+    {
+        Node* root = root_;
+        root_ = root_->p[0];
+        DeleteNode(root);
+        FixNode(root_);
+    }
+
+    if (has_sep)
+    {
+        if (UNDERFLOW == Del(root_, sep))
+        {
+            Node* root = root_;
+            root_ = root_->p[0];
+            DeleteNode(root);
+        }
+
+        ++count;
+    }
+
+    return (count > 0) ? 0 : -1;
+}
+
+inline long BTree::DelRange(Node* r, KeyType lo, KeyType hi, bool above_lo, bool below_hi, KeyType& sep,
+    bool& has_sep)
+{
+    if (NULL == r)
+    {
+        return 0;
+    }
+
+    ++stats_.reads;
+    KeyType* k = r->k;
+    Node** p = r->p;
+    const int n = r->n;
+    int i, j;
+
+    const int a = above_lo ? 0 : SearchInNode(lo, k, n); // 范围内的第一个关键字
+    int b = below_hi ? n : SearchInNode(hi, k, n);       // 范围外的第一个关键字
+    if (b < n && k[b] == hi)
+    {
+        ++b;
+    }
+
+    if (a == b) // 本结点中没有范围内的关键字，范围（如果有）在p[a]子树中
+    {
+        const long count = DelRange(p[a], lo, hi, above_lo && 0 == a, below_hi && n == a, sep, has_sep);
+        if (count > 0)
+        {
+            FixNode(r);
+        }
+
+        return count;
+    }
+
+    long count = b - a;
+
+    if (NULL == p[0]) // 叶结点：直接删掉k[a]到k[b-1]
+    {
+        for (j = a; j < b; ++j)
+        {
+            FreeValue(r, j);
+        }
+
+        for (i = a, j = b; j < n; ++i, ++j)
+        {
+            k[i] = k[j];
+            SetValue(r, i, ValueOf(r, j));
+        }
+
+        r->n = n - count;
+        ++stats_.writes;
+
+        return count;
+    }
+
+    // p[a]和p[b]可能只有一部分关键字在范围内，中间的p[a+1]到p[b-1]整棵都在范围内
+    const bool a_partial = !(above_lo && 0 == a);
+    const bool b_partial = !(below_hi && n == b);
+    const bool keep_sep = a_partial && b_partial;
+
+    for (j = (a_partial ? a + 1 : a); j <= (b_partial ? b - 1 : b); ++j)
+    {
+        count += FreeNode(p[j]);
+    }
+
+    // 留下的依次是：p[0], k[0], ..., p[a-1], k[a-1]，p[a]（a_partial时），k[a]（keep_sep时），p[b]（b_partial时），
+    // 然后是k[b], p[b+1], ..., k[n-1], p[n]
+    int nk = a; // 已经就位的关键字个数
+    int np = a; // 已经就位的子树个数
+
+    if (a_partial)
+    {
+        ++np;
+    }
+
+    if (keep_sep)
+    {
+        sep = k[a];
+        has_sep = true;
+        --count;
+        ++nk;
+    }
+
+    for (j = nk; j < b; ++j)
+    {
+        FreeValue(r, j);
+    }
+
+    if (b_partial)
+    {
+        p[np++] = p[b];
+    }
+
+    for (j = b; j < n; ++j)
+    {
+        SetValue(r, nk, ValueOf(r, j));
+        k[nk++] = k[j];
+        p[np++] = p[j + 1];
+    }
+
+    r->n = nk;
+    ++stats_.writes;
+
+    if (a_partial)
+    {
+        count += DelRange(p[a], lo, hi, false, true, sep, has_sep);
+    }
+
+    if (b_partial)
+    {
+        count += DelRange(p[a_partial ? a + 1 : a], lo, hi, true, false, sep, has_sep);
+    }
+
+    FixNode(r);
+    return count;
+}
+
+inline void BTree::FixNode(Node* r)
+{
+    const int N_MIN = (M - 1) / 2;
+
+    if (NULL == r || NULL == r->p[0])
+    {
+        return;
+    }
+
+    for (int i = 0; i <= r->n && r->n > 0; )
+    {
+        if (r->p[i]->n < N_MIN)
+        {
+            i = FixChild(r, i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    RecomputeAgg(r);
+}
+
+inline int BTree::FixChild(Node* r, int i)
+{
+    KeyType* k = r->k;
+    Node** p = r->p;
+    const int pivot = (i > 0) ? i - 1 : i; // 优先与左兄弟合并或分配
+    Node* pL = p[pivot];
+    Node* pR = p[pivot + 1];
+    int j;
+
+    if (pL->n + 1 + pR->n <= M - 1) // Merge: 将K[pivot]和pR合并到pL中去，删除pR
+    {
+        pL->k[pL->n] = k[pivot];
+        SetValue(pL, pL->n, ValueOf(r, pivot));
+        pL->p[pL->n + 1] = pR->p[0];
+
+        for (j = 0; j < pR->n; ++j)
+        {
+            pL->k[pL->n + 1 + j] = pR->k[j];
+            SetValue(pL, pL->n + 1 + j, ValueOf(pR, j));
+            pL->p[pL->n + 2 + j] = pR->p[j + 1];
+        }
+
+        pL->n += 1 + pR->n;
+        DeleteNode(pR);
+
+        for (j = pivot + 1; j < r->n; ++j)
+        {
+            k[j - 1] = k[j];
+            SetValue(r, j - 1, ValueOf(r, j));
+            p[j] = p[j + 1];
+        }
+
+        --r->n;
+        stats_.writes += 2;
+        ++stats_.merges;
+
+        FixNode(pL); // 两边的子树在合并处相邻了，原来无法调整的子树现在有了兄弟
+        return pivot;
+    }
+
+    // Redistribute: pL、k[pivot]、pR中的关键字和子树依次排开，平均分给pL和pR，中间的那个关键字放回k[pivot]
+    const int total = pL->n + 1 + pR->n;
+    const int nL = (total - 1) / 2;
+    KeyType keys[2 * M];
+    PostingList lists[2 * M];
+    Node* ptrs[2 * M + 1];
+    int t = 0;
+
+    for (j = 0; j < pL->n; ++j, ++t)
+    {
+        keys[t] = pL->k[j];
+        lists[t] = ValueOf(pL, j);
+        ptrs[t] = pL->p[j];
+    }
+
+    keys[t] = k[pivot];
+    lists[t] = ValueOf(r, pivot);
+    ptrs[t++] = pL->p[pL->n];
+
+    for (j = 0; j < pR->n; ++j, ++t)
+    {
+        keys[t] = pR->k[j];
+        lists[t] = ValueOf(pR, j);
+        ptrs[t] = pR->p[j];
+    }
+
+    ptrs[t] = pR->p[pR->n];
+
+    if (nL > pL->n)
+    {
+        ++stats_.borrow_rights;
+    }
+    else
+    {
+        ++stats_.borrow_lefts;
+    }
+
+    pL->n = nL;
+    for (j = 0; j < nL; ++j)
+    {
+        pL->k[j] = keys[j];
+        SetValue(pL, j, lists[j]);
+        pL->p[j] = ptrs[j];
+    }
+
+    pL->p[nL] = ptrs[nL];
+    k[pivot] = keys[nL];
+    SetValue(r, pivot, lists[nL]);
+
+    pR->n = total - 1 - nL;
+    for (j = 0; j < pR->n; ++j)
+    {
+        pR->k[j] = keys[nL + 1 + j];
+        SetValue(pR, j, lists[nL + 1 + j]);
+        pR->p[j] = ptrs[nL + 1 + j];
+    }
+
+    pR->p[pR->n] = ptrs[total];
+    stats_.writes += 3;
+
+    FixNode(pL);
+    FixNode(pR);
+    return pivot; // 调整子树时的合并可能又使pL或pR不够了
+}
+
+inline int BTree::BulkLoad(const KeyType* keys, size_t count, int thread_count)
+{
+    const int N_MIN = (M - 1) / 2;
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (keys[i - 1] >= keys[i])
+        {
+            return -1;
+        }
+    }
+
+    if (thread_count <= 0)
+    {
+        thread_count = max(1, (int) thread::hardware_concurrency());
+    }
+
+    FreeNode(root_);
+    ReleaseImage();
+    ++version_;
+    root_ = NULL;
+
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    // 最小的高度h：高度为h的子树最多能有M^h - 1个关键字
+    int h = 1;
+    for (size_t cap = M; cap < count + 1; cap *= M)
+    {
+        ++h;
+    }
+
+    // 主线程逐层建出上面几层，直到待建的子树足够多，可以均匀地分给各个线程
+    vector<BulkTask> tasks(1, BulkTask{ 0, count + 1, h, 2, &root_ });
+    vector<Node*> upper_nodes; // 主线程建的结点，它们的子树建好后才能算出聚合值
+    long node_count = 0;
+
+    while (tasks.size() < 4 * (size_t) thread_count && tasks[0].h > 1)
+    {
+        vector<BulkTask> children;
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            *tasks[i].slot = BuildNode(keys, tasks[i], &children, node_count);
+            upper_nodes.push_back(*tasks[i].slot);
+        }
+
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            children[i].min_children = N_MIN + 1;
+        }
+
+        tasks.swap(children);
+    }
+
+    // 各个线程轮流领取子树，各自分配结点
+    atomic<size_t> next_task(0);
+    vector<long> node_counts(thread_count, 0);
+
+    auto worker = [&](int id)
+    {
+        for (size_t i = next_task++; i < tasks.size(); i = next_task++)
+        {
+            *tasks[i].slot = BuildNode(keys, tasks[i], NULL, node_counts[id]);
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 1; i < thread_count && i < (int) tasks.size(); ++i)
+    {
+        threads.push_back(thread(worker, i));
+    }
+
+    worker(0);
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    for (int i = 0; i < thread_count; ++i)
+    {
+        node_count += node_counts[i];
+    }
+
+    for (size_t i = upper_nodes.size(); i > 0; --i) // 逐层往上
+    {
+        RecomputeAgg(upper_nodes[i - 1]);
+    }
+
+    stats_.writes += node_count;
+    return 0;
+}
+
+inline Node* BTree::BuildNode(const KeyType* keys, const BulkTask& task, vector<BulkTask>* tasks,
+    long& node_count) const
+{
+    const int N_MIN = (M - 1) / 2;
+    Node* node = NewNode(task.h > 1);
+    ++node_count;
+
+    if (1 == task.h)
+    {
+        node->n = (int) (task.s - 1);
+        for (int i = 0; i < node->n; ++i)
+        {
+            node->k[i] = keys[task.first + i];
+            node->p[i] = NULL;
+        }
+
+        node->p[node->n] = NULL;
+        return node;
+    }
+
+    size_t child_cap = 1; // 高度为h-1的子树最多能有的s：M^(h-1)
+    for (int i = 1; i < task.h; ++i)
+    {
+        child_cap *= M;
+    }
+
+    const int c = max(task.min_children, (int) ((task.s + child_cap - 1) / child_cap));
+    size_t first = task.first;
+
+    node->n = c - 1;
+    for (int i = 0; i < c; ++i)
+    {
+        // 子树i包含keys[first, first + s - 1)，紧接着的keys[first + s - 1]是它与下一棵子树之间的分隔关键字
+        const BulkTask child = { first, task.s / c + ((size_t) i < task.s % c ? 1 : 0), task.h - 1, N_MIN + 1,
+            &node->p[i] };
+
+        if (tasks != NULL)
+        {
+            node->p[i] = NULL;
+            tasks->push_back(child);
+        }
+        else
+        {
+            node->p[i] = BuildNode(keys, child, NULL, node_count);
+        }
+
+        first += child.s;
+        if (i < c - 1)
+        {
+            node->k[i] = keys[first - 1];
+        }
+    }
+
+    if (NULL == tasks)
+    {
+        RecomputeAgg(node);
+    }
+
+    return node;
+}
+
+inline long BTree::FreeNode(Node* node)
+{
+    if (NULL == node)
+    {
+        return 0;
+    }
+
+    long count = node->n;
+    for (int i = 0; i <= node->n; ++i)
+    {
+        count += FreeNode(node->p[i]);
+    }
+
+    for (int i = 0; i < node->n; ++i)
+    {
+        FreeValue(node, i);
+    }
+
+    DeleteNode(node);
+    return count;
+}
+
+inline int BTree::Save(const char* image_file_path) const
+{
+    BTreeImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BTREE_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = BTREE_IMAGE_VERSION;
+    header.order = M;
+    header.node_size = sizeof(Node);
+    header.augmented = augmented_ ? 1 : 0;
+
+    // 基地址在用户空间的16TB到28TB之间随机选，按1GB对齐，同一个进程中Load几个映像时一般也不冲突
+    random_device rd;
+    header.base = ((uint64_t) 16 << 40) + ((uint64_t) (rd() % (12 << 10)) << 30);
+
+    // 写到临时文件再rename：目标文件可能正被Load映射着
+    const string tmp_path = string(image_file_path) + ".tmp";
+    ofstream ofs(tmp_path.c_str(), ios::out | ios::trunc | ios::binary);
+    if (!ofs)
+    {
+        return -1;
+    }
+
+    char pad[BTREE_IMAGE_HEADER_SIZE];
+    memset(pad, 0, sizeof(pad));
+    ofs.write(pad, sizeof(pad)); // 文件头最后再写
+
+    // 层序遍历：先排出所有的结点，第q个结点的子结点紧接在第q-1个结点的子结点之后，聚合值和溢出页在所有的结点之后
+    vector<const Node*> queue;
+    if (root_ != NULL)
+    {
+        queue.push_back(root_);
+        header.root = BTREE_IMAGE_HEADER_SIZE;
+    }
+
+    for (size_t q = 0; q < queue.size(); ++q)
+    {
+        header.agg_count += (queue[q]->a != NULL) ? 1 : 0;
+        header.value_count += (queue[q]->v != NULL) ? 1 : 0;
+        for (int i = 0; i <= queue[q]->n && queue[q]->p[0] != NULL; ++i)
+        {
+            queue.push_back(queue[q]->p[i]);
+        }
+    }
+
+    const uint64_t agg_base = header.base + BTREE_IMAGE_HEADER_SIZE + queue.size() * sizeof(Node);
+    const uint64_t value_base = agg_base + header.agg_count * M * sizeof(SubtreeAgg);
+    const uint64_t page_base = value_base + header.value_count * (M - 1) * sizeof(PostingList);
+    uint64_t agg_index = 0;
+    vector<PostingList> values; // 值块依次排开，head已经换成映像中的地址
+    vector<const PostingPage*> pages;
+    vector<uint64_t> tails; // 每串溢出页的第一页中的tail，其余的页为0
+    size_t child = 1;       // 下一个子结点在queue中的序号
+    Node node;
+
+    for (size_t q = 0; q < queue.size(); ++q)
+    {
+        const Node* r = queue[q];
+        memset(&node, 0, sizeof(node));
+        node.n = r->n;
+        memcpy(node.k, r->k, r->n * sizeof(KeyType));
+        if (r->a != NULL)
+        {
+            node.a = (SubtreeAgg*) (agg_base + agg_index++ * M * sizeof(SubtreeAgg));
+        }
+
+        if (r->v != NULL)
+        {
+            node.v = (PostingList*) (value_base + values.size() * sizeof(PostingList));
+            values.insert(values.end(), r->v, r->v + M - 1);
+            for (int i = r->n; i < M - 1; ++i)
+            {
+                InitPosting(values[values.size() - (M - 1) + i]); // 用不到的位置可能还留着移走的值
+            }
+        }
+
+        for (int i = 0; i < r->n && r->v != NULL; ++i)
+        {
+            if (!r->v[i].IsInline())
+            {
+                const size_t head = pages.size();
+                values[values.size() - (M - 1) + i].head = (PostingPage*) (page_base + head * sizeof(PostingPage));
+
+                for (const PostingPage* page = r->v[i].head; page != NULL; page = page->next)
+                {
+                    pages.push_back(page);
+                    tails.push_back(0);
+                }
+
+                tails[head] = page_base + (pages.size() - 1) * sizeof(PostingPage);
+            }
+        }
+
+        for (int i = 0; i <= r->n && r->p[0] != NULL; ++i)
+        {
+            node.p[i] = (Node*) (header.base + BTREE_IMAGE_HEADER_SIZE + child++ * sizeof(Node));
+        }
+
+        ofs.write((const char*) &node, sizeof(node));
+        header.key_count += r->n;
+    }
+
+    SubtreeAgg aggs[M];
+    for (size_t q = 0; q < queue.size(); ++q)
+    {
+        if (queue[q]->a != NULL)
+        {
+            memset(aggs, 0, sizeof(aggs));
+            memcpy(aggs, queue[q]->a, (queue[q]->n + 1) * sizeof(SubtreeAgg));
+            ofs.write((const char*) aggs, sizeof(aggs));
+        }
+    }
+
+    if (!values.empty())
+    {
+        ofs.write((const char*) values.data(), values.size() * sizeof(PostingList));
+    }
+
+    PostingPage page;
+    for (size_t j = 0; j < pages.size(); ++j)
+    {
+        memcpy(&page, pages[j], sizeof(page));
+        page.next = (pages[j]->next != NULL) ? (PostingPage*) (page_base + (j + 1) * sizeof(PostingPage)) : NULL;
+        page.tail = (PostingPage*) tails[j];
+        ofs.write((const char*) &page, sizeof(page));
+    }
+
+    header.node_count = queue.size();
+    ofs.seekp(0, ios::beg);
+    ofs.write((const char*) &header, sizeof(header));
+    ofs.close();
+
+    if (ofs.fail() || rename(tmp_path.c_str(), image_file_path) != 0)
+    {
+        remove(tmp_path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+inline int BTree::Load(const char* image_file_path)
+{
+    const int fd = open(image_file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    BTreeImageHeader header;
+    struct stat st;
+    uint64_t page_offset = 0; // 溢出页在文件中的开始位置
+
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+        || memcmp(header.magic, BTREE_IMAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != BTREE_IMAGE_VERSION
+        || header.order != (uint32_t) M || header.node_size != sizeof(Node)
+        || (uint64_t) st.st_size < (page_offset = BTREE_IMAGE_HEADER_SIZE + header.node_count * sizeof(Node)
+            + header.agg_count * M * sizeof(SubtreeAgg) + header.value_count * (M - 1) * sizeof(PostingList))
+        || (st.st_size - page_offset) % sizeof(PostingPage) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    void* image = mmap((void*) header.base, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd,
+        0);
+    if (MAP_FAILED == image)
+    {
+        image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+
+    close(fd); // 映射不依赖于文件描述符
+    if (MAP_FAILED == image)
+    {
+        return -1;
+    }
+
+    FreeNode(root_);
+    ReleaseImage();
+    ++version_;
+
+    image_ = (char*) image;
+    image_size_ = st.st_size;
+    image_relocated_ = (image_ != (char*) header.base);
+    augmented_ = (header.augmented != 0);
+    pending_deletes_ = 0;
+    postings_.SetImage(image_, image_size_);
+
+    if (image_relocated_)
+    {
+        const ptrdiff_t delta = image_ - (char*) header.base;
+        Node* nodes = (Node*) (image_ + BTREE_IMAGE_HEADER_SIZE);
+
+        for (uint64_t j = 0; j < header.node_count; ++j)
+        {
+            for (int i = 0; i <= nodes[j].n && nodes[j].p[0] != NULL; ++i)
+            {
+                nodes[j].p[i] = (Node*) ((char*) nodes[j].p[i] + delta);
+            }
+
+            if (nodes[j].a != NULL)
+            {
+                nodes[j].a = (SubtreeAgg*) ((char*) nodes[j].a + delta);
+            }
+
+            if (nodes[j].v != NULL)
+            {
+                nodes[j].v = (PostingList*) ((char*) nodes[j].v + delta);
+            }
+        }
+
+        const uint64_t value_size = header.value_count * (M - 1);
+        PostingList* values = (PostingList*) (image_ + page_offset - value_size * sizeof(PostingList));
+        for (uint64_t j = 0; j < value_size; ++j)
+        {
+            if (!values[j].IsInline())
+            {
+                values[j].head = (PostingPage*) ((char*) values[j].head + delta);
+            }
+        }
+
+        PostingPage* pages = (PostingPage*) (image_ + page_offset);
+        const size_t page_count = (image_ + image_size_ - (char*) pages) / sizeof(PostingPage);
+
+        for (size_t j = 0; j < page_count; ++j)
+        {
+            if (pages[j].next != NULL)
+            {
+                pages[j].next = (PostingPage*) ((char*) pages[j].next + delta);
+            }
+
+            if (pages[j].tail != NULL)
+            {
+                pages[j].tail = (PostingPage*) ((char*) pages[j].tail + delta);
+            }
+        }
+    }
+
+    root_ = (header.root != 0) ? (Node*) (image_ + header.root) : NULL;
+    return 0;
+}
+
+inline void BTree::ReleaseImage()
+{
+    if (image_ != NULL)
+    {
+        munmap(image_, image_size_);
+        image_ = NULL;
+        image_size_ = 0;
+        postings_.SetImage(NULL, 0);
+        image_relocated_ = false;
+    }
+}
+
+inline BTreeStats BTree::Stats() const
+{
+    BTreeStats stats = stats_;
+
+    stats.height = 0;
+    for (const Node* r = root_; r != NULL; r = r->p[0])
+    {
+        ++stats.height;
+    }
+
+    stats.node_count = 0;
+    stats.key_count = 0;
+    stats.underfull_count = 0;
+    stats.image_node_count = 0;
+    stats.value_count = 0;
+    stats.posting_page_count = 0;
+    CountNode(root_, stats);
+    stats.fill_factor = (stats.node_count > 0) ? (double) stats.key_count / (stats.node_count * (M - 1)) : 0;
+
+    return stats;
+}
+
+inline void BTree::PrintStats() const
+{
+    const BTreeStats stats = Stats();
+
+    cout << "Statistics:" << endl
+        << "  reads: " << stats.reads << ", writes: " << stats.writes << endl
+        << "  splits: " << stats.splits << ", sibling shifts: " << stats.sibling_shifts
+        << ", appends: " << stats.appends << ", borrow lefts: " << stats.borrow_lefts
+        << ", borrow rights: " << stats.borrow_rights << ", merges: " << stats.merges << endl
+        << "  lazy deletes: " << stats.lazy_deletes << ", compactions: " << stats.compactions
+        << ", underfull nodes: " << stats.underfull_count << endl
+        << "  height: " << stats.height << ", nodes: " << stats.node_count << ", keys: " << stats.key_count
+        << ", fill factor: " << setprecision(3) << stats.fill_factor << endl
+        << "  values: " << stats.value_count << ", posting pages: " << stats.posting_page_count << endl;
+
+    if (image_ != NULL)
+    {
+        cout << "  image nodes: " << stats.image_node_count << " (of " << stats.node_count << "), image "
+            << (image_relocated_ ? "relocated" : "mapped at its base address") << endl;
+    }
+}
+
+inline void BTree::CountNode(const Node* node, BTreeStats& stats) const
+{
+    if (NULL == node)
+    {
+        return;
+    }
+
+    for (int i = 0; i <= node->n; ++i)
+    {
+        CountNode(node->p[i], stats);
+    }
+
+    ++stats.node_count;
+    stats.key_count += node->n;
+    stats.image_node_count += InImage(node) ? 1 : 0;
+
+    for (int i = 0; i < node->n; ++i)
+    {
+        stats.value_count += ValueOf(node, i).count;
+        stats.posting_page_count += PostingPageCount(ValueOf(node, i));
+    }
+
+    if (node != root_ && node->n < (M - 1) / 2)
+    {
+        ++stats.underfull_count;
+    }
+}
+
+inline void BTree::ScanNode(const Node* node, KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit) const
+{
+    if (NULL == node || keys.size() >= limit)
+    {
+        return;
+    }
+
+    ++stats_.reads;
+    profiler_.Visit((long) node);
+
+    // p[i]子树中的关键字在k[i-1]和k[i]之间，从第一个不小于lo的关键字开始
+    int i = SearchInNode(lo, node->k, node->n);
+
+    for (; i < node->n && node->k[i] <= hi; ++i)
+    {
+        ScanNode(node->p[i], lo, hi, keys, limit);
+        if (keys.size() >= limit)
+        {
+            return;
+        }
+
+        keys.push_back(node->k[i]);
+    }
+
+    ScanNode(node->p[i], lo, hi, keys, limit);
+}
+
+inline void BTree::PrintNode(const Node* node, int indent_space_count) const
+{
+    if (NULL == node)
+    {
+        return;
+    }
+
+    cout << setw(indent_space_count) << "";
+    int i;
+
+    for (i = 0; i < node->n; ++i)
+    {
+        cout << setw(3) << node->k[i] << " ";
+        if (ValueOf(node, i).count > 0)
+        {
+            cout << "(" << ValueOf(node, i).count << " values) ";
+        }
+    }
+
+    cout << endl;
+
+    for (i = 0; i <= node->n; ++i)
+    {
+        PrintNode(node->p[i], indent_space_count + 8);
+    }
+}
+
+inline int BTree::SearchInNode(KeyType x, const KeyType* k, int n) const
+{
+    int i = 0;
+
+    while (i < n && x > k[i])
+    {
+        ++i; // TODO 可以优化为二分查找
+    }
+
+    return i;
+}
+
+inline Status BTree::Ins(Node* r, KeyType x, PostingList& xv, KeyType& y, PostingList& yv, Node*& q)
+{
+    if (NULL == r)
+    {
+        q = NULL;
+        y = x;
+        yv = xv;
+        return INSERT_NOT_COMPLETE;
+    }
+
+    KeyType y1;
+    PostingList y1v;
+    Node* q1 = NULL;
+
+    ++stats_.reads;
+    profiler_.Visit((long) r);
+    const int i = SearchInNode(x, r->k, r->n);
+
+    if (i < r->n && x == r->k[i])
+    {
+        return DUPLICATE_KEY;
+    }
+
+    const Status code = Ins(r->p[i], x, xv, y1, y1v, q1);
+    return InsUp(r, i, code, y1, y1v, q1, y, yv, q);
+}
+
+inline Status BTree::InsUp(Node* r, int i, Status code, KeyType& y1, PostingList& y1v, Node*& q1, KeyType& y,
+    PostingList& yv, Node*& q)
+{
+    // 结点中的最后一个关键字、它的值和子树指针
+    KeyType final_x;
+    PostingList final_v;
+    Node* final_p = NULL;
+
+    int j;
+    const int n = r->n;
+
+    if (INSERT_OVERFLOW == code)
+    {
+        ++version_;
+        code = InsOverflow(r, i, y1, y1v, q1);
+        if (SUCCESS == code)
+        {
+            RecomputeAgg(r);
+            return code;
+        }
+
+        i = SearchInNode(y1, r->k, n); // 分成三个结点后新的分隔关键字在p[i]的左边或右边
+    }
+    else if (code != INSERT_NOT_COMPLETE)
+    {
+        if (SUCCESS == code)
+        {
+            UpdateAgg(r, i);
+        }
+
+        return code;
+    }
+
+    if (q1 != NULL)
+    {
+        ++version_; // 子结点分裂了
+    }
+
+    // Insertion in subtree did not completely succeed;
+    // try to Insert x1 and q1 in the current Node:
+    if (n < M - 1)
+    {
+        // 插入到结点内即可
+        i = SearchInNode(y1, r->k, n);
+
+        for (j = n; j > i; --j)
+        {
+            // 往后移保持关键字数组有序
+            r->k[j] = r->k[j - 1];
+            SetValue(r, j, ValueOf(r, j - 1));
+            r->p[j + 1] = r->p[j];
+        }
+
+        r->k[i] = y1;
+        SetValue(r, i, y1v);
+        r->p[i + 1] = q1;
+        ++(r->n);
+        RecomputeAgg(r);
+        ++stats_.writes;
+
+        return SUCCESS;
+    }
+
+    ++version_;
+    if (bstar_ && r != root_)
+    {
+        // 不分裂，r原样留着，放不下的这一项交给父结点与兄弟重新分配
+        y = y1;
+        yv = y1v;
+        q = q1;
+        return INSERT_OVERFLOW;
+    }
+
+    // Current Node is full (n == M - 1) and will be split.
+    // Pass item k[h] in the middle of the augmented
+    // sequence back via parameter y, so that it
+    // can move upward in the tree. Also, pass a pointer
+    // to the newly created Node back via parameter q:
+    // 此时结点中的关键字个数已经为M-1了，关键字数组已经满了
+    if (i == M - 1)
+    {
+        // 待插入的关键字比结点中所有的关键字都大，则final_x为待插入的关键字，final_p为空
+        final_x = y1;
+        final_v = y1v;
+        final_p = q1;
+    }
+    else
+    {
+        // 在中间位置，final记录结点中的最后一个关键字和子树指针
+        final_x = r->k[M - 2];
+        final_v = ValueOf(r, M - 2);
+        final_p = r->p[M - 1];
+
+        for (j = M - 2; j > i; --j)
+        {
+            r->k[j] = r->k[j - 1];
+            SetValue(r, j, ValueOf(r, j - 1));
+            r->p[j + 1] = r->p[j];
+        }
+
+        r->k[i] = y1;
+        SetValue(r, i, y1v);
+        r->p[i + 1] = q1;
+    }
+
+    const int h = (M - 1) / 2; // 往上提的那个关键字的位置（数组下标）
+    y = r->k[h];             // y and q are passed on to the next higher level in the tree
+    yv = ValueOf(r, h);
+
+    q = NewNode(r->p[0] != NULL); // 分裂产生的新结点
+
+    // The values p[0],k[0],p[1],...,k[h-1],p[h] belong to
+    // the left of k[h] and are kept in *r:
+    r->n = h; // 更新原有结点中的关键字个数
+    // p[h+1],k[h+1],p[h+2],...,k[M-2],p[M-1],final_x,final_p
+    // belong to the right of k[h] and are moved to *q:
+    q->n = M - 1 - h; // 新结点中的关键字个数
+
+    for (j = 0; j < q->n; ++j)
+    {
+        const int idx = j + h + 1;
+        q->k[j] = (j < q->n - 1 ? r->k[idx] : final_x);
+        SetValue(q, j, (j < q->n - 1) ? ValueOf(r, idx) : final_v);
+        q->p[j] = r->p[idx];
+    }
+
+    q->p[q->n] = final_p;
+    RecomputeAgg(r);
+    RecomputeAgg(q);
+    stats_.writes += 2;
+    ++stats_.splits;
+
+    return INSERT_NOT_COMPLETE;
+}
+
+inline Status BTree::InsOverflow(Node* r, int i, KeyType& y, PostingList& yv, Node*& q)
+{
+    Node* c = r->p[i];
+    int pivot, j;
+
+    if (i > 0 && r->p[i - 1]->n < M - 1)
+    {
+        pivot = i - 1;
+    }
+    else if (i < r->n && r->p[i + 1]->n < M - 1)
+    {
+        pivot = i;
+    }
+    else
+    {
+        pivot = (i < r->n) ? i : i - 1; // 两个兄弟都满，与右兄弟（没有时与左兄弟）一起分成三个
+    }
+
+    Node* pL = r->p[pivot];
+    Node* pR = r->p[pivot + 1];
+    ++stats_.reads; // 兄弟
+
+    // pL、k[pivot]、pR依次排开，c中在y的位置插入(y, q)
+    KeyType keys[2 * M];
+    PostingList lists[2 * M];
+    Node* ptrs[2 * M + 1];
+    const int at = SearchInNode(y, c->k, c->n);
+    int t = 0;
+
+    for (Node* node = pL; ; node = pR)
+    {
+        for (j = 0; j <= node->n; ++j)
+        {
+            if (node == c && j == at)
+            {
+                ptrs[t] = node->p[j];
+                keys[t] = y;
+                lists[t++] = yv;
+                ptrs[t] = q;
+            }
+            else
+            {
+                ptrs[t] = node->p[j];
+            }
+
+            if (j < node->n)
+            {
+                keys[t] = node->k[j];
+                lists[t++] = ValueOf(node, j);
+            }
+        }
+
+        if (node == pR)
+        {
+            break;
+        }
+
+        keys[t] = r->k[pivot];
+        lists[t++] = ValueOf(r, pivot);
+    }
+
+    // t个关键字分给m个结点，中间留出m - 1个分隔关键字
+    const int m = (t + M) / M;
+    Node* pieces[3] = { pL, pR, NULL };
+    if (3 == m)
+    {
+        pieces[2] = NewNode(pL->p[0] != NULL);
+    }
+
+    for (int piece = 0, pos = 0; piece < m; ++piece)
+    {
+        Node* node = pieces[piece];
+        node->n = (t - (m - 1)) / m + (piece < (t - (m - 1)) % m ? 1 : 0);
+
+        for (j = 0; j < node->n; ++j, ++pos)
+        {
+            node->k[j] = keys[pos];
+            SetValue(node, j, lists[pos]);
+            node->p[j] = ptrs[pos];
+        }
+
+        node->p[node->n] = ptrs[pos];
+        RecomputeAgg(node);
+
+        if (0 == piece)
+        {
+            r->k[pivot] = keys[pos];
+            SetValue(r, pivot, lists[pos]);
+        }
+        else if (1 == piece && 3 == m)
+        {
+            y = keys[pos];
+            yv = lists[pos];
+        }
+
+        ++pos;
+    }
+
+    stats_.writes += m + 1;
+    if (2 == m)
+    {
+        ++stats_.sibling_shifts;
+        return SUCCESS;
+    }
+
+    q = pieces[2];
+    ++stats_.splits;
+    return INSERT_NOT_COMPLETE;
+}
+
+inline Status BTree::Del(Node* r, KeyType x)
+{
+    if (NULL == r)
+    {
+        return NOT_FOUND;
+    }
+
+    KeyType* k = r->k;  // k[i] means r->k[i]
+    Node** p = r->p;
+    Node* pL = NULL;
+    Node* pR = NULL;       // p[i] means r->p[i]
+    int i, j, pivot, n = r->n;
+    const int N_MIN = (M - 1) / 2;
+    Status code;
+
+    ++stats_.reads;
+    profiler_.Visit((long) r);
+    i = SearchInNode(x, k, n);
+    if (NULL == p[0]) // *r is a leaf 待删除的关键字在最下面一层的分支结点中（或者说就是叶结点）
+    {
+        if (i == n || x < k[i])
+        {
+            return NOT_FOUND;
+        }
+
+        // x == k[i], and *r is a leaf
+        FreeValue(r, i);
+
+        for (j = i + 1; j < n; ++j)
+        {
+            k[j - 1] = k[j];
+            SetValue(r, j - 1, ValueOf(r, j));
+            p[j] = p[j + 1];
+        }
+
+        --(r->n);
+        ++stats_.writes;
+        return CheckUnderflow(r);
+    }
+
+    // *r is an interior Node, not a leaf: 待删除的关键字不在最下面一层的分支结点中（或者说不是叶结点）
+    if (i < n && x == k[i]) // i==0和1<=i<=n-1表示关键字在本结点中；i==n表示关键字在结点的最后一棵子树p[n]中
+    {  // x found in an interior Node. Go to left child
+        // *p[i] and follow a path all the way to a leaf,
+        // using rightmost branches:
+        // 这里是用左子树中的最大关键字与x互换，下面一段循环就是找左子树中的最大关键字
+        Node* q = p[i], * q1;
+        int nq;
+
+        for (; ;)
+        {
+            ++stats_.reads;
+            nq = q->n;
+            q1 = q->p[nq];
+
+            if (q1 == NULL)
+            {
+                break;
+            }
+
+            q = q1;
+        }
+
+        // Exchange k[i] (= x) with rightmost item in leaf: 交换两个关键字
+        k[i] = q->k[nq - 1];
+        q->k[nq - 1] = x;
+        const PostingList xv = ValueOf(r, i); // 值跟着关键字走
+        SetValue(r, i, ValueOf(q, nq - 1));
+        SetValue(q, nq - 1, xv);
+        stats_.writes += 2;
+    }
+
+    // Delete x in leaf of subtree with root p[i]: 从左子树p[i]中删除x
+    code = Del(p[i], x);
+    if (code != UNDERFLOW)
+    {
+        if (SUCCESS == code)
+        {
+            UpdateAgg(r, i); // 与叶结点中的关键字交换过时，路径上的聚合值也都是自下而上重新算出来的
+        }
+
+        return code;
+    }
+
+    // 注意下面均是相对于p[i]操作，p[i-1]是p[i]的左兄弟，p[i+1]是p[i]的右兄弟，且已经从p[i]中删除了x的
+
+    // There is underflow; borrow, and, if necessary, merge:
+    // Too few data items in Node *p[i]
+    if (i > 0 && p[i - 1]->n > N_MIN) // Borrow from left sibling 如果i==0就没有左兄弟了，这个逻辑就不考虑了
+    {
+        // 有相邻的左兄弟且其中的关键字个数大于ceil(m/2)-1，则从左兄弟中借一个关键字，怎么借？通过父结点中转，画个图理理思路
+        pivot = i - 1; // k[pivot] between pL and pR: K[pivot]是待删结点的父结点中小于x的最大关键字
+        pL = p[pivot]; // 左兄弟
+        pR = p[i]; // pR就是真被删关键字的那个结点
+
+        // Increase contents of *pR, borrowing from *pL:
+        // 将K[pivot]插入到pR中作为第一个关键字，后面的关键字顺次后移
+        pR->p[pR->n + 1] = pR->p[pR->n];
+
+        for (j = pR->n; j > 0; --j)
+        {
+            pR->k[j] = pR->k[j - 1];
+            SetValue(pR, j, ValueOf(pR, j - 1));
+            pR->p[j] = pR->p[j - 1];
+        }
+
+        ++pR->n;
+        pR->k[0] = k[pivot];
+        SetValue(pR, 0, ValueOf(r, pivot));
+        pR->p[0] = pL->p[pL->n]; // pL->k[pL->n - 1]是左兄弟中的最大关键字，下一步是把这个最大关键字放到pivot的位置并从左兄弟中删掉，那么相应的子树pL->p[pL->n]应该放哪里呢？就这里！
+
+        // 将左子树的最大关键字上移到待删结点的pivot位置
+        k[pivot] = pL->k[--(pL->n)];
+        SetValue(r, pivot, ValueOf(pL, pL->n));
+        RecomputeAgg(pL);
+        RecomputeAgg(pR);
+        RecomputeAgg(r);
+        stats_.writes += 3;
+        ++stats_.borrow_lefts;
+
+        if (lazy_delete_ && pR->n < N_MIN) // 推迟调整时p[i]原来没有关键字了，借到一个还是不够
+        {
+            ++pending_deletes_;
+            ++stats_.lazy_deletes;
+        }
+
+        return SUCCESS;
+    }
+
+    if (i < n && p[i + 1]->n > N_MIN) // Borrow from right sibling
+    {
+        // 有相邻的右兄弟且其中的关键字个数大于ceil(m/2)-1，这个if的逻辑是从右兄弟借
+        pivot = i; // k[pivot] between pL and pR:
+        pL = p[pivot];
+        pR = p[pivot + 1];
+
+        // Increase contents of *pL, borrowing from *pR:
+        pL->k[pL->n] = k[pivot];
+        SetValue(pL, pL->n, ValueOf(r, pivot));
+        pL->p[pL->n + 1] = pR->p[0];
+        k[pivot] = pR->k[0];
+        SetValue(r, pivot, ValueOf(pR, 0));
+        ++(pL->n);
+        --(pR->n);
+
+        for (j = 0; j < pR->n; ++j)
+        {
+            pR->k[j] = pR->k[j + 1];
+            SetValue(pR, j, ValueOf(pR, j + 1));
+            pR->p[j] = pR->p[j + 1];
+        }
+
+        pR->p[pR->n] = pR->p[pR->n + 1];
+        RecomputeAgg(pL);
+        RecomputeAgg(pR);
+        RecomputeAgg(r);
+        stats_.writes += 3;
+        ++stats_.borrow_rights;
+
+        if (lazy_delete_ && pL->n < N_MIN)
+        {
+            ++pending_deletes_;
+            ++stats_.lazy_deletes;
+        }
+
+        return SUCCESS;
+    }
+
+    // Merge; neither borrow left nor borrow right possible.
+    // 相邻的左兄弟和右兄弟（也可能只有一个）中的关键字数目均等于ceil(m/2)-1，没得借了！这时采用合并的方法，怎么合并？
+    pivot = (i == n ? i - 1 : i); // i==n时pR就是自己，pL是左兄弟；i<n时pL就是自己，pR是右兄弟
+    pL = p[pivot];
+    pR = p[pivot + 1];
+
+    // Add k[pivot] and *pR to *pL: 将K[pivot]和pR合并到pL中去，删除pR
+    pL->k[pL->n] = k[pivot];
+    SetValue(pL, pL->n, ValueOf(r, pivot));
+    pL->p[pL->n + 1] = pR->p[0];
+
+    for (j = 0; j < pR->n; ++j)
+    {
+        pL->k[pL->n + 1 + j] = pR->k[j];
+        SetValue(pL, pL->n + 1 + j, ValueOf(pR, j));
+        pL->p[pL->n + 2 + j] = pR->p[j + 1];
+    }
+
+    pL->n += (1 + pR->n);
+    DeleteNode(pR);
+
+    // 父节点中的关键字减1
+    for (j = i + 1; j < n; ++j)
+    {
+        k[j - 1] = k[j];
+        SetValue(r, j - 1, ValueOf(r, j));
+        p[j] = p[j + 1];
+    }
+
+    --(r->n);
+    RecomputeAgg(pL);
+    RecomputeAgg(r);
+    stats_.writes += 2;
+    ++stats_.merges;
+
+    return CheckUnderflow(r);
+}
+
+#endif // BTREE_H
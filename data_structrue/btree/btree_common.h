@@ -0,0 +1,28 @@
+// btree_common: BTree和DiskBTree共用的类型
+#ifndef BTREE_COMMON_H
+#define BTREE_COMMON_H
+
+typedef int KeyType;
+typedef long long ValueType; // BTree的multimap中关键字对应的值，见posting_list.h
+
+enum Status
+{
+    INSERT_NOT_COMPLETE,
+    INSERT_OVERFLOW, // B*插入：满结点还要插入一个关键字，不分裂，交给父结点与兄弟重新分配
+    SUCCESS,
+    DUPLICATE_KEY,
+    UNDERFLOW,
+    NOT_FOUND,
+};
+
+/**
+ * @brief 一棵子树的聚合值，供Rank/Select/Count/Sum使用
+ * @details 树中只有关键字没有data，sum就是关键字之和；最小值和最大值就是子树最左和最右的关键字，不必另存
+ */
+struct SubtreeAgg
+{
+    long count;    // 关键字个数
+    long long sum; // 关键字之和
+};
+
+#endif // BTREE_COMMON_H
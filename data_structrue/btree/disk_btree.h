@@ -0,0 +1,5127 @@
+// Copyright(c) 1996 Leendert Ammeraal. All rights reserved.
+// This program text occurs in Chapter 7 of
+//
+//    Ammeraal, L. (1996) Algorithms and Data Structures in C++,
+//       Chichester: John Wiley.
+
+
+/* disktree:
+   Demonstration program for a B-tree on disk. After
+   building the B-tree by entering integers on the
+   keyboard or by supplying them as a text fs_, we can
+   Insert and delete items via the keyboard. We can also
+   search the B-tree for a given item. Each time, the tree
+   or a search path is displayed. In contrast to program
+   btree, program disktree writes, reads and updates nodes
+   on disk, using a binary fs_. The name of this fs_ is
+   to be entered on the keyboard. If a B-tree with that
+   name exists, that B-tree is used; otherwise such a fs_
+   is created.
+   Caution:
+      Do not confuse the (binary) fs_ for the B-tree with
+      the optional textfile for input data. Use different
+      fs_-name extensions, such as .bin and .txt.
+*/
+// 将Ｂ-树按node存储在一个二进制文件中，用hexdump -C tree.bin分析
+// 最终这个二进制文件的长度为奇数，如果为偶数则在结尾写一个字节（内容为sizeof(int)）
+// 增强的B-树（维护子树聚合值）的结点带着a[]，结尾的字节中还置上了AUGMENTED_SIGNATURE位
+// 阶数和页大小在新建文件时选定，记在文件头中（见DiskFileHeader），文件中的结点按页对齐；没有文件头的旧文件的阶数
+// 是DISK_M，结点紧接着root和free_list存放
+// 带值的文件（文件头中有DISK_FILE_VALUES）的结点还带着v[]，每个关键字的值放在结点中或者一串溢出页中（见DiskPosting）
+#ifndef DISK_BTREE_H
+#define DISK_BTREE_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include <math.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "btree_common.h"
+#include "bloom_filter.h"
+#include "key_file.h"
+#include "posting_list.h"
+#include "latency_histogram.h"
+#include "../../design_pattern/factory_method.h"
+
+using namespace std;
+
+const int DISK_M = 1000;  // Order of B-tree: DISK_M link fields in each DiskNode，也是文件中阶数的上限和默认值
+const int DISK_MIN_ORDER = 5; // 缓冲模式刷缓冲区时按N_MIN >= 2重新分配关键字
+
+const int DISK_POSTING_INLINE_BYTES = 16; // 结点中能放下的值的编码的字节数
+
+// 一个关键字的所有的值，编码同PostingList（排好序，第一个值zigzag，之后的按差做变长编码）。不超过
+// DISK_POSTING_INLINE_BYTES字节时放在结点中，否则放在一串溢出页中，结点中只留第一页和最后一页的位置
+struct DiskPosting
+{
+    uint32_t count; // 值的个数
+    uint32_t size;  // 编码的总字节数
+    union
+    {
+        unsigned char data[DISK_POSTING_INLINE_BYTES];
+        long pages[2]; // pages[0]是第一页，pages[1]是最后一页（追加时直接找到它）
+    };
+
+    bool IsInline() const
+    {
+        return size <= (uint32_t) DISK_POSTING_INLINE_BYTES;
+    }
+};
+
+// 溢出页占文件中的一页（同结点，从free_list分配），开头是这个页头，后面是编码，一个值的编码不跨页
+struct DiskPostingPage
+{
+    long next;      // 下一页，NIL（-1）表示最后一页
+    ValueType last; // 这一页中最后一个值，追加时从它算差
+    uint32_t used;  // 页头之后已用的字节数
+};
+
+struct DiskNode
+{
+    int n;        // Number of items stored in a Node (n < DISK_M)
+    KeyType k[DISK_M - 1]; // Data items (only the first n in use) k[0]~k[n-1]有效
+    long p[DISK_M];    // 'Pointers' to other nodes (n+1 in use)　p[0]~p[n]有效
+    SubtreeAgg* a;     // 增强的B-树中指向DISK_M个聚合值，a[i]是p[i]子树的聚合值，只在分支结点中有效；否则为NULL
+    DiskPosting* v;    // 带值的文件中指向DISK_M - 1个值，v[i]是k[i]的值，随k[i]一起移动；否则为NULL
+
+    DiskNode() : n(0), a(NULL), v(NULL)
+    {
+    }
+
+    DiskNode(const DiskNode& other) : a(NULL), v(NULL)
+    {
+        *this = other;
+    }
+
+    ~DiskNode()
+    {
+        delete[] a;
+        delete[] v;
+    }
+
+    DiskNode& operator=(const DiskNode& other)
+    {
+        if (this != &other)
+        {
+            n = other.n;
+            memcpy(k, other.k, sizeof(k));
+            memcpy(p, other.p, sizeof(p));
+
+            if (other.a != NULL)
+            {
+                AllocAgg();
+                memcpy(a, other.a, DISK_M * sizeof(SubtreeAgg));
+            }
+            else
+            {
+                delete[] a;
+                a = NULL;
+            }
+
+            if (other.v != NULL)
+            {
+                AllocValues();
+                memcpy(v, other.v, (DISK_M - 1) * sizeof(DiskPosting));
+            }
+            else
+            {
+                delete[] v;
+                v = NULL;
+            }
+        }
+
+        return *this;
+    }
+
+    /**
+     * @brief 增强的B-树才分配a[]，不增强的结点不占这部分内存
+     */
+    void AllocAgg()
+    {
+        if (NULL == a)
+        {
+            a = new SubtreeAgg[DISK_M];
+        }
+    }
+
+    /**
+     * @brief 结点内移动子树时跟着移动a[i]，没有a[]时什么也不做，读到的是0
+     */
+    void SetAgg(int i, const SubtreeAgg& agg)
+    {
+        if (a != NULL)
+        {
+            a[i] = agg;
+        }
+    }
+
+    SubtreeAgg Agg(int i) const
+    {
+        if (NULL == a)
+        {
+            const SubtreeAgg zero = { 0, 0 };
+            return zero;
+        }
+
+        return a[i];
+    }
+
+    /**
+     * @brief 带值的文件才分配v[]，其中的值都是空的
+     */
+    void AllocValues()
+    {
+        if (NULL == v)
+        {
+            v = new DiskPosting[DISK_M - 1];
+            memset(v, 0, (DISK_M - 1) * sizeof(DiskPosting));
+        }
+    }
+
+    /**
+     * @brief 结点内移动关键字时跟着移动v[i]。空的值放进没有v[]的结点时什么也不做，其余的时候按需分配v[]
+     */
+    void SetPosting(int i, const DiskPosting& posting)
+    {
+        if (posting.count > 0 || v != NULL)
+        {
+            AllocValues();
+            v[i] = posting;
+        }
+    }
+
+    DiskPosting Posting(int i) const
+    {
+        return (v != NULL) ? v[i] : DiskPosting();
+    }
+};
+
+const char AUGMENTED_SIGNATURE = (char) 0x80; // 文件结尾的签名字节中的这一位表示增强的B-树
+
+const long DISK_FILE_MAGIC = 0x3130455254424B44L; // "DKBTRE01"，有文件头的文件
+const long DISK_FILE_VALUES = 1;                 // DiskFileHeader::flags中的这一位表示关键字带值
+const long DISK_PAGE_AUTO = -1;                  // DiskBTreeFormat::page_size取这个值时测量设备后选择页大小
+const long DISK_TUNE_PAGE_SIZES[] = { 512, 1024, 2048, 4096, 8192, 16384, 32768 }; // 测量的候选页大小
+const int DISK_TUNE_READS = 256;                 // 测量每种页大小时随机读的次数
+
+// 文件的开头。root和free_list的位置与没有文件头的旧文件相同，整个文件头占一页
+struct DiskFileHeader
+{
+    long root;
+    long free_list;
+    long magic;     // DISK_FILE_MAGIC
+    long order;
+    long page_size; // 每个结点在文件中占的字节数，不小于结点的大小
+    long flags;     // DISK_FILE_VALUES，以前的文件这里是0
+};
+
+/**
+ * @brief 新建文件时选择的格式
+ */
+struct DiskBTreeFormat
+{
+    int order;      // 阶数，不大于DISK_M。为0时由page_size决定（能放下的最大的阶数），page_size也为0时用DISK_M
+    long page_size; // 为0时正好放下一个结点；为DISK_PAGE_AUTO时用TuneDiskPageSize测量设备后选择
+    bool values;    // 关键字是否带值（multimap，见DiskBTree::Insert(x, value)）
+};
+
+const DiskBTreeFormat DEFAULT_DISK_FORMAT = { 0, 0, false };
+
+/**
+ * @brief 结点在文件中的布局：n、k[order - 1]、p[order]、（增强的B-树）a[order]和（带值的文件）v[order - 1]依次
+ *        存放，p、a和v按8字节对齐。n、k和p与DiskNode的内存布局相同，a和v在DiskNode中单独分配
+ */
+struct DiskFileLayout
+{
+    int order;
+    bool augmented;
+    bool values;
+    size_t p_offset;
+    size_t a_offset;
+    size_t v_offset;
+    size_t node_size;   // 结点实际的字节数
+    long page_size;     // 结点在文件中占的字节数
+    long header_size;   // 第一个结点的位置，旧文件是2 * sizeof(long)，否则是一页
+
+    DiskFileLayout() : order(0), augmented(false), values(false), p_offset(0), a_offset(0), v_offset(0),
+        node_size(0), page_size(0), header_size(0)
+    {
+    }
+
+    DiskFileLayout(int order, bool augmented, long page_size = 0, bool values = false)
+        : order(order), augmented(augmented), values(values)
+    {
+        p_offset = (offsetof(DiskNode, k) + order * sizeof(KeyType) - sizeof(KeyType) + 7) & ~(size_t) 7;
+        a_offset = p_offset + order * sizeof(long);
+        v_offset = augmented ? a_offset + order * sizeof(SubtreeAgg) : a_offset;
+        node_size = values ? v_offset + (order - 1) * sizeof(DiskPosting) : v_offset;
+        this->page_size = max(page_size, (long) node_size);
+        header_size = this->page_size;
+    }
+
+    /**
+     * @brief 溢出页中能放编码的字节数
+     */
+    size_t PostingCapacity() const
+    {
+        return page_size - sizeof(DiskPostingPage);
+    }
+
+    /**
+     * @brief 页大小为page_size时能用的最大的阶数，不大于DISK_M，页太小时返回0
+     */
+    static int FitOrder(long page_size, bool augmented, bool values = false)
+    {
+        int order = DISK_M;
+        while (order >= DISK_MIN_ORDER
+            && (long) DiskFileLayout(order, augmented, 0, values).node_size > page_size)
+        {
+            --order;
+        }
+
+        return (order >= DISK_MIN_ORDER) ? order : 0;
+    }
+
+    /**
+     * @brief 文件长度为size时下一个结点的位置：跳过签名字节，对齐到页
+     */
+    long EndPage(long size) const
+    {
+        const long end = max(size & ~1L, header_size);
+        return header_size + (end - header_size + page_size - 1) / page_size * page_size;
+    }
+};
+
+/**
+ * @brief 按布局把文件中的结点page解开到node中，ORDER是编译期的阶数，memcpy的长度都是常量
+ */
+template <int ORDER>
+inline void UnpackDiskNode(const char* page, bool augmented, DiskNode& node)
+{
+    const size_t p_offset = (offsetof(DiskNode, k) + ORDER * sizeof(KeyType) - sizeof(KeyType) + 7) & ~(size_t) 7;
+
+    memcpy(&node.n, page, sizeof(node.n));
+    memcpy(node.k, page + offsetof(DiskNode, k), (ORDER - 1) * sizeof(KeyType));
+    memcpy(node.p, page + p_offset, ORDER * sizeof(long));
+    if (augmented)
+    {
+        node.AllocAgg();
+        memcpy(node.a, page + p_offset + ORDER * sizeof(long), ORDER * sizeof(SubtreeAgg));
+    }
+}
+
+template <int ORDER>
+inline void PackDiskNode(const DiskNode& node, bool augmented, char* page)
+{
+    const size_t p_offset = (offsetof(DiskNode, k) + ORDER * sizeof(KeyType) - sizeof(KeyType) + 7) & ~(size_t) 7;
+
+    memset(page, 0, p_offset);
+    memcpy(page, &node.n, sizeof(node.n));
+    memcpy(page + offsetof(DiskNode, k), node.k, (ORDER - 1) * sizeof(KeyType));
+    memcpy(page + p_offset, node.p, ORDER * sizeof(long));
+    if (augmented && node.a != NULL)
+    {
+        memcpy(page + p_offset + ORDER * sizeof(long), node.a, ORDER * sizeof(SubtreeAgg));
+    }
+    else if (augmented)
+    {
+        memset(page + p_offset + ORDER * sizeof(long), 0, ORDER * sizeof(SubtreeAgg)); // 新的叶结点没有a[]
+    }
+}
+
+/**
+ * @brief 常用的阶数用编译期的版本，其余的按layout中的大小逐段复制
+ */
+inline void UnpackDiskNode(const DiskFileLayout& layout, const char* page, DiskNode& node)
+{
+    switch (layout.order)
+    {
+        case 64:
+            UnpackDiskNode<64>(page, layout.augmented, node);
+            break;
+        case 128:
+            UnpackDiskNode<128>(page, layout.augmented, node);
+            break;
+        case 256:
+            UnpackDiskNode<256>(page, layout.augmented, node);
+            break;
+        case 512:
+            UnpackDiskNode<512>(page, layout.augmented, node);
+            break;
+        default:
+            memcpy(&node.n, page, sizeof(node.n));
+            memcpy(node.k, page + offsetof(DiskNode, k), (layout.order - 1) * sizeof(KeyType));
+            memcpy(node.p, page + layout.p_offset, layout.order * sizeof(long));
+            if (layout.augmented)
+            {
+                node.AllocAgg();
+                memcpy(node.a, page + layout.a_offset, layout.order * sizeof(SubtreeAgg));
+            }
+            break;
+    }
+
+    if (layout.values)
+    {
+        node.AllocValues();
+        memcpy(node.v, page + layout.v_offset, (layout.order - 1) * sizeof(DiskPosting));
+    }
+}
+
+inline void PackDiskNode(const DiskFileLayout& layout, const DiskNode& node, char* page)
+{
+    switch (layout.order)
+    {
+        case 64:
+            PackDiskNode<64>(node, layout.augmented, page);
+            break;
+        case 128:
+            PackDiskNode<128>(node, layout.augmented, page);
+            break;
+        case 256:
+            PackDiskNode<256>(node, layout.augmented, page);
+            break;
+        case 512:
+            PackDiskNode<512>(node, layout.augmented, page);
+            break;
+        default:
+            memset(page, 0, layout.p_offset);
+            memcpy(page, &node.n, sizeof(node.n));
+            memcpy(page + offsetof(DiskNode, k), node.k, (layout.order - 1) * sizeof(KeyType));
+            memcpy(page + layout.p_offset, node.p, layout.order * sizeof(long));
+            if (layout.augmented && node.a != NULL)
+            {
+                memcpy(page + layout.a_offset, node.a, layout.order * sizeof(SubtreeAgg));
+            }
+            else if (layout.augmented)
+            {
+                memset(page + layout.a_offset, 0, layout.order * sizeof(SubtreeAgg));
+            }
+            break;
+    }
+
+    if (layout.values && node.v != NULL)
+    {
+        memcpy(page + layout.v_offset, node.v, (layout.order - 1) * sizeof(DiskPosting));
+    }
+    else if (layout.values)
+    {
+        memset(page + layout.v_offset, 0, (layout.order - 1) * sizeof(DiskPosting)); // 新的结点中的值都是空的
+    }
+}
+
+/**
+ * @brief 映射到内存中的一个结点，字段按布局就地读（页不一定按8字节对齐，用memcpy读）
+ */
+class DiskPageView
+{
+public:
+    DiskPageView(const char* page, const DiskFileLayout& layout) : page_(page), layout_(layout)
+    {
+    }
+
+    int N() const
+    {
+        int n;
+        memcpy(&n, page_, sizeof(n));
+        return n;
+    }
+
+    KeyType Key(int i) const
+    {
+        KeyType k;
+        memcpy(&k, page_ + offsetof(DiskNode, k) + i * sizeof(KeyType), sizeof(k));
+        return k;
+    }
+
+    long Link(int i) const
+    {
+        long p;
+        memcpy(&p, page_ + layout_.p_offset + i * sizeof(long), sizeof(p));
+        return p;
+    }
+
+    SubtreeAgg Agg(int i) const
+    {
+        SubtreeAgg a;
+        memcpy(&a, page_ + layout_.a_offset + i * sizeof(SubtreeAgg), sizeof(a));
+        return a;
+    }
+
+    DiskPosting Posting(int i) const
+    {
+        DiskPosting v;
+        memcpy(&v, page_ + layout_.v_offset + i * sizeof(DiskPosting), sizeof(v));
+        return v;
+    }
+
+private:
+    const char* page_;
+    const DiskFileLayout& layout_;
+};
+
+/**
+ * @brief 从文件的签名字节和文件头得到布局
+ * @return =0成功，不是B-树文件时返回-1
+ */
+inline int ReadDiskFileLayout(PageStore& store, DiskFileLayout& layout)
+{
+    const long size = store.Size();
+    char ch = 0;
+    if (size < (long) (2 * sizeof(long) + 1) || store.Read(size - 1, &ch, 1) != 0 // Read signature.
+        || (ch & ~AUGMENTED_SIGNATURE) != sizeof(int))
+    {
+        return -1;
+    }
+
+    const bool augmented = (ch & AUGMENTED_SIGNATURE) != 0;
+    DiskFileHeader header;
+
+    if (size < (long) sizeof(header) || store.Read(0L, &header, sizeof(header)) != 0
+        || header.magic != DISK_FILE_MAGIC)
+    {
+        // 没有文件头的旧文件
+        layout = DiskFileLayout(DISK_M, augmented);
+        layout.header_size = 2 * sizeof(long);
+        return 0;
+    }
+
+    if (header.order < DISK_MIN_ORDER || header.order > DISK_M)
+    {
+        return -1;
+    }
+
+    layout = DiskFileLayout((int) header.order, augmented, header.page_size, (header.flags & DISK_FILE_VALUES) != 0);
+    return (layout.page_size == header.page_size) ? 0 : -1;
+}
+
+/**
+ * @brief 在path所在的设备上测量各种页大小的随机读时间，选择查找最快的页大小
+ * @details 查找一个关键字要读的页数与log(阶数)成反比，所以比较每页的读时间 / log2(阶数)。用O_DIRECT绕过页缓存，
+ *          文件系统不支持时测到的是页缓存的速度。测量用的临时文件是path.probe，测完删掉
+ * @return 选择的页大小，测量失败时返回0
+ */
+inline long TuneDiskPageSize(const char* path, bool augmented, bool verbose)
+{
+    const long largest = DISK_TUNE_PAGE_SIZES[sizeof(DISK_TUNE_PAGE_SIZES) / sizeof(long) - 1];
+    const long file_size = 512 * largest;
+    const string probe_path = string(path) + ".probe";
+
+    bool created;
+    int fd = OpenFile(probe_path.c_str(), O_DIRECT, created);
+    if (fd < 0)
+    {
+        fd = OpenFile(probe_path.c_str(), 0, created);
+    }
+
+    void* buf = NULL;
+    if (fd < 0 || posix_memalign(&buf, DIRECT_BLOCK_SIZE, largest) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        remove(probe_path.c_str());
+        return 0;
+    }
+
+    memset(buf, 0, largest);
+    bool ok = true;
+    for (long offset = 0; offset < file_size && ok; offset += largest)
+    {
+        ok = (pwrite(fd, buf, largest, offset) == largest);
+    }
+
+    ok = ok && (0 == fsync(fd));
+
+    long best = 0;
+    double best_cost = 0;
+    mt19937 rng(1);
+
+    for (size_t i = 0; ok && i < sizeof(DISK_TUNE_PAGE_SIZES) / sizeof(long); ++i)
+    {
+        const long page_size = DISK_TUNE_PAGE_SIZES[i];
+        const int order = DiskFileLayout::FitOrder(page_size, augmented);
+        if (0 == order)
+        {
+            continue;
+        }
+
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int j = 0; j < DISK_TUNE_READS && ok; ++j)
+        {
+            const long offset = (long) (rng() % (file_size / page_size)) * page_size;
+            ok = (pread(fd, buf, page_size, offset) == page_size);
+        }
+
+        const double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count()
+            / DISK_TUNE_READS;
+        const double cost = us / log2((double) order);
+
+        if (verbose)
+        {
+            cout << "  page size " << setw(6) << page_size << ": order " << setw(4) << order << ", " << fixed
+                << setprecision(2) << us << " us per read, " << cost << " us per level of fanout" << endl;
+            cout.unsetf(ios::fixed);
+        }
+
+        if (0 == best || cost < best_cost)
+        {
+            best = page_size;
+            best_cost = cost;
+        }
+    }
+
+    free(buf);
+    close(fd);
+    remove(probe_path.c_str());
+    return ok ? best : 0;
+}
+
+const long BUFFER_CAPACITY = 16 * DISK_M; // 缓冲模式下每个分支结点的缓冲区默认能放的消息条数
+const long BUFFER_TOTAL_CAPACITY = 16 * BUFFER_CAPACITY; // 缓冲模式下所有缓冲区加起来默认能放的消息条数
+const size_t KEY_FILE_BATCH = 16 * DISK_M; // Insert(key_file_path)每次InsertBatch的关键字个数
+
+// 缓冲模式下分支结点的缓冲区：关键字 -> true表示插入，false表示删除。同一个关键字只留最新的一条消息
+typedef map<KeyType, bool> MessageBuffer;
+
+// 刷缓冲区时结点的临时形式，关键字个数可以超过DISK_M - 1，写回时再分成几个结点
+struct WideNode
+{
+    vector<KeyType> k;
+    vector<long> p;
+    vector<SubtreeAgg> a;
+    vector<DiskPosting> v; // 与k一一对应，不带值的文件中都是空的
+};
+
+// Logical order:
+//    p[0], k[0], p[1], k[1], ..., p[n-1], k[n-1], p[n]
+
+// 帧池中的一个结点。children[i]不为NULL时是node.p[i]的帧（swizzled），Search沿着它直接走到子结点
+struct DiskFrame
+{
+    long page;                   // 结点在文件中的位置，NIL表示帧空闲
+    DiskFrame* parent;           // children[]中有指向这个帧的指针的父帧，NULL表示没有
+    int slot;                    // 在parent->children[]中的下标
+    int swizzled;                // children[]中不为NULL的个数，不为0时不能淘汰
+    bool referenced;             // clock算法的访问位
+    DiskFrame* children[DISK_M];
+    DiskNode node;
+};
+
+// 指（finger），参见BTreeFinger：上一次用它的Search/Insert从根结点到停下的结点的路径（结点在文件中的位置），
+// 以及路径上每棵子树的关键字范围。写过分支结点或者释放过结点以后（version不再等于DiskBTree中的版本）
+// 自动从根结点重新开始
+struct DiskBTreeFinger
+{
+    struct Level
+    {
+        long page;
+        bool has_lo;  // 为false时左边没有界限
+        bool has_hi;  // 为false时右边没有界限
+        KeyType lo;   // 子树中的关键字都大于lo、小于hi
+        KeyType hi;
+
+        bool Contains(KeyType x) const
+        {
+            return (!has_lo || x > lo) && (!has_hi || x < hi);
+        }
+    };
+
+    vector<Level> levels; // levels[0]是根结点，为空时从根结点开始
+    unsigned long version;
+
+    DiskBTreeFinger() : version(0)
+    {
+    }
+};
+
+struct BloomFilterStats
+{
+    long probes;          // 查询过滤器的次数
+    long negatives;       // 过滤器判定一定不存在的次数
+    long false_positives; // 过滤器判定可能存在，实际却不存在的次数
+    long reads_saved;     // 因判定一定不存在而省掉的ReadNode次数
+    long rebuilds;        // 重建次数
+};
+
+struct DiskBTreeStats
+{
+    // 操作计数，从打开文件或者上一次ResetStats()开始累计
+    long reads;           // ReadNode的调用次数（不含根结点缓存命中的次数），带值的文件中还有读溢出页的次数
+    long root_cache_hits; // ReadNode命中常驻内存的根结点的次数
+    long writes;          // WriteNode的调用次数，带值的文件中还有写溢出页的次数
+    long allocs;          // GetNode的调用次数
+    long frees;           // FreeNode的调用次数
+    long splits;          // Ins中结点分裂的次数，B*插入时两个满结点分成三个也算一次
+    long sibling_shifts;  // B*插入时满结点把关键字挪给兄弟（不分裂）的次数
+    long appends;         // 直接追加到最右叶结点的插入次数，见BTreeStats
+    long borrow_lefts;    // Del中从左兄弟借关键字的次数
+    long borrow_rights;   // Del中从右兄弟借关键字的次数
+    long merges;          // Del中与兄弟合并的次数
+    long lazy_deletes;    // 推迟调整的删除次数，见BTreeStats
+    long compactions;     // Compact的次数
+    long deletes;         // 成功的Delete次数
+    long buffered_ops;    // 缓冲模式下放进缓冲区的Insert/Delete次数
+    long buffer_flushes;  // 把一个缓冲区中的一批消息推给一个子结点的次数
+    long frame_hits;      // Search沿swizzled指针直接走到子结点的帧的次数
+    long frame_lookups;   // 按位置在帧池中找到结点、不用读文件的次数
+    long frame_loads;     // 读文件装入帧池的次数（也计入reads）
+    long frame_evictions; // 淘汰帧的次数
+    long long bytes_written;        // 写入文件的字节数
+    long long delete_bytes_written; // 其中Delete（包括它自动触发的Compact）写入的字节数
+
+    // 结构信息，height、buffered_count和frame_count总是有效，其余的只有Stats(true)遍历整棵树时才计算，否则为-1
+    int height;
+    long buffered_count;  // 各个缓冲区中还没有落到叶结点的消息条数
+    long frame_count;     // 帧池中的结点个数
+    long node_count;
+    long key_count;
+    long underfull_count; // 关键字个数少于N_MIN的非根结点个数，包括AppendKey在最右路径上留下的结点
+    double fill_factor;   // key_count / (node_count * (阶数 - 1))
+    long value_count;     // 带值的文件中所有关键字的值的个数
+    long posting_page_count; // 带值的文件中值放不下时用的溢出页的个数
+};
+
+class DiskBTree
+{
+public:
+    /**
+     * @param tree_file_path B-树文件的路径
+     * @param bloom_fpr 布隆过滤器的误判率，为0表示不使用布隆过滤器。过滤器保存在tree_file_path.bloom文件中
+     * @param augmented 新建文件时是否在分支结点中维护各个子树的关键字个数和关键字之和，维护后才能用
+     *                  Rank/Select/Count/Sum。打开已有的文件时忽略，由文件本身决定
+     * @param store_type 读写文件的方式，见PageStoreFactory。文件格式与读写方式无关
+     * @param format 新建文件时的阶数和页大小。打开已有的文件时忽略，由文件头决定
+     */
+    DiskBTree(const char* tree_file_path, double bloom_fpr = 0, bool augmented = false,
+        PageStoreType store_type = PAGE_STORE_FSTREAM, const DiskBTreeFormat& format = DEFAULT_DISK_FORMAT);
+    ~DiskBTree();
+
+    void Print()
+    {
+        cout << "Contents:" << endl;
+        PrintNode(root_, 0);
+    }
+
+    bool IsEmpty() const
+    {
+        return NIL == root_;
+    }
+
+    bool IsAugmented() const
+    {
+        return augmented_;
+    }
+
+    /**
+     * @brief 文件中B-树的阶数
+     */
+    int Order() const
+    {
+        return order_;
+    }
+
+    /**
+     * @brief 每个结点在文件中占的字节数
+     */
+    long PageSize() const
+    {
+        return layout_.page_size;
+    }
+
+    /**
+     * @brief 读写文件的方式，见PageStoreFactory
+     */
+    const char* StoreName() const
+    {
+        return store_->Name();
+    }
+
+    /**
+     * @brief 设置为只读：析构时不写文件头、签名和布隆过滤器文件，Insert/Delete/DeleteRange/BulkLoad都返回-1。
+     *        不会再改变的文件可以同时用几个只读的DiskBTree打开，比如在不同的线程中各用一个
+     */
+    void SetReadOnly(bool read_only)
+    {
+        read_only_ = read_only;
+    }
+
+    /**
+     * @brief 设置Insert/Delete是否打印duplicate key和not found提示，批量操作（比如回放负载）时关掉
+     */
+    void SetVerbose(bool verbose)
+    {
+        verbose_ = verbose;
+    }
+
+    void ShowSearch(KeyType x);
+
+    /**
+     * @brief 查找关键字，不打印
+     * @return true表示找到
+     */
+    bool Search(KeyType x);
+
+    /**
+     * @brief 从finger开始查找，结果同Search(x)，finger换成这次查找的路径，参见BTree::Search(x, finger)
+     * @details 从finger的底端往上退到子树的范围包含x的那一层，再从那里往下读结点，关键字成簇时每次只读很少几个
+     *          结点。DiskBTree没有父指针，finger靠版本判断是否失效：写分支结点（分裂、合并、借关键字，增强的B-树
+     *          每次插入删除都要更新聚合值）和释放结点都使所有的finger从根结点重新开始，只改叶结点的插入和删除不影响。
+     *          缓冲区中有消息时跳过的上层缓冲区中可能有x的消息，退回Search(x)。一个finger只能用在一棵树上
+     */
+    bool Search(KeyType x, DiskBTreeFinger& finger);
+
+    /**
+     * @brief 按从小到大的顺序取出[lo, hi]范围内的所有关键字
+     * @param keys 取出的关键字追加到其中
+     * @param limit 最多取出这么多个（最小的几个），取够了就不再往后读结点。缓冲模式下给出limit时先FlushBuffers，
+     *              否则删除消息会让取出的个数少于limit而后面还有关键字
+     * @return 取出的关键字个数
+     */
+    long Scan(KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit = SIZE_MAX);
+
+    /**
+     * @brief 插入关键字
+     * @return =0成功，关键字已经存在或者只读时返回-1。缓冲模式下是盲写（见SetBuffered）：只把消息放进缓冲区，
+     *         不知道关键字是否已经存在，除了只读时都返回0
+     */
+    int Insert(KeyType x);
+
+    /**
+     * @brief 从finger开始插入，结果同Insert(x)
+     * @details 同Search(x, finger)找到叶结点，叶结点没满时直接插入，只写这一个叶结点，finger仍然有效。叶结点满了
+     *          要分裂时退回从根结点插入：没有父指针，也不像BTree那样沿着finger自下而上分裂，分裂只占很少一部分插入，
+     *          从根结点再走一趟的代价分摊下来不大。增强的B-树（上面各层都要更新聚合值）和缓冲模式下都退回Insert(x)
+     */
+    int Insert(KeyType x, DiskBTreeFinger& finger);
+
+    /**
+     * @brief 插入关键字文件中的所有关键字，文件可以是文本或者二进制格式（见key_file.h），解析和插入并行进行。
+     *        每KEY_FILE_BATCH个关键字用InsertBatch插入一次
+     * @details InsertBatch不打印提示，verbose时每一批先用SearchBatch找出已经存在的和批内重复的关键字，
+     *          同逐个插入时一样每个打印一句Duplicate key ignored.，这多读一遍涉及到的结点
+     * @return =0成功，否则失败
+     */
+    int Insert(const char* key_file_path);
+
+    /**
+     * @brief 批量插入，已经存在的关键字忽略（不打印提示）
+     * @details 关键字排好序后作为插入消息放进根结点的缓冲区，用缓冲模式的方法一路推到叶结点：每棵涉及到的子树
+     *          只下降一次，落在同一个叶结点中的关键字一次归并进去，每个涉及到的结点在这一批中只写一次
+     *          （分裂时一次分成几个）。根结点还是叶结点时先逐个插入。不记录延迟直方图
+     * @return =0成功，只读时返回-1
+     */
+    int InsertBatch(const KeyType* keys, size_t count);
+
+    /**
+     * @brief 批量查找，results[i]表示keys[i]是否存在，结果与逐个Search相同
+     * @details 布隆过滤器挡掉的关键字不用查。其余的关键字排好序后一起从根结点往下走，落在同一棵子树中的相邻
+     *          关键字一起下降，每个涉及到的结点在这一批中只读一次。不记录延迟直方图
+     */
+    void SearchBatch(const KeyType* keys, size_t count, bool* results);
+
+    /**
+     * @brief 删除关键字
+     * @return =0成功，关键字不存在或者只读时返回-1。缓冲模式下是盲写（见SetBuffered）：只把消息放进缓冲区，
+     *         不知道关键字是否存在，除了只读时和布隆过滤器判定一定不存在时都返回0。带值的文件中删除不经过缓冲区，
+     *         返回值总是准确的
+     */
+    int Delete(KeyType x);
+
+    /**
+     * @brief 文件是否带值（新建时DiskBTreeFormat::values），带值时才能用下面三个接口
+     */
+    bool HasValues() const
+    {
+        return values_;
+    }
+
+    /**
+     * @brief 插入一个（关键字, 值）对，同一个关键字可以有任意多个值（multimap），同BTree::Insert(x, value)
+     * @details 关键字不存在时像Insert(x)一样把它插入树中，带着这一个值；已经存在时只把值加入它的posting，
+     *          只写回它所在的结点（或者溢出页）。编码同posting_list.h，少时就在结点中，多了移到溢出页中，
+     *          溢出页同结点一样从空闲链表分配。缓冲模式下先FlushBuffers，值不经过缓冲区
+     * @return =0成功，文件不带值或者只读时返回-1
+     */
+    int Insert(KeyType x, ValueType value);
+
+    /**
+     * @brief 按从小到大的顺序取出关键字的所有值：从根结点往下走一趟找到关键字，再顺序读它的溢出页（如果有）
+     * @param values 取出的值追加到其中
+     * @return 值的个数，关键字不存在（或者文件不带值）时返回-1
+     */
+    long Get(KeyType x, vector<ValueType>& values);
+
+    /**
+     * @brief 删除一个（关键字, 值）对（值出现多次时只删一个），关键字的最后一个值删掉后关键字也从树中删掉
+     * @return =0成功，没有这个对时返回-1
+     */
+    int Delete(KeyType x, ValueType value);
+
+    /**
+     * @brief 删除[lo, hi]范围内的所有关键字
+     * @details 完全落在范围内的子树整棵释放：只读它们的内部结点，叶结点不读（带值的文件中要读，释放其中的溢出页），每个结点只写回空闲链表的链接。
+     *          只修剪范围两端的两条路径并调整上面的结点，代价与树高加上释放的结点个数成正比
+     * @return =0删除了至少一个关键字，范围内没有关键字时返回-1
+     */
+    int DeleteRange(KeyType lo, KeyType hi);
+
+    /**
+     * @brief 用排好序的关键字建树，只能用于空树
+     * @details 树的形状同BTree::BulkLoad，每个非根结点都不少于N_MIN个关键字而且接近于满。结点按后序（先子树，
+     *          后父结点）依次追加到文件末尾，全是顺序写，每个结点只写一次
+     * @param keys 严格递增的关键字
+     * @return =0成功，树不空或者keys不是严格递增的时返回-1
+     */
+    int BulkLoad(const KeyType* keys, size_t count);
+
+    /**
+     * @brief 设置删除后是否推迟调整，参见BTree::SetLazyDelete
+     * @details 推迟调整时每次删除只写回叶结点一个结点，而不是叶结点、兄弟和父结点三个
+     */
+    void SetLazyDelete(bool lazy, long compact_threshold = 0);
+
+    bool IsLazyDelete() const
+    {
+        return lazy_delete_;
+    }
+
+    /**
+     * @brief 调整推迟调整的删除留下的关键字个数少于N_MIN的结点
+     * @details 推迟调整时记下了从叶结点中删掉的关键字，它们排序后从根结点往下分给各个子树，只走到这些关键字
+     *          所在的叶结点，每个分支结点用FixNode调整分到了关键字的子树，不读其余的结点
+     */
+    void Compact();
+
+    /**
+     * @brief 设置插入时是否用B*-树的分裂策略，参见BTree::SetBStar
+     * @details 满结点的内容连同要插入的那一项在overflow_中交给父结点，与兄弟一起用WriteChildren分成两个或三个结点。
+     *          缓冲模式下刷缓冲区时的分裂不受影响
+     */
+    void SetBStar(bool bstar)
+    {
+        bstar_ = bstar;
+    }
+
+    bool IsBStar() const
+    {
+        return bstar_;
+    }
+
+    /**
+     * @brief 设置是否用写优化的缓冲模式（Bε-树）
+     * @details 缓冲模式下Insert/Delete只把消息放进根结点的缓冲区，不读写任何结点。一个分支结点的缓冲区超过
+     *          buffer_capacity条消息时，从消息最多的那棵子树开始，把一棵子树的消息一起推给子结点，直到缓冲区
+     *          降到一半：子结点是分支结点时放进它的缓冲区（满了再往下推），是叶结点时与叶结点中的关键字归并后
+     *          写一次，所以一次写结点分摊给了很多次更新。查找时沿途先查缓冲区再查结点中的关键字，上层的消息比下层的新。
+     *          缓冲区只在内存中，文件格式不变，关闭文件时全部落盘。插入和删除是盲写：重复的插入和删除不存在
+     *          的关键字都返回0（布隆过滤器判定一定不存在的删除除外）。带值的文件中只有Insert(x)是盲写，Delete和
+     *          带值的几个接口都先FlushBuffers再直接改结点。
+     *          每个缓冲区都不超过buffer_capacity条，但分支结点很多时所有缓冲区加起来可能很大，所以还记着上次
+     *          FlushBuffers以后放进缓冲区的消息条数（不少于缓冲区中的消息总数），超过total_capacity时FlushBuffers
+     * @param buffer_capacity 每个分支结点的缓冲区能放的消息条数，<=0时用BUFFER_CAPACITY
+     * @param total_capacity 所有缓冲区加起来能放的消息条数，<=0时用BUFFER_TOTAL_CAPACITY
+     */
+    void SetBuffered(bool buffered, long buffer_capacity = 0, long total_capacity = 0);
+
+    bool IsBuffered() const
+    {
+        return buffered_;
+    }
+
+    /**
+     * @brief 设置帧池能放的结点个数，为0（默认）时不用帧池。每次设置都先清空帧池
+     * @details 帧池把读过的结点留在内存中，ReadNode按位置在帧池中找到时不用读文件。Search经过的帧中的子结点引用
+     *          换成（swizzle）指向子结点的帧的指针，下次沿着指针直接往下走，连按位置查找也省了，同内存中的BTree；
+     *          没有swizzle的子结点才按位置查找，找不到时才读文件。帧池满时用clock算法淘汰一个没有swizzled子结点
+     *          的帧（所以总是先淘汰下层的），淘汰前把父帧中指向它的指针换回（unswizzle）文件中的位置。WriteNode
+     *          同时更新帧，FreeNode丢掉帧，帧总是与文件一致。
+     *          只有Search直接在帧中查找。Insert/Delete等更新仍然经过ReadNode/WriteNode：读时把帧拷贝成DiskNode，
+     *          改完写文件时再拷贝回帧并重新swizzle，没有在帧中就地修改，所以更新比不用帧池时多两次结点拷贝，
+     *          没命中时还要装入新帧、淘汰旧帧。写多读少时不要打开帧池，这也是默认不用帧池的原因
+     */
+    void SetFramePool(long capacity);
+
+    /**
+     * @brief 把所有缓冲区中的消息落到叶结点，之后文件中就是一棵普通的B-树
+     * @details DeleteRange、Compact、Rank/Select/Count/Sum和关闭文件前自动调用；Scan不用，它把沿途的消息归并进结果
+     */
+    void FlushBuffers();
+
+    /**
+     * @brief 小于x的关键字个数，读的结点个数不超过树高，参见BTree::Rank
+     * @return 不是增强的B-树时返回-1
+     */
+    long Rank(KeyType x);
+
+    /**
+     * @brief 取出从小到大的第k个关键字（从0开始），参见BTree::Select
+     * @return =0成功，k超出范围或者不是增强的B-树时返回-1
+     */
+    int Select(long k, KeyType& x);
+
+    /**
+     * @brief [lo, hi]范围内的关键字个数，参见BTree::Count
+     * @return 不是增强的B-树时返回-1
+     */
+    long Count(KeyType lo, KeyType hi);
+
+    /**
+     * @brief [lo, hi]范围内的关键字之和，参见BTree::Sum
+     * @return =0成功，不是增强的B-树时返回-1
+     */
+    int Sum(KeyType lo, KeyType hi, long long& sum);
+
+    const BloomFilterStats& GetBloomFilterStats() const
+    {
+        return bloom_stats_;
+    }
+
+    /**
+     * @brief 取得操作计数和结构信息的快照
+     * @param scan_nodes 为true时遍历整棵树统计结点个数、关键字个数和填充率，需要读所有的结点（这些读不计入reads）
+     */
+    DiskBTreeStats Stats(bool scan_nodes = false);
+
+    /**
+     * @brief 打印Stats(true)和布隆过滤器计数的结果
+     */
+    void PrintStats();
+
+    void ResetStats()
+    {
+        memset(&stats_, 0, sizeof(stats_));
+        memset(&bloom_stats_, 0, sizeof(bloom_stats_));
+        profiler_.Reset();
+    }
+
+    /**
+     * @brief 设置慢操作的采样跟踪，参数见OpProfiler::SetTrace。路径中打印的是结点在文件中的位置
+     */
+    void SetTrace(int sample_every, double slow_us, ostream* out = &cerr)
+    {
+        profiler_.SetTrace(sample_every, slow_us, out);
+    }
+
+    const OpProfiler& Profiler() const
+    {
+        return profiler_;
+    }
+
+    /**
+     * @brief 打印每类操作（Insert/Delete/Search/Scan）的延迟百分位数和读写明细
+     */
+    void PrintLatency() const
+    {
+        profiler_.Print(cout);
+    }
+
+private:
+    void PrintNode(long r, int indent_space_count);
+    int SearchInNode(KeyType x, const KeyType* k, int n) const;
+
+    /**
+     * @brief 不经过缓冲区插入带着xv的关键字x，根结点分裂时在上面加一个新的根结点
+     * @return SUCCESS或者DUPLICATE_KEY
+     */
+    Status InsertKey(KeyType x, const DiskPosting& xv);
+
+    /**
+     * @param xv x的值，带值的文件中与x一起放进叶结点
+     * @param yv 返回INSERT_NOT_COMPLETE时是y的值
+     * @param q_agg 返回INSERT_NOT_COMPLETE时是新结点q的子树的聚合值（增强的B-树）
+     */
+    Status Ins(long r, KeyType x, const DiskPosting& xv, KeyType& y, DiskPosting& yv, long& u, SubtreeAgg& q_agg);
+
+    /**
+     * @brief B*插入：满的子结点node.p[i]放不下的内容在overflow_中，与一个相邻兄弟一起重新分配，同BTree::InsOverflow
+     * @details 分配后r多了一个分隔关键字而放不下时交给SplitWide
+     * @return 同Ins
+     */
+    Status InsOverflow(long r, DiskNode& node, int i, KeyType& y, DiskPosting& yv, long& q, SubtreeAgg& q_agg);
+
+    /**
+     * @brief 处理有order_个关键字的r（w）：B*插入时非根结点放进overflow_交给父结点，返回INSERT_OVERFLOW；
+     *        否则从中间一分为二，返回INSERT_NOT_COMPLETE
+     */
+    Status SplitWide(long r, WideNode& w, KeyType& y, DiskPosting& yv, long& q, SubtreeAgg& q_agg);
+
+    /**
+     * @brief 递增关键字的快速路径，同BTree::AppendKey：x比所有关键字都大时直接追加到最右叶结点，满了的结点
+     *        留下前order_ - 2个关键字，不从中间分裂
+     * @details right_path_是从根结点到最右叶结点的位置，right_leaf_是最右叶结点的内容，追加时不读叶结点，
+     *          不是增强的B-树时也不读写上层的结点（除非要分裂）。别的操作用WriteNode或者FreeNode改到这条路径上的
+     *          结点时清空right_path_，根结点换了时也重新往下走一趟
+     * @param code 追加了时是SUCCESS，或者根结点也分裂了时是INSERT_NOT_COMPLETE（y、yv、q、q_agg同Ins）
+     * @return false表示x不比所有的关键字都大（或者树为空），要走Ins
+     */
+    bool AppendKey(KeyType x, const DiskPosting& xv, KeyType& y, DiskPosting& yv, long& q, SubtreeAgg& q_agg,
+        Status& code);
+
+    /**
+     * @param z r的子树中实际少掉的关键字（增强的B-树用来更新聚合值）。通常就是x，但x在分支结点中时
+     *          先与左子树中的最大关键字y交换，这时左子树中少掉的是y
+     */
+    Status Del(long r, KeyType x, KeyType z);
+    void ReadNode(long r, DiskNode& node);
+    void WriteNode(long r, const DiskNode& node);
+    long GetNode();
+
+    /**
+     * @brief 从根结点往下找x，不看缓冲区
+     * @param r、node、i 找到时是x所在的结点的位置、内容和x在其中的下标
+     */
+    bool FindKey(KeyType x, long& r, DiskNode& node, int& i);
+
+    /**
+     * @brief 按从小到大的顺序把posting中的所有值追加到values中，同DecodePosting
+     */
+    void DecodeValues(const DiskPosting& posting, vector<ValueType>& values);
+
+    /**
+     * @brief 加入一个值，同AddPosting：不小于最大值的值追加到最后一页，否则整个解出来插入后重新编码
+     */
+    void AddValue(DiskPosting& posting, ValueType value);
+
+    /**
+     * @brief 用排好序的values重新编码，原来的溢出页先释放，同RebuildPosting
+     */
+    void RebuildValues(DiskPosting& posting, const vector<ValueType>& values);
+
+    /**
+     * @brief 释放posting的溢出页（只读每页的页头），posting变成空的
+     */
+    void FreeValues(DiskPosting& posting);
+
+    /**
+     * @brief 溢出页与结点一样从空闲链表分配，但不经过帧池：读写都直接在posting_buf_中进行
+     */
+    long GetPostingPage();
+    void ReadPostingPage(long r, DiskPostingPage& page);
+    void WritePostingPage(long r, const DiskPostingPage& page);
+
+    /**
+     * @brief 结点及其所有子树的聚合值，由结点内的关键字和node.a[]算出，不是增强的B-树时为0
+     */
+    SubtreeAgg NodeAgg(const DiskNode& node) const;
+
+    /**
+     * @brief 小于x（inclusive时为不大于x）的关键字的聚合值，从根结点往下走一趟
+     */
+    SubtreeAgg PrefixAgg(KeyType x, bool inclusive);
+
+    /**
+     * @brief 把结点放回空闲链表，只写结点中的链接字段
+     */
+    void FreeNode(long r);
+
+    /**
+     * @brief 释放以r为根、高度为h的子树中的所有结点，高度为1的叶结点不读（带值的文件中要读，释放其中的溢出页）
+     */
+    void FreeSubtree(long r, int h);
+
+    /**
+     * @brief 根结点没有关键字了，用它唯一的子树作为新的根结点
+     */
+    void CollapseRoot();
+    void ReadStart();
+
+    /**
+     * @brief 从r为根、高度为h的子树中删除[lo, hi]范围内的关键字，参数见BTree::DelRange
+     * @param agg 增强的B-树中返回r的子树删除后的聚合值
+     * @return 是否删除了关键字（整棵释放的子树中的叶结点不读，所以不返回个数）
+     */
+    bool DelRange(long r, int h, KeyType lo, KeyType hi, bool above_lo, bool below_hi, KeyType& sep, bool& has_sep,
+        SubtreeAgg& agg);
+
+    /**
+     * @brief 调整r的子树p[first]到p[last]，使它们的关键字个数都不少于N_MIN
+     * @param node r的内容，调整后写回r
+     * @details 检查一棵子树就要读一次结点，所以只检查可能不够的那几棵，而不是像BTree::FixNode那样检查全部
+     */
+    void FixNode(long r, DiskNode& node, int first, int last);
+
+    /**
+     * @brief 把r的子树p[i]和它的一个兄弟合并或者重新分配，参见BTree::FixChild
+     */
+    int FixChild(long r, DiskNode& node, int i);
+
+    /**
+     * @brief 自下而上调整r的子树中pending_keys_[first, last)所在的路径上关键字个数不够的结点
+     * @param node r的内容，调整后写回r
+     */
+    void CompactNode(long r, DiskNode& node, size_t first, size_t last);
+
+    /**
+     * @brief Del修改完r之后判断它是否不够，参见BTree::CheckUnderflow
+     * @param z r的子树中少掉的关键字，推迟调整时记下它，Compact沿着它找到r
+     * @return SUCCESS/UNDERFLOW
+     */
+    Status CheckUnderflow(long r, const DiskNode& node, KeyType z);
+
+    /**
+     * @brief 缓冲模式下的Insert/Delete：把消息放进根结点的缓冲区，满了就往下推
+     * @return SUCCESS
+     */
+    Status BufferOp(KeyType x, bool insert);
+
+    /**
+     * @brief 从finger开始往下找x，参见BTree::SeekFinger
+     * @param node finger最后一层的结点的内容：找到时x在其中，没找到时是该插入x的叶结点
+     * @param i x在node中的位置，没找到时是插入的位置
+     * @return true表示找到。树是空的时返回false，finger也是空的
+     */
+    bool SeekFinger(KeyType x, DiskBTreeFinger& finger, DiskNode& node, int& i);
+
+    /**
+     * @brief 推根结点的缓冲区，然后处理根结点的分裂（可能一次分成几个）和只剩一棵子树的情况，写回根结点
+     * @param all 为true时推到只剩删除分支结点自己的关键字的消息为止，否则推到不超过容量为止
+     */
+    void FlushRoot(bool all);
+
+    /**
+     * @brief 按消息条数从多到少把r的缓冲区中各棵子树的消息推给子结点，直到缓冲区降到容量的一半（all为true时
+     *        直到推不动）
+     * @param w r的内容，子结点分裂、合并时修改其中的关键字和链接，由调用者写回r
+     * @return w是否改变了（需要写回r）
+     */
+    bool FlushBuffer(long r, WideNode& w, bool all);
+
+    /**
+     * @brief 把一批消息推给r的子结点w.p[i]，参数和返回值同FlushBuffer
+     * @param msgs 按关键字排好序的消息
+     */
+    bool FlushChild(long r, WideNode& w, int i, const vector<pair<KeyType, bool> >& msgs, bool all);
+
+    /**
+     * @brief 写回r的子结点w.p[i]的新内容wc，太大时分裂成几个，不够N_MIN个关键字时与兄弟合并或者重新分配
+     * @return w是否改变了
+     */
+    bool ReplaceChild(long r, WideNode& w, int i, WideNode& wc);
+
+    /**
+     * @brief ReplaceChild把只剩一个子结点的子结点与兄弟合并时，调整合并结果w中的这个子结点w.p[i]
+     * @details 子结点的关键字都合并掉了时w.p[i]在其中没有兄弟，不够N_MIN个关键字也只能原样写回（见ReplaceChild中
+     *          w.k为空的情况）；合并以后它有了兄弟，写回w之前与兄弟合并或者重新分配，w中仍不少于N_MIN个关键字
+     * @param r w中的消息暂时放到r的缓冲区，r是w写回时要取出缓冲区的结点之一
+     */
+    void FixLoneChild(long r, WideNode& w, int i);
+
+    /**
+     * @brief 把merged分成尽量少的几个结点写到pages中（不够就分配新的，多了就释放），替换r的子结点
+     *        w.p[first]到w.p[last]和它们之间的分隔关键字，原来这些子结点的缓冲区重新按新的分隔关键字分配
+     * @return w是否改变了
+     */
+    bool WriteChildren(long r, WideNode& w, int first, int last, const WideNode& merged, vector<long>& pages);
+
+    /**
+     * @brief 把从r的子结点中取出的消息重新分给w.p[first]到w.p[last]，等于分隔关键字的消息放到r的缓冲区
+     *        （r中已经有的那条更新，留下它）
+     */
+    void RouteBuffers(long r, const WideNode& w, int first, int last, const MessageBuffer& messages);
+
+    /**
+     * @brief 从上往下把r为根、高度为h的子树中的缓冲区中的消息收集到messages中，同一个关键字留上层的那条
+     * @param remaining 还没有收集的非空缓冲区个数，收集完了就不再往下读结点
+     */
+    void GatherBuffers(long r, int h, MessageBuffer& messages, size_t& remaining);
+
+    /**
+     * @brief 查r的缓冲区中有没有x的消息
+     * @param insert 找到时返回消息是插入还是删除
+     */
+    bool FindBuffered(long r, KeyType x, bool& insert) const;
+    void LoadWide(const DiskNode& node, WideNode& w) const;
+    void StoreWide(const WideNode& w, DiskNode& node) const;
+
+    /**
+     * @brief 查询布隆过滤器，过滤器过期了则先重建
+     * @return false表示x一定不存在，不用再读任何结点；true表示x可能存在（或者没有启用过滤器）
+     */
+    bool BloomMayContain(KeyType x);
+
+    /**
+     * @brief 把插入的关键字加入布隆过滤器，超出容量后标记为过期
+     */
+    void BloomAdd(KeyType x);
+
+    /**
+     * @brief 根结点的帧，不用帧池或者帧池中放不下时返回NULL
+     */
+    DiskFrame* RootFrame();
+
+    /**
+     * @brief 帧f中p[i]的帧：已经swizzle时直接返回，否则按位置查找或者读文件装入，再swizzle到f中
+     * @return 帧池中放不下时返回NULL
+     */
+    DiskFrame* ChildFrame(DiskFrame* f, int i);
+
+    /**
+     * @brief 把结点r装入一个空闲的或者淘汰出来的帧（不会淘汰keep），没有可以淘汰的帧时返回NULL
+     */
+    DiskFrame* LoadFrame(long r, const DiskFrame* keep);
+
+    /**
+     * @brief clock算法：跳过访问位为1的帧（并清零）、有swizzled子结点的帧、根结点的帧和keep
+     */
+    DiskFrame* EvictFrame(const DiskFrame* keep);
+
+    /**
+     * @brief 从父帧中unswizzle
+     */
+    void DetachFrame(DiskFrame* f);
+
+    /**
+     * @brief 结点r被释放了，丢掉它的帧（如果有）
+     */
+    void DropFrame(long r);
+
+    /**
+     * @brief 结点写到了文件中，更新它的帧（如果有），按位置重新找到各个swizzled子帧的下标，已经不是子结点的unswizzle
+     */
+    void UpdateFrame(long r, const DiskNode& node);
+
+    void ClearFrames();
+
+    /**
+     * @brief 从文件中读结点，不经过根结点缓存和帧池
+     */
+    void ReadPage(long r, DiskNode& node);
+
+    /**
+     * @brief 遍历整棵树重建布隆过滤器
+     */
+    void RebuildBloomFilter();
+    void AddToBloomFilter(long r);
+
+    void CountNode(long r, DiskBTreeStats& stats);
+
+    /**
+     * @brief 按BulkLoad规划的形状建出包含keys[first, first + s - 1)、高度为h的子树，追加到文件末尾
+     * @param min_children 根结点至少2棵子树，其余结点至少N_MIN+1棵
+     * @param agg 返回子树的聚合值（增强的B-树）
+     * @return 子树的根结点在文件中的位置
+     */
+    long BuildNode(const KeyType* keys, size_t first, size_t s, int h, int min_children, SubtreeAgg& agg);
+
+    /**
+     * @brief SearchBatch在以r为根的子树中查找sorted[first, last)中的关键字，把结果写到results中
+     * @param sorted 排好序的(关键字, 在keys中的下标)
+     */
+    void SearchBatchNode(long r, const vector<pair<KeyType, size_t> >& sorted, size_t first, size_t last,
+        bool* results);
+
+    /**
+     * @brief 中序遍历结点及其子树，跳过[lo, hi]范围以外的子树
+     * @param messages 不为NULL时还收集沿途的缓冲区中[lo, hi]范围内的消息，同一个关键字留上层的那条
+     * @param limit keys中的关键字达到这么多个时停止，不与messages同时用
+     */
+    void ScanNode(long r, KeyType lo, KeyType hi, vector<KeyType>& keys, MessageBuffer* messages = NULL,
+        size_t limit = SIZE_MAX);
+
+private:
+    enum
+    {
+        NIL = -1
+    };
+
+    long root_, free_list_;
+    DiskNode root_node_;
+    vector<long> right_path_; // 见AppendKey，为空时表示失效了
+    DiskNode right_leaf_;
+    bool appending_;          // AppendKey正在写right_path_上的结点，不用清空它
+    unique_ptr<PageStore> store_;
+    bool verbose_;
+    bool read_only_;
+    int height_; // 树高，等于在树中查找一个不存在的关键字时调用ReadNode的次数
+    bool augmented_;
+    bool values_; // 关键字带值（文件头中有DISK_FILE_VALUES），结点中有v[]
+    bool lazy_delete_;
+    bool bstar_;
+    WideNode overflow_; // Ins返回INSERT_OVERFLOW时满结点的内容加上放不下的那一项
+    long compact_threshold_;
+    vector<KeyType> pending_keys_; // 上次Compact以后推迟调整的删除从叶结点中删掉的关键字
+    bool buffered_;
+    long buffer_capacity_;
+    long total_capacity_;
+    long buffered_total_; // 上次FlushBuffers以后BufferOp放进缓冲区的消息条数，不少于缓冲区中的消息总数
+    map<long, MessageBuffer> buffers_; // 分支结点在文件中的位置 -> 它的缓冲区，叶结点没有缓冲区
+    unsigned long version_; // 每写一次分支结点、释放一个结点加1，finger据此判断是否失效
+    DiskFileLayout layout_; // 结点在文件中的布局
+    int order_;             // 等于layout_.order，不超过DISK_M，DiskNode只用前面的部分
+    vector<char> page_buf_; // 阶数不是DISK_M时读写结点的缓冲区，按layout_打包
+    vector<char> posting_buf_; // 带值的文件中读写溢出页的缓冲区，一页大小
+
+    long frame_capacity_;
+    vector<DiskFrame*> frames_;                 // 所有的帧，clock算法按这个顺序扫描
+    size_t clock_hand_;
+    unordered_map<long, DiskFrame*> frame_map_; // 结点在文件中的位置 -> 它的帧
+    DiskFrame* root_frame_;                     // 上一次RootFrame()的结果，page不再是root_时重新找
+
+    string bloom_file_path_;
+    long bloom_tag_[3];      // root_, free_list_和文件长度，用于校验过滤器文件是否与B-树文件匹配
+    double bloom_fpr_;
+    BloomFilter bloom_;
+    bool bloom_stale_;       // 为true时表示过滤器需要重建，在下一次查询时进行
+    long bloom_deleted_;     // 上次重建以后删除的关键字个数，删除的关键字仍然占着过滤器中的位，太多时会抬高误判率
+    BloomFilterStats bloom_stats_;
+
+    DiskBTreeStats stats_; // 只有操作计数有效，结构信息由Stats()临时计算
+    OpProfiler profiler_;
+};
+
+inline DiskBTree::DiskBTree(const char* tree_file_path, double bloom_fpr, bool augmented, PageStoreType store_type,
+    const DiskBTreeFormat& format)
+    : store_(PageStoreFactory::Create(store_type))
+{
+    height_ = 0;
+    verbose_ = true;
+    read_only_ = false;
+    augmented_ = augmented;
+    values_ = false;
+    lazy_delete_ = false;
+    bstar_ = false;
+    appending_ = false;
+    compact_threshold_ = 0;
+    buffered_ = false;
+    buffer_capacity_ = BUFFER_CAPACITY;
+    total_capacity_ = BUFFER_TOTAL_CAPACITY;
+    buffered_total_ = 0;
+    version_ = 1; // 与新的finger的版本不同
+    frame_capacity_ = 0;
+    clock_hand_ = 0;
+    root_frame_ = NULL;
+    memset(&stats_, 0, sizeof(stats_));
+    bloom_file_path_ = string(tree_file_path) + ".bloom";
+    bloom_fpr_ = bloom_fpr;
+    bloom_stale_ = true;
+    bloom_deleted_ = 0;
+    memset(&bloom_stats_, 0, sizeof(bloom_stats_));
+
+    bool new_file;
+    if (store_->Open(tree_file_path, new_file) != 0)
+    {
+        cout << "Cannot open file " << tree_file_path << " (" << store_->Name() << ")." << endl;
+        exit(1);
+    }
+
+    if (new_file)
+    {
+        // 文件不存在，新建一个
+        long page_size = format.page_size;
+        if (DISK_PAGE_AUTO == page_size)
+        {
+            page_size = TuneDiskPageSize(tree_file_path, augmented_, false);
+        }
+
+        int order = format.order;
+        if (order <= 0)
+        {
+            order = (page_size > 0) ? DiskFileLayout::FitOrder(page_size, augmented_, format.values) : DISK_M;
+        }
+
+        if (order < DISK_MIN_ORDER || order > DISK_M)
+        {
+            cout << "Order must be in " << DISK_MIN_ORDER << ".." << DISK_M << " and fit in the page size." << endl;
+            exit(1);
+        }
+
+        layout_ = DiskFileLayout(order, augmented_, page_size, format.values);
+        values_ = format.values;
+        order_ = order;
+        page_buf_.resize(layout_.node_size);
+        posting_buf_.resize(values_ ? layout_.page_size : 0);
+        root_ = free_list_ = NIL;
+
+        // 文件头占一页，后面的结点都按页对齐
+        vector<char> page(layout_.header_size);
+        const DiskFileHeader header = { NIL, NIL, DISK_FILE_MAGIC, order, layout_.page_size,
+            format.values ? DISK_FILE_VALUES : 0 };
+        memcpy(page.data(), &header, sizeof(header));
+        store_->Write(0L, page.data(), page.size());
+    }
+    else
+    {
+        long start[2];
+        if (ReadDiskFileLayout(*store_, layout_) != 0)
+        {
+            cout << "Wrong file format." << endl;
+            exit(1);
+        }
+
+        store_->Read(0L, start, 2 * sizeof(long));
+        augmented_ = layout_.augmented;
+        values_ = layout_.values;
+        order_ = layout_.order;
+        page_buf_.resize(layout_.node_size);
+        posting_buf_.resize(values_ ? layout_.page_size : 0);
+        root_ = start[0];
+        free_list_ = start[1];
+        root_node_.n = 0;   // Signal for function ReadNode
+        ReadNode(root_, root_node_);
+
+        // 沿最左边的路径走到叶结点，得到树高
+        DiskNode node;
+        for (long r = root_; r != NIL; r = node.p[0])
+        {
+            ReadNode(r, node);
+            ++height_;
+        }
+
+        memset(&stats_, 0, sizeof(stats_));
+    }
+
+    if (bloom_fpr_ > 0)
+    {
+        bloom_tag_[0] = root_;
+        bloom_tag_[1] = free_list_;
+        bloom_tag_[2] = store_->Size();
+
+        // 过滤器文件与B-树文件匹配时直接使用，否则在第一次查询时重建
+        if (!new_file && 0 == bloom_.Load(bloom_file_path_.c_str(), bloom_tag_))
+        {
+            bloom_stale_ = false;
+        }
+        else if (new_file)
+        {
+            bloom_.Init(0, bloom_fpr_);
+            bloom_stale_ = false;
+        }
+    }
+}
+
+inline DiskBTree::~DiskBTree()
+{
+    SetFramePool(0); // 下面的Compact等还要读结点，不再装入帧池
+
+    if (read_only_)
+    {
+        store_->Close();
+        return;
+    }
+
+    FlushBuffers(); // 缓冲区只在内存中
+    // 文件中的B-树除了最右路径上的结点都满足N_MIN的要求，下次打开时不用知道哪些结点不够。最右路径上的结点
+    // 是AppendKey留下的，每层最多一个，可能只有一个关键字，Del和Compact都能处理
+    Compact();
+
+    long start[2];
+    start[0] = root_;
+    start[1] = free_list_;
+    store_->Write(0L, start, 2 * sizeof(long));
+
+    // The remaining code of this destructor is slightly
+    // different from that in the first print of the book.
+    // The length of the final binary file, including the
+    // signature byte at the end, will now always be an odd
+    // number（奇数）, as it should be. There is a similar change in
+    // the function GetNode. I am grateful to Chian Wiz from
+    // Singapore, who showed me the possibility of a 'file leak',
+    // that is, an unused byte, which sometimes caused problems
+    // with the program 'showfile', when this was applied to
+    // this binary file. Such problems should no longer occur.
+    // L. A.
+    char ch = sizeof(int) | (augmented_ ? AUGMENTED_SIGNATURE : 0); // Signature
+
+    if ((store_->Size() & 1) == 0)
+    {
+        store_->Write(store_->Size(), &ch, 1);
+    }
+
+    // If the current file length is an even number（偶数）, a
+    // signature is added; otherwise it is already there.
+    const long file_length = store_->Size();
+    store_->Close();
+
+    if (bloom_fpr_ > 0 && !bloom_stale_)
+    {
+        bloom_tag_[0] = root_;
+        bloom_tag_[1] = free_list_;
+        bloom_tag_[2] = file_length;
+        bloom_.Save(bloom_file_path_.c_str(), bloom_tag_);
+    }
+    else
+    {
+        // 本次没有维护过滤器，旧的过滤器文件可能漏掉了新插入的关键字，必须删掉
+        remove(bloom_file_path_.c_str());
+    }
+}
+
+inline void DiskBTree::ShowSearch(KeyType x)
+{
+    if (!BloomMayContain(x))
+    {
+        cout << "Key " << x << " not found (Bloom filter)." << endl;
+        return;
+    }
+
+    cout << "Search path:" << endl;
+    int i, j, n;
+    long r = root_;
+    DiskNode node;
+
+    while (r != NIL)
+    {
+        ReadNode(r, node);
+        n = node.n;
+
+        for (j = 0; j < node.n; ++j)
+        {
+            cout << " " << node.k[j];
+        }
+
+        cout << endl;
+
+        bool insert;
+        if (FindBuffered(r, x, insert))
+        {
+            cout << "Key " << x << (insert ? " inserted" : " deleted") << " by a message in the buffer of last"
+                << " displayed node." << endl;
+            return;
+        }
+
+        i = SearchInNode(x, node.k, n);
+        if (i < n && x == node.k[i])
+        {
+            cout << "Key " << x << " found in position " << i << " of last displayed node.";
+            return;
+        }
+
+        r = node.p[i];
+    }
+
+    if (bloom_fpr_ > 0)
+    {
+        ++bloom_stats_.false_positives;
+    }
+
+    cout << "Key " << x << " not found." << endl;
+}
+
+inline bool DiskBTree::Search(KeyType x)
+{
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    bool found = false;
+
+    if (BloomMayContain(x))
+    {
+        long r = root_;
+        DiskNode node;
+        DiskFrame* f = RootFrame(); // 不为NULL时是r的帧，直接在帧中查找
+
+        while (r != NIL)
+        {
+            const DiskNode* current = &node;
+            if (f != NULL)
+            {
+                current = &f->node;
+            }
+            else
+            {
+                ReadNode(r, node);
+            }
+
+            profiler_.Visit(r);
+
+            // 缓冲区中的消息比结点中的关键字新
+            bool insert;
+            if (FindBuffered(r, x, insert))
+            {
+                found = insert;
+                break;
+            }
+
+            const int i = SearchInNode(x, current->k, current->n);
+            if (i < current->n && x == current->k[i])
+            {
+                found = true;
+                break;
+            }
+
+            r = current->p[i];
+            f = (f != NULL && r != NIL) ? ChildFrame(f, i) : NULL;
+        }
+
+        if (!found && bloom_fpr_ > 0)
+        {
+            ++bloom_stats_.false_positives;
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return found;
+}
+
+inline bool DiskBTree::Search(KeyType x, DiskBTreeFinger& finger)
+{
+    if (!buffers_.empty())
+    {
+        finger.levels.clear();
+        return Search(x);
+    }
+
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    bool found = false;
+
+    if (BloomMayContain(x))
+    {
+        DiskNode node;
+        int i;
+        found = SeekFinger(x, finger, node, i);
+
+        if (!found && bloom_fpr_ > 0)
+        {
+            ++bloom_stats_.false_positives;
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return found;
+}
+
+inline bool DiskBTree::SeekFinger(KeyType x, DiskBTreeFinger& finger, DiskNode& node, int& i)
+{
+    if (finger.levels.empty() || finger.version != version_ || finger.levels[0].page != root_)
+    {
+        finger.levels.clear();
+        finger.version = version_;
+
+        if (NIL == root_)
+        {
+            return false;
+        }
+
+        const DiskBTreeFinger::Level root = { root_, false, false, 0, 0 };
+        finger.levels.push_back(root);
+    }
+
+    // 往上退到子树的范围包含x的那一层，根结点的范围是所有的关键字
+    size_t top = finger.levels.size() - 1;
+    while (top > 0 && !finger.levels[top].Contains(x))
+    {
+        --top;
+    }
+
+    finger.levels.resize(top + 1);
+
+    for (; ;)
+    {
+        const DiskBTreeFinger::Level level = finger.levels.back();
+
+        ReadNode(level.page, node);
+        profiler_.Visit(level.page);
+
+        i = SearchInNode(x, node.k, node.n);
+        if (i < node.n && x == node.k[i])
+        {
+            return true;
+        }
+
+        if (NIL == node.p[i])
+        {
+            return false;
+        }
+
+        // p[i]子树的范围是k[i - 1]和k[i]之间，两端的子树沿用上一层的界限
+        const DiskBTreeFinger::Level child = { node.p[i], i > 0 || level.has_lo, i < node.n || level.has_hi,
+            (i > 0) ? node.k[i - 1] : level.lo, (i < node.n) ? node.k[i] : level.hi };
+        finger.levels.push_back(child);
+    }
+}
+
+inline long DiskBTree::Scan(KeyType lo, KeyType hi, vector<KeyType>& keys, size_t limit)
+{
+    if (limit < SIZE_MAX && !buffers_.empty())
+    {
+        FlushBuffers();
+    }
+
+    const bool profiling = profiler_.Begin(OP_SCAN, lo, stats_.reads, stats_.writes);
+    const size_t size = keys.size();
+
+    if (lo <= hi && limit > 0 && buffers_.empty())
+    {
+        ScanNode(root_, lo, hi, keys, NULL, (limit < SIZE_MAX - size) ? size + limit : SIZE_MAX);
+    }
+    else if (lo <= hi && limit > 0)
+    {
+        // 沿途的消息比树中的关键字新，归并进结果：插入的加上，删除的去掉
+        vector<KeyType> tree_keys;
+        MessageBuffer messages;
+        ScanNode(root_, lo, hi, tree_keys, &messages);
+
+        size_t j = 0;
+        MessageBuffer::const_iterator m = messages.begin();
+
+        while (j < tree_keys.size() || m != messages.end())
+        {
+            if (m == messages.end() || (j < tree_keys.size() && tree_keys[j] < m->first))
+            {
+                keys.push_back(tree_keys[j++]);
+                continue;
+            }
+
+            if (j < tree_keys.size() && tree_keys[j] == m->first)
+            {
+                ++j;
+            }
+
+            if (m->second)
+            {
+                keys.push_back(m->first);
+            }
+
+            ++m;
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return (long) (keys.size() - size);
+}
+
+inline int DiskBTree::Insert(KeyType x)
+{
+    if (read_only_)
+    {
+        return -1;
+    }
+
+    int ret = 0;
+
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    // 根结点是叶结点时还没有缓冲区，直接插入
+    const Status code = (buffered_ && height_ > 1) ? BufferOp(x, true) : InsertKey(x, DiskPosting());
+    switch (code)
+    {
+        case DUPLICATE_KEY:
+        {
+            if (verbose_)
+            {
+                cout << "Duplicate key ignored." << endl;
+            }
+
+            ret = -1;
+        }
+            break;
+
+        case SUCCESS:
+        {
+            BloomAdd(x);
+        }
+            break;
+
+        default:
+        {
+            ret = -1;
+        }
+            break;
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return ret;
+}
+
+inline int DiskBTree::Insert(KeyType x, DiskBTreeFinger& finger)
+{
+    if (augmented_ || (buffered_ && height_ > 1))
+    {
+        finger.levels.clear();
+        return Insert(x);
+    }
+
+    if (read_only_)
+    {
+        return -1;
+    }
+
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    DiskNode node;
+    int i;
+    Status code = SUCCESS;
+
+    if (SeekFinger(x, finger, node, i))
+    {
+        code = DUPLICATE_KEY;
+    }
+    else if (finger.levels.empty() || node.n >= order_ - 1)
+    {
+        code = InsertKey(x, DiskPosting()); // 空树，或者叶结点要分裂
+    }
+    else
+    {
+        for (int j = node.n; j > i; --j)
+        {
+            node.k[j] = node.k[j - 1];
+            node.SetPosting(j, node.Posting(j - 1));
+        }
+
+        node.k[i] = x;
+        node.SetPosting(i, DiskPosting());
+        node.p[node.n + 1] = NIL;
+        ++(node.n);
+        WriteNode(finger.levels.back().page, node);
+    }
+
+    if (DUPLICATE_KEY == code && verbose_)
+    {
+        cout << "Duplicate key ignored." << endl;
+    }
+    else if (SUCCESS == code)
+    {
+        BloomAdd(x);
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return (SUCCESS == code) ? 0 : -1;
+}
+
+inline Status DiskBTree::InsertKey(KeyType x, const DiskPosting& xv)
+{
+    KeyType y;
+    DiskPosting yv;
+    long q = NIL;
+    SubtreeAgg q_agg;
+
+    Status code;
+    if (!AppendKey(x, xv, y, yv, q, q_agg, code))
+    {
+        code = Ins(root_, x, xv, y, yv, q, q_agg);
+    }
+
+    if (code != INSERT_NOT_COMPLETE)
+    {
+        return code;
+    }
+
+    long root = root_;
+    root_ = GetNode();
+    if (augmented_)
+    {
+        root_node_.AllocAgg();
+    }
+
+    if (root != NIL) // 旧的根结点分裂后留下的左半部分还在root_node_中
+    {
+        root_node_.SetAgg(0, NodeAgg(root_node_));
+    }
+
+    root_node_.SetAgg(1, q_agg);
+    root_node_.SetPosting(0, yv);
+    root_node_.n = 1;
+    root_node_.k[0] = y;
+    root_node_.p[0] = root;
+    root_node_.p[1] = q;
+    WriteNode(root_, root_node_);
+    ++height_;
+
+    return SUCCESS;
+}
+
+inline int DiskBTree::Insert(KeyType x, ValueType value)
+{
+    if (!values_ || read_only_)
+    {
+        return -1;
+    }
+
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.reads, stats_.writes);
+    FlushBuffers();
+
+    long r;
+    DiskNode node;
+    int i;
+
+    if (FindKey(x, r, node, i)) // 已有的关键字只加一个值，不必动树的结构
+    {
+        DiskPosting posting = node.Posting(i);
+        AddValue(posting, value);
+        node.SetPosting(i, posting);
+        WriteNode(r, node);
+    }
+    else
+    {
+        DiskPosting xv = DiskPosting();
+        AddValue(xv, value); // 一个值的编码总是放得进结点中，不写溢出页
+        InsertKey(x, xv);
+        BloomAdd(x);
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return 0;
+}
+
+inline long DiskBTree::Get(KeyType x, vector<ValueType>& values)
+{
+    if (!values_)
+    {
+        return -1;
+    }
+
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.reads, stats_.writes);
+    FlushBuffers();
+
+    long r;
+    DiskNode node;
+    int i;
+    const bool found = BloomMayContain(x) && FindKey(x, r, node, i);
+
+    if (found)
+    {
+        DecodeValues(node.Posting(i), values);
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return found ? (long) node.Posting(i).count : -1;
+}
+
+inline int DiskBTree::Delete(KeyType x, ValueType value)
+{
+    if (!values_ || read_only_)
+    {
+        return -1;
+    }
+
+    FlushBuffers();
+
+    long r;
+    DiskNode node;
+    int i;
+    if (!FindKey(x, r, node, i))
+    {
+        return -1;
+    }
+
+    DiskPosting posting = node.Posting(i);
+    vector<ValueType> values;
+    values.reserve(posting.count);
+    DecodeValues(posting, values);
+
+    const vector<ValueType>::iterator it = lower_bound(values.begin(), values.end(), value);
+    if (it == values.end() || *it != value)
+    {
+        return -1;
+    }
+
+    values.erase(it);
+    RebuildValues(posting, values);
+    node.SetPosting(i, posting);
+    WriteNode(r, node);
+
+    return values.empty() ? Delete(x) : 0;
+}
+
+inline int DiskBTree::Insert(const char* key_file_path)
+{
+    size_t error_offset = SIZE_MAX; // 打不开文件时不变
+    vector<KeyType> batch;
+    batch.reserve(KEY_FILE_BATCH);
+
+    const auto insert_batch = [this, &batch]()
+    {
+        if (verbose_ && !batch.empty())
+        {
+            // 按文件中的顺序提示：树中已经有的，以及这一批中前面已经出现过的
+            unique_ptr<bool[]> found(new bool[batch.size()]);
+            SearchBatch(batch.data(), batch.size(), found.get());
+            unordered_map<KeyType, bool> seen;
+            seen.reserve(batch.size());
+
+            for (size_t j = 0; j < batch.size(); ++j)
+            {
+                if (!seen.insert(make_pair(batch[j], true)).second || found[j])
+                {
+                    cout << "Duplicate key ignored." << endl;
+                }
+            }
+        }
+
+        InsertBatch(batch.data(), batch.size());
+        batch.clear();
+    };
+
+    const long count = IngestKeyFile(key_file_path, [&batch, &insert_batch](KeyType x)
+    {
+        batch.push_back(x);
+        if (batch.size() >= KEY_FILE_BATCH)
+        {
+            insert_batch();
+        }
+    }, &error_offset);
+
+    insert_batch(); // 出错前解析出的关键字也插入，同逐个插入时
+    if (count < 0)
+    {
+        if (SIZE_MAX == error_offset)
+        {
+            cout << "Cannot open input file " << key_file_path << endl;
+        }
+        else
+        {
+            cout << "Invalid key at offset " << error_offset << " of input file " << key_file_path << endl;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+inline int DiskBTree::Delete(KeyType x)
+{
+    if (read_only_)
+    {
+        return -1;
+    }
+
+    int ret = 0;
+
+    const bool profiling = profiler_.Begin(OP_DELETE, x, stats_.reads, stats_.writes);
+    const long long bytes_written = stats_.bytes_written;
+    if (values_)
+    {
+        FlushBuffers(); // 删除消息后面的插入消息会把关键字连同旧的值一起留下，所以带值的文件中删除不经过缓冲区
+    }
+
+    const bool may_contain = BloomMayContain(x);
+    const bool buffer = buffered_ && height_ > 1 && !values_;
+    Status code = !may_contain ? NOT_FOUND : buffer ? BufferOp(x, false) : Del(root_, x, x);
+    if (code != NOT_FOUND && bloom_fpr_ > 0)
+    {
+        // 过滤器不能删除关键字，删得太多时在下一次查询时重建
+        if (++bloom_deleted_ * 4 > bloom_.KeyCount())
+        {
+            bloom_stale_ = true;
+        }
+    }
+
+    switch (code)
+    {
+        case NOT_FOUND:
+        {
+            if (may_contain && bloom_fpr_ > 0)
+            {
+                ++bloom_stats_.false_positives;
+            }
+
+            if (verbose_)
+            {
+                cout << "Key " << x << " not found." << endl;
+            }
+
+            ret = -1;
+        }
+            break;
+
+        case UNDERFLOW:
+            CollapseRoot();
+            break;
+
+        default:
+            break;
+    }
+
+    if (0 == ret)
+    {
+        // 自动Compact的开销算在触发它的这次删除上
+        if (compact_threshold_ > 0 && (long) pending_keys_.size() >= compact_threshold_)
+        {
+            Compact();
+        }
+
+        ++stats_.deletes;
+        stats_.delete_bytes_written += stats_.bytes_written - bytes_written;
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.reads, stats_.writes);
+    }
+
+    return ret;
+}
+
+inline void DiskBTree::SetLazyDelete(bool lazy, long compact_threshold)
+{
+    if (!lazy && lazy_delete_)
+    {
+        Compact();
+    }
+
+    lazy_delete_ = lazy;
+    compact_threshold_ = lazy ? compact_threshold : 0;
+}
+
+inline void DiskBTree::Compact()
+{
+    if (pending_keys_.empty())
+    {
+        return;
+    }
+
+    FlushBuffers(); // FixNode不管缓冲区，先把消息都落到叶结点
+
+    sort(pending_keys_.begin(), pending_keys_.end());
+    pending_keys_.erase(unique(pending_keys_.begin(), pending_keys_.end()), pending_keys_.end());
+
+    if (root_ != NIL)
+    {
+        CompactNode(root_, root_node_, 0, pending_keys_.size());
+
+        // 根结点的子树都合并成一棵时降低树高，同DeleteRange
+        while (root_ != NIL && 0 == root_node_.n)
+        {
+            CollapseRoot();
+
+            if (root_ != NIL)
+            {
+                FixNode(root_, root_node_, 0, root_node_.n);
+            }
+        }
+    }
+
+    pending_keys_.clear();
+    ++stats_.compactions;
+}
+
+inline void DiskBTree::CompactNode(long r, DiskNode& node, size_t first, size_t last)
+{
+    if (NIL == node.p[0])
+    {
+        return;
+    }
+
+    // 按分隔关键字把记下的关键字分给各个子树，p[i]分到(k[i-1], k[i]]中的。等于k[i]的是x在分支结点中时
+    // 与左子树中的最大关键字交换后删掉的那个，它原来在p[i]子树中
+    vector<int> children;
+    DiskNode child;
+
+    for (size_t j = first; j < last; )
+    {
+        const int i = (node.n > 0) ? SearchInNode(pending_keys_[j], node.k, node.n) : 0;
+        size_t end = j + 1;
+
+        while (end < last && (i == node.n || pending_keys_[end] <= node.k[i]))
+        {
+            ++end;
+        }
+
+        ReadNode(node.p[i], child);
+        CompactNode(node.p[i], child, j, end);
+        children.push_back(i);
+        j = end;
+    }
+
+    // 从右往左调整，合并只会使右边的子树左移，不影响还没调整的子树的下标
+    for (size_t j = children.size(); j-- > 0; )
+    {
+        FixNode(r, node, children[j], children[j]);
+    }
+}
+
+inline Status DiskBTree::CheckUnderflow(long r, const DiskNode& node, KeyType z)
+{
+    const int N_MIN = (order_ - 1) / 2;
+
+    if (r == root_ || !lazy_delete_)
+    {
+        return (node.n >= (r == root_ ? 1 : N_MIN)) ? SUCCESS : UNDERFLOW;
+    }
+
+    if (0 == node.n)
+    {
+        return UNDERFLOW;
+    }
+
+    if (node.n < N_MIN)
+    {
+        pending_keys_.push_back(z);
+        ++stats_.lazy_deletes;
+    }
+
+    return SUCCESS;
+}
+
+inline void DiskBTree::SetBuffered(bool buffered, long buffer_capacity, long total_capacity)
+{
+    if (!buffered && buffered_)
+    {
+        FlushBuffers();
+    }
+
+    buffered_ = buffered;
+    buffer_capacity_ = (buffer_capacity > 0) ? buffer_capacity : BUFFER_CAPACITY;
+    total_capacity_ = (total_capacity > 0) ? total_capacity : BUFFER_TOTAL_CAPACITY;
+}
+
+inline void DiskBTree::FlushBuffers()
+{
+    size_t remaining = 0;
+    for (map<long, MessageBuffer>::const_iterator b = buffers_.begin(); b != buffers_.end(); ++b)
+    {
+        remaining += b->second.empty() ? 0 : 1;
+    }
+
+    buffered_total_ = 0;
+
+    if (0 == remaining)
+    {
+        buffers_.clear();
+        return;
+    }
+
+    // 先把所有的消息收集到根结点的缓冲区中，下层的缓冲区都空了，再一路推到底
+    MessageBuffer messages;
+    GatherBuffers(root_, height_, messages, remaining);
+    buffers_.clear();
+    buffers_[root_].swap(messages);
+    FlushRoot(true);
+
+    // 推不动的只有删除分支结点自己的关键字的消息（见FlushBuffer），清空缓冲区后用Del删除
+    vector<KeyType> keys;
+    for (map<long, MessageBuffer>::const_iterator b = buffers_.begin(); b != buffers_.end(); ++b)
+    {
+        for (MessageBuffer::const_iterator m = b->second.begin(); m != b->second.end(); ++m)
+        {
+            if (!m->second)
+            {
+                keys.push_back(m->first);
+            }
+        }
+    }
+
+    buffers_.clear();
+
+    for (size_t j = 0; j < keys.size(); ++j)
+    {
+        if (UNDERFLOW == Del(root_, keys[j], keys[j]))
+        {
+            CollapseRoot();
+        }
+    }
+}
+
+inline Status DiskBTree::BufferOp(KeyType x, bool insert)
+{
+    MessageBuffer& buffer = buffers_[root_];
+    buffer[x] = insert;
+    ++stats_.buffered_ops;
+    ++buffered_total_;
+
+    if ((long) buffer.size() > buffer_capacity_)
+    {
+        FlushRoot(false);
+    }
+
+    if (buffered_total_ > total_capacity_)
+    {
+        FlushBuffers();
+    }
+
+    return SUCCESS;
+}
+
+inline void DiskBTree::FlushRoot(bool all)
+{
+    WideNode w;
+    LoadWide(root_node_, w);
+    bool changed = FlushBuffer(root_, w, all);
+
+    // 根结点的子树都合并成一棵时降低树高。子结点是叶结点时它不能有缓冲区，先把消息都推下去
+    while (w.k.empty() && w.p[0] != NIL)
+    {
+        MessageBuffer& buffer = buffers_[root_];
+        if (!buffer.empty() && 2 == height_)
+        {
+            changed = FlushBuffer(root_, w, true) || changed;
+            continue;
+        }
+
+        if (!buffer.empty())
+        {
+            MessageBuffer& child_buffer = buffers_[w.p[0]];
+            for (MessageBuffer::const_iterator m = buffer.begin(); m != buffer.end(); ++m)
+            {
+                child_buffer[m->first] = m->second; // 根结点中的消息更新，覆盖旧的
+            }
+        }
+
+        const long root = root_;
+        buffers_.erase(root);
+        root_ = w.p[0];
+        FreeNode(root);
+        --height_;
+
+        root_node_.n = 0; // Signal for function ReadNode
+        ReadNode(root_, root_node_);
+        LoadWide(root_node_, w);
+        changed = false;
+    }
+
+    // 根结点太大时分成几个结点，上面加一个新的根结点
+    while (w.k.size() > (size_t) order_ - 1)
+    {
+        const long root = GetNode();
+        WideNode top;
+        const SubtreeAgg agg = { 0, 0 };
+        top.p.push_back(root_);
+        top.a.push_back(agg);
+
+        vector<long> pages(1, root_);
+        WriteChildren(root, top, 0, 0, w, pages);
+        root_ = root;
+        ++height_;
+        w.k.swap(top.k);
+        w.v.swap(top.v);
+        w.p.swap(top.p);
+        w.a.swap(top.a);
+        changed = true;
+    }
+
+    if (changed)
+    {
+        DiskNode node;
+        StoreWide(w, node);
+        WriteNode(root_, node);
+    }
+}
+
+inline bool DiskBTree::FlushBuffer(long r, WideNode& w, bool all)
+{
+    MessageBuffer& buffer = buffers_[r];
+    const size_t target = all ? 0 : (size_t) buffer_capacity_ / 2;
+    bool changed = false;
+
+    while (buffer.size() > target)
+    {
+        // 数一数每棵子树的消息。r自己的关键字的插入消息直接丢掉（关键字已经在了），删除r自己的关键字的
+        // 消息推不下去，留在r中：查找时它挡住r中的关键字，FlushBuffers最后用Del删除
+        const int n = (int) w.k.size();
+        vector<pair<size_t, KeyType> > counts; // (消息条数, 子树的第一条消息的关键字)
+        int i = 0, current = -1;
+
+        for (MessageBuffer::iterator m = buffer.begin(); m != buffer.end(); )
+        {
+            while (i < n && w.k[i] < m->first)
+            {
+                ++i;
+            }
+
+            if (i < n && w.k[i] == m->first)
+            {
+                if (m->second)
+                {
+                    buffer.erase(m++);
+                }
+                else
+                {
+                    ++m;
+                }
+
+                continue;
+            }
+
+            if (i != current)
+            {
+                current = i;
+                counts.push_back(make_pair((size_t) 0, m->first));
+            }
+
+            ++counts.back().first;
+            ++m;
+        }
+
+        if (counts.empty())
+        {
+            break;
+        }
+
+        // 从消息最多的子树开始推，数一次推很多棵，直到缓冲区降到容量的一半。子结点分裂或者合并以后w中的
+        // 下标变了，所以记下的是子树中的一条消息，推之前用它重新找子树；它已经跟着兄弟推下去了就跳过
+        sort(counts.begin(), counts.end(), greater<pair<size_t, KeyType> >());
+
+        for (size_t j = 0; j < counts.size() && buffer.size() > target; ++j)
+        {
+            const KeyType x = counts[j].second;
+            const int best = (int) (lower_bound(w.k.begin(), w.k.end(), x) - w.k.begin());
+            if (0 == buffer.count(x) || (best < (int) w.k.size() && w.k[best] == x))
+            {
+                continue;
+            }
+
+            // 取出p[best]子树的所有消息，它们在(k[best-1], k[best])中
+            MessageBuffer::iterator first = (best > 0) ? buffer.upper_bound(w.k[best - 1]) : buffer.begin();
+            MessageBuffer::iterator last = (best < (int) w.k.size()) ? buffer.lower_bound(w.k[best]) : buffer.end();
+            const vector<pair<KeyType, bool> > msgs(first, last);
+            buffer.erase(first, last);
+
+            ++stats_.buffer_flushes;
+            changed = FlushChild(r, w, best, msgs, all) || changed;
+        }
+    }
+
+    return changed;
+}
+
+inline bool DiskBTree::FlushChild(long r, WideNode& w, int i, const vector<pair<KeyType, bool> >& msgs, bool all)
+{
+    const long c = w.p[i];
+    DiskNode child;
+    ReadNode(c, child);
+    profiler_.Visit(c);
+
+    WideNode wc;
+
+    if (NIL == child.p[0])
+    {
+        // 叶结点：消息与关键字归并，只写一次。已有的关键字再插入时留下它的值，删除时释放
+        size_t j = 0;
+        wc.k.reserve(child.n + msgs.size());
+        wc.v.reserve(child.n + msgs.size());
+
+        for (size_t t = 0; t < msgs.size(); ++t)
+        {
+            while (j < (size_t) child.n && child.k[j] < msgs[t].first)
+            {
+                wc.v.push_back(child.Posting(j));
+                wc.k.push_back(child.k[j++]);
+            }
+
+            DiskPosting posting = DiskPosting();
+            if (j < (size_t) child.n && child.k[j] == msgs[t].first)
+            {
+                posting = child.Posting(j++);
+            }
+
+            if (msgs[t].second)
+            {
+                wc.k.push_back(msgs[t].first);
+                wc.v.push_back(posting);
+            }
+            else
+            {
+                FreeValues(posting);
+            }
+        }
+
+        for (; j < (size_t) child.n; ++j)
+        {
+            wc.k.push_back(child.k[j]);
+            wc.v.push_back(child.Posting(j));
+        }
+
+        const SubtreeAgg agg = { 0, 0 };
+        wc.p.assign(wc.k.size() + 1, NIL);
+        wc.a.assign(wc.k.size() + 1, agg);
+    }
+    else
+    {
+        MessageBuffer& buffer = buffers_[c];
+        for (size_t t = 0; t < msgs.size(); ++t)
+        {
+            buffer[msgs[t].first] = msgs[t].second; // 父结点中的消息更新，覆盖旧的
+        }
+
+        if (!all && (long) buffer.size() <= buffer_capacity_)
+        {
+            return false; // 只是放进了子结点的缓冲区，不写任何结点
+        }
+
+        LoadWide(child, wc);
+        if (!FlushBuffer(c, wc, all))
+        {
+            return false;
+        }
+    }
+
+    return ReplaceChild(r, w, i, wc);
+}
+
+inline bool DiskBTree::ReplaceChild(long r, WideNode& w, int i, WideNode& wc)
+{
+    const size_t N_MIN = (order_ - 1) / 2;
+
+    if (wc.k.size() >= N_MIN || w.k.empty())
+    {
+        vector<long> pages(1, w.p[i]);
+        return WriteChildren(r, w, i, i, wc, pages);
+    }
+
+    // 不够N_MIN个关键字时与兄弟合并或者重新分配，优先用左兄弟，同FixChild
+    const int pivot = (i > 0) ? i - 1 : i;
+    DiskNode sibling;
+    ReadNode(w.p[(i > 0) ? i - 1 : i + 1], sibling);
+
+    WideNode ws;
+    LoadWide(sibling, ws);
+
+    const WideNode& left = (i > 0) ? ws : wc;
+    const WideNode& right = (i > 0) ? wc : ws;
+    WideNode merged;
+
+    merged.k = left.k;
+    merged.k.push_back(w.k[pivot]);
+    merged.k.insert(merged.k.end(), right.k.begin(), right.k.end());
+    merged.v = left.v;
+    merged.v.push_back(w.v[pivot]);
+    merged.v.insert(merged.v.end(), right.v.begin(), right.v.end());
+    merged.p = left.p;
+    merged.p.insert(merged.p.end(), right.p.begin(), right.p.end());
+    merged.a = left.a;
+    merged.a.insert(merged.a.end(), right.a.begin(), right.a.end());
+
+    if (merged.k.size() > (size_t) order_ - 1)
+    {
+        ++((i > 0) ? stats_.borrow_lefts : stats_.borrow_rights);
+    }
+
+    if (wc.k.empty() && wc.p[0] != NIL)
+    {
+        FixLoneChild(w.p[i], merged, (i > 0) ? (int) left.p.size() : 0);
+    }
+
+    vector<long> pages(1, w.p[pivot]);
+    pages.push_back(w.p[pivot + 1]);
+    WriteChildren(r, w, pivot, pivot + 1, merged, pages);
+    return true;
+}
+
+inline void DiskBTree::FixLoneChild(long r, WideNode& w, int i)
+{
+    DiskNode child;
+    ReadNode(w.p[i], child);
+
+    if (child.n < (order_ - 1) / 2)
+    {
+        WideNode wc;
+        LoadWide(child, wc);
+        ReplaceChild(r, w, i, wc); // w中至少有一个关键字，一定与兄弟合并或者重新分配；wc也只剩一个子结点时递归调整
+    }
+}
+
+inline bool DiskBTree::WriteChildren(long r, WideNode& w, int first, int last, const WideNode& merged,
+    vector<long>& pages)
+{
+    // 先取出原来的子结点的缓冲区，它们的页面可能被释放或者换成别的内容
+    MessageBuffer messages;
+    for (size_t j = 0; j < pages.size(); ++j)
+    {
+        map<long, MessageBuffer>::iterator b = buffers_.find(pages[j]);
+        if (b != buffers_.end())
+        {
+            messages.insert(b->second.begin(), b->second.end());
+            buffers_.erase(b);
+        }
+    }
+
+    // 分成m个结点，m - 1个关键字提到r中：K - (m - 1) <= m * (order_ - 1)，即m >= (K + 1) / order_。
+    // 关键字平均分配，m >= 2时每个结点都不少于N_MIN个
+    const size_t old_count = pages.size();
+    const size_t m = (merged.k.size() + order_) / order_;
+    const size_t piece_keys = merged.k.size() - (m - 1);
+
+    while (pages.size() < m)
+    {
+        pages.push_back(GetNode());
+    }
+
+    vector<KeyType> seps;
+    vector<DiskPosting> sep_postings;
+    vector<SubtreeAgg> aggs;
+    DiskNode node;
+    size_t pos = 0;
+
+    for (size_t j = 0; j < m; ++j)
+    {
+        const int n = (int) (piece_keys / m + (j < piece_keys % m ? 1 : 0));
+        node.n = n;
+        copy(merged.k.begin() + pos, merged.k.begin() + pos + n, node.k);
+        copy(merged.p.begin() + pos, merged.p.begin() + pos + n + 1, node.p);
+        if (augmented_)
+        {
+            node.AllocAgg();
+            copy(merged.a.begin() + pos, merged.a.begin() + pos + n + 1, node.a);
+        }
+        if (values_)
+        {
+            node.AllocValues();
+            copy(merged.v.begin() + pos, merged.v.begin() + pos + n, node.v);
+        }
+        WriteNode(pages[j], node);
+        aggs.push_back(NodeAgg(node));
+
+        pos += n;
+        if (j + 1 < m)
+        {
+            sep_postings.push_back(merged.v[pos]);
+            seps.push_back(merged.k[pos++]);
+        }
+    }
+
+    for (size_t j = m; j < old_count; ++j)
+    {
+        FreeNode(pages[j]);
+    }
+
+    if (m > old_count)
+    {
+        stats_.splits += (long) (m - old_count);
+    }
+    else if (m < old_count)
+    {
+        stats_.merges += (long) (old_count - m);
+    }
+
+    w.k.erase(w.k.begin() + first, w.k.begin() + last);
+    w.k.insert(w.k.begin() + first, seps.begin(), seps.end());
+    w.v.erase(w.v.begin() + first, w.v.begin() + last);
+    w.v.insert(w.v.begin() + first, sep_postings.begin(), sep_postings.end());
+    w.p.erase(w.p.begin() + first, w.p.begin() + last + 1);
+    w.p.insert(w.p.begin() + first, pages.begin(), pages.begin() + m);
+    w.a.erase(w.a.begin() + first, w.a.begin() + last + 1);
+    w.a.insert(w.a.begin() + first, aggs.begin(), aggs.end());
+
+    RouteBuffers(r, w, first, first + (int) m - 1, messages);
+
+    // 只重写了一个子结点时r中的关键字和链接都没变，增强的B-树中它的聚合值变了
+    return augmented_ || m != 1 || first != last;
+}
+
+inline void DiskBTree::RouteBuffers(long r, const WideNode& w, int first, int last, const MessageBuffer& messages)
+{
+    for (MessageBuffer::const_iterator m = messages.begin(); m != messages.end(); ++m)
+    {
+        const int i = (int) (lower_bound(w.k.begin() + first, w.k.begin() + last, m->first) - w.k.begin());
+
+        if (i < last && w.k[i] == m->first)
+        {
+            buffers_[r].insert(*m);
+        }
+        else
+        {
+            buffers_[w.p[i]].insert(*m);
+        }
+    }
+}
+
+inline void DiskBTree::GatherBuffers(long r, int h, MessageBuffer& messages, size_t& remaining)
+{
+    if (h <= 1 || 0 == remaining)
+    {
+        return;
+    }
+
+    map<long, MessageBuffer>::const_iterator b = buffers_.find(r);
+    if (b != buffers_.end() && !b->second.empty())
+    {
+        messages.insert(b->second.begin(), b->second.end()); // 先序遍历，上层的先收集，insert不覆盖已有的
+        --remaining;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+
+    for (int i = 0; i <= node.n && remaining > 0; ++i)
+    {
+        GatherBuffers(node.p[i], h - 1, messages, remaining);
+    }
+}
+
+inline bool DiskBTree::FindBuffered(long r, KeyType x, bool& insert) const
+{
+    map<long, MessageBuffer>::const_iterator b = buffers_.find(r);
+    if (b == buffers_.end())
+    {
+        return false;
+    }
+
+    MessageBuffer::const_iterator m = b->second.find(x);
+    if (m == b->second.end())
+    {
+        return false;
+    }
+
+    insert = m->second;
+    return true;
+}
+
+inline void DiskBTree::LoadWide(const DiskNode& node, WideNode& w) const
+{
+    w.k.assign(node.k, node.k + node.n);
+    w.p.assign(node.p, node.p + node.n + 1);
+    if (node.a != NULL)
+    {
+        w.a.assign(node.a, node.a + node.n + 1);
+    }
+    else
+    {
+        w.a.assign(node.n + 1, SubtreeAgg());
+    }
+
+    if (node.v != NULL)
+    {
+        w.v.assign(node.v, node.v + node.n);
+    }
+    else
+    {
+        w.v.assign(node.n, DiskPosting());
+    }
+}
+
+inline void DiskBTree::StoreWide(const WideNode& w, DiskNode& node) const
+{
+    node.n = (int) w.k.size();
+    copy(w.k.begin(), w.k.end(), node.k);
+    copy(w.p.begin(), w.p.end(), node.p);
+    if (augmented_)
+    {
+        node.AllocAgg();
+        copy(w.a.begin(), w.a.end(), node.a);
+    }
+
+    if (values_)
+    {
+        node.AllocValues();
+        copy(w.v.begin(), w.v.end(), node.v);
+    }
+}
+
+inline int DiskBTree::InsertBatch(const KeyType* keys, size_t count)
+{
+    if (read_only_)
+    {
+        return -1;
+    }
+
+    // 根结点是叶结点时还没有分支结点可以放消息，逐个插入直到根结点分裂
+    size_t i = 0;
+    const bool verbose = verbose_;
+    verbose_ = false;
+
+    for (; i < count && height_ <= 1; ++i)
+    {
+        Insert(keys[i]);
+    }
+
+    verbose_ = verbose;
+    if (i == count)
+    {
+        return 0;
+    }
+
+    MessageBuffer& buffer = buffers_[root_];
+    for (; i < count; ++i)
+    {
+        buffer[keys[i]] = true; // 比缓冲模式下已有的消息新，覆盖
+
+        if (bloom_fpr_ > 0 && !bloom_stale_)
+        {
+            bloom_.Add(keys[i]);
+        }
+    }
+
+    if (bloom_fpr_ > 0 && !bloom_stale_ && bloom_.KeyCount() > bloom_.Capacity())
+    {
+        bloom_stale_ = true;
+    }
+
+    FlushRoot(true);
+
+    if (!buffered_)
+    {
+        buffers_.clear(); // 插入消息都推到底了，只剩下空的缓冲区
+    }
+
+    return 0;
+}
+
+inline void DiskBTree::SearchBatch(const KeyType* keys, size_t count, bool* results)
+{
+    vector<pair<KeyType, size_t> > sorted;
+    sorted.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        results[i] = false;
+        if (BloomMayContain(keys[i]))
+        {
+            sorted.push_back(make_pair(keys[i], i));
+        }
+    }
+
+    sort(sorted.begin(), sorted.end());
+    SearchBatchNode(root_, sorted, 0, sorted.size(), results);
+
+    if (bloom_fpr_ > 0)
+    {
+        for (size_t j = 0; j < sorted.size(); ++j)
+        {
+            bloom_stats_.false_positives += results[sorted[j].second] ? 0 : 1;
+        }
+    }
+}
+
+inline void DiskBTree::SearchBatchNode(long r, const vector<pair<KeyType, size_t> >& sorted, size_t first,
+    size_t last, bool* results)
+{
+    if (NIL == r || first == last)
+    {
+        return;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+
+    // 在这个结点中就能确定结果的关键字（缓冲区中有它的消息，或者它就在结点中）返回-1，否则返回它所在的子树
+    auto child_of = [&](size_t j) -> int
+    {
+        const KeyType x = sorted[j].first;
+        bool insert;
+
+        if (FindBuffered(r, x, insert))
+        {
+            results[sorted[j].second] = insert;
+            return -1;
+        }
+
+        const int i = SearchInNode(x, node.k, node.n);
+        if (i < node.n && x == node.k[i])
+        {
+            results[sorted[j].second] = true;
+            return -1;
+        }
+
+        return i;
+    };
+
+    size_t j = first;
+    int i = child_of(j);
+
+    while (j < last)
+    {
+        if (i < 0)
+        {
+            if (++j < last)
+            {
+                i = child_of(j);
+            }
+
+            continue;
+        }
+
+        // 后面落在同一棵子树中的关键字一起下降
+        size_t end = j + 1;
+        int next = -1;
+
+        while (end < last && (next = child_of(end)) == i)
+        {
+            ++end;
+        }
+
+        SearchBatchNode(node.p[i], sorted, j, end, results);
+        j = end;
+        i = next;
+    }
+}
+
+inline void DiskBTree::SetFramePool(long capacity)
+{
+    ClearFrames();
+    frame_capacity_ = max(capacity, 0L);
+}
+
+inline DiskFrame* DiskBTree::RootFrame()
+{
+    if (0 == frame_capacity_ || NIL == root_)
+    {
+        return NULL;
+    }
+
+    if (NULL == root_frame_ || root_frame_->page != root_)
+    {
+        unordered_map<long, DiskFrame*>::const_iterator it = frame_map_.find(root_);
+        root_frame_ = (it != frame_map_.end()) ? it->second : LoadFrame(root_, NULL);
+    }
+
+    if (root_frame_ != NULL)
+    {
+        ++stats_.root_cache_hits;
+    }
+
+    return root_frame_;
+}
+
+inline DiskFrame* DiskBTree::ChildFrame(DiskFrame* f, int i)
+{
+    DiskFrame* c = f->children[i];
+    if (c != NULL)
+    {
+        c->referenced = true;
+        ++stats_.frame_hits;
+        return c;
+    }
+
+    const long r = f->node.p[i];
+    unordered_map<long, DiskFrame*>::const_iterator it = frame_map_.find(r);
+
+    if (it != frame_map_.end())
+    {
+        c = it->second;
+        c->referenced = true;
+        ++stats_.frame_lookups;
+    }
+    else
+    {
+        c = LoadFrame(r, f);
+        if (NULL == c)
+        {
+            return NULL;
+        }
+    }
+
+    DetachFrame(c);
+    c->parent = f;
+    c->slot = i;
+    f->children[i] = c;
+    ++f->swizzled;
+
+    return c;
+}
+
+inline DiskFrame* DiskBTree::LoadFrame(long r, const DiskFrame* keep)
+{
+    DiskFrame* f;
+    if ((long) frames_.size() < frame_capacity_)
+    {
+        f = new DiskFrame;
+        frames_.push_back(f);
+    }
+    else if (NULL == (f = EvictFrame(keep)))
+    {
+        return NULL;
+    }
+
+    f->page = r;
+    f->parent = NULL;
+    f->slot = 0;
+    f->swizzled = 0;
+    f->referenced = true;
+    fill(f->children, f->children + DISK_M, (DiskFrame*) NULL);
+
+    if (r == root_ && root_node_.n > 0)
+    {
+        f->node = root_node_;
+    }
+    else
+    {
+        ReadPage(r, f->node);
+    }
+
+    ++stats_.frame_loads;
+    frame_map_[r] = f;
+    return f;
+}
+
+inline DiskFrame* DiskBTree::EvictFrame(const DiskFrame* keep)
+{
+    // 转两圈：第一圈清零访问位，第二圈还找不到时所有的帧都在用（帧池比树高还小）
+    for (size_t scanned = 0; scanned < 2 * frames_.size(); ++scanned)
+    {
+        DiskFrame* f = frames_[clock_hand_];
+        clock_hand_ = (clock_hand_ + 1) % frames_.size();
+
+        if (NIL == f->page)
+        {
+            return f;
+        }
+
+        if (f == keep || f->swizzled > 0 || f->page == root_)
+        {
+            continue;
+        }
+
+        if (f->referenced)
+        {
+            f->referenced = false;
+            continue;
+        }
+
+        DetachFrame(f);
+        frame_map_.erase(f->page);
+        if (f == root_frame_)
+        {
+            root_frame_ = NULL;
+        }
+
+        ++stats_.frame_evictions;
+        return f;
+    }
+
+    return NULL;
+}
+
+inline void DiskBTree::DetachFrame(DiskFrame* f)
+{
+    if (f->parent != NULL)
+    {
+        f->parent->children[f->slot] = NULL;
+        --f->parent->swizzled;
+        f->parent = NULL;
+    }
+}
+
+inline void DiskBTree::DropFrame(long r)
+{
+    unordered_map<long, DiskFrame*>::iterator it = frame_map_.find(r);
+    if (it == frame_map_.end())
+    {
+        return;
+    }
+
+    DiskFrame* f = it->second;
+    frame_map_.erase(it);
+    DetachFrame(f);
+
+    for (int i = 0; i < order_ && f->swizzled > 0; ++i)
+    {
+        if (f->children[i] != NULL)
+        {
+            DetachFrame(f->children[i]);
+        }
+    }
+
+    f->page = NIL;
+    if (f == root_frame_)
+    {
+        root_frame_ = NULL;
+    }
+}
+
+inline void DiskBTree::UpdateFrame(long r, const DiskNode& node)
+{
+    unordered_map<long, DiskFrame*>::const_iterator it = frame_map_.find(r);
+    if (it == frame_map_.end())
+    {
+        return;
+    }
+
+    DiskFrame* f = it->second;
+    f->node = node;
+
+    if (0 == f->swizzled)
+    {
+        return;
+    }
+
+    // 插入或者删除一个子结点以后，后面的子结点的下标只差1，先在附近找；找不到时再按位置排序后二分查找
+    vector<DiskFrame*> moved;
+    vector<DiskFrame*> children;
+
+    for (int i = 0; i < order_ && (int) children.size() < f->swizzled; ++i)
+    {
+        if (f->children[i] != NULL)
+        {
+            children.push_back(f->children[i]);
+            f->children[i] = NULL;
+        }
+    }
+
+    f->swizzled = 0;
+    vector<pair<long, int> > pages;
+
+    for (size_t j = 0; j < children.size(); ++j)
+    {
+        DiskFrame* c = children[j];
+        int slot = -1;
+
+        for (int d = -1; d <= 1 && slot < 0; ++d)
+        {
+            const int i = c->slot + d;
+            if (i >= 0 && i <= node.n && node.p[i] == c->page)
+            {
+                slot = i;
+            }
+        }
+
+        if (slot < 0)
+        {
+            if (pages.empty())
+            {
+                for (int i = 0; i <= node.n; ++i)
+                {
+                    pages.push_back(make_pair(node.p[i], i));
+                }
+
+                sort(pages.begin(), pages.end());
+            }
+
+            vector<pair<long, int> >::const_iterator p = lower_bound(pages.begin(), pages.end(), make_pair(c->page, 0));
+            if (p != pages.end() && p->first == c->page)
+            {
+                slot = p->second;
+            }
+        }
+
+        if (slot < 0)
+        {
+            c->parent = NULL; // 已经不是这个结点的子结点了
+            continue;
+        }
+
+        c->slot = slot;
+        f->children[slot] = c;
+        ++f->swizzled;
+    }
+}
+
+inline void DiskBTree::ClearFrames()
+{
+    for (size_t i = 0; i < frames_.size(); ++i)
+    {
+        delete frames_[i];
+    }
+
+    frames_.clear();
+    frame_map_.clear();
+    clock_hand_ = 0;
+    root_frame_ = NULL;
+}
+
+inline int DiskBTree::BulkLoad(const KeyType* keys, size_t count)
+{
+    if (root_ != NIL || read_only_)
+    {
+        return -1;
+    }
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (keys[i - 1] >= keys[i])
+        {
+            return -1;
+        }
+    }
+
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    // 最小的高度h：高度为h的子树最多能有order_^h - 1个关键字
+    int h = 1;
+    for (size_t cap = order_; cap < count + 1; cap *= order_)
+    {
+        ++h;
+    }
+
+    SubtreeAgg agg;
+    root_ = BuildNode(keys, 0, count + 1, h, 2, agg);
+    height_ = h;
+    root_node_.n = 0; // Signal for function ReadNode
+    ReadNode(root_, root_node_);
+
+    if (bloom_fpr_ > 0)
+    {
+        bloom_.Init(count, bloom_fpr_);
+        for (size_t i = 0; i < count; ++i)
+        {
+            bloom_.Add(keys[i]);
+        }
+
+        bloom_deleted_ = 0;
+        bloom_stale_ = false;
+    }
+
+    return 0;
+}
+
+inline long DiskBTree::BuildNode(const KeyType* keys, size_t first, size_t s, int h, int min_children,
+    SubtreeAgg& agg)
+{
+    const int N_MIN = (order_ - 1) / 2;
+    DiskNode node;
+
+    if (augmented_ && h > 1)
+    {
+        node.AllocAgg();
+    }
+
+    if (1 == h)
+    {
+        node.n = (int) (s - 1);
+        for (int i = 0; i < node.n; ++i)
+        {
+            node.k[i] = keys[first + i];
+            node.p[i] = NIL;
+        }
+
+        node.p[node.n] = NIL;
+    }
+    else
+    {
+        size_t child_cap = 1; // 高度为h-1的子树最多能有的s：order_^(h-1)
+        for (int i = 1; i < h; ++i)
+        {
+            child_cap *= order_;
+        }
+
+        const int c = max(min_children, (int) ((s + child_cap - 1) / child_cap));
+        node.n = c - 1;
+
+        for (int i = 0; i < c; ++i)
+        {
+            // 子树i包含keys[first, first + child_s - 1)，紧接着的keys[first + child_s - 1]是分隔关键字
+            const size_t child_s = s / c + ((size_t) i < s % c ? 1 : 0);
+            SubtreeAgg child_agg;
+            node.p[i] = BuildNode(keys, first, child_s, h - 1, N_MIN + 1, child_agg);
+            node.SetAgg(i, child_agg);
+
+            first += child_s;
+            if (i < c - 1)
+            {
+                node.k[i] = keys[first - 1];
+            }
+        }
+    }
+
+    // 子树都已经写好了，这个结点追加在它们后面
+    const long r = layout_.EndPage(store_->Size());
+    WriteNode(r, node);
+    ++stats_.allocs;
+
+    agg = NodeAgg(node);
+    return r;
+}
+
+inline int DiskBTree::DeleteRange(KeyType lo, KeyType hi)
+{
+    if (lo > hi || NIL == root_ || read_only_)
+    {
+        return -1;
+    }
+
+    FlushBuffers();
+
+    KeyType sep;
+    bool has_sep = false;
+    SubtreeAgg agg;
+    const bool deleted = DelRange(root_, height_, lo, hi, false, false, sep, has_sep, agg);
+
+    // 根结点没有关键字时降低树高，新的根结点的子树可能还需要调整
+    while (root_ != NIL && 0 == root_node_.n)
+    {
+        CollapseRoot();
+
+        if (root_ != NIL)
+        {
+            FixNode(root_, root_node_, 0, root_node_.n);
+        }
+    }
+
+    if (has_sep && UNDERFLOW == Del(root_, sep, sep))
+    {
+        CollapseRoot();
+    }
+
+    if (deleted && bloom_fpr_ > 0)
+    {
+        bloom_stale_ = true; // 不知道整棵释放的子树中有多少个关键字，重建一次
+    }
+
+    return deleted ? 0 : -1;
+}
+
+inline bool DiskBTree::DelRange(long r, int h, KeyType lo, KeyType hi, bool above_lo, bool below_hi, KeyType& sep,
+    bool& has_sep, SubtreeAgg& agg)
+{
+    if (NIL == r)
+    {
+        agg.count = agg.sum = 0;
+        return false;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+
+    KeyType* k = node.k;
+    long* p = node.p;
+    const int n = node.n;
+    int j;
+
+    const int a = above_lo ? 0 : SearchInNode(lo, k, n); // 范围内的第一个关键字
+    int b = below_hi ? n : SearchInNode(hi, k, n);       // 范围外的第一个关键字
+    if (b < n && k[b] == hi)
+    {
+        ++b;
+    }
+
+    SubtreeAgg agg_a, agg_b; // 两端的子树删除后的聚合值
+
+    if (a == b) // 本结点中没有范围内的关键字，范围（如果有）在p[a]子树中
+    {
+        const bool deleted = DelRange(p[a], h - 1, lo, hi, above_lo && 0 == a, below_hi && n == a, sep, has_sep,
+            agg_a);
+        if (deleted)
+        {
+            if (augmented_)
+            {
+                node.SetAgg(a, agg_a);
+                WriteNode(r, node);
+            }
+
+            FixNode(r, node, a, a);
+        }
+
+        agg = NodeAgg(node);
+        return deleted;
+    }
+
+    if (NIL == p[0]) // 叶结点：直接删掉k[a]到k[b-1]
+    {
+        for (j = a; j < b && node.v != NULL; ++j)
+        {
+            FreeValues(node.v[j]);
+        }
+
+        for (j = b; j < n; ++j)
+        {
+            k[a + j - b] = k[j];
+            node.SetPosting(a + j - b, node.Posting(j));
+        }
+
+        node.n = n - (b - a);
+        WriteNode(r, node);
+
+        agg = NodeAgg(node);
+        return true;
+    }
+
+    // p[a]和p[b]可能只有一部分关键字在范围内，中间的p[a+1]到p[b-1]整棵都在范围内
+    const bool a_partial = !(above_lo && 0 == a);
+    const bool b_partial = !(below_hi && n == b);
+    const bool keep_sep = a_partial && b_partial;
+
+    for (j = (a_partial ? a + 1 : a); j <= (b_partial ? b - 1 : b); ++j)
+    {
+        FreeSubtree(p[j], h - 1);
+    }
+
+    for (j = (keep_sep ? a + 1 : a); j < b && node.v != NULL; ++j)
+    {
+        FreeValues(node.v[j]); // 留下的k[a]最后用Del删除，那时再释放它的值
+    }
+
+    // 留下的依次是：p[0], k[0], ..., p[a-1], k[a-1]，p[a]（a_partial时），k[a]（keep_sep时），p[b]（b_partial时），
+    // 然后是k[b], p[b+1], ..., k[n-1], p[n]
+    int nk = a; // 已经就位的关键字个数
+    int np = a; // 已经就位的子树个数
+
+    if (a_partial)
+    {
+        ++np;
+    }
+
+    if (keep_sep)
+    {
+        sep = k[a];
+        has_sep = true;
+        ++nk;
+    }
+
+    if (b_partial)
+    {
+        node.SetAgg(np, node.Agg(b));
+        p[np++] = p[b];
+    }
+
+    for (j = b; j < n; ++j)
+    {
+        node.SetPosting(nk, node.Posting(j));
+        k[nk++] = k[j];
+        node.SetAgg(np, node.Agg(j + 1));
+        p[np++] = p[j + 1];
+    }
+
+    node.n = nk;
+
+    // 两端的子树修剪后才知道它们的聚合值，所以修剪完再写回r，两端的子树不会读r
+    if (a_partial)
+    {
+        DelRange(p[a], h - 1, lo, hi, false, true, sep, has_sep, agg_a);
+        node.SetAgg(a, agg_a);
+    }
+
+    if (b_partial)
+    {
+        DelRange(p[a_partial ? a + 1 : a], h - 1, lo, hi, true, false, sep, has_sep, agg_b);
+        node.SetAgg(a_partial ? a + 1 : a, agg_b);
+    }
+
+    WriteNode(r, node);
+    FixNode(r, node, a, a_partial && b_partial ? a + 1 : a);
+
+    agg = NodeAgg(node);
+    return true;
+}
+
+inline void DiskBTree::FixNode(long r, DiskNode& node, int first, int last)
+{
+    const int N_MIN = (order_ - 1) / 2;
+
+    if (NIL == node.p[0])
+    {
+        return;
+    }
+
+    DiskNode child;
+    for (int i = max(first, 0); i <= last && i <= node.n && node.n > 0; )
+    {
+        ReadNode(node.p[i], child);
+        if (child.n >= N_MIN)
+        {
+            ++i;
+            continue;
+        }
+
+        const int n = node.n;
+        i = FixChild(r, node, i);
+        last -= n - node.n; // 合并后右边的子树都左移了一位
+    }
+}
+
+inline int DiskBTree::FixChild(long r, DiskNode& node, int i)
+{
+    KeyType* k = node.k;
+    long* p = node.p;
+    const int pivot = (i > 0) ? i - 1 : i; // 优先与左兄弟合并或分配
+    const long pL = p[pivot];
+    const long pR = p[pivot + 1];
+    DiskNode nodeL, nodeR;
+    int j;
+
+    ReadNode(pL, nodeL);
+    ReadNode(pR, nodeR);
+
+    // 不够的子树如果没有关键字，它唯一的子树可能也不够，合并或分配后这棵子树与兄弟相邻了，
+    // 在合并处（pL原来的最后一棵子树和pR的第一棵子树）继续调整
+    const int junction = nodeL.n;
+
+    if (nodeL.n + 1 + nodeR.n <= order_ - 1) // Merge: 将k[pivot]和pR合并到pL中去，释放pR
+    {
+        nodeL.k[nodeL.n] = k[pivot];
+        nodeL.SetPosting(nodeL.n, node.Posting(pivot));
+        nodeL.p[nodeL.n + 1] = nodeR.p[0];
+        nodeL.SetAgg(nodeL.n + 1, nodeR.Agg(0));
+
+        for (j = 0; j < nodeR.n; ++j)
+        {
+            nodeL.k[nodeL.n + 1 + j] = nodeR.k[j];
+            nodeL.SetPosting(nodeL.n + 1 + j, nodeR.Posting(j));
+            nodeL.p[nodeL.n + 2 + j] = nodeR.p[j + 1];
+            nodeL.SetAgg(nodeL.n + 2 + j, nodeR.Agg(j + 1));
+        }
+
+        nodeL.n += 1 + nodeR.n;
+        FreeNode(pR);
+        ++stats_.merges;
+
+        for (j = pivot + 1; j < node.n; ++j)
+        {
+            k[j - 1] = k[j];
+            node.SetPosting(j - 1, node.Posting(j));
+            p[j] = p[j + 1];
+            node.SetAgg(j, node.Agg(j + 1));
+        }
+
+        --node.n;
+        node.SetAgg(pivot, NodeAgg(nodeL)); // 接下来调整pL的子树不会改变pL的聚合值
+        WriteNode(pL, nodeL);
+        WriteNode(r, node);
+
+        FixNode(pL, nodeL, junction, junction + 1);
+        return pivot;
+    }
+
+    // Redistribute: nodeL、k[pivot]、nodeR中的关键字和子树依次排开，平均分给两个结点，中间的那个关键字放回k[pivot]
+    const int total = nodeL.n + 1 + nodeR.n;
+    const int nL = (total - 1) / 2;
+    vector<KeyType> keys(total);
+    vector<DiskPosting> postings(total);
+    vector<long> ptrs(total + 1);
+    vector<SubtreeAgg> aggs(total + 1);
+    int t = 0;
+
+    for (j = 0; j < nodeL.n; ++j, ++t)
+    {
+        keys[t] = nodeL.k[j];
+        postings[t] = nodeL.Posting(j);
+        ptrs[t] = nodeL.p[j];
+        aggs[t] = nodeL.Agg(j);
+    }
+
+    keys[t] = k[pivot];
+    postings[t] = node.Posting(pivot);
+    aggs[t] = nodeL.Agg(nodeL.n);
+    ptrs[t++] = nodeL.p[nodeL.n];
+
+    for (j = 0; j < nodeR.n; ++j, ++t)
+    {
+        keys[t] = nodeR.k[j];
+        postings[t] = nodeR.Posting(j);
+        ptrs[t] = nodeR.p[j];
+        aggs[t] = nodeR.Agg(j);
+    }
+
+    ptrs[t] = nodeR.p[nodeR.n];
+    aggs[t] = nodeR.Agg(nodeR.n);
+
+    if (nL > nodeL.n)
+    {
+        ++stats_.borrow_rights;
+    }
+    else
+    {
+        ++stats_.borrow_lefts;
+    }
+
+    nodeL.n = nL;
+    for (j = 0; j < nL; ++j)
+    {
+        nodeL.k[j] = keys[j];
+        nodeL.SetPosting(j, postings[j]);
+        nodeL.p[j] = ptrs[j];
+        nodeL.SetAgg(j, aggs[j]);
+    }
+
+    nodeL.p[nL] = ptrs[nL];
+    nodeL.SetAgg(nL, aggs[nL]);
+    k[pivot] = keys[nL];
+    node.SetPosting(pivot, postings[nL]);
+
+    nodeR.n = total - 1 - nL;
+    for (j = 0; j < nodeR.n; ++j)
+    {
+        nodeR.k[j] = keys[nL + 1 + j];
+        nodeR.SetPosting(j, postings[nL + 1 + j]);
+        nodeR.p[j] = ptrs[nL + 1 + j];
+        nodeR.SetAgg(j, aggs[nL + 1 + j]);
+    }
+
+    nodeR.p[nodeR.n] = ptrs[total];
+    nodeR.SetAgg(nodeR.n, aggs[total]);
+    node.SetAgg(pivot, NodeAgg(nodeL));
+    node.SetAgg(pivot + 1, NodeAgg(nodeR));
+    WriteNode(pL, nodeL);
+    WriteNode(pR, nodeR);
+    WriteNode(r, node);
+
+    // 合并处在排开后的位置junction和junction + 1，前nL + 1个位置属于pL，其余的属于pR
+    if (junction <= nL)
+    {
+        FixNode(pL, nodeL, junction, junction + 1);
+    }
+
+    if (junction + 1 > nL)
+    {
+        FixNode(pR, nodeR, junction - nL - 1, junction - nL);
+    }
+
+    return pivot; // 调整子树时的合并可能又使pL或pR不够了，从pivot开始再检查一次
+}
+
+inline long DiskBTree::Rank(KeyType x)
+{
+    return augmented_ ? PrefixAgg(x, false).count : -1;
+}
+
+inline int DiskBTree::Select(long k, KeyType& x)
+{
+    if (!augmented_ || k < 0)
+    {
+        return -1;
+    }
+
+    FlushBuffers(); // 缓冲区中的消息没有算进聚合值
+
+    long r = root_;
+    DiskNode node;
+
+    while (r != NIL)
+    {
+        ReadNode(r, node);
+        const bool leaf = (NIL == node.p[0]);
+        int i;
+
+        // 依次跳过p[0], k[0], p[1], k[1], ...，直到第k个关键字落在某棵子树中或者就是某个k[i]
+        for (i = 0; i <= node.n; ++i)
+        {
+            const long count = leaf ? 0 : node.a[i].count;
+            if (k < count)
+            {
+                break;
+            }
+
+            k -= count;
+
+            if (i < node.n)
+            {
+                if (0 == k)
+                {
+                    x = node.k[i];
+                    return 0;
+                }
+
+                --k;
+            }
+        }
+
+        if (i > node.n)
+        {
+            return -1; // k不小于关键字总数
+        }
+
+        r = node.p[i];
+    }
+
+    return -1;
+}
+
+inline long DiskBTree::Count(KeyType lo, KeyType hi)
+{
+    if (!augmented_)
+    {
+        return -1;
+    }
+
+    return (lo <= hi) ? PrefixAgg(hi, true).count - PrefixAgg(lo, false).count : 0;
+}
+
+inline int DiskBTree::Sum(KeyType lo, KeyType hi, long long& sum)
+{
+    if (!augmented_)
+    {
+        return -1;
+    }
+
+    sum = (lo <= hi) ? PrefixAgg(hi, true).sum - PrefixAgg(lo, false).sum : 0;
+    return 0;
+}
+
+inline SubtreeAgg DiskBTree::PrefixAgg(KeyType x, bool inclusive)
+{
+    FlushBuffers(); // 缓冲区中的消息没有算进聚合值
+
+    SubtreeAgg agg = { 0, 0 };
+    long r = root_;
+    DiskNode node;
+
+    while (r != NIL)
+    {
+        ReadNode(r, node);
+        const bool leaf = (NIL == node.p[0]);
+        const int i = SearchInNode(x, node.k, node.n);
+
+        // k[0]到k[i-1]都小于x，p[0]到p[i-1]子树也就都在x的左边
+        for (int j = 0; j < i; ++j)
+        {
+            agg.count += 1;
+            agg.sum += node.k[j];
+
+            if (!leaf)
+            {
+                agg.count += node.a[j].count;
+                agg.sum += node.a[j].sum;
+            }
+        }
+
+        if (i < node.n && x == node.k[i]) // p[i]子树也在x的左边，不必再往下走
+        {
+            if (!leaf)
+            {
+                agg.count += node.a[i].count;
+                agg.sum += node.a[i].sum;
+            }
+
+            if (inclusive)
+            {
+                agg.count += 1;
+                agg.sum += x;
+            }
+
+            break;
+        }
+
+        r = node.p[i];
+    }
+
+    return agg;
+}
+
+inline void DiskBTree::PrintNode(long r, int indent_space_count)
+{
+    if (r != NIL)
+    {
+        int i;
+        cout << setw(indent_space_count) << "";
+
+        DiskNode node;
+        ReadNode(r, node);
+
+        for (i = 0; i < node.n; ++i)
+        {
+            cout << node.k[i] << " ";
+        }
+
+        map<long, MessageBuffer>::const_iterator b = buffers_.find(r);
+        if (b != buffers_.end() && !b->second.empty())
+        {
+            int inserts = 0;
+            for (MessageBuffer::const_iterator m = b->second.begin(); m != b->second.end(); ++m)
+            {
+                inserts += m->second ? 1 : 0;
+            }
+
+            cout << "(buffer: " << inserts << " inserts, " << b->second.size() - inserts << " deletes)";
+        }
+
+        cout << endl;
+
+        for (i = 0; i <= node.n; ++i)
+        {
+            PrintNode(node.p[i], indent_space_count + 8);
+        }
+    }
+}
+
+inline int DiskBTree::SearchInNode(KeyType x, const KeyType* k, int n) const
+{
+    int middle, left = 0, right = n - 1;
+    if (x <= k[left])
+    {
+        return 0;
+    }
+
+    if (x > k[right])
+    {
+        return n;
+    }
+
+    // 二分查找
+    while (right - left > 1)
+    {
+        middle = (right + left) / 2;
+        (x <= k[middle] ? right : left) = middle;
+    }
+
+    return right;
+}
+
+inline Status DiskBTree::Ins(long r, KeyType x, const DiskPosting& xv, KeyType& y, DiskPosting& yv, long& q,
+    SubtreeAgg& q_agg)
+{  // Insert x in *this. If not completely successful, the
+    // integer y and the pointer q remain to be inserted.
+    // Return value:
+    //    SUCCESS, DUPLICATE_KEY, INSERT_NOT_COMPLETE or INSERT_OVERFLOW.
+    if (NIL == r)
+    {
+        y = x;
+        yv = xv;
+        q = NIL;
+        q_agg.count = q_agg.sum = 0;
+        return INSERT_NOT_COMPLETE;
+    }
+
+    KeyType y1;
+    DiskPosting y1v;
+    long q1;
+    SubtreeAgg q1_agg;
+
+    KeyType final_x;
+    DiskPosting final_v;
+    long final_q;
+    SubtreeAgg final_a;
+
+    int i, j, n;
+    Status code;
+
+    DiskNode node, new_node;
+
+    ReadNode(r, node);
+    profiler_.Visit(r);
+    n = node.n;
+
+    i = SearchInNode(x, node.k, n);
+    if (i < n && x == node.k[i])
+    {
+        return DUPLICATE_KEY;
+    }
+
+    code = Ins(node.p[i], x, xv, y1, y1v, q1, q1_agg);
+    if (INSERT_OVERFLOW == code)
+    {
+        return InsOverflow(r, node, i, y, yv, q, q_agg);
+    }
+
+    if (code != INSERT_NOT_COMPLETE)
+    {
+        if (SUCCESS == code && augmented_) // 路径上的每个结点都要更新聚合值
+        {
+            ++node.a[i].count;
+            node.a[i].sum += x;
+            WriteNode(r, node);
+        }
+
+        return code;
+    }
+
+    if (augmented_ && node.p[0] != NIL) // p[i]子树插入了x，分裂出了y1和q1子树，留下的是其余部分
+    {
+        node.a[i].count -= q1_agg.count;
+        node.a[i].sum += (long long) x - y1 - q1_agg.sum;
+    }
+
+    // Insertion in subtree did not completely succeed;
+    // try to Insert y1 and q1 in the current node:
+    if (n < order_ - 1)
+    {
+        i = SearchInNode(y1, node.k, n);
+
+        for (j = n; j > i; --j)
+        {
+            node.k[j] = node.k[j - 1];
+            node.SetPosting(j, node.Posting(j - 1));
+            node.p[j + 1] = node.p[j];
+            node.SetAgg(j + 1, node.Agg(j));
+        }
+
+        node.k[i] = y1;
+        node.SetPosting(i, y1v);
+        node.p[i + 1] = q1;
+        node.SetAgg(i + 1, q1_agg);
+        ++(node.n);
+        WriteNode(r, node);
+
+        return SUCCESS;
+    }
+
+    if (bstar_ && r != root_)
+    {
+        WideNode w;
+        LoadWide(node, w);
+        w.k.insert(w.k.begin() + i, y1);
+        w.v.insert(w.v.begin() + i, y1v);
+        w.p.insert(w.p.begin() + i + 1, q1);
+        w.a.insert(w.a.begin() + i + 1, q1_agg);
+        return SplitWide(r, w, y, yv, q, q_agg);
+    }
+
+    // Current node is full (n == order_ - 1) and will be split.
+    // Pass item k[h] in the middle of the augmented
+    // sequence back via parameter y, so that it
+    // can move upward in the tree. Also, pass a pointer
+    // to the newly created node back via parameter q:
+    if (i == order_ - 1)
+    {
+        final_x = y1;
+        final_v = y1v;
+        final_q = q1;
+        final_a = q1_agg;
+    }
+    else
+    {
+        final_x = node.k[order_ - 2];
+        final_v = node.Posting(order_ - 2);
+        final_q = node.p[order_ - 1];
+        final_a = node.Agg(order_ - 1);
+
+        for (j = order_ - 2; j > i; --j)
+        {
+            node.k[j] = node.k[j - 1];
+            node.SetPosting(j, node.Posting(j - 1));
+            node.p[j + 1] = node.p[j];
+            node.SetAgg(j + 1, node.Agg(j));
+        }
+
+        node.k[i] = y1;
+        node.SetPosting(i, y1v);
+        node.p[i + 1] = q1;
+        node.SetAgg(i + 1, q1_agg);
+    }
+
+    int h = (order_ - 1) / 2;
+    y = node.k[h];           // y and q are passed on to the
+    yv = node.Posting(h);
+    q = GetNode();           // next higher level in the tree
+
+    // The values p[0],k[0],p[1],...,k[h-1],p[h] belong to
+    // the left of k[h] and are kept in *r:
+    node.n = h;
+
+    // p[h+1],k[h+1],p[h+2],...,k[order_-2],p[order_-1],final_x,final_q
+    // belong to the right of k[h] and are moved to *q:
+    new_node.n = order_ - 1 - h;
+    if (node.a != NULL)
+    {
+        new_node.AllocAgg();
+    }
+
+    for (j = 0; j < new_node.n; ++j)
+    {
+        new_node.p[j] = node.p[j + h + 1];
+        new_node.SetAgg(j, node.Agg(j + h + 1));
+        new_node.k[j] = ((j < new_node.n - 1) ? node.k[j + h + 1] : final_x);
+        new_node.SetPosting(j, (j < new_node.n - 1) ? node.Posting(j + h + 1) : final_v);
+    }
+
+    new_node.p[new_node.n] = final_q;
+    new_node.SetAgg(new_node.n, final_a);
+    q_agg = NodeAgg(new_node);
+    WriteNode(r, node);
+    WriteNode(q, new_node);
+    ++stats_.splits;
+
+    return INSERT_NOT_COMPLETE;
+}
+
+inline Status DiskBTree::InsOverflow(long r, DiskNode& node, int i, KeyType& y, DiskPosting& yv, long& q,
+    SubtreeAgg& q_agg)
+{
+    // 先找不满的兄弟，左兄弟优先；两个都满时与右兄弟（没有时与左兄弟）一起分成三个，这时sibling正是它
+    DiskNode sibling;
+    int pivot = -1;
+
+    if (i > 0)
+    {
+        ReadNode(node.p[i - 1], sibling);
+        if (sibling.n < order_ - 1)
+        {
+            pivot = i - 1;
+        }
+    }
+
+    if (pivot < 0 && i < node.n)
+    {
+        ReadNode(node.p[i + 1], sibling);
+        if (sibling.n < order_ - 1)
+        {
+            pivot = i;
+        }
+    }
+
+    if (pivot < 0)
+    {
+        pivot = (i < node.n) ? i : i - 1;
+    }
+
+    WideNode w, ws;
+    LoadWide(node, w);
+    LoadWide(sibling, ws);
+
+    const WideNode& left = (pivot < i) ? ws : overflow_;
+    const WideNode& right = (pivot < i) ? overflow_ : ws;
+    WideNode merged;
+
+    merged.k = left.k;
+    merged.k.push_back(w.k[pivot]);
+    merged.k.insert(merged.k.end(), right.k.begin(), right.k.end());
+    merged.v = left.v;
+    merged.v.push_back(w.v[pivot]);
+    merged.v.insert(merged.v.end(), right.v.begin(), right.v.end());
+    merged.p = left.p;
+    merged.p.insert(merged.p.end(), right.p.begin(), right.p.end());
+    merged.a = left.a;
+    merged.a.insert(merged.a.end(), right.a.begin(), right.a.end());
+
+    vector<long> pages(1, w.p[pivot]);
+    pages.push_back(w.p[pivot + 1]);
+    WriteChildren(r, w, pivot, pivot + 1, merged, pages); // 2M个关键字时分成三个，计入splits
+
+    if ((int) w.k.size() == node.n)
+    {
+        ++stats_.sibling_shifts;
+    }
+
+    if (w.k.size() <= (size_t) order_ - 1)
+    {
+        StoreWide(w, node);
+        WriteNode(r, node);
+        return SUCCESS;
+    }
+
+    return SplitWide(r, w, y, yv, q, q_agg);
+}
+
+inline Status DiskBTree::SplitWide(long r, WideNode& w, KeyType& y, DiskPosting& yv, long& q, SubtreeAgg& q_agg)
+{
+    if (bstar_ && r != root_)
+    {
+        overflow_.k.swap(w.k);
+        overflow_.v.swap(w.v);
+        overflow_.p.swap(w.p);
+        overflow_.a.swap(w.a);
+        return INSERT_OVERFLOW;
+    }
+
+    const int h = (order_ - 1) / 2;
+    DiskNode node, new_node;
+
+    node.n = h;
+    copy(w.k.begin(), w.k.begin() + h, node.k);
+    copy(w.p.begin(), w.p.begin() + h + 1, node.p);
+
+    new_node.n = (int) w.k.size() - h - 1;
+    copy(w.k.begin() + h + 1, w.k.end(), new_node.k);
+    copy(w.p.begin() + h + 1, w.p.end(), new_node.p);
+
+    if (augmented_)
+    {
+        node.AllocAgg();
+        new_node.AllocAgg();
+        copy(w.a.begin(), w.a.begin() + h + 1, node.a);
+        copy(w.a.begin() + h + 1, w.a.end(), new_node.a);
+    }
+
+    if (values_)
+    {
+        node.AllocValues();
+        new_node.AllocValues();
+        copy(w.v.begin(), w.v.begin() + h, node.v);
+        copy(w.v.begin() + h + 1, w.v.end(), new_node.v);
+    }
+
+    y = w.k[h];
+    yv = w.v[h];
+    q = GetNode();
+    q_agg = NodeAgg(new_node);
+    WriteNode(r, node);
+    WriteNode(q, new_node);
+    ++stats_.splits;
+
+    return INSERT_NOT_COMPLETE;
+}
+
+inline bool DiskBTree::AppendKey(KeyType x, const DiskPosting& xv, KeyType& y, DiskPosting& yv, long& q,
+    SubtreeAgg& q_agg, Status& code)
+{
+    if (NIL == root_)
+    {
+        return false;
+    }
+
+    if (right_path_.empty() || right_path_[0] != root_)
+    {
+        right_path_.clear();
+        for (long r = root_; r != NIL; r = right_leaf_.p[right_leaf_.n])
+        {
+            ReadNode(r, right_leaf_);
+            right_path_.push_back(r);
+        }
+    }
+
+    if (0 == right_leaf_.n || x <= right_leaf_.k[right_leaf_.n - 1])
+    {
+        return false;
+    }
+
+    // 从叶结点往上追加(y, q)，left_agg是刚分裂的下层结点留下的部分的聚合值
+    appending_ = true;
+    y = x;
+    yv = xv;
+    q = NIL;
+    q_agg.count = q_agg.sum = 0;
+    SubtreeAgg left_agg = q_agg;
+    DiskNode node, new_node;
+    int level = (int) right_path_.size() - 1;
+
+    for (; level >= 0; --level)
+    {
+        const long r = right_path_[level];
+        DiskNode& cur = (level + 1 == (int) right_path_.size()) ? right_leaf_ : node;
+        if (&cur == &node)
+        {
+            ReadNode(r, node);
+            node.SetAgg(node.n, left_agg);
+        }
+
+        if (cur.n < order_ - 1)
+        {
+            cur.k[cur.n] = y;
+            cur.SetPosting(cur.n, yv);
+            cur.SetAgg(cur.n + 1, q_agg);
+            cur.p[++cur.n] = q;
+            WriteNode(r, cur);
+            break;
+        }
+
+        new_node.n = 1;
+        if (augmented_ && q != NIL)
+        {
+            new_node.AllocAgg();
+        }
+
+        new_node.k[0] = y;
+        new_node.SetPosting(0, yv);
+        new_node.p[0] = cur.p[order_ - 1];
+        new_node.SetAgg(0, cur.Agg(order_ - 1));
+        new_node.p[1] = q;
+        new_node.SetAgg(1, q_agg);
+
+        cur.n = order_ - 2;
+        y = cur.k[order_ - 2];
+        yv = cur.Posting(order_ - 2);
+        q = GetNode();
+        left_agg = NodeAgg(cur);
+        q_agg = NodeAgg(new_node);
+        WriteNode(r, cur);
+        WriteNode(q, new_node);
+        right_path_[level] = q;
+        ++stats_.splits;
+
+        if (&cur == &right_leaf_)
+        {
+            right_leaf_ = new_node;
+        }
+    }
+
+    code = (level < 0) ? INSERT_NOT_COMPLETE : SUCCESS;
+
+    // 增强的B-树中上面各层最右的子树多了x
+    for (--level; augmented_ && level >= 0; --level)
+    {
+        ReadNode(right_path_[level], node);
+        ++node.a[node.n].count;
+        node.a[node.n].sum += x;
+        WriteNode(right_path_[level], node);
+    }
+
+    appending_ = false;
+    ++stats_.appends;
+    return true;
+}
+
+inline Status DiskBTree::Del(long r, KeyType x, KeyType z)
+{
+    if (NIL == r)
+    {
+        return NOT_FOUND;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+    profiler_.Visit(r);
+
+    KeyType* k = node.k;  // k[i] means node.k[i]
+    long* p = node.p;
+    long pL = NIL;
+    long pR = NIL;       // p[i] means node.p[i]
+    int i, j, pivot, n = node.n;
+    const int N_MIN = (order_ - 1) / 2;
+    Status code;
+
+    i = SearchInNode(x, k, n);
+    if (NIL == p[0])  // Are we dealing with a leaf?
+    {
+        if (i == n || x < k[i])
+        {
+            return NOT_FOUND;
+        }
+
+        // x == k[i]
+        if (node.v != NULL)
+        {
+            FreeValues(node.v[i]);
+        }
+
+        for (j = i + 1; j < n; ++j)
+        {
+            k[j - 1] = k[j];
+            node.SetPosting(j - 1, node.Posting(j));
+            p[j] = p[j + 1];
+        }
+
+        --node.n;
+        WriteNode(r, node);
+
+        return CheckUnderflow(r, node, z);
+    }
+
+    // *r is an interior node, not a leaf:
+    KeyType z1 = z; // p[i]子树中少掉的关键字
+
+    if (lazy_delete_ && r != root_ && n < N_MIN)
+    {
+        // 路径上已经不够的结点重新记一次：删除分支结点中的关键字时换上来的是左子树中的最大关键字，
+        // 左子树的范围缩小了，以前记下的关键字可能已经不在r的范围内了
+        pending_keys_.push_back(z);
+    }
+
+    if (i < n && x == k[i])
+    {  // x found in an interior node. Go to left child
+        // and follow a path all the way to a leaf,
+        // using rightmost branches:
+        long q = p[i], q1;
+        int nq;
+        DiskNode node1;
+
+        for (; ;)
+        {
+            ReadNode(q, node1);
+
+            nq = node1.n;
+            q1 = node1.p[nq];
+
+            if (NIL == q1)
+            {
+                break;
+            }
+
+            q = q1;
+        }
+
+        // Exchange k[i] (= x) with rightmost item in leaf:
+        const DiskPosting xv = node.Posting(i);
+        k[i] = node1.k[nq - 1];
+        node.SetPosting(i, node1.Posting(nq - 1));
+        node1.k[nq - 1] = x;
+        node1.SetPosting(nq - 1, xv);
+        z1 = k[i];
+        WriteNode(r, node);
+        WriteNode(q, node1);
+    }
+
+    // Delete x in leaf of subtree with root_ p[i]:
+    code = Del(p[i], x, z1);
+    if (code != NOT_FOUND && augmented_)
+    {
+        --node.a[i].count;
+        node.a[i].sum -= z1;
+    }
+
+    if (code != UNDERFLOW)
+    {
+        if (SUCCESS == code && augmented_) // 路径上的每个结点都要更新聚合值
+        {
+            WriteNode(r, node);
+        }
+
+        return code;
+    }
+
+    // There is underflow; borrow, and, if necessary, merge:
+    // Too few data items in Node *p[i]
+    DiskNode nodeL, nodeR;
+    if (i > 0)
+    {
+        pivot = i - 1;
+        pL = p[pivot];
+        ReadNode(pL, nodeL);
+
+        if (nodeL.n > N_MIN) // Borrow from left sibling
+        {  // k[pivot] between pL and pR:
+            pR = p[i];
+            // Increase contents of *pR, borrowing from *pL:
+            ReadNode(pR, nodeR);
+            nodeR.p[nodeR.n + 1] = nodeR.p[nodeR.n];
+            nodeR.SetAgg(nodeR.n + 1, nodeR.Agg(nodeR.n));
+
+            for (j = nodeR.n; j > 0; --j)
+            {
+                nodeR.k[j] = nodeR.k[j - 1];
+                nodeR.SetPosting(j, nodeR.Posting(j - 1));
+                nodeR.p[j] = nodeR.p[j - 1];
+                nodeR.SetAgg(j, nodeR.Agg(j - 1));
+            }
+
+            ++(nodeR.n);
+            nodeR.k[0] = k[pivot];
+            nodeR.SetPosting(0, node.Posting(pivot));
+            nodeR.p[0] = nodeL.p[nodeL.n];
+            nodeR.SetAgg(0, nodeL.Agg(nodeL.n));
+            k[pivot] = nodeL.k[--nodeL.n];
+            node.SetPosting(pivot, nodeL.Posting(nodeL.n));
+            node.SetAgg(pivot, NodeAgg(nodeL));
+            node.SetAgg(i, NodeAgg(nodeR));
+            ++stats_.borrow_lefts;
+
+            WriteNode(pL, nodeL);
+            WriteNode(pR, nodeR);
+            WriteNode(r, node);
+
+            if (lazy_delete_ && nodeR.n < N_MIN) // 推迟调整时p[i]原来没有关键字了，借到一个还是不够
+            {
+                pending_keys_.push_back(z1);
+                ++stats_.lazy_deletes;
+            }
+
+            return SUCCESS;
+        }
+    }
+
+    pivot = i;
+
+    if (i < n)
+    {
+        pR = p[pivot + 1];
+        ReadNode(pR, nodeR);
+
+        if (nodeR.n > N_MIN) // Borrow from right sibling
+        {  // k[pivot] between pL and pR:
+            pL = p[pivot];
+            ReadNode(pL, nodeL);
+
+            // Increase contents of *pL, borrowing from *pR:
+            nodeL.k[nodeL.n] = k[pivot];
+            nodeL.SetPosting(nodeL.n, node.Posting(pivot));
+            nodeL.p[nodeL.n + 1] = nodeR.p[0];
+            nodeL.SetAgg(nodeL.n + 1, nodeR.Agg(0));
+            k[pivot] = nodeR.k[0];
+            node.SetPosting(pivot, nodeR.Posting(0));
+            ++(nodeL.n);
+            --(nodeR.n);
+
+            for (j = 0; j < nodeR.n; ++j)
+            {
+                nodeR.k[j] = nodeR.k[j + 1];
+                nodeR.SetPosting(j, nodeR.Posting(j + 1));
+                nodeR.p[j] = nodeR.p[j + 1];
+                nodeR.SetAgg(j, nodeR.Agg(j + 1));
+            }
+
+            nodeR.p[nodeR.n] = nodeR.p[nodeR.n + 1];
+            nodeR.SetAgg(nodeR.n, nodeR.Agg(nodeR.n + 1));
+            node.SetAgg(pivot, NodeAgg(nodeL));
+            node.SetAgg(pivot + 1, NodeAgg(nodeR));
+            ++stats_.borrow_rights;
+            WriteNode(pL, nodeL);
+            WriteNode(pR, nodeR);
+            WriteNode(r, node);
+
+            if (lazy_delete_ && nodeL.n < N_MIN)
+            {
+                pending_keys_.push_back(z1);
+                ++stats_.lazy_deletes;
+            }
+
+            return SUCCESS;
+        }
+    }
+
+    // Merge; neither borrow left nor borrow right possible.
+    pivot = ((i == n) ? i - 1 : i);
+    pL = p[pivot];
+    pR = p[pivot + 1];
+
+    // Add k[pivot] and *pR to *pL:
+    ReadNode(pL, nodeL);
+    ReadNode(pR, nodeR);
+    nodeL.k[nodeL.n] = k[pivot];
+    nodeL.SetPosting(nodeL.n, node.Posting(pivot));
+    nodeL.p[nodeL.n + 1] = nodeR.p[0];
+    nodeL.SetAgg(nodeL.n + 1, nodeR.Agg(0));
+
+    for (j = 0; j < nodeR.n; ++j)
+    {
+        nodeL.k[nodeL.n + 1 + j] = nodeR.k[j];
+        nodeL.SetPosting(nodeL.n + 1 + j, nodeR.Posting(j));
+        nodeL.p[nodeL.n + 2 + j] = nodeR.p[j + 1];
+        nodeL.SetAgg(nodeL.n + 2 + j, nodeR.Agg(j + 1));
+    }
+
+    nodeL.n += 1 + nodeR.n;
+    FreeNode(pR);
+    ++stats_.merges;
+
+    for (j = i + 1; j < n; ++j)
+    {
+        k[j - 1] = k[j];
+        node.SetPosting(j - 1, node.Posting(j));
+        p[j] = p[j + 1];
+        node.SetAgg(j, node.Agg(j + 1));
+    }
+
+    --(node.n);
+    node.SetAgg(pivot, NodeAgg(nodeL));
+    WriteNode(pL, nodeL);
+    WriteNode(r, node);
+
+    return CheckUnderflow(r, node, z);
+}
+
+inline void DiskBTree::ReadNode(long r, DiskNode& node)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    if (r == root_ && root_node_.n > 0)
+    {
+        node = root_node_; // 根结点常驻内存
+        ++stats_.root_cache_hits;
+        return;
+    }
+
+    if (frame_capacity_ > 0)
+    {
+        unordered_map<long, DiskFrame*>::const_iterator it = frame_map_.find(r);
+        DiskFrame* f = (it != frame_map_.end()) ? it->second : LoadFrame(r, NULL);
+
+        if (f != NULL)
+        {
+            if (it != frame_map_.end())
+            {
+                f->referenced = true;
+                ++stats_.frame_lookups;
+            }
+
+            node = f->node;
+            return;
+        }
+    }
+
+    ReadPage(r, node);
+}
+
+inline void DiskBTree::ReadPage(long r, DiskNode& node)
+{
+    ++stats_.reads;
+    const uint64_t start_ns = profiler_.Sampled() ? OpProfiler::NowNs() : 0;
+
+    if (DISK_M == order_ && !augmented_ && !values_) // 布局与DiskNode相同
+    {
+        store_->Read(r, &node, layout_.node_size);
+    }
+    else
+    {
+        store_->Read(r, page_buf_.data(), layout_.node_size);
+        UnpackDiskNode(layout_, page_buf_.data(), node);
+    }
+
+    if (start_ns > 0)
+    {
+        profiler_.AddIo(OpProfiler::NowNs() - start_ns);
+    }
+}
+
+inline void DiskBTree::WriteNode(long r, const DiskNode& node)
+{
+    if (!appending_ && !right_path_.empty() && find(right_path_.begin(), right_path_.end(), r) != right_path_.end())
+    {
+        right_path_.clear(); // 别的操作改了最右路径上的结点，下一次追加时重新往下走一趟
+    }
+
+    if (r == root_)
+    {
+        root_node_ = node;
+    }
+
+    if (node.p[0] != NIL)
+    {
+        ++version_; // 分隔关键字或者子结点可能变了
+    }
+
+    if (!frame_map_.empty())
+    {
+        UpdateFrame(r, node);
+    }
+
+    ++stats_.writes;
+    stats_.bytes_written += layout_.node_size;
+    const uint64_t start_ns = profiler_.Sampled() ? OpProfiler::NowNs() : 0;
+
+    if (DISK_M == order_ && !augmented_ && !values_)
+    {
+        store_->Write(r, &node, layout_.node_size);
+    }
+    else
+    {
+        PackDiskNode(layout_, node, page_buf_.data());
+        store_->Write(r, page_buf_.data(), layout_.node_size);
+    }
+
+    if (start_ns > 0)
+    {
+        profiler_.AddIo(OpProfiler::NowNs() - start_ns);
+    }
+}
+
+inline long DiskBTree::GetNode()  // Modified (see also the destructor DiskBTreeTree)
+{
+    long r;
+    DiskNode node;
+
+    ++stats_.allocs;
+    if (NIL == free_list_)
+    {
+        // 增加一个node
+        // Allocate space on disk; if file length is an odd number, the new node will overwrite signature byte at end of file
+        r = layout_.EndPage(store_->Size()); // 去掉签名字节后对齐到页
+        WriteNode(r, node);
+    }
+    else
+    {
+        // 取free_list的第一个元素
+        r = free_list_;
+        ReadNode(r, node);        // To update free_list:
+        free_list_ = node.p[0];     // Reduce the free list by 1
+    }
+
+    return r;
+}
+
+inline SubtreeAgg DiskBTree::NodeAgg(const DiskNode& node) const
+{
+    SubtreeAgg agg = { 0, 0 };
+    if (!augmented_)
+    {
+        return agg;
+    }
+
+    agg.count = node.n;
+    for (int i = 0; i < node.n; ++i)
+    {
+        agg.sum += node.k[i];
+    }
+
+    for (int i = 0; node.p[0] != NIL && i <= node.n; ++i)
+    {
+        agg.count += node.a[i].count;
+        agg.sum += node.a[i].sum;
+    }
+
+    return agg;
+}
+
+inline void DiskBTree::FreeNode(long r)
+{
+    if (!right_path_.empty() && find(right_path_.begin(), right_path_.end(), r) != right_path_.end())
+    {
+        right_path_.clear();
+    }
+
+    ++version_;
+    if (!frame_map_.empty())
+    {
+        DropFrame(r);
+    }
+
+    // 空闲结点中只用到p[0]（链到下一个空闲结点），只写这一个字段
+    ++stats_.frees;
+    ++stats_.writes;
+    stats_.bytes_written += sizeof(free_list_);
+    store_->Write(r + layout_.p_offset, &free_list_, sizeof(free_list_));
+    free_list_ = r;
+}
+
+inline bool DiskBTree::FindKey(KeyType x, long& r, DiskNode& node, int& i)
+{
+    for (r = root_; r != NIL; r = node.p[i])
+    {
+        ReadNode(r, node);
+        i = SearchInNode(x, node.k, node.n);
+        if (i < node.n && x == node.k[i])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline void DiskBTree::DecodeValues(const DiskPosting& posting, vector<ValueType>& values)
+{
+    ValueType value = 0;
+    uint32_t count = 0;
+
+    if (posting.IsInline())
+    {
+        DecodePostingBytes(posting.data, posting.size, value, count, values);
+        return;
+    }
+
+    DiskPostingPage page;
+    for (long r = posting.pages[0]; r != NIL; r = page.next)
+    {
+        ReadPostingPage(r, page);
+        DecodePostingBytes((const unsigned char*) posting_buf_.data() + sizeof(page), page.used, value, count,
+            values);
+    }
+}
+
+inline void DiskBTree::AddValue(DiskPosting& posting, ValueType value)
+{
+    unsigned char bytes[POSTING_MAX_VARINT];
+
+    if (0 == posting.count)
+    {
+        posting.size = PutVarint(ZigZag(value), bytes);
+        memcpy(posting.data, bytes, posting.size);
+        posting.count = 1;
+        return;
+    }
+
+    // 结点中的编码和比最大值小的值都整个重新编码；溢出页中的最大值在最后一页的页头中
+    DiskPostingPage page;
+    if (!posting.IsInline())
+    {
+        ReadPostingPage(posting.pages[1], page);
+    }
+
+    if (posting.IsInline() || value < page.last)
+    {
+        vector<ValueType> values;
+        values.reserve(posting.count + 1);
+        DecodeValues(posting, values);
+        values.insert(upper_bound(values.begin(), values.end(), value), value);
+        RebuildValues(posting, values);
+        return;
+    }
+
+    const int n = PutVarint((uint64_t) value - (uint64_t) page.last, bytes);
+    if (page.used + n > layout_.PostingCapacity())
+    {
+        // 最后一页放不下，新开一页链到它后面
+        const long r = GetPostingPage();
+        page.next = r;
+        WritePostingPage(posting.pages[1], page);
+
+        page.next = NIL;
+        page.used = 0;
+        posting.pages[1] = r;
+    }
+
+    memcpy(posting_buf_.data() + sizeof(page) + page.used, bytes, n);
+    page.last = value;
+    page.used += n;
+    WritePostingPage(posting.pages[1], page);
+
+    posting.size += n;
+    ++posting.count;
+}
+
+inline void DiskBTree::RebuildValues(DiskPosting& posting, const vector<ValueType>& values)
+{
+    FreeValues(posting);
+    if (values.empty())
+    {
+        return;
+    }
+
+    vector<unsigned char> code(values.size() * POSTING_MAX_VARINT);
+    vector<uint32_t> ends(values.size()); // 每个值的编码的结尾，分页时一个值的编码不跨页
+    uint32_t size = 0;
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const uint64_t x = (0 == i) ? ZigZag(values[0]) : (uint64_t) values[i] - (uint64_t) values[i - 1];
+        size += PutVarint(x, code.data() + size);
+        ends[i] = size;
+    }
+
+    posting.count = (uint32_t) values.size();
+    posting.size = size;
+    if (posting.IsInline())
+    {
+        memcpy(posting.data, code.data(), size);
+        return;
+    }
+
+    DiskPostingPage page = { NIL, 0, 0 };
+    long r = GetPostingPage();
+    uint32_t start = 0; // 当前页的第一个字节在code中的位置
+    posting.pages[0] = r;
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (ends[i] - start > layout_.PostingCapacity())
+        {
+            const long next = GetPostingPage();
+            page.next = next;
+            page.used = (i > 0 ? ends[i - 1] : 0) - start;
+            memcpy(posting_buf_.data() + sizeof(page), code.data() + start, page.used);
+            WritePostingPage(r, page);
+
+            r = next;
+            start += page.used;
+        }
+
+        page.last = values[i];
+    }
+
+    page.next = NIL;
+    page.used = size - start;
+    memcpy(posting_buf_.data() + sizeof(page), code.data() + start, page.used);
+    WritePostingPage(r, page);
+    posting.pages[1] = r;
+}
+
+inline void DiskBTree::FreeValues(DiskPosting& posting)
+{
+    if (!posting.IsInline())
+    {
+        DiskPostingPage page;
+        for (long r = posting.pages[0]; r != NIL; r = page.next)
+        {
+            ++stats_.reads;
+            store_->Read(r, &page, sizeof(page)); // 只要页头中的next
+            FreeNode(r);
+        }
+    }
+
+    posting = DiskPosting();
+}
+
+inline long DiskBTree::GetPostingPage()
+{
+    const long r = GetNode();
+    if (!frame_map_.empty())
+    {
+        DropFrame(r); // 从空闲链表取出时ReadNode可能把它装进了帧池
+    }
+
+    return r;
+}
+
+inline void DiskBTree::ReadPostingPage(long r, DiskPostingPage& page)
+{
+    ++stats_.reads;
+    store_->Read(r, posting_buf_.data(), layout_.page_size);
+    memcpy(&page, posting_buf_.data(), sizeof(page));
+}
+
+inline void DiskBTree::WritePostingPage(long r, const DiskPostingPage& page)
+{
+    ++stats_.writes;
+    stats_.bytes_written += layout_.page_size;
+    memcpy(posting_buf_.data(), &page, sizeof(page));
+    store_->Write(r, posting_buf_.data(), layout_.page_size);
+}
+
+inline void DiskBTree::FreeSubtree(long r, int h)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    if (h > 1 || values_)
+    {
+        DiskNode node;
+        ReadNode(r, node);
+
+        for (int i = 0; i < node.n && node.v != NULL; ++i)
+        {
+            FreeValues(node.v[i]);
+        }
+
+        for (int i = 0; h > 1 && i <= node.n; ++i)
+        {
+            FreeSubtree(node.p[i], h - 1);
+        }
+    }
+
+    FreeNode(r);
+}
+
+inline void DiskBTree::CollapseRoot()
+{
+    long root = root_;
+    root_ = root_node_.p[0];
+    FreeNode(root);
+    --height_;
+
+    if (root_ != NIL)
+    {
+        ReadNode(root_, root_node_);
+    }
+}
+
+inline bool DiskBTree::BloomMayContain(KeyType x)
+{
+    if (bloom_fpr_ <= 0)
+    {
+        return true;
+    }
+
+    if (bloom_stale_)
+    {
+        RebuildBloomFilter();
+    }
+
+    ++bloom_stats_.probes;
+
+    if (bloom_.MayContain(x))
+    {
+        return true;
+    }
+
+    ++bloom_stats_.negatives;
+    bloom_stats_.reads_saved += height_;
+    return false;
+}
+
+inline void DiskBTree::BloomAdd(KeyType x)
+{
+    if (bloom_fpr_ > 0 && !bloom_stale_)
+    {
+        bloom_.Add(x);
+        if (bloom_.KeyCount() > bloom_.Capacity())
+        {
+            bloom_stale_ = true; // 超出容量后误判率上升，重建时按新的关键字个数扩容
+        }
+    }
+}
+
+inline void DiskBTree::RebuildBloomFilter()
+{
+    // 按当前关键字个数的2倍分配容量，避免接下来的插入很快又触发重建。
+    // 没有可用的过滤器时用结点个数估算关键字个数的上限
+    long capacity = 2 * (bloom_.KeyCount() - bloom_deleted_);
+    if (0 == bloom_.Capacity())
+    {
+        capacity = (long) (store_->Size() / layout_.page_size) * (order_ - 1);
+    }
+
+    bloom_.Init(capacity, bloom_fpr_);
+    AddToBloomFilter(root_);
+
+    // 缓冲区中还没有落到叶结点的插入
+    for (map<long, MessageBuffer>::const_iterator b = buffers_.begin(); b != buffers_.end(); ++b)
+    {
+        for (MessageBuffer::const_iterator m = b->second.begin(); m != b->second.end(); ++m)
+        {
+            if (m->second)
+            {
+                bloom_.Add(m->first);
+            }
+        }
+    }
+
+    bloom_deleted_ = 0;
+    bloom_stale_ = false;
+    ++bloom_stats_.rebuilds;
+}
+
+inline void DiskBTree::AddToBloomFilter(long r)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+
+    for (int i = 0; i < node.n; ++i)
+    {
+        bloom_.Add(node.k[i]);
+    }
+
+    if (node.p[0] != NIL)
+    {
+        for (int i = 0; i <= node.n; ++i)
+        {
+            AddToBloomFilter(node.p[i]);
+        }
+    }
+}
+
+inline DiskBTreeStats DiskBTree::Stats(bool scan_nodes)
+{
+    DiskBTreeStats stats = stats_;
+
+    stats.height = height_;
+    stats.frame_count = (long) frame_map_.size();
+    stats.buffered_count = 0;
+    stats.node_count = -1;
+    stats.key_count = -1;
+    stats.underfull_count = -1;
+    stats.fill_factor = -1;
+    stats.value_count = -1;
+    stats.posting_page_count = -1;
+
+    for (map<long, MessageBuffer>::const_iterator b = buffers_.begin(); b != buffers_.end(); ++b)
+    {
+        stats.buffered_count += (long) b->second.size();
+    }
+
+    if (scan_nodes)
+    {
+        stats.node_count = 0;
+        stats.key_count = 0;
+        stats.underfull_count = 0;
+        stats.value_count = 0;
+        stats.posting_page_count = 0;
+        CountNode(root_, stats);
+        stats.fill_factor = (stats.node_count > 0) ? (double) stats.key_count / (stats.node_count * (order_ - 1)) : 0;
+        stats_ = stats; // 遍历时的读不计入
+        stats_.node_count = stats_.key_count = stats_.underfull_count = -1;
+        stats_.value_count = stats_.posting_page_count = -1;
+        stats_.fill_factor = -1;
+    }
+
+    return stats;
+}
+
+inline void DiskBTree::PrintStats()
+{
+    const DiskBTreeStats stats = Stats(true);
+
+    cout << "Statistics:" << endl
+        << "  order: " << order_ << ", page size: " << layout_.page_size << ", store: " << store_->Name() << endl
+        << "  reads: " << stats.reads << ", root cache hits: " << stats.root_cache_hits
+        << ", writes: " << stats.writes << endl
+        << "  allocs: " << stats.allocs << ", frees: " << stats.frees << endl
+        << "  splits: " << stats.splits << ", sibling shifts: " << stats.sibling_shifts
+        << ", appends: " << stats.appends << ", borrow lefts: " << stats.borrow_lefts
+        << ", borrow rights: " << stats.borrow_rights << ", merges: " << stats.merges << endl
+        << "  lazy deletes: " << stats.lazy_deletes << ", compactions: " << stats.compactions
+        << ", underfull nodes: " << stats.underfull_count << endl
+        << "  bytes written: " << stats.bytes_written << ", by deletes: " << stats.delete_bytes_written
+        << " (" << setprecision(6) << (stats.deletes > 0 ? (double) stats.delete_bytes_written / stats.deletes : 0)
+        << " per delete)" << endl
+        << "  buffered ops: " << stats.buffered_ops << ", buffer flushes: " << stats.buffer_flushes
+        << ", buffered messages: " << stats.buffered_count << endl
+        << "  frame hits: " << stats.frame_hits << ", frame lookups: " << stats.frame_lookups << ", frame loads: "
+        << stats.frame_loads << ", evictions: " << stats.frame_evictions << ", frames: " << stats.frame_count << endl
+        << "  height: " << stats.height << ", nodes: " << stats.node_count << ", keys: " << stats.key_count
+        << ", fill factor: " << setprecision(3) << stats.fill_factor << endl;
+
+    if (values_)
+    {
+        cout << "  values: " << stats.value_count << ", posting pages: " << stats.posting_page_count << endl;
+    }
+
+    if (bloom_fpr_ > 0)
+    {
+        cout << "  Bloom filter probes: " << bloom_stats_.probes << ", negatives: " << bloom_stats_.negatives
+            << ", false positives: " << bloom_stats_.false_positives << ", reads saved: " << bloom_stats_.reads_saved
+            << ", rebuilds: " << bloom_stats_.rebuilds << endl;
+    }
+}
+
+inline void DiskBTree::CountNode(long r, DiskBTreeStats& stats)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+
+    ++stats.node_count;
+    stats.key_count += node.n;
+
+    if (r != root_ && node.n < (order_ - 1) / 2)
+    {
+        ++stats.underfull_count;
+    }
+
+    for (int i = 0; i < node.n && node.v != NULL; ++i)
+    {
+        stats.value_count += node.v[i].count;
+
+        DiskPostingPage page;
+        for (long q = node.v[i].IsInline() ? (long) NIL : node.v[i].pages[0]; q != NIL; q = page.next)
+        {
+            ++stats.posting_page_count;
+            store_->Read(q, &page, sizeof(page));
+        }
+    }
+
+    if (node.p[0] != NIL)
+    {
+        for (int i = 0; i <= node.n; ++i)
+        {
+            CountNode(node.p[i], stats);
+        }
+    }
+}
+
+inline void DiskBTree::ScanNode(long r, KeyType lo, KeyType hi, vector<KeyType>& keys, MessageBuffer* messages,
+    size_t limit)
+{
+    if (NIL == r || keys.size() >= limit)
+    {
+        return;
+    }
+
+    DiskNode node;
+    ReadNode(r, node);
+    profiler_.Visit(r);
+
+    map<long, MessageBuffer>::const_iterator b = (messages != NULL) ? buffers_.find(r) : buffers_.end();
+    if (b != buffers_.end())
+    {
+        // 先序遍历，上层的消息先收集，insert不覆盖已有的
+        messages->insert(b->second.lower_bound(lo), b->second.upper_bound(hi));
+    }
+
+    // p[i]子树中的关键字在k[i-1]和k[i]之间，从第一个不小于lo的关键字开始
+    int i = (node.n > 0) ? SearchInNode(lo, node.k, node.n) : 0;
+
+    for (; i < node.n && node.k[i] <= hi; ++i)
+    {
+        ScanNode(node.p[i], lo, hi, keys, messages, limit);
+        if (keys.size() >= limit)
+        {
+            return;
+        }
+
+        keys.push_back(node.k[i]);
+    }
+
+    ScanNode(node.p[i], lo, hi, keys, messages, limit);
+}
+
+inline void DiskBTree::ReadStart()
+{
+    long start[2];
+    store_->Read(0L, start, 2 * sizeof(long));
+    root_ = start[0];
+    free_list_ = start[1];
+    ReadNode(root_, root_node_);
+}
+
+#endif // DISK_BTREE_H
@@ -0,0 +1,679 @@
+// export_tree: 把DiskBTree文件中的全部关键字按从小到大的顺序导出，用于备份或者给下游做归并连接
+//
+// 用法：export_tree in=FILE out=FILE [name=value ...]
+//   out=FILE     输出文件，为-时写到标准输出
+//   format=F     binary（默认）：二进制关键字文件；text：每行一个十进制整数。两种都是key_file.h的格式，
+//                可以再用DiskBTree::Insert(const char*)装回去
+//   chunks=0|1   为1时不合成一个文件，每个分区写一个out.00000、out.00001……（按关键字顺序编号，
+//                每个都是完整的关键字文件），并打印每块的关键字范围，默认0
+//   threads=N    线程数，默认是CPU个数
+//
+// 文件映射进来就地读。从根往下逐层展开，直到子树个数够分给各个线程（或者到了叶结点），相邻的几棵子树连同它们
+// 后面的分隔关键字合成一个分区。各线程按顺序领取分区，中序遍历子树，进入分支结点时先对所有子结点madvise(MADV_WILLNEED)
+// 让内核提前并发地读进来。合成一个文件时，分区的输出先放在内存中，由主线程按分区的顺序写出；领取的分区最多
+// 比已写出的超前EXPORT_WINDOW_PER_THREAD * 线程数个，所以占用的内存不随文件大小增长。
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "disk_btree.h"
+#include "workload.h"
+
+using namespace std;
+
+const int TASKS_PER_THREAD = 8;          // 展开到分区个数不少于这么多倍的线程数
+const int EXPORT_WINDOW_PER_THREAD = 2;  // 合成一个文件时每个线程最多超前的分区个数
+const size_t WRITE_BLOCK = 4 << 20;      // 输出缓冲区满了这么多字节就写出（按块输出时）
+const size_t MAX_KEY_CHARS = 12;         // 一个关键字的文本加换行最多的字节数
+
+// 一棵子树，和（最后一棵以外）它后面的分隔关键字
+struct ExportSubtree
+{
+    long page;
+    int height;   // 子树的高度，叶结点为0
+    bool has_sep;
+    KeyType sep;
+};
+
+// 一个分区的导出结果
+struct ExportResult
+{
+    long long keys;
+    KeyType first;
+    KeyType last;
+    bool done;
+};
+
+/**
+ * @brief 关键字的输出缓冲区。fd < 0时全部留在内存中，否则满了就写到fd
+ */
+class KeySink
+{
+public:
+    KeySink(bool binary, int fd) : binary_(binary), fd_(fd), used_(0), error_(false)
+    {
+        data_.resize(fd_ >= 0 ? WRITE_BLOCK + MAX_KEY_CHARS : 64 * 1024);
+    }
+
+    void Put(KeyType x)
+    {
+        if (used_ + MAX_KEY_CHARS > data_.size())
+        {
+            Grow();
+        }
+
+        if (binary_)
+        {
+            PutKeyLE((unsigned char*) &data_[used_], x);
+            used_ += sizeof(int32_t);
+        }
+        else
+        {
+            char* end = to_chars(&data_[used_], &data_[used_] + MAX_KEY_CHARS, x).ptr;
+            *end++ = '\n';
+            used_ = end - &data_[0];
+        }
+    }
+
+    void PutHeader()
+    {
+        if (binary_)
+        {
+            memcpy(&data_[used_], KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC));
+            used_ += sizeof(KEY_FILE_MAGIC);
+        }
+    }
+
+    /**
+     * @return =0成功，写文件出错时返回-1
+     */
+    int Flush()
+    {
+        if (fd_ >= 0 && used_ > 0)
+        {
+            error_ = error_ || WriteAll(fd_, &data_[0], used_) != 0;
+            used_ = 0;
+        }
+
+        return error_ ? -1 : 0;
+    }
+
+    const char* Data() const
+    {
+        return &data_[0];
+    }
+
+    size_t Size() const
+    {
+        return used_;
+    }
+
+    static int WriteAll(int fd, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t n = write(fd, data, size);
+            if (n <= 0)
+            {
+                return -1;
+            }
+
+            data += n;
+            size -= n;
+        }
+
+        return 0;
+    }
+
+private:
+    void Grow()
+    {
+        if (fd_ >= 0)
+        {
+            Flush();
+            return;
+        }
+
+        data_.resize(data_.size() * 2);
+    }
+
+    bool binary_;
+    int fd_;
+    vector<char> data_;
+    size_t used_;
+    bool error_;
+};
+
+class TreeExporter
+{
+public:
+    TreeExporter(const char* base, long size, const DiskFileLayout& layout)
+        : base_(base), size_(size), layout_(layout), failed_(false)
+    {
+    }
+
+    /**
+     * @brief 从根往下展开出分区
+     * @return =0成功，文件中的树不完整时返回-1
+     */
+    int Partition(long root, int thread_count);
+
+    /**
+     * @brief 导出所有的分区，fd是合成的输出文件，chunk_prefix不为NULL时改为每个分区写一个文件
+     * @return =0成功，否则失败（错误在Error()中）
+     */
+    int Run(int fd, const char* chunk_prefix, bool binary, int thread_count);
+
+    const vector<ExportResult>& Results() const
+    {
+        return results_;
+    }
+
+    const string& Error() const
+    {
+        return error_;
+    }
+
+private:
+    /**
+     * @return r是不是文件中有效的结点位置
+     */
+    bool IsPage(long r) const
+    {
+        return r >= layout_.header_size && r + (long) layout_.node_size <= size_
+            && (r - layout_.header_size) % layout_.page_size == 0;
+    }
+
+    DiskPageView View(long r) const
+    {
+        return DiskPageView(base_ + r, layout_);
+    }
+
+    /**
+     * @brief 检查结点r的关键字个数和链接，height是它应有的高度
+     */
+    bool CheckNode(long r, int height);
+
+    /**
+     * @brief 让内核提前读进分支结点r的所有子结点
+     */
+    void Prefetch(const DiskPageView& view, int n) const;
+
+    /**
+     * @brief 中序遍历子树r，把关键字依次放进sink，同时检查关键字是严格递增的
+     */
+    bool Walk(long r, int height, KeySink& sink, ExportResult& result);
+
+    /**
+     * @brief 输出子树中紧跟在前面的关键字之后的x
+     */
+    bool Emit(KeyType x, long r, KeySink& sink, ExportResult& result);
+    bool ExportPartition(size_t i, KeySink& sink);
+    void Fail(const string& message);
+
+    const char* base_;
+    long size_;
+    const DiskFileLayout& layout_;
+    vector<ExportSubtree> subtrees_; // 按关键字顺序
+    vector<size_t> partitions_;      // 第i个分区是subtrees_[partitions_[i]]到subtrees_[partitions_[i + 1] - 1]
+    vector<ExportResult> results_;
+    atomic<bool> failed_;
+    mutex error_mutex_;
+    string error_;
+};
+
+inline void TreeExporter::Fail(const string& message)
+{
+    lock_guard<mutex> lock(error_mutex_);
+    if (!failed_)
+    {
+        error_ = message;
+        failed_ = true;
+    }
+}
+
+inline bool TreeExporter::CheckNode(long r, int height)
+{
+    if (!IsPage(r))
+    {
+        Fail("link " + to_string(r) + " is not a node position");
+        return false;
+    }
+
+    const DiskPageView view = View(r);
+    const int n = view.N();
+    if (n < 0 || n > layout_.order - 1)
+    {
+        Fail("node " + to_string(r) + ": n = " + to_string(n) + " out of range");
+        return false;
+    }
+
+    if ((0 == height) != (-1 == view.Link(0)))
+    {
+        Fail("node " + to_string(r) + ": leaves are not all at the same depth");
+        return false;
+    }
+
+    return true;
+}
+
+inline int TreeExporter::Partition(long root, int thread_count)
+{
+    subtrees_.clear();
+    partitions_.assign(1, 0);
+    if (-1 == root)
+    {
+        return 0;
+    }
+
+    // 沿最左的链接得到树的高度
+    int height = 0;
+    for (long r = root; ; ++height)
+    {
+        if (!IsPage(r) || height > 64)
+        {
+            Fail("link " + to_string(r) + " is not a node position");
+            return -1;
+        }
+
+        r = View(r).Link(0);
+        if (-1 == r)
+        {
+            break;
+        }
+    }
+
+    const size_t target = (size_t) thread_count * TASKS_PER_THREAD;
+    ExportSubtree subtree = { root, height, false, 0 };
+    subtrees_.push_back(subtree);
+
+    while (subtrees_.size() < target && subtrees_[0].height > 0)
+    {
+        vector<ExportSubtree> next;
+
+        for (size_t t = 0; t < subtrees_.size(); ++t)
+        {
+            if (!CheckNode(subtrees_[t].page, subtrees_[t].height))
+            {
+                return -1;
+            }
+
+            const DiskPageView view = View(subtrees_[t].page);
+            const int n = view.N();
+
+            for (int i = 0; i <= n; ++i)
+            {
+                subtree.page = view.Link(i);
+                subtree.height = subtrees_[t].height - 1;
+                subtree.has_sep = (i < n) || subtrees_[t].has_sep;
+                subtree.sep = (i < n) ? view.Key(i) : subtrees_[t].sep;
+                next.push_back(subtree);
+            }
+        }
+
+        subtrees_.swap(next);
+    }
+
+    // 最后一层展开后子树可能远多于target个（阶数那么多倍），相邻的几棵合成一个分区
+    const size_t partition_count = min(target, subtrees_.size());
+    for (size_t i = 1; i <= partition_count; ++i)
+    {
+        partitions_.push_back(subtrees_.size() * i / partition_count);
+    }
+
+    return 0;
+}
+
+inline void TreeExporter::Prefetch(const DiskPageView& view, int n) const
+{
+    const long os_page = sysconf(_SC_PAGESIZE);
+
+    for (int i = 0; i <= n; ++i)
+    {
+        const long r = view.Link(i);
+        if (IsPage(r))
+        {
+            const long first = r / os_page * os_page;
+            madvise((void*) (base_ + first), r + layout_.node_size - first, MADV_WILLNEED);
+        }
+    }
+}
+
+inline bool TreeExporter::Walk(long r, int height, KeySink& sink, ExportResult& result)
+{
+    if (failed_ || !CheckNode(r, height))
+    {
+        return false;
+    }
+
+    const DiskPageView view = View(r);
+    const int n = view.N();
+
+    if (height > 0)
+    {
+        Prefetch(view, n);
+    }
+
+    for (int i = 0; i <= n; ++i)
+    {
+        if (height > 0 && !Walk(view.Link(i), height - 1, sink, result))
+        {
+            return false;
+        }
+
+        if (i == n)
+        {
+            break;
+        }
+
+        if (!Emit(view.Key(i), r, sink, result))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool TreeExporter::Emit(KeyType x, long r, KeySink& sink, ExportResult& result)
+{
+    if (result.keys > 0 && x <= result.last)
+    {
+        Fail("node " + to_string(r) + ": key " + to_string(x) + " out of order");
+        return false;
+    }
+
+    if (0 == result.keys)
+    {
+        result.first = x;
+    }
+
+    result.last = x;
+    ++result.keys;
+    sink.Put(x);
+    return true;
+}
+
+inline bool TreeExporter::ExportPartition(size_t i, KeySink& sink)
+{
+    ExportResult& result = results_[i];
+
+    for (size_t t = partitions_[i]; t < partitions_[i + 1]; ++t)
+    {
+        const ExportSubtree& subtree = subtrees_[t];
+        if (!Walk(subtree.page, subtree.height, sink, result)
+            || (subtree.has_sep && !Emit(subtree.sep, subtree.page, sink, result)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline int TreeExporter::Run(int fd, const char* chunk_prefix, bool binary, int thread_count)
+{
+    const size_t partition_count = partitions_.size() - 1;
+    const size_t window = (size_t) thread_count * EXPORT_WINDOW_PER_THREAD;
+    results_.assign(partition_count, ExportResult());
+
+    vector<vector<char> > outputs(partition_count); // 合成一个文件时各分区的输出
+    atomic<size_t> next_partition(0);
+    size_t written = 0;
+    mutex mtx;
+    condition_variable cv;
+
+    auto work = [&]()
+    {
+        for (; ;)
+        {
+            const size_t i = next_partition++;
+            if (i >= partition_count || failed_)
+            {
+                break;
+            }
+
+            if (chunk_prefix != NULL)
+            {
+                char suffix[32];
+                snprintf(suffix, sizeof(suffix), ".%05zu", i);
+                const string path = string(chunk_prefix) + suffix;
+
+                const int chunk_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (chunk_fd < 0)
+                {
+                    Fail("cannot create " + path);
+                    break;
+                }
+
+                KeySink sink(binary, chunk_fd);
+                sink.PutHeader();
+                const bool ok = ExportPartition(i, sink);
+                if (ok && sink.Flush() != 0)
+                {
+                    Fail("cannot write " + path);
+                }
+
+                close(chunk_fd);
+                continue;
+            }
+
+            {
+                // 不超前太多，已写出的分区之后的那个一定有线程在做，所以不会死锁
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [&]() { return i < written + window || failed_; });
+            }
+
+            KeySink sink(binary, -1);
+            ExportPartition(i, sink);
+
+            {
+                lock_guard<mutex> lock(mtx);
+                outputs[i].assign(sink.Data(), sink.Data() + sink.Size());
+                results_[i].done = true;
+            }
+
+            cv.notify_all();
+        }
+
+        cv.notify_all();
+    };
+
+    vector<thread> threads;
+    for (int t = 0; t < min(thread_count, (int) max(partition_count, (size_t) 1)); ++t)
+    {
+        threads.push_back(thread(work));
+    }
+
+    if (NULL == chunk_prefix)
+    {
+        KeySink header(binary, fd);
+        header.PutHeader();
+        if (header.Flush() != 0)
+        {
+            Fail("cannot write the output");
+        }
+
+        while (written < partition_count && !failed_)
+        {
+            vector<char> output;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [&]() { return results_[written].done || failed_; });
+                output.swap(outputs[written]);
+            }
+
+            if (!failed_ && KeySink::WriteAll(fd, output.data(), output.size()) != 0)
+            {
+                Fail("cannot write the output");
+            }
+
+            {
+                lock_guard<mutex> lock(mtx);
+                ++written;
+            }
+
+            cv.notify_all();
+        }
+
+        cv.notify_all();
+    }
+
+    for (size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+
+    // 分区内已经检查过，再检查分区之间
+    const ExportResult* prev = NULL;
+    for (size_t i = 0; i < partition_count && !failed_; ++i)
+    {
+        if (results_[i].keys > 0)
+        {
+            if (prev != NULL && results_[i].first <= prev->last)
+            {
+                Fail("partition " + to_string(i) + " overlaps the previous one");
+            }
+
+            prev = &results_[i];
+        }
+    }
+
+    return failed_ ? -1 : 0;
+}
+
+static void Usage()
+{
+    cout << "Usage: export_tree in=FILE out=FILE|- [format=binary|text] [chunks=0|1] [threads=N]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    map<string, string> options;
+    if (ParseOptions(argc, argv, options) != 0 || 0 == options.count("in") || 0 == options.count("out"))
+    {
+        Usage();
+        return 1;
+    }
+
+    const string in = GetOption(options, "in", "");
+    const string out = GetOption(options, "out", "");
+    const string format = GetOption(options, "format", "binary");
+    const bool chunks = (GetOption(options, "chunks", "0") != "0");
+    const int thread_count = max(1, atoi(GetOption(options, "threads",
+        to_string(max(1, (int) thread::hardware_concurrency()))).c_str()));
+
+    if ((format != "binary" && format != "text") || (chunks && "-" == out))
+    {
+        Usage();
+        return 1;
+    }
+
+    // 数据写到标准输出时，其余的信息写到标准错误
+    ostream& log = ("-" == out) ? cerr : cout;
+
+    const int fd = open(in.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        log << "Cannot open file " << in << endl;
+        return 1;
+    }
+
+    FstreamPageStore file;
+    bool created;
+    DiskFileLayout layout;
+
+    // 阶数和页大小从文件头中得到，没有文件头的旧文件是DISK_M阶
+    if (file.Open(in.c_str(), created) != 0 || ReadDiskFileLayout(file, layout) != 0)
+    {
+        log << "Wrong file format: " << in << endl;
+        return 1;
+    }
+
+    long start[2];
+    const long size = file.Size();
+    file.Read(0L, start, 2 * sizeof(long));
+    file.Close();
+
+    const char* base = (const char*) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == (const void*) base)
+    {
+        log << "Cannot map file " << in << endl;
+        return 1;
+    }
+
+    const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+    TreeExporter exporter(base, size, layout);
+    if (exporter.Partition(start[0], thread_count) != 0)
+    {
+        log << "Corrupt tree: " << exporter.Error() << endl;
+        return 1;
+    }
+
+    int out_fd = -1;
+    if ("-" == out)
+    {
+        out_fd = STDOUT_FILENO;
+    }
+    else if (!chunks)
+    {
+        out_fd = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            log << "Cannot open output file " << out << endl;
+            return 1;
+        }
+    }
+
+    const int result = exporter.Run(out_fd, chunks ? out.c_str() : NULL, "binary" == format, thread_count);
+
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO)
+    {
+        close(out_fd);
+    }
+
+    munmap((void*) base, size);
+    close(fd);
+
+    if (result != 0)
+    {
+        log << "Export failed: " << exporter.Error() << endl;
+        return 1;
+    }
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    const vector<ExportResult>& results = exporter.Results();
+
+    long long keys = 0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        keys += results[i].keys;
+    }
+
+    if (chunks)
+    {
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            log << out << "." << setw(5) << setfill('0') << i << setfill(' ') << ": " << results[i].keys << " keys";
+            if (results[i].keys > 0)
+            {
+                log << " [" << results[i].first << ", " << results[i].last << "]";
+            }
+
+            log << endl;
+        }
+    }
+
+    log << "Exported " << keys << " keys in " << results.size() << " partitions from " << size << " bytes in "
+        << fixed << setprecision(3) << seconds << " s (" << setprecision(1)
+        << (seconds > 0 ? size / seconds / 1e6 : 0) << " MB/s, " << thread_count << " threads)" << endl;
+    return 0;
+}
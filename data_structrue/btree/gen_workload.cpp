@@ -0,0 +1,319 @@
+// gen_workload: 生成YCSB风格的负载文件，取代只能生成均匀分布随机数的gen_num
+//
+// 用法：gen_workload out=FILE [name=value ...]
+//   records=N       装载阶段插入的记录数，默认100000
+//   ops=N           运行阶段的操作数，默认100000
+//   read=R insert=R delete=R scan=R
+//                   运行阶段各类操作的比例，默认0.5/0.3/0.1/0.1，不必加起来等于1
+//   dist=D          运行阶段选择关键字的分布：uniform、zipfian（默认）、sequential、latest或hotspot
+//   theta=T         zipfian和latest的倾斜程度，默认0.99
+//   hot_keys=F hot_ops=F
+//                   hotspot分布中热点关键字占的比例和访问热点的操作占的比例，默认0.2/0.8
+//   scan_length=N   每次Scan平均取出的记录数，默认100
+//   duplicates=F    运行阶段的插入中有这么大比例是重复插入已有的关键字，默认0
+//   ordered=0|1     为1时第i条记录的关键字就是i（单调递增），否则把i打散到[0, 2^31)，默认0
+//   seed=N          随机数种子，相同的参数和种子生成完全相同的负载，默认1
+//   format=F        ops（默认）：二进制操作日志；text：只把装载阶段的关键字写成文本，每行10个；
+//                   binary：只把装载阶段的关键字写成二进制关键字文件（见key_file.h）。
+//                   text和binary都可以作为DiskBTree::Insert(const char*)的输入
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <math.h>
+#include <stdlib.h>
+#include "workload.h"
+#include "key_file.h"
+
+using namespace std;
+
+/**
+ * @brief 把记录序号i一一映射成[0, 2^31)中的关键字：乘奇数和右移异或在2^31的模下都是可逆的，所以不会产生重复的关键字
+ */
+static int32_t ScrambleKey(uint32_t i)
+{
+    uint32_t x = i & 0x7fffffff;
+    x = (x * 0x5bd1e995U) & 0x7fffffff;
+    x ^= x >> 15;
+    x = (x * 0x2c1b3c6dU) & 0x7fffffff;
+    x ^= x >> 13;
+    return (int32_t) x;
+}
+
+enum Distribution
+{
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_SEQUENTIAL,
+    DIST_LATEST,
+    DIST_HOTSPOT
+};
+
+/**
+ * @brief 按给定的分布从[0, n)中选记录序号，n随插入增长
+ * @details zipfian采用YCSB的做法（Gray等人的算法），n增长时增量地更新zeta(n)
+ */
+class KeyChooser
+{
+public:
+    KeyChooser(Distribution dist, double theta, double hot_keys, double hot_ops, mt19937_64& rng)
+        : dist_(dist), theta_(theta), hot_keys_(hot_keys), hot_ops_(hot_ops), rng_(rng)
+    {
+        zeta_n_ = 0;
+        zeta_count_ = 0;
+        zeta2_ = 1 + pow(0.5, theta_);
+        alpha_ = 1 / (1 - theta_);
+        seq_ = 0;
+    }
+
+    long Next(long n)
+    {
+        switch (dist_)
+        {
+            case DIST_UNIFORM:
+                return Uniform(0, n);
+
+            case DIST_ZIPFIAN:
+                return Zipfian(n);
+
+            case DIST_SEQUENTIAL:
+                return seq_++ % n;
+
+            case DIST_LATEST:
+                return n - 1 - Zipfian(n); // 最近插入的记录最热
+
+            case DIST_HOTSPOT:
+            {
+                const long hot_n = (long) (n * hot_keys_);
+                if (hot_n > 0 && Random01() < hot_ops_)
+                {
+                    return Uniform(0, hot_n);
+                }
+
+                return (hot_n < n) ? Uniform(hot_n, n) : Uniform(0, n);
+            }
+        }
+
+        return 0;
+    }
+
+private:
+    double Random01()
+    {
+        return uniform_real_distribution<double>(0, 1)(rng_);
+    }
+
+    long Uniform(long lo, long hi)
+    {
+        return uniform_int_distribution<long>(lo, hi - 1)(rng_);
+    }
+
+    long Zipfian(long n)
+    {
+        for (; zeta_count_ < n; ++zeta_count_)
+        {
+            zeta_n_ += 1 / pow((double) (zeta_count_ + 1), theta_);
+        }
+
+        const double eta = (1 - pow(2.0 / n, 1 - theta_)) / (1 - zeta2_ / zeta_n_);
+        const double u = Random01();
+        const double uz = u * zeta_n_;
+
+        if (uz < 1)
+        {
+            return 0;
+        }
+
+        if (uz < 1 + pow(0.5, theta_))
+        {
+            return (n > 1) ? 1 : 0;
+        }
+
+        const long i = (long) (n * pow(eta * u - eta + 1, alpha_));
+        return (i < n) ? i : n - 1;
+    }
+
+private:
+    Distribution dist_;
+    double theta_;
+    double hot_keys_;
+    double hot_ops_;
+    mt19937_64& rng_;
+
+    double zeta_n_;   // zeta(zeta_count_) = 1 + 1/2^theta + ... + 1/zeta_count_^theta
+    long zeta_count_;
+    double zeta2_;
+    double alpha_;
+    long seq_;
+};
+
+static void Usage()
+{
+    cout << "Usage: gen_workload out=FILE [records=N] [ops=N] [read=R] [insert=R] [delete=R] [scan=R]" << endl
+        << "         [dist=uniform|zipfian|sequential|latest|hotspot] [theta=T] [hot_keys=F] [hot_ops=F]" << endl
+        << "         [scan_length=N] [duplicates=F] [ordered=0|1] [seed=N] [format=ops|text|binary]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    map<string, string> options;
+    if (ParseOptions(argc, argv, options) != 0 || 0 == options.count("out"))
+    {
+        Usage();
+        return 1;
+    }
+
+    const string out = GetOption(options, "out", "");
+    const long records = atol(GetOption(options, "records", "100000").c_str());
+    const long op_count = atol(GetOption(options, "ops", "100000").c_str());
+    const double ratios[WORKLOAD_OP_CODE_COUNT] =
+    {
+        atof(GetOption(options, "insert", "0.3").c_str()),
+        atof(GetOption(options, "delete", "0.1").c_str()),
+        atof(GetOption(options, "read", "0.5").c_str()),
+        atof(GetOption(options, "scan", "0.1").c_str())
+    };
+    const double theta = atof(GetOption(options, "theta", "0.99").c_str());
+    const double hot_keys = atof(GetOption(options, "hot_keys", "0.2").c_str());
+    const double hot_ops = atof(GetOption(options, "hot_ops", "0.8").c_str());
+    const long scan_length = atol(GetOption(options, "scan_length", "100").c_str());
+    const double duplicates = atof(GetOption(options, "duplicates", "0").c_str());
+    const bool ordered = (GetOption(options, "ordered", "0") != "0");
+    const uint64_t seed = strtoull(GetOption(options, "seed", "1").c_str(), NULL, 10);
+    const string format = GetOption(options, "format", "ops");
+    const string dist_name = GetOption(options, "dist", "zipfian");
+
+    static const char* const DIST_NAMES[] = { "uniform", "zipfian", "sequential", "latest", "hotspot" };
+    int dist = -1;
+    for (int i = 0; i < 5; ++i)
+    {
+        if (dist_name == DIST_NAMES[i])
+        {
+            dist = i;
+        }
+    }
+
+    double ratio_sum = 0;
+    for (int i = 0; i < WORKLOAD_OP_CODE_COUNT; ++i)
+    {
+        ratio_sum += ratios[i];
+    }
+
+    if (dist < 0 || records < 0 || records > INT32_MAX || op_count < 0 || ratio_sum <= 0 || theta <= 0 || 1 == theta)
+    {
+        Usage();
+        return 1;
+    }
+
+    mt19937_64 rng(seed);
+
+    if ("text" == format)
+    {
+        ofstream ofs(out.c_str(), ios::out);
+        if (ofs.fail())
+        {
+            cout << "Cannot open output file." << endl;
+            return 1;
+        }
+
+        for (long i = 0; i < records; ++i)
+        {
+            ofs << (ordered ? (int32_t) i : ScrambleKey(i)) << ((9 == i % 10) ? '\n' : ' ');
+        }
+
+        return 0;
+    }
+
+    if ("binary" == format)
+    {
+        ofstream ofs(out.c_str(), ios::out | ios::trunc | ios::binary);
+        if (ofs.fail())
+        {
+            cout << "Cannot open output file." << endl;
+            return 1;
+        }
+
+        ofs.write(KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC));
+
+        vector<unsigned char> buffer;
+        for (long i = 0; i < records; ++i)
+        {
+            unsigned char p[sizeof(int32_t)];
+            PutKeyLE(p, ordered ? (int32_t) i : ScrambleKey(i));
+            buffer.insert(buffer.end(), p, p + sizeof(p));
+
+            if (buffer.size() >= (1 << 20) || i == records - 1)
+            {
+                ofs.write((const char*) &buffer[0], buffer.size());
+                buffer.clear();
+            }
+        }
+
+        ofs.close();
+        if (ofs.fail())
+        {
+            cout << "Failed to write output file." << endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    WorkloadWriter writer;
+    if (writer.Open(out.c_str(), seed) != 0)
+    {
+        cout << "Cannot open output file." << endl;
+        return 1;
+    }
+
+    // 装载阶段：依次插入records条记录
+    long record_count = 0;
+    for (; record_count < records; ++record_count)
+    {
+        writer.Append(MakeWorkloadOp(WORKLOAD_INSERT, ordered ? record_count : ScrambleKey(record_count)), true);
+    }
+
+    // 运行阶段：按比例混合各类操作，插入总是追加新的记录（latest分布因此偏向新插入的记录）
+    KeyChooser chooser((Distribution) dist, theta, hot_keys, hot_ops, rng);
+    uniform_real_distribution<double> random01(0, 1);
+    const double key_span = ordered ? 1 : 2147483648.0 / (records > 0 ? records : 1); // 相邻记录的关键字平均间隔
+    const double max_width = 16777215; // 24位
+    const uint32_t scan_width = (uint32_t) min(scan_length * key_span, max_width);
+
+    for (long i = 0; i < op_count; ++i)
+    {
+        double r = random01(rng) * ratio_sum;
+        int code = 0;
+
+        while (code < WORKLOAD_OP_CODE_COUNT - 1 && r >= ratios[code])
+        {
+            r -= ratios[code];
+            ++code;
+        }
+
+        if (0 == record_count)
+        {
+            code = WORKLOAD_INSERT;
+        }
+
+        long record;
+        if (WORKLOAD_INSERT == code && (random01(rng) >= duplicates || 0 == record_count))
+        {
+            record = record_count++;
+        }
+        else
+        {
+            record = chooser.Next(record_count);
+        }
+
+        const int32_t key = ordered ? (int32_t) record : ScrambleKey(record);
+        writer.Append(MakeWorkloadOp((WorkloadOpCode) code, key, (WORKLOAD_SCAN == code) ? scan_width : 0), false);
+    }
+
+    if (writer.Close() != 0)
+    {
+        cout << "Failed to write output file." << endl;
+        return 1;
+    }
+
+    return 0;
+}
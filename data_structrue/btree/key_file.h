@@ -0,0 +1,412 @@
+// key_file: 读关键字文件，供DiskBTree::Insert(const char*)批量装载
+//
+// 支持两种格式，按文件开头的魔数自动识别：
+//   文本：用空白分隔的十进制整数（gen_workload format=text的输出）
+//   二进制："BTKEYS01"后面紧跟若干个4字节的小端整数（gen_workload format=binary的输出）
+// 文件用mmap整个映射进来顺序读；不能映射的（比如管道）退化为每次4MB的大块read。
+// 文本用from_chars解析，不经过iostream和locale。解析在单独的线程中进行，和插入并行。
+#ifndef KEY_FILE_H
+#define KEY_FILE_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "btree_common.h"
+
+using namespace std;
+
+static const char KEY_FILE_MAGIC[8] = { 'B', 'T', 'K', 'E', 'Y', 'S', '0', '1' };
+
+/**
+ * @brief 按小端字节序存取4字节整数，与本机字节序无关（小端机器上编译器会优化成一次访存）
+ */
+inline int32_t GetKeyLE(const unsigned char* p)
+{
+    return (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+inline void PutKeyLE(unsigned char* p, int32_t key)
+{
+    const uint32_t x = (uint32_t) key;
+    p[0] = (unsigned char) x;
+    p[1] = (unsigned char) (x >> 8);
+    p[2] = (unsigned char) (x >> 16);
+    p[3] = (unsigned char) (x >> 24);
+}
+
+/**
+ * @brief 顺序读出关键字文件中的关键字
+ */
+class KeyFileReader
+{
+public:
+    KeyFileReader()
+    {
+        fd_ = -1;
+        map_ = NULL;
+        map_size_ = 0;
+        data_ = NULL;
+        size_ = 0;
+        pos_ = 0;
+        offset_ = 0;
+        eof_ = false;
+        binary_ = false;
+        error_ = false;
+    }
+
+    ~KeyFileReader()
+    {
+        Close();
+    }
+
+    /**
+     * @return =0成功，否则失败
+     */
+    int Open(const char* key_file_path)
+    {
+        Close();
+
+        fd_ = open(key_file_path, O_RDONLY);
+        if (fd_ < 0)
+        {
+            return -1;
+        }
+
+        struct stat st;
+        if (0 == fstat(fd_, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (p != MAP_FAILED)
+            {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                map_ = p;
+                map_size_ = st.st_size;
+                data_ = (const char*) p;
+                size_ = st.st_size;
+                eof_ = true;
+            }
+        }
+
+        if (NULL == map_)
+        {
+            buffer_.resize(READ_SIZE);
+            data_ = &buffer_[0];
+            Fill();
+        }
+
+        while (size_ < sizeof(KEY_FILE_MAGIC) && !eof_)
+        {
+            Fill();
+        }
+
+        if (size_ >= sizeof(KEY_FILE_MAGIC) && 0 == memcmp(data_, KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC)))
+        {
+            binary_ = true;
+            pos_ = sizeof(KEY_FILE_MAGIC);
+        }
+
+        return 0;
+    }
+
+    void Close()
+    {
+        if (map_ != NULL)
+        {
+            munmap(map_, map_size_);
+            map_ = NULL;
+        }
+
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+
+        buffer_.clear();
+        data_ = NULL;
+        size_ = pos_ = offset_ = 0;
+        eof_ = binary_ = error_ = false;
+    }
+
+    bool IsBinary() const
+    {
+        return binary_;
+    }
+
+    /**
+     * @brief 文本中有不是整数（或者超出KeyType范围）的内容，或者二进制文件的长度不完整
+     */
+    bool Error() const
+    {
+        return error_;
+    }
+
+    /**
+     * @brief 出错位置（或者当前位置）在文件中的偏移
+     */
+    size_t Offset() const
+    {
+        return offset_ + pos_;
+    }
+
+    /**
+     * @brief 读出最多max个关键字
+     * @return 读出的关键字个数，=0表示读完了或者出错了
+     */
+    size_t Next(KeyType* keys, size_t max)
+    {
+        return binary_ ? NextBinary(keys, max) : NextText(keys, max);
+    }
+
+private:
+    enum
+    {
+        READ_SIZE = 4 << 20
+    };
+
+    /**
+     * @brief 非映射方式：把还没用的字节挪到缓冲区开头，再读入一块
+     */
+    void Fill()
+    {
+        if (eof_)
+        {
+            return;
+        }
+
+        memmove(&buffer_[0], &buffer_[pos_], size_ - pos_);
+        offset_ += pos_;
+        size_ -= pos_;
+        pos_ = 0;
+
+        if (buffer_.size() - size_ < READ_SIZE / 2)
+        {
+            buffer_.resize(buffer_.size() * 2);
+            data_ = &buffer_[0];
+        }
+
+        const ssize_t n = read(fd_, &buffer_[size_], buffer_.size() - size_);
+        if (n <= 0)
+        {
+            eof_ = true;
+            return;
+        }
+
+        size_ += n;
+    }
+
+    size_t NextBinary(KeyType* keys, size_t max)
+    {
+        size_t count = 0;
+
+        while (count < max)
+        {
+            if (size_ - pos_ < sizeof(int32_t))
+            {
+                if (eof_)
+                {
+                    error_ = (pos_ != size_);
+                    break;
+                }
+
+                Fill();
+                continue;
+            }
+
+            const size_t n = min(max - count, (size_ - pos_) / sizeof(int32_t));
+            const unsigned char* p = (const unsigned char*) data_ + pos_;
+
+            for (size_t i = 0; i < n; ++i, p += sizeof(int32_t))
+            {
+                keys[count++] = GetKeyLE(p);
+            }
+
+            pos_ += n * sizeof(int32_t);
+        }
+
+        return count;
+    }
+
+    static bool IsSpace(char c)
+    {
+        return ' ' == c || '\n' == c || '\t' == c || '\r' == c || '\f' == c || '\v' == c;
+    }
+
+    size_t NextText(KeyType* keys, size_t max)
+    {
+        size_t count = 0;
+
+        while (count < max && !error_)
+        {
+            while (pos_ < size_ && IsSpace(data_[pos_]))
+            {
+                ++pos_;
+            }
+
+            // 找到这个数的结尾；非映射方式下一个数可能被缓冲区的边界截断，先补齐
+            size_t end = pos_;
+            while (end < size_ && !IsSpace(data_[end]))
+            {
+                ++end;
+            }
+
+            if (end == size_ && !eof_)
+            {
+                Fill();
+                continue;
+            }
+
+            if (pos_ == end)
+            {
+                break; // 读完了
+            }
+
+            const char* first = data_ + pos_;
+            if ('+' == *first && end - pos_ > 1)
+            {
+                ++first;
+            }
+
+            KeyType x;
+            const from_chars_result result = from_chars(first, data_ + end, x);
+            if (result.ec != errc() || result.ptr != data_ + end)
+            {
+                error_ = true;
+                break;
+            }
+
+            keys[count++] = x;
+            pos_ = end;
+        }
+
+        return count;
+    }
+
+private:
+    int fd_;
+    void* map_;           // mmap映射的整个文件，不能映射时为NULL
+    size_t map_size_;
+    vector<char> buffer_; // 不能映射时的读缓冲区
+    const char* data_;    // 当前可用的字节：映射的文件或者读缓冲区
+    size_t size_;
+    size_t pos_;          // 下一个要解析的字节
+    size_t offset_;       // data_[0]在文件中的偏移
+    bool eof_;            // data_后面没有更多的字节了
+    bool binary_;
+    bool error_;
+};
+
+/**
+ * @brief 流水线方式装载关键字文件：一个线程解析出一批批关键字，调用者的线程依次把它们插入
+ * @details 两个线程之间用有界队列传递批次，解析快于插入时解析线程等待，反之插入线程等待，
+ *          所以内存占用不随文件大小增长。插入的顺序与文件中的顺序相同。
+ * @param insert 对每个关键字调用insert(x)
+ * @param error_offset 不为NULL时，文件内容有误时在这里返回出错的位置
+ * @return 读出的关键字个数，打不开文件或者文件内容有误时为-1（出错之前的关键字已经插入）
+ */
+template <class Insert>
+long IngestKeyFile(const char* key_file_path, Insert insert, size_t* error_offset = NULL)
+{
+    KeyFileReader reader;
+    if (reader.Open(key_file_path) != 0)
+    {
+        return -1;
+    }
+
+    const size_t BATCH_SIZE = 64 * 1024;
+    const size_t QUEUE_SIZE = 4;
+
+    mutex mtx;
+    condition_variable cv;
+    vector<vector<KeyType> > free_batches(QUEUE_SIZE, vector<KeyType>(BATCH_SIZE));
+    deque<vector<KeyType> > full_batches; // 按解析顺序排队，空的批次表示结束
+
+    thread parser([&]()
+    {
+        for (; ;)
+        {
+            vector<KeyType> batch;
+            {
+                unique_lock<mutex> lock(mtx);
+                cv.wait(lock, [&]() { return !free_batches.empty(); });
+                batch.swap(free_batches.back());
+                free_batches.pop_back();
+            }
+
+            batch.resize(BATCH_SIZE);
+            batch.resize(reader.Next(&batch[0], BATCH_SIZE));
+            const bool last = batch.empty();
+
+            {
+                lock_guard<mutex> lock(mtx);
+                full_batches.push_back(vector<KeyType>());
+                full_batches.back().swap(batch);
+            }
+
+            cv.notify_all();
+
+            if (last)
+            {
+                return;
+            }
+        }
+    });
+
+    long count = 0;
+
+    for (; ;)
+    {
+        vector<KeyType> batch;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [&]() { return !full_batches.empty(); });
+            batch.swap(full_batches.front());
+            full_batches.pop_front();
+        }
+
+        if (batch.empty())
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            insert(batch[i]);
+        }
+
+        count += batch.size();
+
+        {
+            lock_guard<mutex> lock(mtx);
+            free_batches.push_back(vector<KeyType>());
+            free_batches.back().swap(batch);
+        }
+
+        cv.notify_all();
+    }
+
+    parser.join();
+
+    if (reader.Error())
+    {
+        if (error_offset != NULL)
+        {
+            *error_offset = reader.Offset();
+        }
+
+        return -1;
+    }
+
+    return count;
+}
+
+#endif // KEY_FILE_H
@@ -0,0 +1,385 @@
+// latency_histogram: 按操作类型统计延迟分布，并对慢操作做采样跟踪
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief HDR风格的延迟直方图
+ * @details 对数-线性分桶：小于128的值每个值一个桶；其余的值按最高位所在的段分组，每段再线性地分成64个子桶，
+ *          所以任何值的相对误差都不超过1/64。记录一个值只是一次数组元素的加1，可以在每次操作时都记录。
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        sum_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    void Record(uint64_t v)
+    {
+        ++counts_[BucketIndex(v)];
+        ++count_;
+        sum_ += v;
+
+        if (v < min_)
+        {
+            min_ = v;
+        }
+
+        if (v > max_)
+        {
+            max_ = v;
+        }
+    }
+
+    uint64_t Count() const
+    {
+        return count_;
+    }
+
+    uint64_t Min() const
+    {
+        return (count_ > 0) ? min_ : 0;
+    }
+
+    uint64_t Max() const
+    {
+        return max_;
+    }
+
+    double Mean() const
+    {
+        return (count_ > 0) ? (double) sum_ / count_ : 0;
+    }
+
+    /**
+     * @brief 取百分位数
+     * @param p 百分比，取值范围[0, 100]，例如99.9
+     * @return 第p百分位的值所在的桶的上界（不超过最大值）
+     */
+    uint64_t Percentile(double p) const
+    {
+        if (0 == count_)
+        {
+            return 0;
+        }
+
+        uint64_t rank = (uint64_t) (p / 100 * count_ + 0.5);
+        if (rank < 1)
+        {
+            rank = 1;
+        }
+
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+            {
+                const uint64_t upper = BucketUpper(i);
+                return (upper < max_) ? upper : max_;
+            }
+        }
+
+        return max_;
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        for (int i = 0; i < BUCKET_COUNT; ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+
+        count_ += other.count_;
+        sum_ += other.sum_;
+
+        if (other.min_ < min_)
+        {
+            min_ = other.min_;
+        }
+
+        if (other.max_ > max_)
+        {
+            max_ = other.max_;
+        }
+    }
+
+private:
+    enum
+    {
+        SUB_BUCKET_BITS = 6,
+        SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS, // 64
+        BUCKET_COUNT = SUB_BUCKET_COUNT * (64 - SUB_BUCKET_BITS + 1)
+    };
+
+    static int BucketIndex(uint64_t v)
+    {
+        if (v < 2 * SUB_BUCKET_COUNT)
+        {
+            return (int) v;
+        }
+
+        // v = m << e，其中m在[64, 128)之间
+        const int e = 63 - __builtin_clzll(v) - SUB_BUCKET_BITS;
+        return SUB_BUCKET_COUNT * e + (int) (v >> e);
+    }
+
+    static uint64_t BucketUpper(int i)
+    {
+        if (i < 2 * SUB_BUCKET_COUNT)
+        {
+            return i;
+        }
+
+        const int e = i / SUB_BUCKET_COUNT - 1;
+        const uint64_t m = i % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+        return ((m + 1) << e) - 1;
+    }
+
+private:
+    uint64_t counts_[BUCKET_COUNT];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+enum OpType
+{
+    OP_INSERT,
+    OP_DELETE,
+    OP_SEARCH,
+    OP_SCAN,
+    OP_TYPE_COUNT
+};
+
+static const char* const OP_TYPE_NAMES[OP_TYPE_COUNT] = { "insert", "delete", "search", "scan" };
+
+/**
+ * @brief 某一类操作的累计明细
+ */
+struct OpBreakdown
+{
+    uint64_t count;
+    uint64_t reads;          // 读结点的次数
+    uint64_t writes;         // 写结点的次数
+    uint64_t levels;         // 经过的层数
+    uint64_t sampled;        // 被采样的操作个数，下面两项只在被采样的操作上统计
+    uint64_t sampled_ns;     // 总耗时
+    uint64_t sampled_io_ns;  // 其中花在读写结点（I/O）上的时间，其余的是查找和结点内操作的时间
+};
+
+/**
+ * @brief 操作剖析器：每个操作都记录延迟直方图和读写次数，每sample_every个操作采样一个，
+ *        采样的操作额外记录I/O时间和经过的结点，耗时超过阈值的采样操作连同路径一起打印出来
+ * @details 用法：操作开始时Begin()，每经过一层调用Visit()，每次I/O前后用Sampled()/AddIo()计时，操作结束时End()。
+ *          不采样的操作只多了两次读时钟和几次整数加法，可以一直开着。
+ */
+class OpProfiler
+{
+public:
+    OpProfiler()
+    {
+        sample_every_ = 0;
+        slow_ns_ = 0;
+        out_ = &std::cerr;
+        op_seq_ = 0;
+        active_ = false;
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (int i = 0; i < OP_TYPE_COUNT; ++i)
+        {
+            histograms_[i].Reset();
+        }
+
+        memset(breakdowns_, 0, sizeof(breakdowns_));
+    }
+
+    /**
+     * @brief 设置采样跟踪
+     * @param sample_every 每多少个操作采样一个，为0表示不采样
+     * @param slow_us 采样的操作耗时达到这么多微秒时打印出来
+     * @param out 打印的目的地
+     */
+    void SetTrace(int sample_every, double slow_us, std::ostream* out = &std::cerr)
+    {
+        sample_every_ = sample_every;
+        slow_ns_ = (uint64_t) (slow_us * 1000);
+        out_ = out;
+    }
+
+    static uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @param reads 操作开始前树的读结点计数
+     * @param writes 操作开始前树的写结点计数
+     * @return false表示已经有一个操作在进行中（嵌套调用），这时不记录，也不要调用End()
+     */
+    bool Begin(OpType type, long key, long reads, long writes)
+    {
+        if (active_)
+        {
+            return false;
+        }
+
+        active_ = true;
+        type_ = type;
+        key_ = key;
+        reads_ = reads;
+        writes_ = writes;
+        levels_ = 0;
+        io_ns_ = 0;
+        path_len_ = 0;
+        sampled_ = (sample_every_ > 0 && 0 == ++op_seq_ % sample_every_);
+        start_ns_ = NowNs();
+
+        return true;
+    }
+
+    void Visit(long node_id)
+    {
+        ++levels_;
+
+        if (sampled_ && path_len_ < MAX_PATH)
+        {
+            path_[path_len_++] = node_id;
+        }
+    }
+
+    bool Sampled() const
+    {
+        return active_ && sampled_;
+    }
+
+    void AddIo(uint64_t ns)
+    {
+        io_ns_ += ns;
+    }
+
+    void End(long reads, long writes)
+    {
+        const uint64_t elapsed = NowNs() - start_ns_;
+        OpBreakdown& b = breakdowns_[type_];
+
+        histograms_[type_].Record(elapsed);
+        ++b.count;
+        b.reads += reads - reads_;
+        b.writes += writes - writes_;
+        b.levels += levels_;
+
+        if (sampled_)
+        {
+            ++b.sampled;
+            b.sampled_ns += elapsed;
+            b.sampled_io_ns += io_ns_;
+
+            if (elapsed >= slow_ns_)
+            {
+                *out_ << "slow " << OP_TYPE_NAMES[type_] << " key " << key_ << ": " << elapsed / 1000 << " us, io "
+                    << io_ns_ / 1000 << " us, reads " << reads - reads_ << ", writes " << writes - writes_
+                    << ", levels " << levels_ << ", path";
+
+                for (int i = 0; i < path_len_; ++i)
+                {
+                    *out_ << " " << path_[i];
+                }
+
+                *out_ << std::endl;
+            }
+        }
+
+        active_ = false;
+    }
+
+    const LatencyHistogram& Histogram(OpType type) const
+    {
+        return histograms_[type];
+    }
+
+    const OpBreakdown& Breakdown(OpType type) const
+    {
+        return breakdowns_[type];
+    }
+
+    /**
+     * @brief 每类操作打印一行：次数、延迟的百分位数（微秒）、平均读写次数和层数、采样操作中I/O时间的占比
+     */
+    void Print(std::ostream& out) const
+    {
+        out << "Latency (us):" << std::endl
+            << std::setw(8) << "op" << std::setw(10) << "count" << std::setw(9) << "p50" << std::setw(9) << "p90"
+            << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max" << std::setw(9) << "reads"
+            << std::setw(9) << "writes" << std::setw(8) << "levels" << std::setw(7) << "io%" << std::endl;
+
+        for (int i = 0; i < OP_TYPE_COUNT; ++i)
+        {
+            const LatencyHistogram& h = histograms_[i];
+            const OpBreakdown& b = breakdowns_[i];
+            if (0 == h.Count())
+            {
+                continue;
+            }
+
+            out << std::setw(8) << OP_TYPE_NAMES[i] << std::setw(10) << h.Count() << std::fixed << std::setprecision(1)
+                << std::setw(9) << h.Percentile(50) / 1000.0 << std::setw(9) << h.Percentile(90) / 1000.0
+                << std::setw(9) << h.Percentile(99) / 1000.0 << std::setw(9) << h.Percentile(99.9) / 1000.0
+                << std::setw(9) << h.Max() / 1000.0 << std::setprecision(2)
+                << std::setw(9) << (double) b.reads / b.count << std::setw(9) << (double) b.writes / b.count
+                << std::setw(8) << (double) b.levels / b.count << std::setprecision(1)
+                << std::setw(7) << (b.sampled_ns > 0 ? 100.0 * b.sampled_io_ns / b.sampled_ns : 0.0) << std::endl;
+            out.unsetf(std::ios::fixed);
+        }
+    }
+
+private:
+    enum
+    {
+        MAX_PATH = 32
+    };
+
+    LatencyHistogram histograms_[OP_TYPE_COUNT];
+    OpBreakdown breakdowns_[OP_TYPE_COUNT];
+
+    int sample_every_;
+    uint64_t slow_ns_;
+    std::ostream* out_;
+    uint64_t op_seq_;
+
+    // 当前操作
+    bool active_;
+    bool sampled_;
+    OpType type_;
+    long key_;
+    long reads_;
+    long writes_;
+    int levels_;
+    uint64_t io_ns_;
+    uint64_t start_ns_;
+    long path_[MAX_PATH];
+    int path_len_;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,110 @@
+// lsm_tree: demonstration program for the LSM tree in lsm_tree.h
+#include "lsm_tree.h"
+#include "workload.h"
+
+int main()
+{
+    cout << "Demonstration program for an LSM tree. Inserts and" << endl
+        << "deletes go into an in-memory B-tree (the memtable)." << endl
+        << "A full memtable is written by a background thread" << endl
+        << "as a sorted, immutable B-tree file on disk (a run)," << endl
+        << "and runs are merged level by level. Searches look" << endl
+        << "at the memtable first and then at the runs from the" << endl
+        << "newest to the oldest." << endl << endl;
+
+    char path_prefix[50];
+    cout << "Enter the path prefix of the (possibly nonexistent)" << endl
+        << "LSM tree files: ";
+    cin >> setw(50) >> path_prefix;
+
+    long memtable_capacity;
+    cout << "Number of keys and tombstones in a full memtable" << endl
+        << "(0 for the default " << LSM_MEMTABLE_CAPACITY << "): ";
+    cin >> memtable_capacity;
+
+    int fanout;
+    cout << "Number of runs in a level that are merged into the" << endl
+        << "next level (0 for the default " << LSM_FANOUT << "): ";
+    cin >> fanout;
+
+    LsmTree tree(path_prefix, memtable_capacity > 0 ? memtable_capacity : LSM_MEMTABLE_CAPACITY,
+        fanout > 0 ? fanout : LSM_FANOUT);
+    tree.Print();
+
+    char ch;
+    cout << endl << "Do you want to replay a workload file? (Y/N): ";
+    cin >> ch;
+
+    if (toupper(ch) == 'Y')
+    {
+        char workload_file_path[50];
+        cout << "Name of this workload file (see gen_workload): ";
+        cin >> setw(50) >> workload_file_path;
+        ReplayWorkloadFile(tree, workload_file_path, cout);
+        tree.Print();
+    }
+
+    KeyType x;
+
+    for (; ;)
+    {
+        cout << endl << "Enter an integer, followed by I, D, S, T, H or F (for" << endl
+            << "Insert, Delete, Search, sTatistics, latency Histograms" << endl
+            << "and Flush the memtable to a run; T, H and F ignore" << endl
+            << "the integer), or enter two integers with L in between" << endl
+            << "(lo L hi) to List the keys in lo..hi; enter Q to quit: ";
+        cin >> x >> ch;
+        if (cin.fail())
+        {
+            break;
+        }
+
+        ch = (char) toupper(ch);
+        switch (ch)
+        {
+            case 'S':
+                cout << "Key " << x << (tree.Search(x) ? " found." : " not found.") << endl;
+                break;
+            case 'I':
+                tree.Insert(x);
+                break;
+            case 'D':
+                tree.Delete(x);
+                break;
+            case 'T':
+                tree.PrintStats();
+                break;
+            case 'H':
+                tree.PrintLatency();
+                break;
+            case 'F':
+                tree.Flush();
+                break;
+            case 'L':
+            {
+                KeyType hi;
+                vector<KeyType> keys;
+                cin >> hi;
+                tree.Scan(x, hi, keys);
+
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    cout << " " << keys[i];
+                }
+
+                cout << endl << keys.size() << " keys in range " << x << ".." << hi << endl;
+            }
+                break;
+            default:
+                cout << "Invalid command, use S, I, D, T, H, F or L" << endl;
+                break;
+        }
+
+        if (ch == 'I' || ch == 'D' || ch == 'F')
+        {
+            tree.Print();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,935 @@
+// lsm_tree: 以BTree为内存表、以不可变的DiskBTree为磁盘上的有序段（run）的LSM树
+//
+// 写入（Insert/Delete）只改内存表：memtable_中是插入的关键字，tombstones_中是删除的关键字（墓碑），一个关键字
+// 至多在其中一个里面。内存表满了（两者的关键字个数之和达到memtable_capacity）时冻结成一个有序的不可变表，
+// 后台线程用DiskBTree::BulkLoad把它顺序写成一个run：prefix.<seq>.run中是关键字，prefix.<seq>.run.del中是墓碑，
+// 两个文件都不会再修改，用只读的DiskBTree打开。
+//
+// run按层组织（分层合并，tiered）：新的run放在第0层的末尾，某一层的run达到fanout个时，后台线程把这一层的run
+// 全部合并成一个，放到下一层的末尾。同一层中越靠后的run越新，浅层的run比深层的新。合并时新的run中的关键字或者
+// 墓碑覆盖旧的；合并结果之下再没有更旧的run时，墓碑已经没有用了，直接丢掉。
+//
+// 读（Search/Scan）依次查内存表、冻结的表和从新到旧的各个run，遇到的第一个关键字或者墓碑就是结果。
+// 每个run的布隆过滤器挡掉了大部分不存在的关键字。第0层的run多于2 * fanout个（后台合并跟不上）或者上一个冻结
+// 的表还没有写完时，写入等待后台线程（stall），这样一次查找要查的run的个数总是有上限的，见LsmTreeStats。
+//
+// run的列表保存在prefix.manifest中，每行是一个run的"层 序号 关键字个数 墓碑个数"，先写临时文件再改名。
+// 没有预写日志：内存表只在析构时写成run，进程异常退出时内存表中的修改会丢失。
+#ifndef LSM_TREE_H
+#define LSM_TREE_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include "btree.h"
+#include "disk_btree.h"
+#include "latency_histogram.h"
+
+using namespace std;
+
+const long LSM_MEMTABLE_CAPACITY = 64 * DISK_M;
+const int LSM_FANOUT = 4;
+
+struct LsmTreeStats
+{
+    // 操作计数，从打开或者上一次ResetStats()开始累计
+    long inserts;
+    long deletes;
+    long searches;
+    long memtable_hits;       // 在内存表或者冻结的表中就得到结果的查找次数
+    long run_probes;          // 查找时查过的run的个数之和
+    long run_reads;           // 查找时各个run的ReadNode次数之和（不含布隆过滤器挡掉的）
+    long flushes;             // 冻结的表写成run的次数
+    long compactions;         // 合并的次数
+    long stalls;              // 写入等待后台线程的次数
+    long long user_bytes;     // 写入的关键字和墓碑的字节数
+    long long flush_bytes;    // 写成run时写入文件的字节数
+    long long compaction_bytes; // 合并时写入文件的字节数
+
+    // 结构信息
+    long memtable_count;      // 内存表中的关键字和墓碑个数
+    long immutable_count;     // 冻结的表中的关键字和墓碑个数
+    vector<int> level_runs;   // 每层的run个数
+    int max_runs;             // 一次查找最多要查的run的个数：2 * fanout + (层数 - 1) * (fanout - 1)
+};
+
+/**
+ * @brief 冻结的内存表，关键字和墓碑都已排好序
+ */
+struct LsmTable
+{
+    vector<KeyType> keys;
+    vector<KeyType> tombstones;
+};
+
+/**
+ * @brief 磁盘上的一个不可变的run，持有两个只读的DiskBTree，只在前台线程中使用
+ */
+struct LsmRun
+{
+    LsmRun(const string& run_path, long seq_no, long key_count, long tombstone_count, double bloom_fpr)
+        : path(run_path), seq(seq_no), count(key_count), tombstone_count(tombstone_count),
+          keys(new DiskBTree(run_path.c_str(), bloom_fpr)),
+          tombstones(new DiskBTree((run_path + ".del").c_str(), bloom_fpr)), obsolete(false)
+    {
+        keys->SetReadOnly(true);
+        tombstones->SetReadOnly(true);
+    }
+
+    /**
+     * @brief 被合并掉的run在最后一个引用释放时删除文件
+     */
+    ~LsmRun();
+
+    string path;
+    long seq;
+    long count;
+    long tombstone_count;
+    unique_ptr<DiskBTree> keys;
+    unique_ptr<DiskBTree> tombstones;
+    atomic<bool> obsolete; // 后台线程置上，析构可能发生在前台线程中
+};
+
+/**
+ * @brief 某一时刻冻结的表和各层的run，发布后不再修改，前台线程拿着它查找，后台线程构造新的版本替换它
+ */
+struct LsmVersion
+{
+    shared_ptr<const LsmTable> immutable;
+    vector<vector<shared_ptr<LsmRun> > > levels;
+};
+
+class LsmTree
+{
+public:
+    /**
+     * @param path_prefix 文件名的前缀，run和manifest文件都以它开头。prefix.manifest存在时打开已有的LSM树
+     * @param memtable_capacity 内存表中的关键字和墓碑达到这么多个时冻结，写成一个run
+     * @param fanout 一层的run达到这么多个时合并到下一层
+     * @param bloom_fpr 每个run的布隆过滤器的误判率，为0表示不用
+     */
+    LsmTree(const char* path_prefix, long memtable_capacity = LSM_MEMTABLE_CAPACITY, int fanout = LSM_FANOUT,
+        double bloom_fpr = 0.01);
+
+    /**
+     * @brief 把内存表写成run，等后台线程做完所有的写入和合并后退出
+     */
+    ~LsmTree();
+
+    /**
+     * @brief 删除以path_prefix开头的LSM树的所有文件（manifest中列出的run）
+     */
+    static void RemoveFiles(const char* path_prefix);
+
+    bool Search(KeyType x);
+
+    /**
+     * @brief 把[lo, hi]中的关键字按升序追加到keys中
+     * @return 追加的关键字个数
+     */
+    long Scan(KeyType lo, KeyType hi, vector<KeyType>& keys);
+
+    /**
+     * @brief 盲写：不查关键字是否已经存在，总是返回0
+     */
+    int Insert(KeyType x);
+
+    /**
+     * @brief 盲写：只记下一个墓碑，不查关键字是否存在，总是返回0
+     */
+    int Delete(KeyType x);
+
+    /**
+     * @brief 立即冻结内存表，并等后台线程把它写成run、做完由此引起的合并
+     */
+    void Flush();
+
+    /**
+     * @brief Insert/Delete不打印提示，为了能用ReplayWorkload回放负载而保留
+     */
+    void SetVerbose(bool verbose)
+    {
+        verbose_ = verbose;
+    }
+
+    LsmTreeStats Stats();
+
+    /**
+     * @brief 打印Stats()，包括每次查找平均查的run数和读结点数（读放大）、写入文件的字节数与用户写入的字节数之比
+     *        （写放大）
+     */
+    void PrintStats();
+
+    void ResetStats();
+
+    /**
+     * @brief 打印内存表的大小和各层的run
+     */
+    void Print();
+
+    /**
+     * @brief 设置慢操作的采样跟踪，参数见OpProfiler::SetTrace。路径中打印的是查过的run的序号
+     */
+    void SetTrace(int sample_every, double slow_us, ostream* out = &cerr)
+    {
+        profiler_.SetTrace(sample_every, slow_us, out);
+    }
+
+    void PrintLatency() const
+    {
+        profiler_.Print(cout);
+    }
+
+private:
+    string RunPath(long seq) const;
+
+    /**
+     * @brief 内存表满了时调用：等到可以冻结（没有还没写完的冻结表，第0层的run不太多）时冻结内存表，通知后台线程
+     */
+    void Freeze();
+
+    shared_ptr<const LsmVersion> CurrentVersion();
+
+    /**
+     * @brief 读manifest，打开其中列出的run
+     */
+    void LoadManifest();
+
+    /**
+     * @brief 把version中的run列表写到manifest，调用时持有mutex_
+     */
+    void SaveManifest(const LsmVersion& version);
+
+    /**
+     * @brief 后台线程：先把冻结的表写成run，再合并run数达到fanout的层，没有事情可做时等待
+     */
+    void BackgroundLoop();
+
+    /**
+     * @brief 把有序的关键字和墓碑写成一个新的run
+     * @param bytes 返回写入文件的字节数
+     */
+    shared_ptr<LsmRun> WriteRun(const vector<KeyType>& keys, const vector<KeyType>& tombstones, long long& bytes);
+
+    void FlushImmutable();
+
+    /**
+     * @brief 把第level层的run合并成一个，放到第level + 1层
+     */
+    void CompactLevel(int level);
+
+    static void MergeInto(map<KeyType, bool>& merged, const vector<KeyType>& keys, const vector<KeyType>& tombstones);
+
+private:
+    string prefix_;
+    long memtable_capacity_;
+    int fanout_;
+    double bloom_fpr_;
+    bool verbose_;
+
+    unique_ptr<BTree> memtable_;
+    unique_ptr<BTree> tombstones_;
+    long mem_count_;
+
+    // 下面的成员由mutex_保护，stats_中只有后台线程和Freeze更新的计数（flushes、compactions、stalls和写入
+    // 文件的字节数）需要保护
+    mutex mutex_;
+    condition_variable work_cond_; // 有冻结的表要写、有层要合并或者要退出时通知后台线程
+    condition_variable done_cond_; // 后台线程发布了新的版本时通知前台线程
+    shared_ptr<const LsmVersion> version_;
+    long next_seq_;
+    bool stop_;
+    LsmTreeStats stats_;
+
+    thread background_;
+    OpProfiler profiler_;
+};
+
+inline LsmRun::~LsmRun()
+{
+    keys.reset(); // 先关闭文件
+    tombstones.reset();
+
+    if (obsolete)
+    {
+        remove(path.c_str());
+        remove((path + ".bloom").c_str());
+        remove((path + ".del").c_str());
+        remove((path + ".del.bloom").c_str());
+    }
+}
+
+inline LsmTree::LsmTree(const char* path_prefix, long memtable_capacity, int fanout, double bloom_fpr)
+    : prefix_(path_prefix), memtable_capacity_(max(memtable_capacity, 1L)), fanout_(max(fanout, 2)),
+      bloom_fpr_(bloom_fpr), verbose_(true), memtable_(new BTree), tombstones_(new BTree), mem_count_(0),
+      version_(new LsmVersion), next_seq_(1), stop_(false)
+{
+    memtable_->SetVerbose(false);
+    tombstones_->SetVerbose(false);
+
+    ResetStats();
+    LoadManifest();
+
+    background_ = thread(&LsmTree::BackgroundLoop, this);
+}
+
+inline LsmTree::~LsmTree()
+{
+    if (mem_count_ > 0)
+    {
+        Freeze();
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    work_cond_.notify_one();
+    background_.join();
+}
+
+inline void LsmTree::RemoveFiles(const char* path_prefix)
+{
+    const string manifest_path = string(path_prefix) + ".manifest";
+    ifstream ifs(manifest_path.c_str());
+    int level;
+    long seq, count, tombstone_count;
+
+    while (ifs >> level >> seq >> count >> tombstone_count)
+    {
+        const string path = string(path_prefix) + "." + to_string(seq) + ".run";
+        remove(path.c_str());
+        remove((path + ".bloom").c_str());
+        remove((path + ".del").c_str());
+        remove((path + ".del.bloom").c_str());
+    }
+
+    ifs.close();
+    remove(manifest_path.c_str());
+}
+
+inline string LsmTree::RunPath(long seq) const
+{
+    return prefix_ + "." + to_string(seq) + ".run";
+}
+
+inline shared_ptr<const LsmVersion> LsmTree::CurrentVersion()
+{
+    lock_guard<mutex> lock(mutex_);
+    return version_;
+}
+
+inline bool LsmTree::Search(KeyType x)
+{
+    const bool profiling = profiler_.Begin(OP_SEARCH, x, stats_.run_reads, 0);
+    ++stats_.searches;
+
+    bool found = false;
+    bool decided = true;
+
+    if (tombstones_->Search(x))
+    {
+        found = false;
+    }
+    else if (memtable_->Search(x))
+    {
+        found = true;
+    }
+    else
+    {
+        decided = false;
+    }
+
+    const shared_ptr<const LsmVersion> version = CurrentVersion();
+    const LsmTable* immutable = version->immutable.get();
+
+    if (!decided && immutable != NULL)
+    {
+        if (binary_search(immutable->tombstones.begin(), immutable->tombstones.end(), x))
+        {
+            decided = true;
+        }
+        else if (binary_search(immutable->keys.begin(), immutable->keys.end(), x))
+        {
+            found = decided = true;
+        }
+    }
+
+    if (decided)
+    {
+        ++stats_.memtable_hits;
+    }
+
+    // 从新到旧：第0层的最后一个run最新，深层的run比浅层的旧
+    for (size_t level = 0; level < version->levels.size() && !decided; ++level)
+    {
+        const vector<shared_ptr<LsmRun> >& runs = version->levels[level];
+
+        for (size_t i = runs.size(); i > 0 && !decided; --i)
+        {
+            LsmRun& run = *runs[i - 1];
+            const long reads = run.keys->Stats().reads + run.tombstones->Stats().reads;
+
+            ++stats_.run_probes;
+            profiler_.Visit(run.seq);
+
+            if (run.tombstone_count > 0 && run.tombstones->Search(x))
+            {
+                decided = true;
+            }
+            else if (run.keys->Search(x))
+            {
+                found = decided = true;
+            }
+
+            stats_.run_reads += run.keys->Stats().reads + run.tombstones->Stats().reads - reads;
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.run_reads, 0);
+    }
+
+    return found;
+}
+
+inline void LsmTree::MergeInto(map<KeyType, bool>& merged, const vector<KeyType>& keys,
+    const vector<KeyType>& tombstones)
+{
+    // 从新到旧合并，map::insert不会覆盖已有的（更新的）结果
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        merged.insert(make_pair(keys[i], true));
+    }
+
+    for (size_t i = 0; i < tombstones.size(); ++i)
+    {
+        merged.insert(make_pair(tombstones[i], false));
+    }
+}
+
+inline long LsmTree::Scan(KeyType lo, KeyType hi, vector<KeyType>& keys)
+{
+    const bool profiling = profiler_.Begin(OP_SCAN, lo, stats_.run_reads, 0);
+    const size_t size = keys.size();
+
+    map<KeyType, bool> merged;
+    vector<KeyType> source_keys, source_tombstones;
+
+    memtable_->Scan(lo, hi, source_keys);
+    tombstones_->Scan(lo, hi, source_tombstones);
+    MergeInto(merged, source_keys, source_tombstones);
+
+    const shared_ptr<const LsmVersion> version = CurrentVersion();
+    const LsmTable* immutable = version->immutable.get();
+
+    if (immutable != NULL)
+    {
+        const vector<KeyType>::const_iterator k0 = lower_bound(immutable->keys.begin(), immutable->keys.end(), lo);
+        const vector<KeyType>::const_iterator k1 = upper_bound(k0, immutable->keys.end(), hi);
+        const vector<KeyType>::const_iterator t0 =
+            lower_bound(immutable->tombstones.begin(), immutable->tombstones.end(), lo);
+        const vector<KeyType>::const_iterator t1 = upper_bound(t0, immutable->tombstones.end(), hi);
+
+        MergeInto(merged, vector<KeyType>(k0, k1), vector<KeyType>(t0, t1));
+    }
+
+    for (size_t level = 0; level < version->levels.size(); ++level)
+    {
+        const vector<shared_ptr<LsmRun> >& runs = version->levels[level];
+
+        for (size_t i = runs.size(); i > 0; --i)
+        {
+            LsmRun& run = *runs[i - 1];
+            const long reads = run.keys->Stats().reads + run.tombstones->Stats().reads;
+
+            source_keys.clear();
+            source_tombstones.clear();
+            run.keys->Scan(lo, hi, source_keys);
+            if (run.tombstone_count > 0)
+            {
+                run.tombstones->Scan(lo, hi, source_tombstones);
+            }
+
+            MergeInto(merged, source_keys, source_tombstones);
+            profiler_.Visit(run.seq);
+            stats_.run_reads += run.keys->Stats().reads + run.tombstones->Stats().reads - reads;
+        }
+    }
+
+    for (map<KeyType, bool>::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        if (it->second)
+        {
+            keys.push_back(it->first);
+        }
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.run_reads, 0);
+    }
+
+    return (long) (keys.size() - size);
+}
+
+inline int LsmTree::Insert(KeyType x)
+{
+    const bool profiling = profiler_.Begin(OP_INSERT, x, stats_.run_reads, 0);
+
+    if (0 == tombstones_->Delete(x))
+    {
+        --mem_count_;
+    }
+
+    if (0 == memtable_->Insert(x))
+    {
+        ++mem_count_;
+    }
+
+    ++stats_.inserts;
+    stats_.user_bytes += sizeof(KeyType);
+
+    if (mem_count_ >= memtable_capacity_)
+    {
+        Freeze();
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.run_reads, 0);
+    }
+
+    return 0;
+}
+
+inline int LsmTree::Delete(KeyType x)
+{
+    const bool profiling = profiler_.Begin(OP_DELETE, x, stats_.run_reads, 0);
+
+    if (0 == memtable_->Delete(x))
+    {
+        --mem_count_;
+    }
+
+    if (0 == tombstones_->Insert(x))
+    {
+        ++mem_count_;
+    }
+
+    ++stats_.deletes;
+    stats_.user_bytes += sizeof(KeyType);
+
+    if (mem_count_ >= memtable_capacity_)
+    {
+        Freeze();
+    }
+
+    if (profiling)
+    {
+        profiler_.End(stats_.run_reads, 0);
+    }
+
+    return 0;
+}
+
+inline void LsmTree::Freeze()
+{
+    shared_ptr<LsmTable> table(new LsmTable);
+    memtable_->Scan(numeric_limits<KeyType>::min(), numeric_limits<KeyType>::max(), table->keys);
+    tombstones_->Scan(numeric_limits<KeyType>::min(), numeric_limits<KeyType>::max(), table->tombstones);
+
+    memtable_.reset(new BTree);
+    tombstones_.reset(new BTree);
+    memtable_->SetVerbose(false);
+    tombstones_->SetVerbose(false);
+    mem_count_ = 0;
+
+    unique_lock<mutex> lock(mutex_);
+
+    // 冻结的表只能有一个；第0层的run太多时先等后台合并，保证查找要查的run的个数有上限。
+    // 等待期间查找还要用到旧的内存表，所以上面先取出了它的内容，换成新的内存表后冻结的表才发布
+    if (version_->immutable != NULL || (!version_->levels.empty() && (int) version_->levels[0].size() >= 2 * fanout_))
+    {
+        ++stats_.stalls;
+        while (version_->immutable != NULL
+            || (!version_->levels.empty() && (int) version_->levels[0].size() >= 2 * fanout_))
+        {
+            done_cond_.wait(lock);
+        }
+    }
+
+    shared_ptr<LsmVersion> version(new LsmVersion(*version_));
+    version->immutable = table;
+    version_ = version;
+
+    lock.unlock();
+    work_cond_.notify_one();
+}
+
+inline void LsmTree::Flush()
+{
+    if (mem_count_ > 0)
+    {
+        Freeze();
+    }
+
+    unique_lock<mutex> lock(mutex_);
+    while (version_->immutable != NULL)
+    {
+        done_cond_.wait(lock);
+    }
+
+    for (; ;)
+    {
+        bool pending = false;
+        for (size_t level = 0; level < version_->levels.size(); ++level)
+        {
+            pending = pending || ((int) version_->levels[level].size() >= fanout_);
+        }
+
+        if (!pending)
+        {
+            break;
+        }
+
+        done_cond_.wait(lock);
+    }
+}
+
+inline shared_ptr<LsmRun> LsmTree::WriteRun(const vector<KeyType>& keys, const vector<KeyType>& tombstones,
+    long long& bytes)
+{
+    long seq;
+    {
+        lock_guard<mutex> lock(mutex_);
+        seq = next_seq_++;
+    }
+
+    const string path = RunPath(seq);
+    const string tombstone_path = path + ".del";
+    remove(path.c_str());
+    remove(tombstone_path.c_str());
+
+    // 建好的DiskBTree析构时写文件头、签名和布隆过滤器，之后再用只读的DiskBTree打开
+    {
+        DiskBTree tree(path.c_str(), bloom_fpr_);
+        tree.BulkLoad(keys.data(), keys.size());
+        bytes = tree.Stats().bytes_written;
+    }
+
+    {
+        DiskBTree tree(tombstone_path.c_str(), bloom_fpr_);
+        tree.BulkLoad(tombstones.data(), tombstones.size());
+        bytes += tree.Stats().bytes_written;
+    }
+
+    return shared_ptr<LsmRun>(new LsmRun(path, seq, (long) keys.size(), (long) tombstones.size(), bloom_fpr_));
+}
+
+inline void LsmTree::FlushImmutable()
+{
+    shared_ptr<const LsmTable> table;
+    bool bottom;
+    {
+        lock_guard<mutex> lock(mutex_);
+        table = version_->immutable;
+
+        bottom = true;
+        for (size_t level = 0; level < version_->levels.size(); ++level)
+        {
+            bottom = bottom && version_->levels[level].empty();
+        }
+    }
+
+    // 没有更旧的run时，墓碑不用写
+    long long bytes;
+    const shared_ptr<LsmRun> run = WriteRun(table->keys, bottom ? vector<KeyType>() : table->tombstones, bytes);
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        shared_ptr<LsmVersion> version(new LsmVersion(*version_));
+        version->immutable.reset();
+        if (version->levels.empty())
+        {
+            version->levels.resize(1);
+        }
+
+        version->levels[0].push_back(run);
+        SaveManifest(*version);
+        version_ = version;
+
+        ++stats_.flushes;
+        stats_.flush_bytes += bytes;
+    }
+
+    done_cond_.notify_all();
+}
+
+inline void LsmTree::CompactLevel(int level)
+{
+    vector<shared_ptr<LsmRun> > inputs;
+    bool bottom;
+    {
+        lock_guard<mutex> lock(mutex_);
+        inputs = version_->levels[level];
+
+        bottom = true;
+        for (size_t i = level + 1; i < version_->levels.size(); ++i)
+        {
+            bottom = bottom && version_->levels[i].empty();
+        }
+    }
+
+    // 前台线程在用各个run的DiskBTree，后台线程另外以只读方式打开它们
+    map<KeyType, bool> merged;
+    vector<KeyType> keys, tombstones;
+
+    for (size_t i = inputs.size(); i > 0; --i)
+    {
+        keys.clear();
+        tombstones.clear();
+
+        DiskBTree run_keys(inputs[i - 1]->path.c_str());
+        run_keys.SetReadOnly(true);
+        run_keys.Scan(numeric_limits<KeyType>::min(), numeric_limits<KeyType>::max(), keys);
+
+        DiskBTree run_tombstones((inputs[i - 1]->path + ".del").c_str());
+        run_tombstones.SetReadOnly(true);
+        run_tombstones.Scan(numeric_limits<KeyType>::min(), numeric_limits<KeyType>::max(), tombstones);
+
+        MergeInto(merged, keys, tombstones);
+    }
+
+    keys.clear();
+    tombstones.clear();
+
+    for (map<KeyType, bool>::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        if (it->second)
+        {
+            keys.push_back(it->first);
+        }
+        else if (!bottom)
+        {
+            tombstones.push_back(it->first);
+        }
+    }
+
+    long long bytes;
+    const shared_ptr<LsmRun> run = WriteRun(keys, tombstones, bytes);
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        shared_ptr<LsmVersion> version(new LsmVersion(*version_));
+
+        // 只有后台线程修改各层的run，这一层在合并期间没有变过
+        version->levels[level].clear();
+        if ((int) version->levels.size() == level + 1)
+        {
+            version->levels.resize(level + 2);
+        }
+
+        version->levels[level + 1].push_back(run);
+        SaveManifest(*version);
+        version_ = version;
+
+        // manifest中已经没有它们了，最后一个引用（可能在前台线程拿着的旧版本中）释放时删除文件
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            inputs[i]->obsolete = true;
+        }
+
+        ++stats_.compactions;
+        stats_.compaction_bytes += bytes;
+    }
+
+    done_cond_.notify_all();
+}
+
+inline void LsmTree::BackgroundLoop()
+{
+    unique_lock<mutex> lock(mutex_);
+
+    for (; ;)
+    {
+        int level = -1;
+        for (size_t i = 0; i < version_->levels.size() && level < 0; ++i)
+        {
+            if ((int) version_->levels[i].size() >= fanout_)
+            {
+                level = (int) i;
+            }
+        }
+
+        if (version_->immutable != NULL)
+        {
+            lock.unlock();
+            FlushImmutable();
+            lock.lock();
+        }
+        else if (level >= 0)
+        {
+            lock.unlock();
+            CompactLevel(level);
+            lock.lock();
+        }
+        else if (stop_)
+        {
+            break;
+        }
+        else
+        {
+            work_cond_.wait(lock);
+        }
+    }
+}
+
+inline void LsmTree::LoadManifest()
+{
+    const string manifest_path = prefix_ + ".manifest";
+    ifstream ifs(manifest_path.c_str());
+    if (!ifs)
+    {
+        return;
+    }
+
+    shared_ptr<LsmVersion> version(new LsmVersion);
+    int level;
+    long seq, count, tombstone_count;
+
+    while (ifs >> level >> seq >> count >> tombstone_count)
+    {
+        if ((int) version->levels.size() <= level)
+        {
+            version->levels.resize(level + 1);
+        }
+
+        version->levels[level].push_back(
+            shared_ptr<LsmRun>(new LsmRun(RunPath(seq), seq, count, tombstone_count, bloom_fpr_)));
+        next_seq_ = max(next_seq_, seq + 1);
+    }
+
+    version_ = version;
+}
+
+inline void LsmTree::SaveManifest(const LsmVersion& version)
+{
+    const string manifest_path = prefix_ + ".manifest";
+    const string tmp_path = manifest_path + ".tmp";
+
+    {
+        ofstream ofs(tmp_path.c_str(), ios::trunc);
+        for (size_t level = 0; level < version.levels.size(); ++level)
+        {
+            for (size_t i = 0; i < version.levels[level].size(); ++i)
+            {
+                const LsmRun& run = *version.levels[level][i];
+                ofs << level << " " << run.seq << " " << run.count << " " << run.tombstone_count << endl;
+            }
+        }
+    }
+
+    rename(tmp_path.c_str(), manifest_path.c_str());
+}
+
+inline LsmTreeStats LsmTree::Stats()
+{
+    lock_guard<mutex> lock(mutex_);
+    LsmTreeStats stats = stats_;
+
+    stats.memtable_count = mem_count_;
+    stats.immutable_count = (version_->immutable != NULL)
+        ? (long) (version_->immutable->keys.size() + version_->immutable->tombstones.size()) : 0;
+
+    stats.level_runs.clear();
+    for (size_t level = 0; level < version_->levels.size(); ++level)
+    {
+        stats.level_runs.push_back((int) version_->levels[level].size());
+    }
+
+    // 第0层最多2 * fanout个run，其余各层在合并前最多fanout - 1个
+    const int level_count = max((int) version_->levels.size(), 1);
+    stats.max_runs = 2 * fanout_ + (level_count - 1) * (fanout_ - 1);
+
+    return stats;
+}
+
+inline void LsmTree::PrintStats()
+{
+    const LsmTreeStats stats = Stats();
+    const long long written = stats.flush_bytes + stats.compaction_bytes;
+
+    cout << "Statistics:" << endl
+        << "  inserts: " << stats.inserts << ", deletes: " << stats.deletes << ", searches: " << stats.searches
+        << ", memtable hits: " << stats.memtable_hits << endl
+        << "  run probes: " << stats.run_probes << ", run reads: " << stats.run_reads << " (" << setprecision(3)
+        << (stats.searches > 0 ? (double) stats.run_probes / stats.searches : 0) << " runs and "
+        << (stats.searches > 0 ? (double) stats.run_reads / stats.searches : 0) << " reads per search, at most "
+        << stats.max_runs << " runs)" << endl
+        << "  flushes: " << stats.flushes << ", compactions: " << stats.compactions << ", stalls: " << stats.stalls
+        << endl
+        << "  user bytes: " << stats.user_bytes << ", flush bytes: " << stats.flush_bytes << ", compaction bytes: "
+        << stats.compaction_bytes << " (write amplification "
+        << (stats.user_bytes > 0 ? (double) written / stats.user_bytes : 0) << ")" << endl
+        << "  memtable: " << stats.memtable_count << ", immutable: " << stats.immutable_count << ", runs per level:";
+
+    for (size_t level = 0; level < stats.level_runs.size(); ++level)
+    {
+        cout << " " << stats.level_runs[level];
+    }
+
+    cout << endl;
+}
+
+inline void LsmTree::ResetStats()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stats_ = LsmTreeStats();
+    }
+
+    profiler_.Reset();
+}
+
+inline void LsmTree::Print()
+{
+    const shared_ptr<const LsmVersion> version = CurrentVersion();
+
+    cout << "Memtable: " << mem_count_ << " keys and tombstones";
+    if (version->immutable != NULL)
+    {
+        cout << ", immutable: " << version->immutable->keys.size() << " keys, "
+            << version->immutable->tombstones.size() << " tombstones";
+    }
+
+    cout << endl;
+
+    for (size_t level = 0; level < version->levels.size(); ++level)
+    {
+        cout << "Level " << level << ":";
+        for (size_t i = 0; i < version->levels[level].size(); ++i)
+        {
+            const LsmRun& run = *version->levels[level][i];
+            cout << " run " << run.seq << " (" << run.count << " keys, " << run.tombstone_count << " tombstones)";
+        }
+
+        cout << endl;
+    }
+}
+
+#endif // LSM_TREE_H
@@ -0,0 +1,331 @@
+// posting_list: BTree中一个关键字的所有值（multimap），放在结点中与关键字并排的PostingList里
+//
+// 值从小到大排好序，第一个值按zigzag、之后的按与前一个值的差做变长编码（每字节7位，最高位表示后面还有），
+// 连续的序号这样每个只占一个字节。编码不超过POSTING_INLINE_BYTES字节时就放在结点中，超过了移到一串溢出页中，
+// 结点中只留第一页的指针。一个值的编码不跨页，所以取出所有的值就是从第一页开始顺序解码。
+// 不小于最大值的值直接追加到最后一页，否则（以及删除一个值时）整个解出来改好再重新编码。
+#ifndef POSTING_LIST_H
+#define POSTING_LIST_H
+
+#include <algorithm>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "btree_common.h"
+
+using namespace std;
+
+const int POSTING_INLINE_BYTES = 16; // 结点中能放下的编码的字节数
+const int POSTING_PAGE_SIZE = 256;   // 溢出页的大小
+const int POSTING_MAX_VARINT = 10;   // 一个64位数的变长编码最多的字节数
+
+struct PostingPage
+{
+    PostingPage* next;
+    PostingPage* tail;  // 只在第一页中有效：最后一页，追加时直接找到它
+    ValueType last;     // 只在第一页中有效：最大的值
+    uint32_t used;      // data中已用的字节数
+    unsigned char data[POSTING_PAGE_SIZE - 2 * sizeof(PostingPage*) - sizeof(ValueType) - sizeof(uint32_t)];
+};
+
+struct PostingList
+{
+    uint32_t count; // 值的个数
+    uint32_t size;  // 编码的总字节数，不超过POSTING_INLINE_BYTES时编码在data中，否则在head开始的溢出页中
+    union
+    {
+        unsigned char data[POSTING_INLINE_BYTES];
+        PostingPage* head;
+    };
+
+    bool IsInline() const
+    {
+        return size <= (uint32_t) POSTING_INLINE_BYTES;
+    }
+};
+
+/**
+ * @brief 溢出页的分配和释放。映像（BTree::Load映射的文件）中的页不释放，同BTree中映像里的结点
+ */
+class PostingAllocator
+{
+public:
+    PostingAllocator()
+    {
+        image_ = NULL;
+        image_size_ = 0;
+    }
+
+    void SetImage(const char* image, size_t image_size)
+    {
+        image_ = image;
+        image_size_ = image_size;
+    }
+
+    PostingPage* NewPage() const
+    {
+        PostingPage* page = new PostingPage;
+        page->next = NULL;
+        page->tail = page;
+        page->used = 0;
+        return page;
+    }
+
+    void DeletePage(PostingPage* page) const
+    {
+        if ((const char*) page < image_ || (const char*) page >= image_ + image_size_)
+        {
+            delete page;
+        }
+    }
+
+private:
+    const char* image_;
+    size_t image_size_;
+};
+
+inline uint64_t ZigZag(ValueType value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+inline ValueType UnZigZag(uint64_t x)
+{
+    return (ValueType) ((x >> 1) ^ (~(x & 1) + 1));
+}
+
+/**
+ * @return 写入的字节数，out至少要有POSTING_MAX_VARINT个字节
+ */
+inline int PutVarint(uint64_t x, unsigned char* out)
+{
+    int n = 0;
+    for (; x >= 0x80; x >>= 7)
+    {
+        out[n++] = (unsigned char) (x | 0x80);
+    }
+
+    out[n++] = (unsigned char) x;
+    return n;
+}
+
+/**
+ * @return 读出的字节数
+ */
+inline int GetVarint(const unsigned char* in, uint64_t& x)
+{
+    x = 0;
+    int n = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        const unsigned char b = in[n++];
+        x |= (uint64_t) (b & 0x7F) << shift;
+        if (b < 0x80)
+        {
+            return n;
+        }
+    }
+}
+
+inline void InitPosting(PostingList& list)
+{
+    memset(&list, 0, sizeof(list));
+}
+
+inline void FreePosting(PostingList& list, const PostingAllocator& allocator)
+{
+    if (!list.IsInline())
+    {
+        for (PostingPage* page = list.head; page != NULL; )
+        {
+            PostingPage* next = page->next;
+            allocator.DeletePage(page);
+            page = next;
+        }
+    }
+
+    InitPosting(list);
+}
+
+/**
+ * @brief 解码一段编码（结点中的或者一页中的），追加到values中
+ * @param value、count 这一段之前最后一个值和值的个数，解码后更新，下一段接着从它们开始
+ */
+inline void DecodePostingBytes(const unsigned char* data, uint32_t used, ValueType& value, uint32_t& count,
+    vector<ValueType>& values)
+{
+    for (uint32_t pos = 0; pos < used; ++count)
+    {
+        uint64_t x;
+        pos += GetVarint(data + pos, x);
+        value = (0 == count) ? UnZigZag(x) : (ValueType) ((uint64_t) value + x);
+        values.push_back(value);
+    }
+}
+
+/**
+ * @brief 按从小到大的顺序把所有的值追加到values中
+ */
+inline void DecodePosting(const PostingList& list, vector<ValueType>& values)
+{
+    ValueType value = 0;
+    uint32_t count = 0;
+
+    if (list.IsInline())
+    {
+        DecodePostingBytes(list.data, list.size, value, count, values);
+        return;
+    }
+
+    for (const PostingPage* page = list.head; page != NULL; page = page->next)
+    {
+        DecodePostingBytes(page->data, page->used, value, count, values);
+    }
+}
+
+/**
+ * @brief 追加一个值的编码，编码放不下时从结点中移到溢出页中，或者新开一页
+ */
+inline void AppendPostingBytes(PostingList& list, const unsigned char* bytes, int n, const PostingAllocator& allocator)
+{
+    if (list.IsInline() && list.size + n <= (uint32_t) POSTING_INLINE_BYTES)
+    {
+        memcpy(list.data + list.size, bytes, n);
+        list.size += n;
+        return;
+    }
+
+    if (list.IsInline())
+    {
+        // 结点中已有的编码原样搬到第一页中，最大的值由调用者设置
+        PostingPage* page = allocator.NewPage();
+        memcpy(page->data, list.data, list.size);
+        page->used = list.size;
+        list.head = page;
+    }
+
+    PostingPage* tail = list.head->tail;
+    if (tail->used + n > sizeof(tail->data))
+    {
+        tail->next = allocator.NewPage();
+        tail = list.head->tail = tail->next;
+    }
+
+    memcpy(tail->data + tail->used, bytes, n);
+    tail->used += n;
+    list.size += n;
+}
+
+/**
+ * @brief 用排好序的values重新编码
+ */
+inline void RebuildPosting(PostingList& list, const vector<ValueType>& values, const PostingAllocator& allocator)
+{
+    FreePosting(list, allocator);
+    unsigned char bytes[POSTING_MAX_VARINT];
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const uint64_t x = (0 == i) ? ZigZag(values[0]) : (uint64_t) values[i] - (uint64_t) values[i - 1];
+        AppendPostingBytes(list, bytes, PutVarint(x, bytes), allocator);
+    }
+
+    list.count = (uint32_t) values.size();
+    if (!list.IsInline())
+    {
+        list.head->last = values.back();
+    }
+}
+
+/**
+ * @return 最大的值，list不能为空
+ */
+inline ValueType LastPosting(const PostingList& list)
+{
+    if (!list.IsInline())
+    {
+        return list.head->last;
+    }
+
+    ValueType value = 0;
+    uint64_t x;
+    for (uint32_t pos = 0, i = 0; pos < list.size; ++i)
+    {
+        pos += GetVarint(list.data + pos, x);
+        value = (0 == i) ? UnZigZag(x) : (ValueType) ((uint64_t) value + x);
+    }
+
+    return value;
+}
+
+/**
+ * @brief 加入一个值，同一个值可以出现多次
+ */
+inline void AddPosting(PostingList& list, ValueType value, const PostingAllocator& allocator)
+{
+    unsigned char bytes[POSTING_MAX_VARINT];
+
+    if (0 == list.count)
+    {
+        AppendPostingBytes(list, bytes, PutVarint(ZigZag(value), bytes), allocator);
+    }
+    else
+    {
+        const ValueType last = LastPosting(list);
+        if (value < last)
+        {
+            vector<ValueType> values;
+            values.reserve(list.count + 1);
+            DecodePosting(list, values);
+            values.insert(upper_bound(values.begin(), values.end(), value), value);
+            RebuildPosting(list, values, allocator);
+            return;
+        }
+
+        AppendPostingBytes(list, bytes, PutVarint((uint64_t) value - (uint64_t) last, bytes), allocator);
+    }
+
+    ++list.count;
+    if (!list.IsInline())
+    {
+        list.head->last = value;
+    }
+}
+
+/**
+ * @brief 删除一个值（出现多次时只删一个）
+ * @return =0成功，没有这个值时返回-1
+ */
+inline int RemovePosting(PostingList& list, ValueType value, const PostingAllocator& allocator)
+{
+    vector<ValueType> values;
+    values.reserve(list.count);
+    DecodePosting(list, values);
+
+    const vector<ValueType>::iterator it = lower_bound(values.begin(), values.end(), value);
+    if (it == values.end() || *it != value)
+    {
+        return -1;
+    }
+
+    values.erase(it);
+    RebuildPosting(list, values, allocator);
+    return 0;
+}
+
+/**
+ * @brief 溢出页的个数
+ */
+inline long PostingPageCount(const PostingList& list)
+{
+    long count = 0;
+    for (const PostingPage* page = list.IsInline() ? NULL : list.head; page != NULL; page = page->next)
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+#endif // POSTING_LIST_H
@@ -0,0 +1,951 @@
+// sharded_tree: 按关键字范围分片的树，每个分片是一棵BTree或者DiskBTree，由一个工作线程独占
+//
+// 关键字空间分成若干个连续的范围，每个范围一个分片。分片的树只有它的工作线程访问，不用加锁；客户线程把请求
+// 放进分片的无锁队列（多生产者单消费者，Vyukov的侵入式MPSC队列），然后等工作线程做完。点操作路由到一个分片，
+// 范围查询按分片的边界切开，同时发给各个分片，结果按分片的顺序拼起来。
+//
+// 路由表（各个分片的下界）是不可变的，整个替换（shared_ptr的原子读写）。Rebalance按上次以来各个分片的操作数
+// 找出最热的分片，热到一定程度时在它的中位数处分成两个，在线迁移：
+//   1. 中位数：增强的树用Select(Count / 2)，否则用工作线程对做过的操作的关键字蓄水池抽样的中位数，都不扫描分片
+//   2. 新建一个分片，范围是空的[中位数, 中位数 - 1]
+//   3. 给旧分片发SPLIT请求：工作线程从中位数开始每次取出并删掉至多SHARD_MIGRATE_BATCH个关键字，放在LOAD请求中
+//      交给新分片，新分片插入后把上界推到这一批的末尾。两批之间照常处理至多SHARD_MIGRATE_OPS个请求，已经迁移
+//      过去的关键字的请求转给新分片（排在那一批的LOAD后面），跨过去的范围查询分成几段。迁移完旧分片缩小范围
+//   4. 发布新的路由表，之后新的请求直接去新分片；再给旧分片发SPLIT_END，停止转发
+// 按旧路由表发给旧分片、排在SPLIT_END后面的请求已经不归它管了，工作线程返回STALE，客户线程重读路由表后重发。
+#ifndef SHARDED_TREE_H
+#define SHARDED_TREE_H
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include "btree.h"
+#include "disk_btree.h"
+
+using namespace std;
+
+const int SHARD_COUNT = 4;
+const int MAX_SHARD_COUNT = 64;
+const double HOT_SHARD_FACTOR = 2.0; // 最热的分片的操作数超过其余分片的平均的这么多倍时分裂
+const long MIN_REBALANCE_OPS = 1000; // 上次以来的操作数太少时不分裂，统计不可靠
+const long SINGLE_SHARD_SPLIT_OPS = 16 * MIN_REBALANCE_OPS; // 只有一个分片时上次以来的操作数达到这么多就分裂
+const size_t SHARD_SAMPLE_SIZE = 256;  // 不是增强的树时，用这么多个关键字的抽样估计中位数
+const size_t SHARD_MIGRATE_BATCH = 4096; // 分裂时每批迁移的关键字个数
+const int SHARD_MIGRATE_OPS = 64;      // 分裂时两批之间至多处理的请求个数
+
+enum ShardOpType
+{
+    SHARD_INSERT,
+    SHARD_DELETE,
+    SHARD_SEARCH,
+    SHARD_SCAN,
+    SHARD_VERBOSE,
+    SHARD_MEDIAN,
+    SHARD_SPLIT,
+    SHARD_LOAD,
+    SHARD_SPLIT_END,
+    SHARD_STOP
+};
+
+enum ShardRequestState
+{
+    SHARD_PENDING,
+    SHARD_DONE,
+    SHARD_STALE   // 关键字已经不归这个分片了，重读路由表后重发
+};
+
+template <class Tree> class Shard;
+
+/**
+ * @brief 发给分片的请求，由客户线程分配（一般在栈上），做完之前不能释放。LOAD请求例外：由迁移的工作线程new出来，
+ *        接收的工作线程做完后连同keys一起delete
+ */
+template <class Tree>
+struct ShardRequest
+{
+    atomic<ShardRequest*> next; // MPSC队列中的链接
+    ShardOpType type;
+    KeyType key;                // SCAN时是lo，SPLIT时是分裂点
+    KeyType hi;                 // SCAN的hi，MEDIAN的结果，LOAD的这一批的上界
+    vector<KeyType>* keys;      // SCAN的结果，LOAD的这一批关键字
+    Shard<Tree>* target;        // SPLIT时的新分片
+    int result;
+    atomic<int> state;
+
+    ShardRequest() : next(NULL), type(SHARD_SEARCH), key(0), hi(0), keys(NULL), target(NULL), result(0),
+        state(SHARD_PENDING)
+    {
+    }
+
+    /**
+     * @brief 等工作线程做完，先自旋，再让出CPU
+     */
+    int Wait() const
+    {
+        int s;
+        for (int spins = 0; SHARD_PENDING == (s = state.load(memory_order_acquire)); ++spins)
+        {
+            if (spins >= 1000)
+            {
+                this_thread::yield();
+            }
+        }
+
+        return s;
+    }
+};
+
+/**
+ * @brief Vyukov的侵入式多生产者单消费者队列：Push是一次原子交换，不会阻塞；Pop只能由一个线程调用
+ */
+template <class Tree>
+class MpscQueue
+{
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_)
+    {
+    }
+
+    void Push(ShardRequest<Tree>* node)
+    {
+        node->next.store(NULL, memory_order_relaxed);
+        ShardRequest<Tree>* prev = head_.exchange(node, memory_order_acq_rel);
+        prev->next.store(node, memory_order_release);
+    }
+
+    /**
+     * @return 队列为空（或者有生产者正在Push，还没有链上）时返回NULL
+     */
+    ShardRequest<Tree>* Pop()
+    {
+        ShardRequest<Tree>* tail = tail_;
+        ShardRequest<Tree>* next = tail->next.load(memory_order_acquire);
+
+        if (tail == &stub_)
+        {
+            if (NULL == next)
+            {
+                return NULL;
+            }
+
+            tail_ = next;
+            tail = next;
+            next = next->next.load(memory_order_acquire);
+        }
+
+        if (next != NULL)
+        {
+            tail_ = next;
+            return tail;
+        }
+
+        if (tail != head_.load(memory_order_acquire))
+        {
+            return NULL;
+        }
+
+        // tail是最后一个结点，把stub_放回去，tail才能取走
+        Push(&stub_);
+        next = tail->next.load(memory_order_acquire);
+        if (next != NULL)
+        {
+            tail_ = next;
+            return tail;
+        }
+
+        return NULL;
+    }
+
+private:
+    atomic<ShardRequest<Tree>*> head_; // 生产者往这一头放
+    ShardRequest<Tree>* tail_;         // 消费者从这一头取
+    ShardRequest<Tree> stub_;
+};
+
+/**
+ * @brief 一个分片：一棵树、它的请求队列和独占它的工作线程。范围[lo_, hi_]只由工作线程修改
+ */
+template <class Tree>
+class Shard
+{
+public:
+    /**
+     * @param lo, hi 负责的范围，hi < lo时是空的（分裂出来的新分片，等LOAD把上界推上去）
+     */
+    Shard(int id, Tree* tree, KeyType lo, KeyType hi);
+
+    /**
+     * @brief 发STOP请求并等工作线程退出
+     */
+    ~Shard();
+
+    void Submit(ShardRequest<Tree>* req);
+
+    int Id() const
+    {
+        return id_;
+    }
+
+    /**
+     * @brief 工作线程做过的点操作和范围查询的个数
+     */
+    long Ops() const
+    {
+        return ops_.load(memory_order_relaxed);
+    }
+
+    KeyType Lo() const
+    {
+        return lo_.load(memory_order_relaxed);
+    }
+
+    KeyType Hi() const
+    {
+        return hi_.load(memory_order_relaxed);
+    }
+
+private:
+    void Run();
+    void Process(ShardRequest<Tree>* req);
+
+    /**
+     * @brief 这个分片能回答的范围查询的上界：迁移完、SPLIT_END之前还要回答到迁移过去的范围的上界
+     */
+    KeyType ScanHi(KeyType hi) const
+    {
+        return (target_ != NULL && split_hi_ > hi) ? split_hi_ : hi;
+    }
+
+    /**
+     * @brief 范围查询，跨过已经迁移过去的范围时中间一段同步地交给target_
+     */
+    void Scan(ShardRequest<Tree>* req);
+
+    /**
+     * @brief 找分裂点，只读O(log n)个结点
+     * @return =0成功，分裂点放在mid中，它大于lo_，分裂后两边的范围都不空
+     */
+    int Median(KeyType& mid);
+
+    /**
+     * @brief 把分裂点以上还没有迁移的关键字中最小的至多SHARD_MIGRATE_BATCH个取出、删掉，用LOAD请求交给target_，
+     *        全部迁移完时缩小范围、标记SPLIT请求做完
+     */
+    void MigrateBatch();
+
+    /**
+     * @brief 对做过的操作的关键字蓄水池抽样
+     */
+    void Sample(KeyType x);
+
+private:
+    int id_;
+    unique_ptr<Tree> tree_;
+    atomic<KeyType> lo_;
+    atomic<KeyType> hi_;
+    atomic<long> ops_;
+
+    MpscQueue<Tree> queue_;
+    atomic<bool> sleeping_;  // 工作线程队列空了、要睡眠时置上，Submit看到后才去唤醒它
+    mutex mutex_;
+    condition_variable cond_;
+    bool signaled_;          // 由mutex_保护
+
+    // 以下只由工作线程读写
+    ShardRequest<Tree>* split_; // 正在迁移的SPLIT请求，迁移完才标记做完
+    Shard* target_;             // 分裂出来的新分片，SPLIT_END之前[split_lo_, split_hi_]中的请求转给它
+    KeyType split_lo_;          // 分裂点
+    KeyType split_hi_;          // 已经迁移过去的范围的上界，split_hi_ < split_lo_时还没有迁移
+    int split_ops_;             // 上次迁移一批以来处理的请求个数
+    vector<KeyType> sample_;
+    long sample_seen_;
+    mt19937 rng_;
+
+    thread worker_;
+};
+
+/**
+ * @brief 一个分片的统计
+ */
+struct ShardStats
+{
+    int id;
+    KeyType lo;
+    KeyType hi;
+    long ops;
+};
+
+struct ShardedTreeStats
+{
+    vector<ShardStats> shards; // 按范围排列
+    long splits;               // 分裂热分片的次数
+    long stale_retries;        // 请求发给了旧分片，重读路由表后重发的次数
+};
+
+template <class Tree>
+class ShardedTree
+{
+public:
+    typedef function<Tree*(int shard_id)> TreeFactory;
+
+    /**
+     * @param factory 为编号为shard_id的分片新建一棵空树，分裂时也用它。DiskBTree的每个分片要用不同的文件
+     * @param shard_count 开始时的分片个数，关键字空间平均分
+     * @param rebalance_ms >0时后台线程每隔这么多毫秒Rebalance一次，为0时只能手动调用Rebalance
+     */
+    ShardedTree(const TreeFactory& factory, int shard_count = SHARD_COUNT, int rebalance_ms = 0);
+    ~ShardedTree();
+
+    int Insert(KeyType x)
+    {
+        return PointOp(SHARD_INSERT, x);
+    }
+
+    int Delete(KeyType x)
+    {
+        return PointOp(SHARD_DELETE, x);
+    }
+
+    bool Search(KeyType x)
+    {
+        return PointOp(SHARD_SEARCH, x) != 0;
+    }
+
+    /**
+     * @brief 把[lo, hi]中的关键字按升序追加到keys中，各个分片并行查找
+     * @return 追加的关键字个数
+     */
+    long Scan(KeyType lo, KeyType hi, vector<KeyType>& keys);
+
+    /**
+     * @brief 设置各个分片的树是否打印提示
+     */
+    void SetVerbose(bool verbose);
+
+    /**
+     * @brief 最热的分片的操作数（上次Rebalance以来）超过其余分片的平均的HOT_SHARD_FACTOR倍时，在它的中位数处
+     *        在线分裂。不与包括它自己在内的平均比：只有一两个分片时最热的分片不可能超过平均的两倍。
+     *        只有一个分片时操作数达到SINGLE_SHARD_SPLIT_OPS就分裂
+     * @return =0分裂了一个分片，否则返回-1
+     */
+    int Rebalance();
+
+    ShardedTreeStats Stats();
+    void PrintStats();
+
+private:
+    struct Routing
+    {
+        vector<KeyType> lows;          // 各个分片的下界，升序
+        vector<Shard<Tree>*> shards;
+
+        size_t Find(KeyType x) const
+        {
+            return upper_bound(lows.begin(), lows.end(), x) - lows.begin() - 1;
+        }
+    };
+
+    int PointOp(ShardOpType type, KeyType x);
+
+    shared_ptr<const Routing> CurrentRouting() const
+    {
+        return atomic_load(&routing_);
+    }
+
+    void MonitorLoop(int rebalance_ms);
+
+private:
+    TreeFactory factory_;
+    shared_ptr<const Routing> routing_;   // 用atomic_load/atomic_store读写
+    vector<unique_ptr<Shard<Tree> > > all_shards_; // 由rebalance_mutex_保护
+    vector<long> last_ops_;               // 上次统计负载时各个分片（按all_shards_的下标）的操作数
+    int next_id_;
+    bool verbose_;
+
+    mutex rebalance_mutex_;
+    atomic<long> splits_;
+    atomic<long> stale_retries_;
+
+    mutex monitor_mutex_;
+    condition_variable monitor_cond_;
+    bool stop_;
+    thread monitor_;
+};
+
+template <class Tree>
+inline Shard<Tree>::Shard(int id, Tree* tree, KeyType lo, KeyType hi)
+    : id_(id), tree_(tree), lo_(lo), hi_(hi), ops_(0), sleeping_(false), signaled_(false), split_(NULL),
+    target_(NULL), split_lo_(0), split_hi_(0), split_ops_(0), sample_seen_(0), rng_(id)
+{
+    worker_ = thread(&Shard::Run, this);
+
+    // 每个核一个工作线程
+    const unsigned cpu_count = thread::hardware_concurrency();
+    if (cpu_count > 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(id % cpu_count, &cpus);
+        pthread_setaffinity_np(worker_.native_handle(), sizeof(cpus), &cpus);
+    }
+}
+
+template <class Tree>
+inline Shard<Tree>::~Shard()
+{
+    ShardRequest<Tree> req;
+    req.type = SHARD_STOP;
+    Submit(&req);
+    req.Wait();
+    worker_.join();
+}
+
+template <class Tree>
+inline void Shard<Tree>::Submit(ShardRequest<Tree>* req)
+{
+    queue_.Push(req);
+
+    // 与Run中先置sleeping_再查队列配对（Dekker式的先写后读）：Push中链上req的最后一次写是普通的release写，
+    // 不加全屏障时它可能还在store buffer中、sleeping_已经读到了false，Run那边Pop又看到没链上的req，双方都错过
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sleeping_.load(memory_order_relaxed))
+    {
+        lock_guard<mutex> lock(mutex_);
+        signaled_ = true;
+        cond_.notify_one();
+    }
+}
+
+template <class Tree>
+inline void Shard<Tree>::Run()
+{
+    for (; ;)
+    {
+        ShardRequest<Tree>* req = NULL;
+
+        if (split_ != NULL)
+        {
+            // 迁移中不睡眠：队列空了或者做了SHARD_MIGRATE_OPS个请求时迁移一批
+            req = queue_.Pop();
+            if (NULL == req || ++split_ops_ >= SHARD_MIGRATE_OPS)
+            {
+                MigrateBatch();
+                split_ops_ = 0;
+            }
+
+            if (NULL == req)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            for (int spins = 0; spins < 1000 && NULL == req; ++spins)
+            {
+                req = queue_.Pop();
+            }
+        }
+
+        if (NULL == req)
+        {
+            unique_lock<mutex> lock(mutex_);
+            sleeping_.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst); // 同Submit，置上sleeping_之后再查队列
+
+            while (NULL == (req = queue_.Pop()))
+            {
+                cond_.wait(lock, [this] { return signaled_; });
+                signaled_ = false;
+            }
+
+            sleeping_.store(false, memory_order_relaxed);
+        }
+
+        if (SHARD_STOP == req->type)
+        {
+            req->state.store(SHARD_DONE, memory_order_release);
+            return;
+        }
+
+        Process(req);
+    }
+}
+
+template <class Tree>
+inline void Shard<Tree>::Process(ShardRequest<Tree>* req)
+{
+    const KeyType lo = lo_.load(memory_order_relaxed);
+    const KeyType hi = hi_.load(memory_order_relaxed);
+    int state = SHARD_DONE;
+
+    switch (req->type)
+    {
+        case SHARD_INSERT:
+        case SHARD_DELETE:
+        case SHARD_SEARCH:
+            if (target_ != NULL && req->key >= split_lo_ && req->key <= split_hi_)
+            {
+                target_->Submit(req); // 已经迁移过去了，排在那一批的LOAD后面
+                return;
+            }
+
+            if (req->key < lo || req->key > hi)
+            {
+                state = SHARD_STALE;
+                break;
+            }
+
+            ops_.fetch_add(1, memory_order_relaxed);
+            Sample(req->key);
+            if (SHARD_SEARCH == req->type)
+            {
+                req->result = tree_->Search(req->key) ? 1 : 0;
+            }
+            else
+            {
+                req->result = (SHARD_INSERT == req->type) ? tree_->Insert(req->key) : tree_->Delete(req->key);
+            }
+            break;
+
+        case SHARD_SCAN:
+            if (req->key < lo || req->hi > ScanHi(hi))
+            {
+                state = SHARD_STALE;
+                break;
+            }
+
+            ops_.fetch_add(1, memory_order_relaxed);
+            Sample(req->key);
+            Scan(req);
+            break;
+
+        case SHARD_VERBOSE:
+            tree_->SetVerbose(req->key != 0);
+            break;
+
+        case SHARD_MEDIAN:
+            req->result = Median(req->hi);
+            break;
+
+        case SHARD_SPLIT:
+            // 迁移完才标记做完，见MigrateBatch
+            split_ = req;
+            target_ = req->target;
+            split_lo_ = req->key;
+            split_hi_ = req->key - 1;
+            split_ops_ = 0;
+            sample_.clear();
+            sample_seen_ = 0;
+            return;
+
+        case SHARD_LOAD:
+            // 这一批都大于已有的关键字，逐个插入走最右路径的追加
+            for (size_t i = 0; i < req->keys->size(); ++i)
+            {
+                tree_->Insert((*req->keys)[i]);
+            }
+
+            hi_.store(req->hi, memory_order_relaxed);
+            delete req->keys;
+            delete req;
+            return;
+
+        case SHARD_SPLIT_END:
+            target_ = NULL;
+            break;
+
+        default:
+            break;
+    }
+
+    req->state.store(state, memory_order_release);
+}
+
+template <class Tree>
+inline void Shard<Tree>::Scan(ShardRequest<Tree>* req)
+{
+    const size_t size = req->keys->size();
+
+    if (NULL == target_ || req->hi < split_lo_ || req->key > split_hi_)
+    {
+        tree_->Scan(req->key, req->hi, *req->keys);
+    }
+    else
+    {
+        if (req->key < split_lo_)
+        {
+            tree_->Scan(req->key, split_lo_ - 1, *req->keys);
+        }
+
+        // target_从不等这个分片，同步地等它不会死锁；它先做完了迁移过去的LOAD，有[split_lo_, split_hi_]
+        ShardRequest<Tree> part;
+        part.type = SHARD_SCAN;
+        part.key = max(req->key, split_lo_);
+        part.hi = min(req->hi, split_hi_);
+        part.keys = req->keys;
+        target_->Submit(&part);
+        part.Wait();
+
+        if (req->hi > split_hi_)
+        {
+            tree_->Scan(split_hi_ + 1, req->hi, *req->keys);
+        }
+    }
+
+    req->result = (int) (req->keys->size() - size);
+}
+
+template <class Tree>
+inline int Shard<Tree>::Median(KeyType& mid)
+{
+    const KeyType lo = lo_.load(memory_order_relaxed);
+    const KeyType hi = hi_.load(memory_order_relaxed);
+
+    // 增强的树：从根结点往下走三趟
+    const long count = tree_->Count(lo, hi);
+    if (count >= 0)
+    {
+        return (count >= 2 && 0 == tree_->Select(tree_->Rank(lo) + count / 2, mid)) ? 0 : -1;
+    }
+
+    // 否则用抽样的中位数，按负载而不是关键字个数分，正是分裂热分片要的
+    if (sample_.size() < 2)
+    {
+        return -1;
+    }
+
+    vector<KeyType> keys(sample_);
+    nth_element(keys.begin(), keys.begin() + keys.size() / 2, keys.end());
+    mid = keys[keys.size() / 2];
+    return (mid > lo) ? 0 : -1;
+}
+
+template <class Tree>
+inline void Shard<Tree>::MigrateBatch()
+{
+    const KeyType hi = hi_.load(memory_order_relaxed);
+
+    vector<KeyType>* keys = new vector<KeyType>;
+    tree_->Scan(split_hi_ + 1, hi, *keys, SHARD_MIGRATE_BATCH);
+
+    const KeyType end = (keys->size() < SHARD_MIGRATE_BATCH) ? hi : keys->back();
+    if (!keys->empty())
+    {
+        tree_->DeleteRange(split_hi_ + 1, end);
+    }
+
+    ShardRequest<Tree>* load = new ShardRequest<Tree>;
+    load->type = SHARD_LOAD;
+    load->keys = keys;
+    load->hi = end;
+    target_->Submit(load);
+    split_hi_ = end;
+
+    if (end == hi)
+    {
+        hi_.store(split_lo_ - 1, memory_order_relaxed);
+        split_->state.store(SHARD_DONE, memory_order_release);
+        split_ = NULL;
+    }
+}
+
+template <class Tree>
+inline void Shard<Tree>::Sample(KeyType x)
+{
+    ++sample_seen_;
+    if (sample_.size() < SHARD_SAMPLE_SIZE)
+    {
+        sample_.push_back(x);
+        return;
+    }
+
+    const unsigned long j = rng_() % (unsigned long) sample_seen_;
+    if (j < SHARD_SAMPLE_SIZE)
+    {
+        sample_[j] = x;
+    }
+}
+
+template <class Tree>
+inline ShardedTree<Tree>::ShardedTree(const TreeFactory& factory, int shard_count, int rebalance_ms)
+    : factory_(factory), next_id_(0), verbose_(true), splits_(0), stale_retries_(0), stop_(false)
+{
+    shard_count = max(1, min(shard_count, MAX_SHARD_COUNT));
+    shared_ptr<Routing> routing(new Routing);
+
+    const double lowest = (double) numeric_limits<KeyType>::min();
+    const double width = ((double) numeric_limits<KeyType>::max() - lowest + 1) / shard_count;
+
+    for (int i = 0; i < shard_count; ++i)
+    {
+        const KeyType lo = (KeyType) (lowest + width * i);
+        const KeyType hi = (i + 1 < shard_count) ? (KeyType) (lowest + width * (i + 1)) - 1
+            : numeric_limits<KeyType>::max();
+
+        all_shards_.push_back(unique_ptr<Shard<Tree> >(new Shard<Tree>(next_id_, factory_(next_id_), lo, hi)));
+        ++next_id_;
+
+        routing->lows.push_back(lo);
+        routing->shards.push_back(all_shards_.back().get());
+    }
+
+    last_ops_.assign(all_shards_.size(), 0);
+    atomic_store(&routing_, shared_ptr<const Routing>(routing));
+
+    if (rebalance_ms > 0)
+    {
+        monitor_ = thread(&ShardedTree::MonitorLoop, this, rebalance_ms);
+    }
+}
+
+template <class Tree>
+inline ShardedTree<Tree>::~ShardedTree()
+{
+    if (monitor_.joinable())
+    {
+        {
+            lock_guard<mutex> lock(monitor_mutex_);
+            stop_ = true;
+        }
+
+        monitor_cond_.notify_one();
+        monitor_.join();
+    }
+
+    all_shards_.clear(); // 逐个停止工作线程
+}
+
+template <class Tree>
+inline int ShardedTree<Tree>::PointOp(ShardOpType type, KeyType x)
+{
+    ShardRequest<Tree> req;
+    req.type = type;
+    req.key = x;
+
+    for (; ;)
+    {
+        const shared_ptr<const Routing> routing = CurrentRouting();
+        req.state.store(SHARD_PENDING, memory_order_relaxed);
+        routing->shards[routing->Find(x)]->Submit(&req);
+
+        if (req.Wait() != SHARD_STALE)
+        {
+            return req.result;
+        }
+
+        stale_retries_.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+template <class Tree>
+inline long ShardedTree<Tree>::Scan(KeyType lo, KeyType hi, vector<KeyType>& keys)
+{
+    if (lo > hi)
+    {
+        return 0;
+    }
+
+    for (; ;)
+    {
+        const shared_ptr<const Routing> routing = CurrentRouting();
+        const size_t first = routing->Find(lo);
+        const size_t last = routing->Find(hi);
+
+        // 按分片的边界切开，同时发出去
+        vector<ShardRequest<Tree> > reqs(last - first + 1);
+        vector<vector<KeyType> > parts(reqs.size());
+
+        for (size_t j = 0; j < reqs.size(); ++j)
+        {
+            const size_t s = first + j;
+            reqs[j].type = SHARD_SCAN;
+            reqs[j].key = max(lo, routing->lows[s]);
+            reqs[j].hi = (s + 1 < routing->lows.size()) ? min(hi, routing->lows[s + 1] - 1) : hi;
+            reqs[j].keys = &parts[j];
+            routing->shards[s]->Submit(&reqs[j]);
+        }
+
+        bool stale = false;
+        for (size_t j = 0; j < reqs.size(); ++j)
+        {
+            stale = (reqs[j].Wait() == SHARD_STALE) || stale;
+        }
+
+        if (stale)
+        {
+            stale_retries_.fetch_add(1, memory_order_relaxed);
+            continue;
+        }
+
+        const size_t size = keys.size();
+        for (size_t j = 0; j < parts.size(); ++j)
+        {
+            keys.insert(keys.end(), parts[j].begin(), parts[j].end());
+        }
+
+        return (long) (keys.size() - size);
+    }
+}
+
+template <class Tree>
+inline void ShardedTree<Tree>::SetVerbose(bool verbose)
+{
+    lock_guard<mutex> lock(rebalance_mutex_);
+    verbose_ = verbose;
+
+    vector<ShardRequest<Tree> > reqs(all_shards_.size());
+    for (size_t i = 0; i < all_shards_.size(); ++i)
+    {
+        reqs[i].type = SHARD_VERBOSE;
+        reqs[i].key = verbose ? 1 : 0;
+        all_shards_[i]->Submit(&reqs[i]);
+    }
+
+    for (size_t i = 0; i < reqs.size(); ++i)
+    {
+        reqs[i].Wait();
+    }
+}
+
+template <class Tree>
+inline int ShardedTree<Tree>::Rebalance()
+{
+    lock_guard<mutex> lock(rebalance_mutex_);
+
+    if ((int) all_shards_.size() >= MAX_SHARD_COUNT)
+    {
+        return -1;
+    }
+
+    // 上次以来各个分片的操作数
+    vector<long> ops(all_shards_.size());
+    long total = 0, hottest_ops = -1;
+    size_t hottest = 0;
+
+    for (size_t i = 0; i < all_shards_.size(); ++i)
+    {
+        ops[i] = all_shards_[i]->Ops();
+        const long delta = ops[i] - last_ops_[i];
+
+        total += delta;
+        if (delta > hottest_ops)
+        {
+            hottest_ops = delta;
+            hottest = i;
+        }
+    }
+
+    const size_t n = all_shards_.size();
+    if (total < ((1 == n) ? SINGLE_SHARD_SPLIT_OPS : MIN_REBALANCE_OPS)) // 继续累计
+    {
+        return -1;
+    }
+
+    last_ops_ = ops;
+    if (n > 1 && hottest_ops <= HOT_SHARD_FACTOR * (total - hottest_ops) / (n - 1))
+    {
+        return -1;
+    }
+
+    Shard<Tree>* shard = all_shards_[hottest].get();
+
+    // 1. 找分裂点
+    ShardRequest<Tree> median;
+    median.type = SHARD_MEDIAN;
+    shard->Submit(&median);
+    median.Wait();
+    if (median.result != 0)
+    {
+        return -1;
+    }
+
+    // 2. 新分片开始时范围是空的
+    const KeyType mid = median.hi;
+    Tree* tree = factory_(next_id_);
+    tree->SetVerbose(verbose_);
+    all_shards_.push_back(unique_ptr<Shard<Tree> >(new Shard<Tree>(next_id_, tree, mid, mid - 1)));
+    last_ops_.push_back(0);
+    ++next_id_;
+
+    // 3. 旧分片分批迁移，其间照常处理请求
+    ShardRequest<Tree> split;
+    split.type = SHARD_SPLIT;
+    split.key = mid;
+    split.target = all_shards_.back().get();
+    shard->Submit(&split);
+    split.Wait();
+
+    // 4. 发布新的路由表，旧分片不再转发
+    shared_ptr<Routing> routing(new Routing(*CurrentRouting()));
+    const size_t pos = routing->Find(mid) + 1;
+    routing->lows.insert(routing->lows.begin() + pos, mid);
+    routing->shards.insert(routing->shards.begin() + pos, all_shards_.back().get());
+    atomic_store(&routing_, shared_ptr<const Routing>(routing));
+
+    ShardRequest<Tree> end;
+    end.type = SHARD_SPLIT_END;
+    shard->Submit(&end);
+    end.Wait();
+
+    splits_.fetch_add(1, memory_order_relaxed);
+    return 0;
+}
+
+template <class Tree>
+inline void ShardedTree<Tree>::MonitorLoop(int rebalance_ms)
+{
+    unique_lock<mutex> lock(monitor_mutex_);
+
+    while (!monitor_cond_.wait_for(lock, chrono::milliseconds(rebalance_ms), [this] { return stop_; }))
+    {
+        lock.unlock();
+        Rebalance();
+        lock.lock();
+    }
+}
+
+template <class Tree>
+inline ShardedTreeStats ShardedTree<Tree>::Stats()
+{
+    const shared_ptr<const Routing> routing = CurrentRouting();
+    ShardedTreeStats stats;
+
+    for (size_t i = 0; i < routing->shards.size(); ++i)
+    {
+        const Shard<Tree>* shard = routing->shards[i];
+        const ShardStats s = { shard->Id(), shard->Lo(), shard->Hi(), shard->Ops() };
+        stats.shards.push_back(s);
+    }
+
+    stats.splits = splits_.load(memory_order_relaxed);
+    stats.stale_retries = stale_retries_.load(memory_order_relaxed);
+    return stats;
+}
+
+template <class Tree>
+inline void ShardedTree<Tree>::PrintStats()
+{
+    const ShardedTreeStats stats = Stats();
+
+    cout << "Statistics:" << endl
+        << "  shards: " << stats.shards.size() << ", splits: " << stats.splits << ", stale retries: "
+        << stats.stale_retries << endl;
+
+    for (size_t i = 0; i < stats.shards.size(); ++i)
+    {
+        const ShardStats& s = stats.shards[i];
+        cout << "  shard " << s.id << ": " << s.lo << ".." << s.hi << ", ops: " << s.ops << endl;
+    }
+}
+
+#endif // SHARDED_TREE_H
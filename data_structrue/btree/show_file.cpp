@@ -5,66 +5,516 @@
 //       Chichester: John Wiley.
 
 // showfile: Show contents of B-tree fs_
+// 把文件映射进来，从根开始逐层并行地检查各个结点，报告树的结构（高度、各层的结点个数、填充率的分布、空闲链表、
+// 碎片、文件与有效数据的字节数），并校验关键字的顺序、子树的范围、可达性、空闲链表和子树的聚合值。
+// 带值的文件中关键字的溢出页也算可达的页，同样检查它们不在空闲链表中、只被引用一次
+// 结点都在映射中就地读，不复制；只在要求时才逐个打印结点
 #include <iostream>
-#include <fstream>
 #include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <vector>
 #include <stdlib.h>
+#include "disk_btree.h"
 
 using namespace std;
 
-const int M = 1000;  // Order of B-tree: M link fields in each Node
+const int FILL_BUCKETS = 10;     // 填充率分布的区间个数
+const int MAX_ERRORS_SHOWN = 20; // 最多打印的错误个数
 
-typedef int KeyType;
+enum PageState
+{
+    PAGE_UNSEEN,
+    PAGE_FREE,
+    PAGE_LIVE
+};
 
-struct Node
+// 待检查的结点和它的关键字应在的开区间(lo, hi)
+struct PendingNode
 {
-    int n;        // Number of items stored in a Node (n < M)
-    KeyType k[M - 1]; // Data items (only the first n in use) k[0]~k[n-1]有效
-    long p[M];    // 'Pointers' to other nodes (n+1 in use)　p[0]~p[n]有效
+    long page;
+    long long lo;
+    long long hi;
 };
 
-int main()
+// 每个线程各自累计，最后合并
+struct ScanTotals
 {
-    char fname[50];
-    cout << "B-tree file name: ";
-    cin >> setw(50) >> fname;
+    long nodes;
+    long leaves;
+    long inner;
+    long long keys;
+    long underfull;
+    long long values;
+    long posting_pages;
+    long fill[FILL_BUCKETS];
+    long errors;
+    vector<string> messages;
+};
 
-    ifstream file(fname, ios::in | ios::binary);
-    // ios::binary required with MSDOS, but possibly
-    // not accepted with other environments.
-    if (file.fail())
+class FileAnalyzer
+{
+public:
+    FileAnalyzer(const char* base, long size, const DiskFileLayout& layout, int thread_count)
+        : base_(base), size_(size), layout_(layout), thread_count_(thread_count), page_count_(0), free_count_(0),
+          leaf_gaps_(0), totals_()
     {
-        cout << "Cannot open file " << fname << endl;
-        exit(1);
+        // 最后一个结点之后只有签名字节
+        if (size_ - layout_.header_size >= (long) layout_.node_size)
+        {
+            page_count_ = (size_ - layout_.header_size - (long) layout_.node_size) / layout_.page_size + 1;
+        }
+
+        states_ = vector<atomic<unsigned char> >(page_count_);
+        if (layout_.augmented)
+        {
+            aggs_.resize(page_count_);
+        }
     }
 
-    int i;
-    long start[2], pos;
+    /**
+     * @brief 先走空闲链表，再从根开始逐层并行检查
+     */
+    void Run(long root, long free_list);
+    void Report(ostream& out) const;
 
-    file.seekg(-1L, ios::end);
-    char ch;
-    file.read(&ch, 1); // Read signature.
+private:
+    /**
+     * @return 文件中位置为r的页的下标，不是有效的结点位置时返回-1
+     */
+    long PageIndex(long r) const
+    {
+        if (r < layout_.header_size || r + (long) layout_.node_size > size_
+            || (r - layout_.header_size) % layout_.page_size != 0)
+        {
+            return -1;
+        }
 
-    if (ch != sizeof(int))
+        return (r - layout_.header_size) / layout_.page_size;
+    }
+
+    DiskPageView View(long r) const
     {
-        cout << "Wrong file format.\n";
-        exit(1);
+        return DiskPageView(base_ + r, layout_);
     }
 
-    file.seekg(0L, ios::beg);
-    file.read((char*) start, 2 * sizeof(long));
-    cout << "root: " << start[0] << " free_list: " << start[1] << endl;
-    Node node;
+    static void Error(ScanTotals& totals, const string& message)
+    {
+        if (totals.messages.size() < (size_t) MAX_ERRORS_SHOWN)
+        {
+            totals.messages.push_back(message);
+        }
 
-    for (; ;)
+        ++totals.errors;
+    }
+
+    void WalkFreeList(long free_list);
+
+    /**
+     * @brief 检查level中的结点，把它们的子结点按关键字的顺序放进next
+     */
+    void CheckLevel(const vector<PendingNode>& level, bool is_root, vector<PendingNode>& next, bool& has_leaf,
+        bool& has_inner);
+    void CheckNode(const PendingNode& node, bool is_root, ScanTotals& totals, vector<PendingNode>& children,
+        bool& leaf);
+
+    /**
+     * @brief 带值的文件：把结点page中第i个关键字的溢出页标记为可达
+     */
+    void CheckPosting(long page, int i, const DiskPosting& posting, ScanTotals& totals);
+
+    /**
+     * @brief 增强的B-树：自底向上算出各个子树的聚合值，与父结点中的a[]比较
+     */
+    void CheckAggregates();
+
+    /**
+     * @brief 把[0, count)分成thread_count_段并行执行work(first, last, t)
+     */
+    template <class Work>
+    void ParallelFor(size_t count, const Work& work) const;
+
+    void Merge(const ScanTotals& totals);
+
+private:
+    const char* base_;
+    long size_;
+    const DiskFileLayout& layout_;
+    int thread_count_;
+
+    long page_count_;
+    vector<atomic<unsigned char> > states_; // 各页的PageState
+    vector<SubtreeAgg> aggs_;               // 增强的B-树中各页的子树聚合值
+    vector<vector<long> > levels_;          // 各层结点的位置，按关键字的顺序
+    long free_count_;
+    long leaf_gaps_;                        // 关键字相邻的两个叶结点在文件中不相邻的次数
+    ScanTotals totals_;
+};
+
+template <class Work>
+inline void FileAnalyzer::ParallelFor(size_t count, const Work& work) const
+{
+    const int thread_count = (int) min((size_t) thread_count_, max(count / 64, (size_t) 1));
+    if (1 == thread_count)
     {
-        pos = file.tellg();
-        file.read((char*) &node, sizeof(node));
-        if (file.fail())
+        work(0, count, 0);
+        return;
+    }
+
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.push_back(thread(work, count * t / thread_count, count * (t + 1) / thread_count, t));
+    }
+
+    for (size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+}
+
+inline void FileAnalyzer::Merge(const ScanTotals& totals)
+{
+    totals_.nodes += totals.nodes;
+    totals_.leaves += totals.leaves;
+    totals_.inner += totals.inner;
+    totals_.keys += totals.keys;
+    totals_.underfull += totals.underfull;
+    totals_.values += totals.values;
+    totals_.posting_pages += totals.posting_pages;
+    totals_.errors += totals.errors;
+
+    for (int b = 0; b < FILL_BUCKETS; ++b)
+    {
+        totals_.fill[b] += totals.fill[b];
+    }
+
+    for (size_t i = 0; i < totals.messages.size() && totals_.messages.size() < (size_t) MAX_ERRORS_SHOWN; ++i)
+    {
+        totals_.messages.push_back(totals.messages[i]);
+    }
+}
+
+inline void FileAnalyzer::WalkFreeList(long free_list)
+{
+    ScanTotals totals = ScanTotals();
+    free_count_ = 0;
+
+    // 空闲结点中只有p[0]有效，链到下一个空闲结点
+    for (long r = free_list; r != -1; r = View(r).Link(0))
+    {
+        const long i = PageIndex(r);
+        if (i < 0)
+        {
+            Error(totals, "free list: invalid position " + to_string(r));
+            break;
+        }
+
+        if (states_[i].exchange(PAGE_FREE) != PAGE_UNSEEN)
         {
+            Error(totals, "free list: cycle at position " + to_string(r));
             break;
         }
 
+        ++free_count_;
+    }
+
+    Merge(totals);
+}
+
+inline void FileAnalyzer::CheckNode(const PendingNode& node, bool is_root, ScanTotals& totals,
+    vector<PendingNode>& children, bool& leaf)
+{
+    const DiskPageView view = View(node.page);
+    const int n = view.N();
+
+    leaf = (-1 == view.Link(0));
+    if (n > layout_.order - 1 || (n < 1 && !(is_root && leaf))) // 空树的根是没有关键字的叶结点
+    {
+        Error(totals, "node " + to_string(node.page) + ": " + "n = " + to_string(n) + " out of range");
+        return;
+    }
+
+    ++totals.nodes;
+    totals.keys += n;
+    ++totals.fill[min(FILL_BUCKETS - 1, n * FILL_BUCKETS / layout_.order)];
+    if (!is_root && n < (layout_.order - 1) / 2)
+    {
+        ++totals.underfull;
+    }
+
+    // 关键字严格递增，而且在父结点给出的开区间内
+    long long prev = node.lo;
+    for (int i = 0; i < n; ++i)
+    {
+        const KeyType k = view.Key(i);
+        if (k <= prev || k >= node.hi)
+        {
+            Error(totals, "node " + to_string(node.page) + ": " + "key " + to_string(k) + " at " + to_string(i) + " out of order or range");
+            break;
+        }
+
+        prev = k;
+    }
+
+    for (int i = 0; i < n && layout_.values; ++i)
+    {
+        CheckPosting(node.page, i, view.Posting(i), totals);
+    }
+
+    if (leaf)
+    {
+        ++totals.leaves;
+        return;
+    }
+
+    ++totals.inner;
+    for (int i = 0; i <= n; ++i)
+    {
+        const long child = view.Link(i);
+        const long c = PageIndex(child);
+        if (c < 0)
+        {
+            Error(totals, "node " + to_string(node.page) + ": " + "invalid link " + to_string(child) + " at " + to_string(i));
+            continue;
+        }
+
+        const unsigned char state = states_[c].exchange(PAGE_LIVE);
+        if (state != PAGE_UNSEEN)
+        {
+            Error(totals, "node " + to_string(node.page) + ": " + "link " + to_string(child) + (state == PAGE_FREE ? " is on the free list"
+                : " is reachable more than once"));
+            continue;
+        }
+
+        const PendingNode pending = { child, (i > 0) ? view.Key(i - 1) : node.lo, (i < n) ? view.Key(i) : node.hi };
+        children.push_back(pending);
+    }
+}
+
+inline void FileAnalyzer::CheckPosting(long page, int i, const DiskPosting& posting, ScanTotals& totals)
+{
+    totals.values += posting.count;
+
+    DiskPostingPage header;
+    for (long r = posting.IsInline() ? -1 : posting.pages[0]; r != -1; r = header.next)
+    {
+        const long c = PageIndex(r);
+        if (c < 0 || states_[c].exchange(PAGE_LIVE) != PAGE_UNSEEN)
+        {
+            Error(totals, "node " + to_string(page) + ": " + "posting page " + to_string(r) + " of key " + to_string(i)
+                + " is invalid, on the free list or reachable more than once");
+            return;
+        }
+
+        ++totals.posting_pages;
+        memcpy(&header, base_ + r, sizeof(header));
+    }
+}
+
+inline void FileAnalyzer::CheckLevel(const vector<PendingNode>& level, bool is_root, vector<PendingNode>& next,
+    bool& has_leaf, bool& has_inner)
+{
+    vector<ScanTotals> totals(thread_count_);
+    vector<vector<PendingNode> > children(thread_count_);
+    vector<char> leaves(thread_count_, 0), inners(thread_count_, 0);
+
+    // 每个线程处理连续的一段，子结点按段的顺序拼起来，仍然按关键字的顺序
+    ParallelFor(level.size(), [&](size_t first, size_t last, int t)
+    {
+        bool leaf;
+        for (size_t i = first; i < last; ++i)
+        {
+            CheckNode(level[i], is_root, totals[t], children[t], leaf);
+            (leaf ? leaves[t] : inners[t]) = 1;
+        }
+    });
+
+    has_leaf = has_inner = false;
+    for (int t = 0; t < thread_count_; ++t)
+    {
+        Merge(totals[t]);
+        next.insert(next.end(), children[t].begin(), children[t].end());
+        has_leaf = has_leaf || leaves[t];
+        has_inner = has_inner || inners[t];
+    }
+}
+
+inline void FileAnalyzer::CheckAggregates()
+{
+    vector<ScanTotals> totals(thread_count_);
+
+    for (size_t d = levels_.size(); d-- > 0; )
+    {
+        const vector<long>& level = levels_[d];
+
+        ParallelFor(level.size(), [&](size_t first, size_t last, int t)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const DiskPageView view = View(level[i]);
+                const int n = view.N();
+                SubtreeAgg agg = { n, 0 };
+
+                for (int j = 0; j < n; ++j)
+                {
+                    agg.sum += view.Key(j);
+                }
+
+                for (int j = 0; view.Link(0) != -1 && j <= n; ++j)
+                {
+                    const SubtreeAgg child = aggs_[PageIndex(view.Link(j))];
+                    const SubtreeAgg stored = view.Agg(j);
+                    if (stored.count != child.count || stored.sum != child.sum)
+                    {
+                        Error(totals[t], "node " + to_string(level[i]) + ": aggregate of child " + to_string(j)
+                            + " is " + to_string(stored.count) + "/" + to_string(stored.sum) + ", expected "
+                            + to_string(child.count) + "/" + to_string(child.sum));
+                    }
+
+                    agg.count += child.count;
+                    agg.sum += child.sum;
+                }
+
+                aggs_[PageIndex(level[i])] = agg;
+            }
+        });
+    }
+
+    for (int t = 0; t < thread_count_; ++t)
+    {
+        Merge(totals[t]);
+    }
+}
+
+inline void FileAnalyzer::Run(long root, long free_list)
+{
+    WalkFreeList(free_list);
+    leaf_gaps_ = 0;
+
+    if (-1 == root)
+    {
+        return;
+    }
+
+    const long r = PageIndex(root);
+    if (r < 0 || states_[r].exchange(PAGE_LIVE) != PAGE_UNSEEN)
+    {
+        ScanTotals totals = ScanTotals();
+        Error(totals, "root " + to_string(root) + " is invalid or on the free list");
+        Merge(totals);
+        return;
+    }
+
+    const PendingNode pending = { root, LLONG_MIN, LLONG_MAX };
+    vector<PendingNode> level(1, pending);
+
+    while (!level.empty())
+    {
+        vector<PendingNode> next;
+        bool has_leaf, has_inner;
+        CheckLevel(level, levels_.empty(), next, has_leaf, has_inner);
+
+        levels_.push_back(vector<long>());
+        for (size_t i = 0; i < level.size(); ++i)
+        {
+            levels_.back().push_back(level[i].page);
+        }
+
+        if (has_leaf && has_inner)
+        {
+            ScanTotals totals = ScanTotals();
+            Error(totals, "level " + to_string(levels_.size() - 1) + ": leaves at different depths");
+            Merge(totals);
+        }
+
+        if (!has_inner) // 叶结点这一层，统计关键字相邻的叶结点在文件中是否相邻
+        {
+            for (size_t i = 1; i < level.size(); ++i)
+            {
+                leaf_gaps_ += (level[i].page != level[i - 1].page + layout_.page_size) ? 1 : 0;
+            }
+        }
+
+        level.swap(next);
+    }
+
+    if (layout_.augmented && 0 == totals_.errors)
+    {
+        CheckAggregates();
+    }
+}
+
+inline void FileAnalyzer::Report(ostream& out) const
+{
+    long leaked = 0;
+    for (long i = 0; i < page_count_; ++i)
+    {
+        leaked += (states_[i].load(memory_order_relaxed) == PAGE_UNSEEN) ? 1 : 0;
+    }
+
+    out << "Height: " << levels_.size() << ", nodes: " << totals_.nodes << " (" << totals_.inner << " branch, "
+        << totals_.leaves << " leaf), keys: " << totals_.keys << endl << "Nodes per level:";
+    for (size_t d = 0; d < levels_.size(); ++d)
+    {
+        out << " " << levels_[d].size();
+    }
+
+    out << endl << "Fill factor: " << fixed << setprecision(3)
+        << (totals_.nodes > 0 ? (double) totals_.keys / (totals_.nodes * (layout_.order - 1.0)) : 0)
+        << ", underfull nodes: " << totals_.underfull << endl;
+
+    if (layout_.values)
+    {
+        out << "Values: " << totals_.values << ", posting pages: " << totals_.posting_pages << endl;
+    }
+
+    for (int b = 0; b < FILL_BUCKETS; ++b)
+    {
+        out << "  " << setw(3) << b * 100 / FILL_BUCKETS << "%-" << setw(3) << (b + 1) * 100 / FILL_BUCKETS << "%: "
+            << setw(10) << totals_.fill[b] << endl;
+    }
+
+    const long pages = page_count_;
+    const long long live_bytes = (long long) totals_.nodes * layout_.node_size;
+    out << "Pages: " << pages << ", free list: " << free_count_ << ", leaked (neither reachable nor free): "
+        << leaked << ", fragmentation: " << setprecision(1)
+        << (pages > 0 ? 100.0 * (free_count_ + leaked) / pages : 0) << "%" << endl
+        << "Leaves not adjacent to their key order successor: " << leaf_gaps_ << " of "
+        << max(totals_.leaves - 1, 0L) << endl
+        << "Bytes: file " << size_ << ", live nodes " << live_bytes << " (" << (size_ > 0 ? 100.0 * live_bytes
+        / size_ : 0) << "%), keys " << totals_.keys * (long long) sizeof(KeyType) << " (" << (size_ > 0 ? 100.0
+        * totals_.keys * sizeof(KeyType) / size_ : 0) << "%)" << endl;
+    out.unsetf(ios::fixed);
+
+    if (0 == totals_.errors && 0 == leaked)
+    {
+        out << "Validation: OK" << endl;
+        return;
+    }
+
+    out << "Validation: " << totals_.errors << " errors, " << leaked << " leaked pages" << endl;
+    for (size_t i = 0; i < totals_.messages.size(); ++i)
+    {
+        out << "  " << totals_.messages[i] << endl;
+    }
+}
+
+/**
+ * @brief 逐个打印结点，只适合小文件
+ */
+void PrintNodes(const char* base, long size, const DiskFileLayout& layout)
+{
+    int i;
+    const bool augmented = layout.augmented;
+    DiskNode node;
+
+    for (long pos = layout.header_size; pos + (long) layout.node_size <= size; pos += layout.page_size)
+    {
+        UnpackDiskNode(layout, base + pos, node);
+
         cout << endl << "Position " << setw(8) << pos << ": ";
         cout << "n = " << node.n << endl << "Data : ";
 
@@ -81,7 +531,100 @@ int main()
         }
 
         cout << endl;
+
+        if (augmented && node.p[0] != -1)
+        {
+            cout << "Counts: ";
+
+            for (i = 0; i <= node.n; ++i)
+            {
+                cout << setw(8) << node.a[i].count << " ";
+            }
+
+            cout << endl << "Sums: ";
+
+            for (i = 0; i <= node.n; ++i)
+            {
+                cout << setw(8) << node.a[i].sum << " ";
+            }
+
+            cout << endl;
+        }
+    }
+}
+
+int main()
+{
+    char fname[50];
+    cout << "B-tree file name: ";
+    cin >> setw(50) >> fname;
+
+    ifstream ifs(fname, ios::in | ios::binary);
+    // ios::binary required with MSDOS, but possibly
+    // not accepted with other environments.
+    if (ifs.fail())
+    {
+        cout << "Cannot open file " << fname << endl;
+        exit(1);
+    }
+
+    ifs.close();
+
+    FstreamPageStore file;
+    bool created;
+    DiskFileLayout layout;
+
+    // 阶数和页大小从文件头中得到，没有文件头的旧文件是DISK_M阶
+    if (file.Open(fname, created) != 0 || ReadDiskFileLayout(file, layout) != 0)
+    {
+        cout << "Wrong file format.\n";
+        exit(1);
+    }
+
+    long start[2];
+    const long size = file.Size();
+    file.Read(0L, start, 2 * sizeof(long));
+    file.Close();
+
+    char ch;
+    cout << "Print every node as well (only for small files)? (Y/N): ";
+    cin >> ch;
+
+    const int fd = open(fname, O_RDONLY);
+    const char* base = (const char*) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd < 0 || MAP_FAILED == (const void*) base)
+    {
+        cout << "Cannot map file " << fname << endl;
+        exit(1);
+    }
+
+    madvise((void*) base, size, MADV_WILLNEED);
+
+    cout << "root: " << start[0] << " free_list: " << start[1] << (layout.augmented ? " (augmented)" : "")
+        << (layout.values ? " (values)" : "") << endl
+        << "order: " << layout.order << " page size: " << layout.page_size << endl;
+
+    if (toupper(ch) == 'Y')
+    {
+        PrintNodes(base, size, layout);
+        cout << endl;
     }
 
+    const int thread_count = max(1, (int) thread::hardware_concurrency());
+    const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+    FileAnalyzer analyzer(base, size, layout, thread_count);
+    analyzer.Run(start[0], start[1]);
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Checked " << size << " bytes in " << fixed << setprecision(3) << seconds << " s ("
+        << setprecision(2) << (seconds > 0 ? size / seconds / 1e9 : 0) << " GB/s, " << thread_count << " threads)"
+        << endl;
+    cout.unsetf(ios::fixed);
+
+    analyzer.Report(cout);
+
+    munmap((void*) base, size);
+    close(fd);
     return 0;
 }
@@ -0,0 +1,127 @@
+// string_disk_btree: demonstration program for the B-tree on disk with
+// variable-length string keys in string_disk_btree.h
+#include "string_disk_btree.h"
+
+int main()
+{
+    cout << "sizeof(page): " << sizeof(StringPage) << endl;
+
+    cout << "Demonstration program for a B-tree on disk with" << endl
+        << "string keys of at most " << MAX_STRING_KEY_SIZE << " bytes. Each node is a" << endl
+        << "page of " << STRING_PAGE_SIZE << " bytes, so the number of keys in a node" << endl
+        << "depends on their lengths. The B-tree representation" << endl
+        << "is similar to the table of contents of a book. The" << endl
+        << "items stored in each Node are displayed on a single line." << endl << endl;
+
+    char tree_file_path[50];
+    cout << "Enter name of (possibly nonexistent) BINARY file path for" << endl
+            << "the B-tree: ";
+    cin >> setw(50) >> tree_file_path;
+
+    StringDiskBTree tree(tree_file_path);
+    if (!tree.IsEmpty())
+    {
+        tree.Print();
+    }
+
+    cout << endl << "Enter a (possibly empty) sequence of keys separated" << endl
+        << "by white space, followed by a slash (/):" << endl;
+    string x;
+    char ch = 0;
+
+    while (cin >> x, !cin.fail() && x != "/")
+    {
+        tree.Insert(x);
+        ch = 1;
+    }
+
+    if (ch)
+    {
+        tree.Print();
+    }
+
+    cout << endl << "Do you want keys to be read from a text file" << endl
+        << "(one key per line)? (Y/N): ";
+    cin >> ch;
+
+    if (toupper(ch) == 'Y')
+    {
+        char key_file_path[50];
+        cout << "Name of this text file: ";
+        cin >> setw(50) >> key_file_path;
+
+        ifstream ifs(key_file_path);
+        if (!ifs)
+        {
+            cout << "Cannot open " << key_file_path << endl;
+        }
+        else
+        {
+            string line;
+            while (getline(ifs, line))
+            {
+                tree.Insert(line);
+            }
+        }
+    }
+
+    for (; ;)
+    {
+        cout << endl << "Enter I, D or S followed by a key (for Insert," << endl
+            << "Delete and Search), L followed by two keys lo and hi" << endl
+            << "to List the keys in lo..hi, T for sTatistics or" << endl
+            << "Q to quit: ";
+        cin >> ch;
+        if (cin.fail())
+        {
+            break;
+        }
+
+        ch = (char) toupper(ch);
+        switch (ch)
+        {
+            case 'S':
+                cin >> x;
+                tree.ShowSearch(x);
+                break;
+            case 'I':
+                cin >> x;
+                tree.Insert(x);
+                break;
+            case 'D':
+                cin >> x;
+                tree.Delete(x);
+                break;
+            case 'L':
+            {
+                string hi;
+                vector<string> keys;
+                cin >> x >> hi;
+                tree.Scan(x, hi, keys);
+
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    cout << keys[i] << endl;
+                }
+
+                cout << keys.size() << " keys in range " << x << ".." << hi << endl;
+            }
+                break;
+            case 'T':
+                tree.PrintStats();
+                break;
+            case 'Q':
+                return 0;
+            default:
+                cout << "Invalid command, use I, D, S, L, T or Q" << endl;
+                break;
+        }
+
+        if (ch == 'I' || ch == 'D')
+        {
+            tree.Print();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,1163 @@
+// string_disk_btree: 关键字为变长字符串的磁盘B-树，结点采用slotted page格式
+//
+// 文件的组织与DiskBTree相同：开头是long start[2]（根结点和空闲链表），后面是一个个STRING_PAGE_SIZE字节的页，
+// 最终文件的长度为奇数，结尾的签名字节为STRING_TREE_SIGNATURE。一页就是一个结点：
+//   PageHeader | Slot[0] ... Slot[n-1] -> | 空闲空间 | <- 公共前缀 | 各个关键字的剩余部分
+// 结点内所有关键字共同的前缀只存一次。每个Slot中的head是关键字去掉公共前缀后的前4个字节（按大端序装成整数，
+// 不足4个字节时补0），剩余部分（第4个字节以后）存在页尾。查找时先比较head，只有head相等时才去比较页尾的字节，
+// 二分查找的大部分比较都只访问连续的Slot数组。
+//
+// 逻辑结构与DiskBTree相同：p[0], k[0], p[1], k[1], ..., p[n-1], k[n-1], p[n]。结点是否放得下、是否太空
+// 按字节数而不是关键字个数判断：放不下时分裂（变长的关键字可能使一个结点要分成不止两个），
+// 少于STRING_PAGE_SIZE / 4字节时与兄弟合并或者重新分配。
+#ifndef STRING_DISK_BTREE_H
+#define STRING_DISK_BTREE_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "btree_common.h"
+
+using namespace std;
+
+const int STRING_PAGE_SIZE = 4096;
+const int MAX_STRING_KEY_SIZE = 512;  // 保证一页至少能放下好几个关键字
+const char STRING_TREE_SIGNATURE = 'S';
+
+struct PageHeader
+{
+    uint16_t n;          // 关键字个数
+    uint16_t prefix_len; // 公共前缀的长度
+    uint16_t heap;       // 公共前缀和各个关键字的剩余部分从页尾往前存放，这是它们的起始偏移，公共前缀在最前面
+    uint16_t reserved;
+    long p0;             // 最左边的子树p[0]；空闲页中是空闲链表的下一页
+};
+
+struct Slot
+{
+    uint32_t head;   // 去掉公共前缀后的前4个字节，大端序，不足4个字节时补0
+    uint16_t offset; // 剩余部分（去掉公共前缀后第4个字节以后）在页中的偏移
+    uint16_t length; // 去掉公共前缀后的长度（含head的部分）
+    long p;          // k[i]右边的子树p[i+1]
+};
+
+struct StringPage
+{
+    PageHeader header;
+    char body[STRING_PAGE_SIZE - sizeof(PageHeader)]; // Slot数组从body的开头往后长，关键字从页尾往前长
+};
+
+/**
+ * @brief 解码后的结点，插入、删除时在内存中修改，放得下时再编码写回
+ */
+struct StringNode
+{
+    vector<string> k;
+    vector<long> p; // p.size() == k.size() + 1
+
+    void swap(StringNode& other)
+    {
+        k.swap(other.k);
+        p.swap(other.p);
+    }
+};
+
+struct StringDiskBTreeStats
+{
+    // 操作计数，从打开文件或者上一次ResetStats()开始累计
+    long reads;           // 读页的次数（不含根结点缓存命中的次数）
+    long root_cache_hits; // 命中常驻内存的根结点的次数
+    long writes;          // 写页的次数
+    long allocs;          // GetNode的调用次数
+    long frees;           // FreeNode的调用次数
+    long splits;          // 分裂新增的结点个数
+    long merges;          // 与兄弟合并的次数
+    long redistributions; // 与兄弟重新分配的次数
+    long head_compares;   // 只比较Slot中的head就分出大小的次数
+    long full_compares;   // head相等，还要比较页尾字节的次数
+
+    // 结构信息，由Stats()遍历整棵树得到
+    int height;
+    long node_count;
+    long key_count;
+    long key_bytes;       // 所有关键字的总长度
+    long stored_bytes;    // 页中实际存放关键字用的字节数（公共前缀只算一次，head算在Slot中不计入）
+    double fill_factor;   // 所有页中已用的字节数 / (node_count * STRING_PAGE_SIZE)
+};
+
+class StringDiskBTree
+{
+public:
+    /**
+     * @param tree_file_path B-树文件的路径，文件不存在时新建
+     */
+    StringDiskBTree(const char* tree_file_path);
+    ~StringDiskBTree();
+
+    void Print()
+    {
+        cout << "Contents:" << endl;
+        PrintNode(root_, 0);
+    }
+
+    bool IsEmpty() const
+    {
+        return NIL == root_;
+    }
+
+    /**
+     * @brief 设置Insert/Delete是否打印duplicate key和not found提示
+     */
+    void SetVerbose(bool verbose)
+    {
+        verbose_ = verbose;
+    }
+
+    void ShowSearch(const string& x);
+
+    /**
+     * @brief 查找关键字，不打印
+     * @return true表示找到
+     */
+    bool Search(const string& x);
+
+    /**
+     * @brief 按从小到大的顺序取出[lo, hi]范围内的所有关键字
+     * @param keys 取出的关键字追加到其中
+     * @return 取出的关键字个数
+     */
+    long Scan(const string& lo, const string& hi, vector<string>& keys);
+
+    /**
+     * @return =0插入成功，关键字已经存在或者长度超过MAX_STRING_KEY_SIZE时返回-1
+     */
+    int Insert(const string& x);
+
+    /**
+     * @return =0删除成功，关键字不存在时返回-1
+     */
+    int Delete(const string& x);
+
+    /**
+     * @brief 取得操作计数和结构信息的快照，结构信息需要读所有的结点（这些读不计入reads）
+     */
+    StringDiskBTreeStats Stats();
+    void PrintStats();
+
+    void ResetStats()
+    {
+        memset(&stats_, 0, sizeof(stats_));
+    }
+
+private:
+    /**
+     * @brief 在页中查找，先比较公共前缀，然后在Slot数组中二分查找
+     * @param found 返回x是否就是k[i]
+     * @return 第一个不小于x的关键字的下标i，x比所有的关键字都大时为n
+     */
+    int SearchInPage(const StringPage& page, const string& x, bool& found);
+
+    /**
+     * @brief 插入x，返回SUCCESS时r已经写回
+     * @param node 返回INSERT_NOT_COMPLETE时是r插入后的内容，r还没有写回，这时一页放不下了，由调用者分裂
+     */
+    Status Ins(long r, const string& x, StringNode& node);
+
+    /**
+     * @brief 删除x，x在分支结点中时用左子树中的最大关键字替换它，再从左子树中删除这个关键字
+     * @param node 返回INSERT_NOT_COMPLETE（替换的关键字更长，放不下了）或UNDERFLOW（太空了）时是r删除后的内容，
+     *             r还没有写回，由调用者分裂或者与兄弟合并、重新分配
+     */
+    Status Del(long r, const string& x, StringNode& node);
+
+    /**
+     * @brief 结点修改后：放不下时返回INSERT_NOT_COMPLETE，太空时返回UNDERFLOW，都不写回；否则写回r并返回SUCCESS
+     * @param deleting 插入只会使结点变大，这时不检查是否太空（分裂出来的结点因为公共前缀变长，可能本来就不到四分之一页）
+     */
+    Status Settle(long r, const StringNode& node, bool deleting);
+
+    /**
+     * @brief 把放不下的子树p[i]（内容为child）分裂成几个结点，分隔关键字和新结点插入到parent中，parent不写回
+     */
+    void SplitChild(StringNode& parent, int i, const StringNode& child);
+
+    /**
+     * @brief 把太空的子树p[i]（内容为child）与它的一个兄弟合并（合并后放得下时）或者重新分配，parent不写回
+     */
+    void FixChild(StringNode& parent, int i, StringNode& child);
+
+    /**
+     * @brief 根结点放不下时把它分裂，用分隔关键字组成新的根结点，新的根结点还放不下时继续
+     */
+    void GrowRoot(StringNode& node);
+
+    /**
+     * @brief 把node分成放得下的几个结点：能分成两个时选两边字节数最接近的分割点，否则从左往右尽量装满
+     * @param pieces 分成的结点
+     * @param seps 相邻的两个结点之间的分隔关键字
+     */
+    static void SplitNode(const StringNode& node, vector<StringNode>& pieces, vector<string>& seps);
+
+    /**
+     * @brief 关键字k[first, last)编码后占的字节数（含页头和Slot）
+     */
+    static size_t EncodedSize(const vector<string>& k, size_t first, size_t last);
+
+    /**
+     * @brief 有序的关键字k[first, last)的公共前缀长度，就是第一个和最后一个关键字的公共前缀长度
+     */
+    static size_t PrefixLength(const vector<string>& k, size_t first, size_t last);
+
+    static bool Fits(const StringNode& node)
+    {
+        return EncodedSize(node.k, 0, node.k.size()) <= (size_t) STRING_PAGE_SIZE;
+    }
+
+    static uint32_t Head(const char* s, size_t len);
+    static void Encode(const StringNode& node, StringPage& page);
+    static void Decode(const StringPage& page, StringNode& node);
+    static string KeyAt(const StringPage& page, int i);
+
+    static long ChildAt(const StringPage& page, int i)
+    {
+        return (0 == i) ? page.header.p0 : ((const Slot*) page.body)[i - 1].p;
+    }
+
+    void PrintNode(long r, int indent_space_count);
+    void ScanNode(long r, const string& lo, const string& hi, vector<string>& keys);
+    void CountNode(long r, StringDiskBTreeStats& stats);
+
+    /**
+     * @brief r的子树中最大的关键字，沿最右边的路径走到叶结点
+     */
+    string MaxKey(long r);
+
+    void ReadPage(long r, StringPage& page);
+    void WritePage(long r, const StringPage& page);
+
+    void ReadNode(long r, StringNode& node)
+    {
+        StringPage page;
+        ReadPage(r, page);
+        Decode(page, node);
+    }
+
+    void WriteNode(long r, const StringNode& node)
+    {
+        StringPage page;
+        Encode(node, page);
+        WritePage(r, page);
+    }
+
+    long GetNode();
+
+    /**
+     * @brief 把页放回空闲链表，只写页头中的链接字段
+     */
+    void FreeNode(long r);
+
+private:
+    enum
+    {
+        NIL = -1
+    };
+
+    long root_, free_list_;
+    StringPage root_page_; // 根结点常驻内存
+    long root_page_pos_;   // root_page_是哪一页的内容，不等于root_时缓存无效
+    fstream fs_;
+    bool verbose_;
+    int height_;
+    StringDiskBTreeStats stats_; // 只有操作计数有效，结构信息由Stats()临时计算
+};
+
+inline StringDiskBTree::StringDiskBTree(const char* tree_file_path)
+{
+    height_ = 0;
+    verbose_ = true;
+    root_page_pos_ = NIL;
+    memset(&stats_, 0, sizeof(stats_));
+
+    ifstream ifs(tree_file_path, ios::in);
+    bool new_file = ifs.fail();
+    ifs.close();
+
+    if (new_file)
+    {
+        fs_.open(tree_file_path, ios::out | ios::in | ios::trunc | ios::binary);
+        root_ = free_list_ = NIL;
+        long start[2] = { NIL, NIL };
+        fs_.write((char*) start, 2 * sizeof(long));
+    }
+    else
+    {
+        long start[2];
+        fs_.open(tree_file_path, ios::out | ios::in | ios::binary);
+        fs_.seekg(-1L, ios::end);
+        char ch;
+        fs_.read(&ch, 1); // Read signature.
+        fs_.seekg(0L, ios::beg);
+        fs_.read((char*) start, 2 * sizeof(long));
+        if (ch != STRING_TREE_SIGNATURE)
+        {
+            cout << "Wrong file format." << endl;
+            exit(1);
+        }
+
+        root_ = start[0];
+        free_list_ = start[1];
+
+        // 沿最左边的路径走到叶结点，得到树高
+        StringPage page;
+        for (long r = root_; r != NIL; r = page.header.p0)
+        {
+            ReadPage(r, page);
+            ++height_;
+        }
+
+        memset(&stats_, 0, sizeof(stats_));
+    }
+}
+
+inline StringDiskBTree::~StringDiskBTree()
+{
+    long start[2] = { root_, free_list_ };
+    fs_.seekp(0L, ios::beg);
+    fs_.write((char*) start, 2 * sizeof(long));
+
+    // 与DiskBTree相同：文件长度为偶数时在结尾加上签名字节，否则签名字节已经在那里了
+    char ch = STRING_TREE_SIGNATURE;
+    fs_.seekg(0L, ios::end);
+    if ((fs_.tellg() & 1) == 0)
+    {
+        fs_.write(&ch, 1);
+    }
+
+    fs_.close();
+}
+
+inline void StringDiskBTree::ShowSearch(const string& x)
+{
+    cout << "Search path:" << endl;
+    StringPage page;
+
+    for (long r = root_; r != NIL; )
+    {
+        ReadPage(r, page);
+
+        for (int j = 0; j < page.header.n; ++j)
+        {
+            cout << " " << KeyAt(page, j);
+        }
+
+        cout << "  (common prefix: " << page.header.prefix_len << " bytes)" << endl;
+
+        bool found;
+        const int i = SearchInPage(page, x, found);
+        if (found)
+        {
+            cout << "Key " << x << " found in position " << i << " of last displayed node." << endl;
+            return;
+        }
+
+        r = ChildAt(page, i);
+    }
+
+    cout << "Key " << x << " not found." << endl;
+}
+
+inline bool StringDiskBTree::Search(const string& x)
+{
+    StringPage page;
+
+    for (long r = root_; r != NIL; )
+    {
+        ReadPage(r, page);
+
+        bool found;
+        const int i = SearchInPage(page, x, found);
+        if (found)
+        {
+            return true;
+        }
+
+        r = ChildAt(page, i);
+    }
+
+    return false;
+}
+
+inline long StringDiskBTree::Scan(const string& lo, const string& hi, vector<string>& keys)
+{
+    const size_t size = keys.size();
+
+    if (lo <= hi)
+    {
+        ScanNode(root_, lo, hi, keys);
+    }
+
+    return (long) (keys.size() - size);
+}
+
+inline int StringDiskBTree::Insert(const string& x)
+{
+    if (x.size() > (size_t) MAX_STRING_KEY_SIZE)
+    {
+        if (verbose_)
+        {
+            cout << "Key longer than " << MAX_STRING_KEY_SIZE << " bytes ignored." << endl;
+        }
+
+        return -1;
+    }
+
+    if (NIL == root_)
+    {
+        StringNode node;
+        node.k.push_back(x);
+        node.p.assign(2, NIL);
+
+        root_ = GetNode();
+        WriteNode(root_, node);
+        height_ = 1;
+        return 0;
+    }
+
+    StringNode node;
+    Status code = Ins(root_, x, node);
+    switch (code)
+    {
+        case DUPLICATE_KEY:
+        {
+            if (verbose_)
+            {
+                cout << "Duplicate key ignored." << endl;
+            }
+        }
+            return -1;
+
+        case INSERT_NOT_COMPLETE:
+            GrowRoot(node);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+inline int StringDiskBTree::Delete(const string& x)
+{
+    if (NIL == root_)
+    {
+        if (verbose_)
+        {
+            cout << "Key " << x << " not found." << endl;
+        }
+
+        return -1;
+    }
+
+    StringNode node;
+    Status code = Del(root_, x, node);
+    switch (code)
+    {
+        case NOT_FOUND:
+        {
+            if (verbose_)
+            {
+                cout << "Key " << x << " not found." << endl;
+            }
+        }
+            return -1;
+
+        case UNDERFLOW: // 根结点没有关键字了，用它唯一的子树作为新的根结点（叶结点时树变空）
+        {
+            long root = root_;
+            root_ = node.p[0];
+            FreeNode(root);
+            --height_;
+        }
+            break;
+
+        case INSERT_NOT_COMPLETE:
+            GrowRoot(node);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+inline Status StringDiskBTree::Ins(long r, const string& x, StringNode& node)
+{
+    StringPage page;
+    ReadPage(r, page);
+
+    bool found;
+    const int i = SearchInPage(page, x, found);
+    if (found)
+    {
+        return DUPLICATE_KEY;
+    }
+
+    if (NIL == page.header.p0) // 叶结点：直接插入
+    {
+        Decode(page, node);
+        node.k.insert(node.k.begin() + i, x);
+        node.p.push_back(NIL);
+        return Settle(r, node, false);
+    }
+
+    StringNode child;
+    Status code = Ins(ChildAt(page, i), x, child);
+    if (code != INSERT_NOT_COMPLETE)
+    {
+        return code; // 本结点不变
+    }
+
+    Decode(page, node);
+    SplitChild(node, i, child);
+    return Settle(r, node, false);
+}
+
+inline Status StringDiskBTree::Del(long r, const string& x, StringNode& node)
+{
+    StringPage page;
+    ReadPage(r, page);
+
+    bool found;
+    const int i = SearchInPage(page, x, found);
+
+    if (NIL == page.header.p0) // 叶结点
+    {
+        if (!found)
+        {
+            return NOT_FOUND;
+        }
+
+        Decode(page, node);
+        node.k.erase(node.k.begin() + i);
+        node.p.pop_back();
+        return Settle(r, node, true);
+    }
+
+    // 分支结点：x在本结点中时用左子树中的最大关键字y替换它，转化为从左子树中删除y
+    string target = x;
+    if (found)
+    {
+        target = MaxKey(ChildAt(page, i));
+        Decode(page, node);
+        node.k[i] = target;
+    }
+
+    StringNode child;
+    Status code = Del(ChildAt(page, i), target, child);
+    if (NOT_FOUND == code || (SUCCESS == code && !found))
+    {
+        return code; // 本结点不变
+    }
+
+    if (!found)
+    {
+        Decode(page, node);
+    }
+
+    if (UNDERFLOW == code)
+    {
+        FixChild(node, i, child);
+    }
+    else if (INSERT_NOT_COMPLETE == code)
+    {
+        SplitChild(node, i, child);
+    }
+
+    return Settle(r, node, true);
+}
+
+inline Status StringDiskBTree::Settle(long r, const StringNode& node, bool deleting)
+{
+    const size_t size = EncodedSize(node.k, 0, node.k.size());
+
+    if (size > (size_t) STRING_PAGE_SIZE)
+    {
+        return INSERT_NOT_COMPLETE;
+    }
+
+    // 根结点只要还有关键字就行，其余的结点至少要用到四分之一页
+    if (deleting && (node.k.empty() || (r != root_ && size < (size_t) STRING_PAGE_SIZE / 4)))
+    {
+        return UNDERFLOW;
+    }
+
+    WriteNode(r, node);
+    return SUCCESS;
+}
+
+inline void StringDiskBTree::SplitChild(StringNode& parent, int i, const StringNode& child)
+{
+    vector<StringNode> pieces;
+    vector<string> seps;
+    SplitNode(child, pieces, seps);
+
+    WriteNode(parent.p[i], pieces[0]);
+
+    for (size_t j = 1; j < pieces.size(); ++j)
+    {
+        const long q = GetNode();
+        WriteNode(q, pieces[j]);
+        parent.k.insert(parent.k.begin() + i + j - 1, seps[j - 1]);
+        parent.p.insert(parent.p.begin() + i + j, q);
+        ++stats_.splits;
+    }
+}
+
+inline void StringDiskBTree::FixChild(StringNode& parent, int i, StringNode& child)
+{
+    const int pivot = (i > 0) ? i - 1 : i; // 优先与左兄弟合并或分配
+    const long pL = parent.p[pivot];
+    const long pR = parent.p[pivot + 1];
+    StringNode merged, right;
+
+    if (i > 0)
+    {
+        ReadNode(pL, merged);
+        right.swap(child);
+    }
+    else
+    {
+        merged.swap(child);
+        ReadNode(pR, right);
+    }
+
+    // 两个结点和中间的分隔关键字依次排开
+    merged.k.push_back(parent.k[pivot]);
+    merged.k.insert(merged.k.end(), right.k.begin(), right.k.end());
+    merged.p.insert(merged.p.end(), right.p.begin(), right.p.end());
+
+    if (Fits(merged)) // Merge: 合并到pL中，释放pR
+    {
+        WriteNode(pL, merged);
+        FreeNode(pR);
+        parent.k.erase(parent.k.begin() + pivot);
+        parent.p.erase(parent.p.begin() + pivot + 1);
+        ++stats_.merges;
+        return;
+    }
+
+    // Redistribute: 按字节数重新平分。原来的分法就放得下，所以总能分成两个
+    vector<StringNode> pieces;
+    vector<string> seps;
+    SplitNode(merged, pieces, seps);
+
+    WriteNode(pL, pieces[0]);
+    WriteNode(pR, pieces[1]);
+    parent.k[pivot] = seps[0];
+    ++stats_.redistributions;
+
+    for (size_t j = 2; j < pieces.size(); ++j)
+    {
+        const long q = GetNode();
+        WriteNode(q, pieces[j]);
+        parent.k.insert(parent.k.begin() + pivot + j - 1, seps[j - 1]);
+        parent.p.insert(parent.p.begin() + pivot + j, q);
+        ++stats_.splits;
+    }
+}
+
+inline void StringDiskBTree::GrowRoot(StringNode& node)
+{
+    do
+    {
+        StringNode parent;
+        parent.p.push_back(root_);
+        SplitChild(parent, 0, node);
+
+        root_ = GetNode();
+        ++height_;
+        node.swap(parent);
+    } while (!Fits(node));
+
+    WriteNode(root_, node);
+}
+
+inline void StringDiskBTree::SplitNode(const StringNode& node, vector<StringNode>& pieces, vector<string>& seps)
+{
+    const size_t n = node.k.size();
+    vector<size_t> bounds; // 各个结点的第一个关键字的下标，分隔关键字就在下一个结点的第一个关键字前面
+    size_t best_diff = (size_t) -1;
+    size_t best = 0;
+
+    for (size_t m = 1; m + 1 < n; ++m) // 左边k[0, m)，分隔关键字k[m]，右边k[m+1, n)
+    {
+        const size_t left = EncodedSize(node.k, 0, m);
+        const size_t right = EncodedSize(node.k, m + 1, n);
+
+        if (left <= (size_t) STRING_PAGE_SIZE && right <= (size_t) STRING_PAGE_SIZE)
+        {
+            const size_t diff = (left > right) ? left - right : right - left;
+            if (diff < best_diff)
+            {
+                best_diff = diff;
+                best = m;
+            }
+        }
+    }
+
+    bounds.push_back(0);
+
+    if (best > 0)
+    {
+        bounds.push_back(best + 1);
+    }
+    else
+    {
+        // 公共前缀变短了很多时可能要分成不止两个：从左往右尽量装满，每个结点至少一个关键字
+        for (size_t first = 0; EncodedSize(node.k, first, n) > (size_t) STRING_PAGE_SIZE; )
+        {
+            size_t last = first + 1; // 本结点k[first, last)，分隔关键字k[last]，后面至少还留一个关键字
+            while (last + 2 < n && EncodedSize(node.k, first, last + 1) <= (size_t) STRING_PAGE_SIZE)
+            {
+                ++last;
+            }
+
+            first = last + 1;
+            bounds.push_back(first);
+        }
+    }
+
+    pieces.assign(bounds.size(), StringNode());
+    seps.clear();
+
+    for (size_t j = 0; j < bounds.size(); ++j)
+    {
+        const size_t first = bounds[j];
+        const size_t last = (j + 1 < bounds.size()) ? bounds[j + 1] - 1 : n;
+
+        pieces[j].k.assign(node.k.begin() + first, node.k.begin() + last);
+        pieces[j].p.assign(node.p.begin() + first, node.p.begin() + last + 1);
+
+        if (j > 0)
+        {
+            seps.push_back(node.k[first - 1]);
+        }
+    }
+}
+
+inline size_t StringDiskBTree::EncodedSize(const vector<string>& k, size_t first, size_t last)
+{
+    const size_t prefix_len = PrefixLength(k, first, last);
+    size_t size = sizeof(PageHeader) + (last - first) * sizeof(Slot) + prefix_len;
+
+    for (size_t i = first; i < last; ++i)
+    {
+        const size_t len = k[i].size() - prefix_len;
+        if (len > 4)
+        {
+            size += len - 4;
+        }
+    }
+
+    return size;
+}
+
+inline size_t StringDiskBTree::PrefixLength(const vector<string>& k, size_t first, size_t last)
+{
+    if (last - first < 2)
+    {
+        return 0;
+    }
+
+    const string& a = k[first];
+    const string& b = k[last - 1];
+    size_t len = 0;
+
+    while (len < a.size() && len < b.size() && a[len] == b[len])
+    {
+        ++len;
+    }
+
+    return len;
+}
+
+inline uint32_t StringDiskBTree::Head(const char* s, size_t len)
+{
+    uint32_t head = 0;
+
+    for (size_t i = 0; i < 4; ++i)
+    {
+        head = (head << 8) | (i < len ? (unsigned char) s[i] : 0);
+    }
+
+    return head;
+}
+
+inline void StringDiskBTree::Encode(const StringNode& node, StringPage& page)
+{
+    const int n = (int) node.k.size();
+    const size_t prefix_len = PrefixLength(node.k, 0, n);
+    char* base = (char*) &page;
+    Slot* slots = (Slot*) page.body;
+    size_t heap = STRING_PAGE_SIZE;
+
+    memset(&page, 0, sizeof(page));
+
+    for (int i = n - 1; i >= 0; --i)
+    {
+        const string& key = node.k[i];
+        const size_t len = key.size() - prefix_len;
+        const size_t rest = (len > 4) ? len - 4 : 0;
+
+        heap -= rest;
+        memcpy(base + heap, key.data() + prefix_len + len - rest, rest);
+
+        slots[i].head = Head(key.data() + prefix_len, len);
+        slots[i].offset = (uint16_t) heap;
+        slots[i].length = (uint16_t) len;
+        slots[i].p = node.p[i + 1];
+    }
+
+    heap -= prefix_len;
+    if (prefix_len > 0)
+    {
+        memcpy(base + heap, node.k[0].data(), prefix_len);
+    }
+
+    page.header.n = (uint16_t) n;
+    page.header.prefix_len = (uint16_t) prefix_len;
+    page.header.heap = (uint16_t) heap;
+    page.header.p0 = node.p[0];
+}
+
+inline void StringDiskBTree::Decode(const StringPage& page, StringNode& node)
+{
+    const int n = page.header.n;
+    node.k.resize(n);
+    node.p.resize(n + 1);
+    node.p[0] = page.header.p0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        node.k[i] = KeyAt(page, i);
+        node.p[i + 1] = ((const Slot*) page.body)[i].p;
+    }
+}
+
+inline string StringDiskBTree::KeyAt(const StringPage& page, int i)
+{
+    const char* base = (const char*) &page;
+    const Slot& slot = ((const Slot*) page.body)[i];
+    string key(base + page.header.heap, page.header.prefix_len);
+
+    for (int j = 0; j < 4 && j < slot.length; ++j)
+    {
+        key.push_back((char) (slot.head >> (24 - 8 * j)));
+    }
+
+    if (slot.length > 4)
+    {
+        key.append(base + slot.offset, slot.length - 4);
+    }
+
+    return key;
+}
+
+inline int StringDiskBTree::SearchInPage(const StringPage& page, const string& x, bool& found)
+{
+    const int n = page.header.n;
+    const size_t prefix_len = page.header.prefix_len;
+    const char* base = (const char*) &page;
+    const Slot* slots = (const Slot*) page.body;
+
+    found = false;
+
+    // 先与公共前缀比较：x不以它开头时比所有的关键字都小或者都大
+    const int c = memcmp(x.data(), base + page.header.heap, min(x.size(), prefix_len));
+    if (c < 0 || (0 == c && x.size() < prefix_len))
+    {
+        return 0;
+    }
+
+    if (c > 0)
+    {
+        return n;
+    }
+
+    const size_t len = x.size() - prefix_len;
+    const uint32_t head = Head(x.data() + prefix_len, len);
+    const char* rest = x.data() + prefix_len + min(len, (size_t) 4);
+    const size_t rest_len = (len > 4) ? len - 4 : 0;
+
+    int left = 0, right = n; // 第一个不小于x的关键字在[left, right]中
+
+    while (left < right)
+    {
+        const int middle = (left + right) / 2;
+        const Slot& slot = slots[middle];
+        int cmp;
+
+        if (head != slot.head)
+        {
+            ++stats_.head_compares;
+            cmp = (head < slot.head) ? -1 : 1;
+        }
+        else
+        {
+            // head相等：比较剩余部分，再比较长度（head中补的0与真正的0字节由长度区分）
+            ++stats_.full_compares;
+            const size_t slot_rest_len = (slot.length > 4) ? slot.length - 4 : 0;
+            cmp = memcmp(rest, base + slot.offset, min(rest_len, slot_rest_len));
+            if (0 == cmp)
+            {
+                cmp = (len < slot.length) ? -1 : ((len > slot.length) ? 1 : 0);
+            }
+        }
+
+        if (0 == cmp)
+        {
+            found = true;
+            return middle;
+        }
+
+        if (cmp < 0)
+        {
+            right = middle;
+        }
+        else
+        {
+            left = middle + 1;
+        }
+    }
+
+    return left;
+}
+
+inline string StringDiskBTree::MaxKey(long r)
+{
+    StringPage page;
+
+    for (; ;)
+    {
+        ReadPage(r, page);
+        const long q = ChildAt(page, page.header.n);
+
+        if (NIL == q)
+        {
+            return KeyAt(page, page.header.n - 1);
+        }
+
+        r = q;
+    }
+}
+
+inline void StringDiskBTree::PrintNode(long r, int indent_space_count)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    StringPage page;
+    ReadPage(r, page);
+    cout << setw(indent_space_count) << "";
+
+    for (int i = 0; i < page.header.n; ++i)
+    {
+        cout << KeyAt(page, i) << " ";
+    }
+
+    cout << endl;
+
+    if (page.header.p0 != NIL)
+    {
+        for (int i = 0; i <= page.header.n; ++i)
+        {
+            PrintNode(ChildAt(page, i), indent_space_count + 8);
+        }
+    }
+}
+
+inline void StringDiskBTree::ScanNode(long r, const string& lo, const string& hi, vector<string>& keys)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    StringPage page;
+    ReadPage(r, page);
+
+    // p[i]子树中的关键字在k[i-1]和k[i]之间，从第一个不小于lo的关键字开始
+    bool found;
+    int i = SearchInPage(page, lo, found);
+
+    for (; i < page.header.n; ++i)
+    {
+        string key = KeyAt(page, i);
+        if (key > hi)
+        {
+            break;
+        }
+
+        ScanNode(ChildAt(page, i), lo, hi, keys);
+        keys.push_back(key);
+    }
+
+    ScanNode(ChildAt(page, i), lo, hi, keys);
+}
+
+inline StringDiskBTreeStats StringDiskBTree::Stats()
+{
+    StringDiskBTreeStats stats = stats_;
+
+    stats.height = height_;
+    stats.node_count = 0;
+    stats.key_count = 0;
+    stats.key_bytes = 0;
+    stats.stored_bytes = 0;
+    stats.fill_factor = 0;
+    CountNode(root_, stats);
+
+    if (stats.node_count > 0)
+    {
+        stats.fill_factor /= (double) stats.node_count * STRING_PAGE_SIZE; // CountNode中累加的是已用的字节数
+    }
+
+    // 遍历时的读不计入
+    stats_.reads = stats.reads;
+    stats_.root_cache_hits = stats.root_cache_hits;
+    return stats;
+}
+
+inline void StringDiskBTree::PrintStats()
+{
+    const StringDiskBTreeStats stats = Stats();
+
+    cout << "Statistics:" << endl
+        << "  reads: " << stats.reads << ", root cache hits: " << stats.root_cache_hits
+        << ", writes: " << stats.writes << endl
+        << "  allocs: " << stats.allocs << ", frees: " << stats.frees << endl
+        << "  splits: " << stats.splits << ", merges: " << stats.merges
+        << ", redistributions: " << stats.redistributions << endl
+        << "  compares decided by slot head: " << stats.head_compares << ", full compares: " << stats.full_compares
+        << endl
+        << "  height: " << stats.height << ", nodes: " << stats.node_count << ", keys: " << stats.key_count
+        << ", fill factor: " << setprecision(3) << stats.fill_factor << endl
+        << "  key bytes: " << stats.key_bytes << ", stored in pages: " << stats.stored_bytes << endl;
+}
+
+inline void StringDiskBTree::CountNode(long r, StringDiskBTreeStats& stats)
+{
+    if (NIL == r)
+    {
+        return;
+    }
+
+    StringPage page;
+    ReadPage(r, page);
+
+    const int n = page.header.n;
+    const Slot* slots = (const Slot*) page.body;
+
+    ++stats.node_count;
+    stats.key_count += n;
+    stats.stored_bytes += STRING_PAGE_SIZE - page.header.heap;
+    stats.fill_factor += sizeof(PageHeader) + n * sizeof(Slot) + STRING_PAGE_SIZE - page.header.heap;
+
+    for (int i = 0; i < n; ++i)
+    {
+        stats.key_bytes += page.header.prefix_len + slots[i].length;
+    }
+
+    if (page.header.p0 != NIL)
+    {
+        for (int i = 0; i <= n; ++i)
+        {
+            CountNode(ChildAt(page, i), stats);
+        }
+    }
+}
+
+inline void StringDiskBTree::ReadPage(long r, StringPage& page)
+{
+    if (r == root_ && r == root_page_pos_)
+    {
+        page = root_page_;
+        ++stats_.root_cache_hits;
+        return;
+    }
+
+    ++stats_.reads;
+    fs_.seekg(r, ios::beg);
+    fs_.read((char*) &page, sizeof(page));
+
+    if (r == root_)
+    {
+        root_page_ = page;
+        root_page_pos_ = r;
+    }
+}
+
+inline void StringDiskBTree::WritePage(long r, const StringPage& page)
+{
+    if (r == root_)
+    {
+        root_page_ = page;
+        root_page_pos_ = r;
+    }
+
+    ++stats_.writes;
+    fs_.seekp(r, ios::beg);
+    fs_.write((const char*) &page, sizeof(page));
+}
+
+inline long StringDiskBTree::GetNode()
+{
+    long r;
+    ++stats_.allocs;
+
+    if (NIL == free_list_)
+    {
+        // 文件长度为奇数时新的页覆盖结尾的签名字节，见DiskBTree::GetNode
+        StringPage page;
+        memset(&page, 0, sizeof(page));
+        fs_.seekp(0L, ios::end);
+        r = fs_.tellp() & ~1;
+        WritePage(r, page);
+    }
+    else
+    {
+        StringPage page;
+        r = free_list_;
+        ReadPage(r, page);
+        free_list_ = page.header.p0;
+    }
+
+    return r;
+}
+
+inline void StringDiskBTree::FreeNode(long r)
+{
+    ++stats_.frees;
+    ++stats_.writes;
+
+    if (r == root_page_pos_)
+    {
+        root_page_pos_ = NIL;
+    }
+
+    fs_.seekp(r + offsetof(PageHeader, p0), ios::beg);
+    fs_.write((const char*) &free_list_, sizeof(free_list_));
+    free_list_ = r;
+}
+
+#endif // STRING_DISK_BTREE_H
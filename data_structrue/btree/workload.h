@@ -0,0 +1,317 @@
+// workload: 负载文件（二进制操作日志）的格式，以及把负载回放到BTree/DiskBTree上的函数
+// 负载文件由gen_workload生成，btree、disk_btree和bench都可以全速回放
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+#include "btree_common.h"
+
+using namespace std;
+
+enum WorkloadOpCode
+{
+    WORKLOAD_INSERT,
+    WORKLOAD_DELETE,
+    WORKLOAD_SEARCH,
+    WORKLOAD_SCAN,
+    WORKLOAD_OP_CODE_COUNT
+};
+
+/**
+ * @brief 负载中的一个操作，8字节，按小端字节序存放
+ */
+struct WorkloadOp
+{
+    int32_t key;
+    uint32_t code; // 低8位是WorkloadOpCode；Scan时高24位是范围的宽度width，扫描[key, key + width]
+};
+
+/**
+ * @brief 负载文件头，后面紧跟op_count个WorkloadOp
+ */
+struct WorkloadHeader
+{
+    char magic[8];       // "BTWLOAD1"
+    uint64_t seed;       // 生成负载时用的随机数种子
+    uint64_t load_count; // 前load_count个操作是装载阶段的插入，其余的是运行阶段的混合操作
+    uint64_t op_count;   // 操作总数（含装载阶段）
+};
+
+static const char WORKLOAD_MAGIC[8] = { 'B', 'T', 'W', 'L', 'O', 'A', 'D', '1' };
+
+inline WorkloadOp MakeWorkloadOp(WorkloadOpCode code, int32_t key, uint32_t width = 0)
+{
+    WorkloadOp op;
+    op.key = key;
+    op.code = (uint32_t) code | (width << 8);
+    return op;
+}
+
+inline WorkloadOpCode GetWorkloadOpCode(const WorkloadOp& op)
+{
+    return (WorkloadOpCode) (op.code & 0xff);
+}
+
+inline uint32_t GetWorkloadScanWidth(const WorkloadOp& op)
+{
+    return op.code >> 8;
+}
+
+/**
+ * @brief 边生成边写负载文件，关闭时回填文件头中的操作个数
+ */
+class WorkloadWriter
+{
+public:
+    WorkloadWriter()
+    {
+        memset(&header_, 0, sizeof(header_));
+    }
+
+    ~WorkloadWriter()
+    {
+        Close();
+    }
+
+    /**
+     * @return =0成功，否则失败
+     */
+    int Open(const char* file_path, uint64_t seed)
+    {
+        ofs_.open(file_path, ios::out | ios::trunc | ios::binary);
+        if (ofs_.fail())
+        {
+            return -1;
+        }
+
+        memcpy(header_.magic, WORKLOAD_MAGIC, sizeof(header_.magic));
+        header_.seed = seed;
+        header_.load_count = 0;
+        header_.op_count = 0;
+        ofs_.write((const char*) &header_, sizeof(header_));
+
+        return 0;
+    }
+
+    /**
+     * @param load 是否属于装载阶段，装载阶段的操作必须写在最前面
+     */
+    void Append(const WorkloadOp& op, bool load)
+    {
+        buffer_.push_back(op);
+        ++header_.op_count;
+
+        if (load)
+        {
+            ++header_.load_count;
+        }
+
+        if (buffer_.size() >= 65536)
+        {
+            Flush();
+        }
+    }
+
+    int Close()
+    {
+        if (!ofs_.is_open())
+        {
+            return 0;
+        }
+
+        Flush();
+        ofs_.seekp(0L, ios::beg);
+        ofs_.write((const char*) &header_, sizeof(header_));
+        ofs_.close();
+
+        return ofs_.fail() ? -1 : 0;
+    }
+
+private:
+    void Flush()
+    {
+        if (!buffer_.empty())
+        {
+            ofs_.write((const char*) &buffer_[0], buffer_.size() * sizeof(WorkloadOp));
+            buffer_.clear();
+        }
+    }
+
+private:
+    ofstream ofs_;
+    WorkloadHeader header_;
+    vector<WorkloadOp> buffer_;
+};
+
+/**
+ * @brief 把整个负载文件读入内存，回放时不再有任何解析开销
+ * @return =0成功，否则失败
+ */
+inline int ReadWorkload(const char* file_path, WorkloadHeader& header, vector<WorkloadOp>& ops)
+{
+    ifstream ifs(file_path, ios::in | ios::binary);
+    if (ifs.fail())
+    {
+        return -1;
+    }
+
+    ifs.read((char*) &header, sizeof(header));
+    if (ifs.fail() || memcmp(header.magic, WORKLOAD_MAGIC, sizeof(header.magic)) != 0)
+    {
+        return -1;
+    }
+
+    ops.resize(header.op_count);
+    if (header.op_count > 0)
+    {
+        ifs.read((char*) &ops[0], header.op_count * sizeof(WorkloadOp));
+    }
+
+    return ifs.fail() ? -1 : 0;
+}
+
+struct ReplayResult
+{
+    long ops[WORKLOAD_OP_CODE_COUNT]; // 各类操作的个数
+    long failed[WORKLOAD_OP_CODE_COUNT]; // 插入重复的关键字、删除或查找不存在的关键字的个数
+    long scanned;                     // Scan取出的关键字总数
+    double seconds;
+};
+
+/**
+ * @brief 依次执行ops中的操作
+ * @details Tree需要提供Insert(x)、Delete(x)、Search(x)和Scan(lo, hi, keys)，BTree和DiskBTree都满足。
+ *          回放前应当用SetVerbose(false)关掉逐个操作的提示
+ */
+template <class Tree>
+ReplayResult ReplayWorkload(Tree& tree, const WorkloadOp* ops, size_t count)
+{
+    ReplayResult result;
+    memset(&result, 0, sizeof(result));
+
+    vector<KeyType> keys;
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const WorkloadOp& op = ops[i];
+        const WorkloadOpCode code = GetWorkloadOpCode(op);
+        bool ok = true;
+
+        switch (code)
+        {
+            case WORKLOAD_INSERT:
+                ok = (0 == tree.Insert(op.key));
+                break;
+
+            case WORKLOAD_DELETE:
+                ok = (0 == tree.Delete(op.key));
+                break;
+
+            case WORKLOAD_SEARCH:
+                ok = tree.Search(op.key);
+                break;
+
+            case WORKLOAD_SCAN:
+            {
+                const int64_t hi = (int64_t) op.key + GetWorkloadScanWidth(op);
+                keys.clear();
+                result.scanned += tree.Scan(op.key, (KeyType) (hi > INT32_MAX ? INT32_MAX : hi), keys);
+            }
+                break;
+
+            default:
+                continue;
+        }
+
+        ++result.ops[code];
+        if (!ok)
+        {
+            ++result.failed[code];
+        }
+    }
+
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+inline void PrintReplayResult(const ReplayResult& result, ostream& out)
+{
+    long total = 0;
+    for (int i = 0; i < WORKLOAD_OP_CODE_COUNT; ++i)
+    {
+        total += result.ops[i];
+    }
+
+    out << total << " ops in " << fixed << setprecision(3) << result.seconds << " s ("
+        << setprecision(0) << (result.seconds > 0 ? total / result.seconds : 0) << " ops/s)" << endl;
+    out.unsetf(ios::fixed);
+    out << "  inserts: " << result.ops[WORKLOAD_INSERT] << " (" << result.failed[WORKLOAD_INSERT] << " duplicates)"
+        << ", deletes: " << result.ops[WORKLOAD_DELETE] << " (" << result.failed[WORKLOAD_DELETE] << " not found)"
+        << ", searches: " << result.ops[WORKLOAD_SEARCH] << " (" << result.failed[WORKLOAD_SEARCH] << " not found)"
+        << ", scans: " << result.ops[WORKLOAD_SCAN] << " (" << result.scanned << " keys)" << endl;
+}
+
+/**
+ * @brief 读入负载文件并在tree上回放全部操作（先装载阶段，后运行阶段），打印两个阶段的结果。btree和disk_btree的驱动程序共用
+ * @return =0成功，否则失败
+ */
+template <class Tree>
+int ReplayWorkloadFile(Tree& tree, const char* file_path, ostream& out)
+{
+    WorkloadHeader header;
+    vector<WorkloadOp> ops;
+
+    if (ReadWorkload(file_path, header, ops) != 0)
+    {
+        out << "Cannot read workload file." << endl;
+        return -1;
+    }
+
+    tree.SetVerbose(false);
+
+    out << "Load phase: ";
+    PrintReplayResult(ReplayWorkload(tree, ops.data(), header.load_count), out);
+
+    out << "Run phase: ";
+    PrintReplayResult(ReplayWorkload(tree, ops.data() + header.load_count, ops.size() - header.load_count), out);
+
+    tree.SetVerbose(true);
+    return 0;
+}
+
+/**
+ * @brief 解析name=value形式的命令行参数，gen_workload和bench共用
+ * @return =0成功，遇到不是name=value形式的参数时返回-1
+ */
+inline int ParseOptions(int argc, char* argv[], map<string, string>& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* eq = strchr(argv[i], '=');
+        if (NULL == eq)
+        {
+            return -1;
+        }
+
+        options[string(argv[i], eq - argv[i])] = eq + 1;
+    }
+
+    return 0;
+}
+
+inline string GetOption(const map<string, string>& options, const string& name, const string& default_value)
+{
+    map<string, string>::const_iterator it = options.find(name);
+    return (it != options.end()) ? it->second : default_value;
+}
+
+#endif // WORKLOAD_H
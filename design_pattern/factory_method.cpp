@@ -0,0 +1,75 @@
+// factory_method: 演示PageStoreFactory。每种PageStore写一个文件，关闭后重新打开，读回来检查
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include "factory_method.h"
+
+const int PAGE_SIZE = 4096;
+const int PAGE_COUNT = 1000;
+
+/**
+ * @brief 第i页的内容：每个int都是i
+ */
+void FillPage(int i, vector<int>& page)
+{
+    page.assign(PAGE_SIZE / sizeof(int), i);
+}
+
+int main()
+{
+    const char* path = "factory_method.bin";
+    vector<int> page, read_page(PAGE_SIZE / sizeof(int));
+
+    for (int type = 0; type < PAGE_STORE_TYPE_COUNT; ++type)
+    {
+        remove(path);
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        unique_ptr<PageStore> store(PageStoreFactory::Create((PageStoreType) type));
+        bool created;
+        if (store->Open(path, created) != 0)
+        {
+            cout << PageStoreFactory::Name((PageStoreType) type) << ": cannot open " << path << endl;
+            continue;
+        }
+
+        for (int i = 0; i < PAGE_COUNT; ++i)
+        {
+            FillPage(i, page);
+            store->Write((long) i * PAGE_SIZE, page.data(), PAGE_SIZE);
+        }
+
+        // memory关闭后内容就没有了，不重新打开
+        if (type != PAGE_STORE_MEMORY)
+        {
+            store->Close();
+            store->Open(path, created);
+        }
+
+        int errors = (store->Size() == (long) PAGE_COUNT * PAGE_SIZE) ? 0 : 1;
+        for (int i = PAGE_COUNT - 1; i >= 0; --i)
+        {
+            FillPage(i, page);
+            if (store->Read((long) i * PAGE_SIZE, read_page.data(), PAGE_SIZE) != 0 || read_page != page)
+            {
+                ++errors;
+            }
+        }
+
+        // 超出文件结尾
+        if (0 == store->Read((long) PAGE_COUNT * PAGE_SIZE, read_page.data(), PAGE_SIZE))
+        {
+            ++errors;
+        }
+
+        store->Close();
+        const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        cout << store->Name() << ": " << PAGE_COUNT << " pages written and read back in " << ms << " ms, "
+            << errors << " errors" << endl;
+    }
+
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,664 @@
+// factory_method: 工厂方法模式，以DiskBTree的页存储为例
+//
+// DiskBTree只通过PageStore按字节偏移读写文件，不关心文件是怎样读写的。PageStoreFactory::Create按类型创建
+// 具体的PageStore，打开文件时再决定用哪一种，适应不同的部署环境（tmpfs、NVMe、网络块存储等）：
+//   fstream  std::fstream，原来的做法
+//   pread    pread/pwrite，没有流的缓冲区和定位状态
+//   mmap     把整个文件映射进来，读写就是memcpy，文件按倍增扩大
+//   direct   O_DIRECT，绕过操作系统的页缓存，自己用clock算法缓存对齐的块（写回）。文件系统不支持O_DIRECT时
+//            （比如tmpfs）退回到普通的读写，仍然用自己的缓存
+//   memory   全部在内存中，不读写文件，关闭后内容就没有了
+#ifndef FACTORY_METHOD_H
+#define FACTORY_METHOD_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+enum PageStoreType
+{
+    PAGE_STORE_FSTREAM,
+    PAGE_STORE_PREAD,
+    PAGE_STORE_MMAP,
+    PAGE_STORE_DIRECT,
+    PAGE_STORE_MEMORY,
+    PAGE_STORE_TYPE_COUNT
+};
+
+const size_t MMAP_MIN_CAPACITY = 1 << 20;  // mmap文件第一次扩大到的字节数
+const size_t DIRECT_BLOCK_SIZE = 4096;     // O_DIRECT读写的块大小，也是缓冲区的对齐要求
+const size_t DIRECT_CACHE_BLOCKS = 4096;   // direct自己缓存的块数（16MB）
+
+/**
+ * @brief 按字节偏移读写的页存储
+ */
+class PageStore
+{
+public:
+    virtual ~PageStore()
+    {
+    }
+
+    /**
+     * @brief 打开文件，文件不存在时新建一个空文件
+     * @param created 返回是否新建了文件
+     * @return =0成功，否则返回-1
+     */
+    virtual int Open(const char* path, bool& created) = 0;
+
+    /**
+     * @brief 关闭文件，缓存的内容都写到文件中。析构时如果还没有关闭，也会关闭
+     */
+    virtual void Close() = 0;
+
+    /**
+     * @return =0成功，超出文件结尾或者读失败时返回-1
+     */
+    virtual int Read(long offset, void* buf, size_t size) = 0;
+
+    /**
+     * @brief 写在文件结尾以后时文件随之变长
+     * @return =0成功，否则返回-1
+     */
+    virtual int Write(long offset, const void* buf, size_t size) = 0;
+
+    /**
+     * @brief 文件的长度（字节）
+     */
+    virtual long Size() = 0;
+
+    virtual const char* Name() const = 0;
+};
+
+class FstreamPageStore : public PageStore
+{
+public:
+    ~FstreamPageStore()
+    {
+        Close();
+    }
+
+    int Open(const char* path, bool& created)
+    {
+        ifstream ifs(path, ios::in);
+        created = ifs.fail();
+        ifs.close();
+
+        // ios::binary required with MSDOS, but possibly not accepted with other environments.
+        fs_.open(path, created ? (ios::out | ios::in | ios::trunc | ios::binary) : (ios::out | ios::in | ios::binary));
+        return fs_.is_open() ? 0 : -1;
+    }
+
+    void Close()
+    {
+        if (fs_.is_open())
+        {
+            fs_.close();
+        }
+    }
+
+    int Read(long offset, void* buf, size_t size)
+    {
+        fs_.seekg(offset, ios::beg); // 读文件时使用tellg()；写文件时使用tellp()。g代表get，p代表put
+        fs_.read((char*) buf, size);
+        if (fs_.fail())
+        {
+            fs_.clear();
+            return -1;
+        }
+
+        return 0;
+    }
+
+    int Write(long offset, const void* buf, size_t size)
+    {
+        fs_.seekp(offset, ios::beg);
+        fs_.write((const char*) buf, size);
+        return fs_.fail() ? -1 : 0;
+    }
+
+    long Size()
+    {
+        fs_.seekg(0L, ios::end);
+        return fs_.tellg();
+    }
+
+    const char* Name() const
+    {
+        return "fstream";
+    }
+
+private:
+    fstream fs_;
+};
+
+/**
+ * @brief 打开或者新建文件，新建时created为true
+ */
+inline int OpenFile(const char* path, int flags, bool& created)
+{
+    created = (access(path, F_OK) != 0);
+    return open(path, O_RDWR | O_CREAT | (created ? O_TRUNC : 0) | flags, 0644);
+}
+
+class PreadPageStore : public PageStore
+{
+public:
+    PreadPageStore() : fd_(-1), size_(0)
+    {
+    }
+
+    ~PreadPageStore()
+    {
+        Close();
+    }
+
+    int Open(const char* path, bool& created)
+    {
+        fd_ = OpenFile(path, 0, created);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0)
+        {
+            return -1;
+        }
+
+        size_ = st.st_size;
+        return 0;
+    }
+
+    void Close()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int Read(long offset, void* buf, size_t size)
+    {
+        return (pread(fd_, buf, size, offset) == (ssize_t) size) ? 0 : -1;
+    }
+
+    int Write(long offset, const void* buf, size_t size)
+    {
+        if (pwrite(fd_, buf, size, offset) != (ssize_t) size)
+        {
+            return -1;
+        }
+
+        size_ = max(size_, offset + (long) size);
+        return 0;
+    }
+
+    long Size()
+    {
+        return size_;
+    }
+
+    const char* Name() const
+    {
+        return "pread";
+    }
+
+private:
+    int fd_;
+    long size_;
+};
+
+class MmapPageStore : public PageStore
+{
+public:
+    MmapPageStore() : fd_(-1), data_(NULL), capacity_(0), size_(0)
+    {
+    }
+
+    ~MmapPageStore()
+    {
+        Close();
+    }
+
+    int Open(const char* path, bool& created)
+    {
+        fd_ = OpenFile(path, 0, created);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0)
+        {
+            return -1;
+        }
+
+        size_ = st.st_size;
+        return Reserve(size_);
+    }
+
+    /**
+     * @brief 解除映射，把文件截回到实际的长度
+     */
+    void Close()
+    {
+        if (data_ != NULL)
+        {
+            munmap(data_, capacity_);
+            data_ = NULL;
+            capacity_ = 0;
+        }
+
+        if (fd_ >= 0)
+        {
+            if (ftruncate(fd_, size_) != 0)
+            {
+                // 只是文件结尾多了些0，下次打开时签名字节的位置不对，与fstream写失败的后果一样
+            }
+
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int Read(long offset, void* buf, size_t size)
+    {
+        if (offset < 0 || offset + size > size_)
+        {
+            return -1;
+        }
+
+        memcpy(buf, data_ + offset, size);
+        return 0;
+    }
+
+    int Write(long offset, const void* buf, size_t size)
+    {
+        if (offset < 0 || Reserve(offset + size) != 0)
+        {
+            return -1;
+        }
+
+        memcpy(data_ + offset, buf, size);
+        size_ = max(size_, offset + size);
+        return 0;
+    }
+
+    long Size()
+    {
+        return size_;
+    }
+
+    const char* Name() const
+    {
+        return "mmap";
+    }
+
+private:
+    /**
+     * @brief 保证映射至少有size字节，不够时把文件和映射扩大到两倍
+     */
+    int Reserve(size_t size)
+    {
+        if (size <= capacity_ && data_ != NULL)
+        {
+            return 0;
+        }
+
+        size_t capacity = max(max(capacity_ * 2, MMAP_MIN_CAPACITY), size);
+        if (ftruncate(fd_, capacity) != 0)
+        {
+            return -1;
+        }
+
+        void* data = (NULL == data_) ? mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)
+            : mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
+        if (MAP_FAILED == data)
+        {
+            return -1;
+        }
+
+        data_ = (char*) data;
+        capacity_ = capacity;
+        return 0;
+    }
+
+private:
+    int fd_;
+    char* data_;
+    size_t capacity_; // 映射和文件的长度
+    size_t size_;     // 实际的长度，关闭时把文件截回到这个长度
+};
+
+class DirectPageStore : public PageStore
+{
+public:
+    DirectPageStore() : fd_(-1), direct_(true), size_(0), disk_size_(0), hand_(0)
+    {
+    }
+
+    ~DirectPageStore()
+    {
+        Close();
+    }
+
+    int Open(const char* path, bool& created)
+    {
+        fd_ = OpenFile(path, O_DIRECT, created);
+        if (fd_ < 0 && EINVAL == errno)
+        {
+            direct_ = false;
+            fd_ = OpenFile(path, 0, created);
+        }
+
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0)
+        {
+            return -1;
+        }
+
+        size_ = disk_size_ = st.st_size;
+        return 0;
+    }
+
+    /**
+     * @brief 写回脏块，把文件截回到实际的长度（整块写入时文件可能变长了）
+     */
+    void Close()
+    {
+        if (fd_ < 0)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < blocks_.size(); ++i)
+        {
+            WriteBack(blocks_[i]);
+            free(blocks_[i].data);
+        }
+
+        blocks_.clear();
+        index_.clear();
+
+        if (ftruncate(fd_, size_) != 0)
+        {
+            // 见MmapPageStore::Close
+        }
+
+        close(fd_);
+        fd_ = -1;
+    }
+
+    int Read(long offset, void* buf, size_t size)
+    {
+        if (offset < 0 || offset + (long) size > size_)
+        {
+            return -1;
+        }
+
+        return Copy(offset, (char*) buf, size, false);
+    }
+
+    int Write(long offset, const void* buf, size_t size)
+    {
+        if (offset < 0 || Copy(offset, (char*) buf, size, true) != 0)
+        {
+            return -1;
+        }
+
+        size_ = max(size_, offset + (long) size);
+        return 0;
+    }
+
+    long Size()
+    {
+        return size_;
+    }
+
+    const char* Name() const
+    {
+        return direct_ ? "direct" : "direct (no O_DIRECT)";
+    }
+
+private:
+    struct CachedBlock
+    {
+        long block;      // 块号
+        char* data;      // DIRECT_BLOCK_SIZE字节，按DIRECT_BLOCK_SIZE对齐
+        bool dirty;
+        bool referenced; // clock算法的访问位
+    };
+
+    /**
+     * @brief 在文件的[offset, offset + size)与buf之间逐块复制
+     * @param write 为true时从buf复制到块中，否则从块中复制到buf
+     */
+    int Copy(long offset, char* buf, size_t size, bool write)
+    {
+        while (size > 0)
+        {
+            const long block = offset / DIRECT_BLOCK_SIZE;
+            const size_t start = offset % DIRECT_BLOCK_SIZE;
+            const size_t n = min(size, DIRECT_BLOCK_SIZE - start);
+
+            CachedBlock* b = GetBlock(block);
+            if (NULL == b)
+            {
+                return -1;
+            }
+
+            if (write)
+            {
+                memcpy(b->data + start, buf, n);
+                b->dirty = true;
+            }
+            else
+            {
+                memcpy(buf, b->data + start, n);
+            }
+
+            offset += n;
+            buf += n;
+            size -= n;
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief 找到缓存中的块，不在缓存中时读进来，缓存满了时用clock算法淘汰一块
+     */
+    CachedBlock* GetBlock(long block)
+    {
+        unordered_map<long, size_t>::const_iterator it = index_.find(block);
+        if (it != index_.end())
+        {
+            blocks_[it->second].referenced = true;
+            return &blocks_[it->second];
+        }
+
+        size_t slot;
+        if (blocks_.size() < DIRECT_CACHE_BLOCKS)
+        {
+            CachedBlock b = { -1, NULL, false, false };
+            void* data;
+            if (posix_memalign(&data, DIRECT_BLOCK_SIZE, DIRECT_BLOCK_SIZE) != 0)
+            {
+                return NULL;
+            }
+
+            b.data = (char*) data;
+            slot = blocks_.size();
+            blocks_.push_back(b);
+        }
+        else
+        {
+            while (blocks_[hand_].referenced)
+            {
+                blocks_[hand_].referenced = false;
+                hand_ = (hand_ + 1) % blocks_.size();
+            }
+
+            slot = hand_;
+            hand_ = (hand_ + 1) % blocks_.size();
+            if (WriteBack(blocks_[slot]) != 0)
+            {
+                return NULL;
+            }
+
+            index_.erase(blocks_[slot].block);
+        }
+
+        CachedBlock& b = blocks_[slot];
+        memset(b.data, 0, DIRECT_BLOCK_SIZE);
+
+        const long offset = block * DIRECT_BLOCK_SIZE;
+        if (offset < disk_size_ && pread(fd_, b.data, DIRECT_BLOCK_SIZE, offset) < 0)
+        {
+            return NULL;
+        }
+
+        b.block = block;
+        b.dirty = false;
+        b.referenced = true;
+        index_[block] = slot;
+        return &b;
+    }
+
+    int WriteBack(CachedBlock& b)
+    {
+        if (!b.dirty)
+        {
+            return 0;
+        }
+
+        const long offset = b.block * DIRECT_BLOCK_SIZE;
+        if (pwrite(fd_, b.data, DIRECT_BLOCK_SIZE, offset) != (ssize_t) DIRECT_BLOCK_SIZE)
+        {
+            return -1;
+        }
+
+        b.dirty = false;
+        disk_size_ = max(disk_size_, offset + (long) DIRECT_BLOCK_SIZE);
+        return 0;
+    }
+
+private:
+    int fd_;
+    bool direct_;      // 是否真的用了O_DIRECT
+    long size_;        // 实际的长度
+    long disk_size_;   // 文件现在的长度，之后的块不用读
+    vector<CachedBlock> blocks_;
+    unordered_map<long, size_t> index_; // 块号 -> 在blocks_中的下标
+    size_t hand_;
+};
+
+class MemoryPageStore : public PageStore
+{
+public:
+    int Open(const char* /* path */, bool& created)
+    {
+        created = true;
+        data_.clear();
+        return 0;
+    }
+
+    void Close()
+    {
+        vector<char>().swap(data_);
+    }
+
+    int Read(long offset, void* buf, size_t size)
+    {
+        if (offset < 0 || offset + size > data_.size())
+        {
+            return -1;
+        }
+
+        memcpy(buf, data_.data() + offset, size);
+        return 0;
+    }
+
+    int Write(long offset, const void* buf, size_t size)
+    {
+        if (offset < 0)
+        {
+            return -1;
+        }
+
+        if (offset + size > data_.size())
+        {
+            data_.resize(offset + size);
+        }
+
+        memcpy(data_.data() + offset, buf, size);
+        return 0;
+    }
+
+    long Size()
+    {
+        return data_.size();
+    }
+
+    const char* Name() const
+    {
+        return "memory";
+    }
+
+private:
+    vector<char> data_;
+};
+
+class PageStoreFactory
+{
+public:
+    /**
+     * @brief 创建一个还没有打开的PageStore，由调用者delete
+     */
+    static PageStore* Create(PageStoreType type)
+    {
+        switch (type)
+        {
+            case PAGE_STORE_PREAD:
+                return new PreadPageStore;
+            case PAGE_STORE_MMAP:
+                return new MmapPageStore;
+            case PAGE_STORE_DIRECT:
+                return new DirectPageStore;
+            case PAGE_STORE_MEMORY:
+                return new MemoryPageStore;
+            default:
+                return new FstreamPageStore;
+        }
+    }
+
+    static const char* Name(PageStoreType type)
+    {
+        static const char* names[PAGE_STORE_TYPE_COUNT] = { "fstream", "pread", "mmap", "direct", "memory" };
+        return names[type];
+    }
+
+    /**
+     * @brief 按名字（fstream、pread、mmap、direct或memory）得到类型
+     * @return =0成功，名字不对时返回-1
+     */
+    static int Parse(const string& name, PageStoreType& type)
+    {
+        for (int i = 0; i < PAGE_STORE_TYPE_COUNT; ++i)
+        {
+            if (name == Name((PageStoreType) i))
+            {
+                type = (PageStoreType) i;
+                return 0;
+            }
+        }
+
+        return -1;
+    }
+};
+
+#endif // FACTORY_METHOD_H